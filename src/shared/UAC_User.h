@@ -59,6 +59,11 @@ Environment:
 #define UAC_MIN_ASIO_PERIOD_SAMPLES 8
 #define UAC_MAX_ASIO_CHANNELS       64
 #define UAC_MIN_ASIO_CHANNELS       1
+#define UAC_CHANNEL_NOT_ROUTED      (-1)
+
+#define UAC_SAFETY_OFFSET_HISTOGRAM_SIZE 64
+#define UAC_WAKE_LATENCY_HISTOGRAM_SIZE  32
+#define UAC_WAKE_LATENCY_BUCKET_US       100
 
 enum class UACSampleFormat : ULONG
 {
@@ -124,6 +129,12 @@ enum class KsPropertyUACLowLatencyAudio
     GetOutputLatency,
     SetAsioDevice,
     GetAsioDevice,
+    SetChannelRouting,
+    GetChannelRouting,
+    GetMeters,
+    GetSafetyOffset,
+    GetBufferPeriodSwitch,
+    GetSampleRateSwitch,
 };
 
 constexpr int toInt(KsPropertyUACLowLatencyAudio Property)
@@ -234,6 +245,96 @@ typedef struct UAC_SET_CLOCK_SOURCE_CONTEXT_
     ULONG Index;
 } UAC_SET_CLOCK_SOURCE_CONTEXT, *PUAC_SET_CLOCK_SOURCE_CONTEXT;
 
+// Each entry holds the USB channel that a logical channel is routed to, or
+// UAC_CHANNEL_NOT_ROUTED. A WDM channel is indexed by its default USB
+// position, i.e. the first USB channel of its stream plus its channel number
+// within the stream.
+typedef struct UAC_CHANNEL_ROUTING_CONTEXT_
+{
+    LONG AsioInput[UAC_MAX_ASIO_CHANNELS];
+    LONG AsioOutput[UAC_MAX_ASIO_CHANNELS];
+    LONG WdmInput[UAC_MAX_ASIO_CHANNELS];
+    LONG WdmOutput[UAC_MAX_ASIO_CHANNELS];
+} UAC_CHANNEL_ROUTING_CONTEXT, *PUAC_CHANNEL_ROUTING_CONTEXT;
+
+// Peak and energy of one channel since the previous GetMeters request.
+// Integer samples are measured left-aligned to 32 bits and float samples are
+// scaled to the same range. The square is taken of the upper 16 bits of each
+// sample, so the RMS level is sqrt(SumOfSquares / Samples) / 32768.
+typedef struct UAC_CHANNEL_METER_
+{
+    ULONG     Peak;
+    ULONG     Samples;
+    ULONGLONG SumOfSquares;
+} UAC_CHANNEL_METER, *PUAC_CHANNEL_METER;
+
+// Indexed by USB channel. Metering only runs while the meters are read, so
+// the first request after a pause returns empty meters. The uncached packet
+// counts are the packets metered in the non-cached transfer buffer because
+// the staging buffer or the mix bus could not be allocated; the meters stay
+// complete, but each such packet costs uncached reads.
+typedef struct UAC_METERS_CONTEXT_
+{
+    UAC_CHANNEL_METER Input[UAC_MAX_ASIO_CHANNELS];
+    UAC_CHANNEL_METER Output[UAC_MAX_ASIO_CHANNELS];
+    ULONG             InputUncachedPackets;
+    ULONG             OutputUncachedPackets;
+} UAC_METERS_CONTEXT, *PUAC_METERS_CONTEXT;
+
+// State of the output safety offset of the running stream. Offsets are in
+// packets, i.e. USB frames or microframes. The safety offset histogram holds
+// the margin between OUT and IN processing seen on each wake, and the wake
+// latency histogram holds the time from an IN completion to the first wake
+// that processes it. The last bucket of each histogram also counts every
+// larger value.
+typedef struct UAC_SAFETY_OFFSET_CONTEXT_
+{
+    ULONG QuietPeriodSeconds; // AdaptiveSafetyOffset registry value, 0 while the offset is fixed
+    ULONG ConfiguredOffsetFrame;
+    ULONG MinimumOffsetFrame;
+    ULONG CurrentOffsetFrame;
+    ULONG Dropouts;
+    ULONG SafetyOffsetHistogram[UAC_SAFETY_OFFSET_HISTOGRAM_SIZE];
+    ULONG WakeLatencyHistogram[UAC_WAKE_LATENCY_HISTOGRAM_SIZE];
+} UAC_SAFETY_OFFSET_CONTEXT, *PUAC_SAFETY_OFFSET_CONTEXT;
+
+// Result of the last SetBufferPeriod request that changed the period. When
+// the stream was running, it is drained and resubmitted without selecting
+// the interfaces again; the gap is the time from draining the URBs to
+// resubmitting them, and the gap in frames includes the start frame delay.
+// Transfer objects whose packet count is unchanged are handed over to the
+// new stream, the others are rebuilt. The gap and the counts are 0 when no
+// stream was running or the stream had to be restarted from the interfaces.
+typedef struct UAC_BUFFER_PERIOD_SWITCH_CONTEXT_
+{
+    ULONG PreviousBufferPeriod;
+    ULONG BufferPeriod;
+    ULONG ClassicFramesPerIrp;
+    ULONG GapUs;
+    ULONG GapFrames;
+    ULONG ReusedTransferObjects;
+    ULONG RebuiltTransferObjects;
+} UAC_BUFFER_PERIOD_SWITCH_CONTEXT, *PUAC_BUFFER_PERIOD_SWITCH_CONTEXT;
+
+// Phases of the last ChangeSampleRate request, as performance counter
+// values. A phase that did not take place is 0: the clock request when the
+// device already runs at the rate, and the stream phases when no stream was
+// running. The first IN completion is the first one delivered to the clients
+// and the first audible OUT completion is the first one past the lock delay.
+typedef struct UAC_SAMPLE_RATE_SWITCH_CONTEXT_
+{
+    ULONG                          PreviousSampleRate;
+    ULONG                          SampleRate;
+    __declspec(align(8)) LONGLONG  PerformanceFrequency;
+    __declspec(align(8)) LONGLONG  RequestQpc;
+    __declspec(align(8)) LONGLONG  StreamStoppedQpc;
+    __declspec(align(8)) LONGLONG  ClockSetQpc;
+    __declspec(align(8)) LONGLONG  AlternateSettingQpc;
+    __declspec(align(8)) LONGLONG  StreamStartQpc;
+    __declspec(align(8)) LONGLONG  FirstInputQpc;
+    __declspec(align(8)) LONGLONG  FirstAudibleOutputQpc;
+} UAC_SAMPLE_RATE_SWITCH_CONTEXT, *PUAC_SAMPLE_RATE_SWITCH_CONTEXT;
+
 typedef struct UAC_SET_FLAGS_CONTEXT_
 {
     ULONG FirstPacketLatency;
@@ -30,6 +30,8 @@ Environment:
 #include "ErrorStatistics.h"
 #include "AsioBufferObject.h"
 #include "USBAudioDataFormat.h"
+#include "SampleConverter.h"
+#include "StreamTiming.h"
 
 #ifndef __INTELLISENSE__
 #include "AsioBufferObject.tmh"
@@ -257,6 +259,8 @@ AsioBufferObject::SetBuffer(
     m_recChannels = m_playHeader->RecChannels;
     m_playChannelsMap = m_playHeader->PlayChannelsMap;
     m_recChannelsMap = m_playHeader->RecChannelsMap;
+    m_playSpanCount = SampleConverter::BuildChannelSpans(m_playSpans, m_deviceContext->ChannelRouting.AsioOutput, m_playChannels, m_playChannelsMap, m_deviceContext->OutputProperty.UsbChannels);
+    m_recSpanCount = SampleConverter::BuildChannelSpans(m_recSpans, m_deviceContext->ChannelRouting.AsioInput, m_recChannels, m_recChannelsMap, m_deviceContext->InputProperty.UsbChannels);
     m_recHeader->CurrentSampleRate = m_deviceContext->AudioProperty.SampleRate;
     m_recHeader->CurrentClockSource = m_deviceContext->CurrentClockSource;
 
@@ -495,7 +499,6 @@ AsioBufferObject::CopyFromAsioToOutputData(
     ULONG asioReadEndIndex = (ULONG)((asioPosition + samples + m_deviceContext->Params.PreSendFrames) % (m_bufferLength));
 
     ULONG asioSampleSize = USBAudioDataFormat::ConvertSampleTypeToBytesPerSample(m_deviceContext->AudioProperty.SampleType);
-    ULONG asioByteOffset = asioSampleSize - usbBytesPerSample;
 
     //
     // ASIO provides audio samples in a non-interleaved format. These samples
@@ -504,111 +507,58 @@ AsioBufferObject::CopyFromAsioToOutputData(
     //
     switch (m_deviceContext->AudioProperty.CurrentSampleFormat)
     {
-    case UACSampleFormat::UAC_SAMPLE_FORMAT_PCM: {
-        for (ULONG asioCh = 0; asioCh < m_playChannels; ++asioCh)
-        {
-            ULONG usbCh = asioCh;
-            if (usbCh >= m_deviceContext->OutputProperty.UsbChannels)
-            {
-                // TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_ASIO, "ASIO OUT channel %u is not mapped", asioCh);
-                continue;
-            }
-            ULONG samplesFirst = samples;
-            if (asioReadStartIndex > asioReadEndIndex)
-            {
-                samplesFirst = m_bufferLength - asioReadStartIndex;
-            }
+    case UACSampleFormat::UAC_SAMPLE_FORMAT_PCM:
+    case UACSampleFormat::UAC_SAMPLE_FORMAT_IEEE_FLOAT: {
+        ASSERT((m_deviceContext->AudioProperty.CurrentSampleFormat != UACSampleFormat::UAC_SAMPLE_FORMAT_IEEE_FLOAT) || ((usbBytesPerSample == 4) && (asioSampleSize == 4)));
 
-            if ((m_playChannelsMap & (1ULL << asioCh)) != 0)
-            {
-                volatile BYTE * asioBuffer = m_playBuffer + (m_bufferLength * asioSampleSize * asioCh);
-                switch (usbBytesPerSample)
-                {
-                case 1:
-                    for (ULONG index = 0; index < samplesFirst; ++index)
-                    {
-                        outBuffer[index * bytesPerBlock + usbCh * usbBytesPerSample] = asioBuffer[(asioReadStartIndex + index) * asioSampleSize + asioByteOffset];
-                    }
-                    for (ULONG index = samplesFirst; index < samples; ++index)
-                    {
-                        volatile BYTE * src = &(asioBuffer[(index - samplesFirst) * asioSampleSize + asioByteOffset]);
-                        BYTE *          dst = &(outBuffer[index * bytesPerBlock + usbCh * usbBytesPerSample]);
-                        *dst = *src;
-                    }
-                    break;
-                case 2:
-                    for (ULONG index = 0; index < samplesFirst; ++index)
-                    {
-                        *(USHORT *)&(outBuffer[index * bytesPerBlock + usbCh * usbBytesPerSample]) = *(USHORT *)&(asioBuffer[(asioReadStartIndex + index) * asioSampleSize + asioByteOffset]);
-                    }
-                    for (ULONG index = samplesFirst; index < samples; ++index)
-                    {
-                        *(USHORT *)&(outBuffer[index * bytesPerBlock + usbCh * usbBytesPerSample]) = *(USHORT *)&(asioBuffer[(index - samplesFirst) * asioSampleSize + asioByteOffset]);
-                    }
-                    break;
-                case 3:
-                    for (ULONG index = 0; index < samplesFirst; ++index)
-                    {
-                        volatile BYTE * src = &(asioBuffer[(asioReadStartIndex + index) * asioSampleSize + asioByteOffset]);
-                        BYTE *          dst = &(outBuffer[index * bytesPerBlock + usbCh * usbBytesPerSample]);
-                        *dst++ = *src++;
-                        *dst++ = *src++;
-                        *dst++ = *src++;
-                    }
-                    for (ULONG index = samplesFirst; index < samples; ++index)
-                    {
-                        volatile BYTE * src = &(asioBuffer[(index - samplesFirst) * asioSampleSize + asioByteOffset]);
-                        BYTE *          dst = &(outBuffer[index * bytesPerBlock + usbCh * usbBytesPerSample]);
-                        *dst++ = *src++;
-                        *dst++ = *src++;
-                        *dst++ = *src++;
-                    }
-                    break;
-                case 4:
-                    for (ULONG index = 0; index < samplesFirst; ++index)
-                    {
-                        *(ULONG *)&(outBuffer[index * bytesPerBlock + usbCh * usbBytesPerSample]) = *(ULONG *)&(asioBuffer[(asioReadStartIndex + index) * asioSampleSize + asioByteOffset]);
-                    }
-                    for (ULONG index = samplesFirst; index < samples; ++index)
-                    {
-                        *(ULONG *)&(outBuffer[index * bytesPerBlock + usbCh * usbBytesPerSample]) = *(ULONG *)&(asioBuffer[(index - samplesFirst) * asioSampleSize + asioByteOffset]);
-                    }
-                    break;
-                default:
-                    break; // max 32bit
-                }
-            }
+        ULONG samplesFirst = samples;
+        if (asioReadStartIndex > asioReadEndIndex)
+        {
+            samplesFirst = m_bufferLength - asioReadStartIndex;
         }
-    }
-    break;
-    case UACSampleFormat::UAC_SAMPLE_FORMAT_IEEE_FLOAT: {
-        ASSERT(usbBytesPerSample == 4);
-        ASSERT(asioSampleSize == 4);
-        for (ULONG asioCh = 0; asioCh < m_playChannels; ++asioCh)
+
+        //
+        // Each span is a run of ASIO channels routed to consecutive USB
+        // channels. Spans that no longer fit the current interface are
+        // skipped until the buffer is set up again.
+        //
+        const ULONG planarChannelStride = m_bufferLength * asioSampleSize;
+        for (ULONG spanIndex = 0; spanIndex < m_playSpanCount; ++spanIndex)
         {
-            ULONG usbCh = asioCh;
-            if (usbCh >= m_deviceContext->OutputProperty.UsbChannels)
+            const CHANNEL_SPAN & span = m_playSpans[spanIndex];
+            if (span.UsbChannel + span.Channels > m_deviceContext->OutputProperty.UsbChannels)
             {
-                // TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_ASIO, "ASIO OUT channel %u is not mapped", asioCh);
                 continue;
             }
-            ULONG samplesFirst = samples;
-            if (asioReadStartIndex > asioReadEndIndex)
-            {
-                samplesFirst = m_bufferLength - asioReadStartIndex;
-            }
 
-            if ((m_playChannelsMap & (1ULL << asioCh)) != 0)
+            SampleConverter::PlanarToInterleaved(
+                outBuffer + span.UsbChannel * usbBytesPerSample,
+                bytesPerBlock,
+                usbBytesPerSample,
+                span.Channels,
+                m_playBuffer + span.Channel * planarChannelStride,
+                planarChannelStride,
+                asioSampleSize,
+                span.Channels,
+                ~0ULL,
+                asioReadStartIndex,
+                samplesFirst
+            );
+            if (samplesFirst < samples)
             {
-                volatile BYTE * asioBuffer = m_playBuffer + (m_bufferLength * asioSampleSize * asioCh);
-                for (ULONG index = 0; index < samplesFirst; ++index)
-                {
-                    *(float *)&(outBuffer[index * bytesPerBlock + usbCh * usbBytesPerSample]) = *(float *)&(asioBuffer[(asioReadStartIndex + index) * asioSampleSize + asioByteOffset]);
-                }
-                for (ULONG index = samplesFirst; index < samples; ++index)
-                {
-                    *(float *)&(outBuffer[index * bytesPerBlock + usbCh * usbBytesPerSample]) = *(float *)&(asioBuffer[(index - samplesFirst) * asioSampleSize + asioByteOffset]);
-                }
+                SampleConverter::PlanarToInterleaved(
+                    outBuffer + samplesFirst * bytesPerBlock + span.UsbChannel * usbBytesPerSample,
+                    bytesPerBlock,
+                    usbBytesPerSample,
+                    span.Channels,
+                    m_playBuffer + span.Channel * planarChannelStride,
+                    planarChannelStride,
+                    asioSampleSize,
+                    span.Channels,
+                    ~0ULL,
+                    0,
+                    samples - samplesFirst
+                );
             }
         }
     }
@@ -657,130 +607,61 @@ AsioBufferObject::CopyToAsioFromInputData(
     const ULONG asioWriteEndIndex = (ULONG)((asioPosition + samples) % (m_bufferLength));
 
     ULONG asioSampleSize = USBAudioDataFormat::ConvertSampleTypeToBytesPerSample(m_deviceContext->AudioProperty.SampleType);
-    ULONG asioByteOffset = asioSampleSize - usbBytesPerSample;
 
+    //
+    // The interleaved USB isochronous data is converted into the
+    // non-interleaved format used by ASIO. If asioSampleSize is larger than
+    // usbBytesPerSample, the lower bytes of each ASIO sample are cleared.
+    //
     switch (m_deviceContext->AudioProperty.CurrentSampleFormat)
     {
-    case UACSampleFormat::UAC_SAMPLE_FORMAT_PCM: {
-        for (ULONG asioCh = 0; asioCh < m_recChannels; ++asioCh)
+    case UACSampleFormat::UAC_SAMPLE_FORMAT_PCM:
+    case UACSampleFormat::UAC_SAMPLE_FORMAT_IEEE_FLOAT: {
+        ASSERT((m_deviceContext->AudioProperty.CurrentSampleFormat != UACSampleFormat::UAC_SAMPLE_FORMAT_IEEE_FLOAT) || ((usbBytesPerSample == 4) && (asioSampleSize == 4)));
+
+        ULONG samplesFirst = samples;
+        if (asioWriteStartIndex > asioWriteEndIndex)
         {
-            ULONG usbCh = asioCh;
-            if (usbCh >= m_deviceContext->InputProperty.UsbChannels)
-            {
-                // TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_ASIO, "ASIO IN channel %u is not mapped", asioCh);
-                continue;
-            }
-            if ((m_recChannelsMap & (1ULL << asioCh)) != 0)
-            {
-                ULONG samplesFirst = samples;
-                PBYTE asioBuffer = (PBYTE)m_recBuffer + (m_bufferLength * asioSampleSize * asioCh);
-
-                // Since asioSampleSize and usbBytesPerSample are usually the same,
-                // zero-clearing is not necessary. However, if asioSampleSize is larger,
-                // we clear the entire buffer once.
-                //
-                // To improve efficiency, instead of writing zeros sparsely,
-                // we use RtlZeroMemory to clear the entire buffer at once.
-                if (asioSampleSize > usbBytesPerSample)
-                {
-                    if (asioWriteStartIndex > asioWriteEndIndex)
-                    {
-                        samplesFirst = m_bufferLength - asioWriteStartIndex;
-                        RtlZeroMemory(&(asioBuffer[asioWriteStartIndex * asioSampleSize + asioByteOffset]), samplesFirst * usbBytesPerSample);
-                        RtlZeroMemory(&(asioBuffer[asioByteOffset]), (samples - samplesFirst) * usbBytesPerSample);
-                    }
-                    else
-                    {
-                        RtlZeroMemory(&(asioBuffer[asioWriteStartIndex * asioSampleSize + asioByteOffset]), samplesFirst * usbBytesPerSample);
-                    }
-                }
-                switch (usbBytesPerSample)
-                {
-                case 1:
-                    for (ULONG index = 0; index < samplesFirst; ++index)
-                    {
-                        BYTE * src = &(inBuffer[index * bytesPerBlock + usbCh * usbBytesPerSample]);
-                        BYTE * dst = &(asioBuffer[(asioWriteStartIndex + index) * asioSampleSize + asioByteOffset]);
-                        *dst = *src;
-                    }
-                    for (ULONG index = samplesFirst; index < samples; ++index)
-                    {
-                        BYTE * src = &(inBuffer[index * bytesPerBlock + usbCh * usbBytesPerSample]);
-                        BYTE * dst = &(asioBuffer[(index - samplesFirst) * asioSampleSize + asioByteOffset]);
-                        *dst = *src;
-                    }
-                    break;
-                case 2:
-                    for (ULONG index = 0; index < samplesFirst; ++index)
-                    {
-                        *(USHORT *)&(asioBuffer[(asioWriteStartIndex + index) * asioSampleSize + asioByteOffset]) = *(USHORT *)&(inBuffer[index * bytesPerBlock + usbCh * usbBytesPerSample]);
-                    }
-                    for (ULONG index = samplesFirst; index < samples; ++index)
-                    {
-                        *(USHORT *)&(asioBuffer[(index - samplesFirst) * asioSampleSize + asioByteOffset]) = *(USHORT *)&(inBuffer[index * bytesPerBlock + usbCh * usbBytesPerSample]);
-                    }
-                    break;
-                case 3:
-                    for (ULONG index = 0; index < samplesFirst; ++index)
-                    {
-                        BYTE * src = &(inBuffer[index * bytesPerBlock + usbCh * usbBytesPerSample]);
-                        BYTE * dst = &(asioBuffer[(asioWriteStartIndex + index) * asioSampleSize + asioByteOffset]);
-                        *dst++ = *src++;
-                        *dst++ = *src++;
-                        *dst++ = *src++;
-                    }
-                    for (ULONG index = samplesFirst; index < samples; ++index)
-                    {
-                        BYTE * src = &(inBuffer[index * bytesPerBlock + usbCh * usbBytesPerSample]);
-                        BYTE * dst = &(asioBuffer[(index - samplesFirst) * asioSampleSize + asioByteOffset]);
-                        *dst++ = *src++;
-                        *dst++ = *src++;
-                        *dst++ = *src++;
-                    }
-                    break;
-                case 4:
-                    for (ULONG index = 0; index < samplesFirst; ++index)
-                    {
-                        *(ULONG *)&(asioBuffer[(asioWriteStartIndex + index) * asioSampleSize + asioByteOffset]) = *(ULONG *)&(inBuffer[index * bytesPerBlock + usbCh * usbBytesPerSample]);
-                    }
-                    for (ULONG index = samplesFirst; index < samples; ++index)
-                    {
-                        *(ULONG *)&(asioBuffer[(index - samplesFirst) * asioSampleSize + asioByteOffset]) = *(ULONG *)&(inBuffer[index * bytesPerBlock + usbCh * usbBytesPerSample]);
-                    }
-                    break;
-                default:
-                    break; // max 32bit
-                }
-            }
+            samplesFirst = m_bufferLength - asioWriteStartIndex;
         }
-    }
-    break;
-    case UACSampleFormat::UAC_SAMPLE_FORMAT_IEEE_FLOAT: {
-        ASSERT(usbBytesPerSample == 4);
-        ASSERT(asioSampleSize == 4);
-        for (ULONG asioCh = 0; asioCh < m_recChannels; ++asioCh)
+
+        const ULONG planarChannelStride = m_bufferLength * asioSampleSize;
+        for (ULONG spanIndex = 0; spanIndex < m_recSpanCount; ++spanIndex)
         {
-            ULONG usbCh = asioCh;
-            if (usbCh >= m_deviceContext->InputProperty.UsbChannels)
+            const CHANNEL_SPAN & span = m_recSpans[spanIndex];
+            if (span.UsbChannel + span.Channels > m_deviceContext->InputProperty.UsbChannels)
             {
-                // TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_ASIO, "ASIO IN channel %u is not mapped", asioCh);
                 continue;
             }
-            if ((m_recChannelsMap & (1ULL << asioCh)) != 0)
+
+            SampleConverter::InterleavedToPlanar(
+                m_recBuffer + span.Channel * planarChannelStride,
+                planarChannelStride,
+                asioSampleSize,
+                span.Channels,
+                ~0ULL,
+                asioWriteStartIndex,
+                inBuffer + span.UsbChannel * usbBytesPerSample,
+                bytesPerBlock,
+                usbBytesPerSample,
+                span.Channels,
+                samplesFirst
+            );
+            if (samplesFirst < samples)
             {
-                ULONG samplesFirst = samples;
-                PBYTE asioBuffer = (PBYTE)m_recBuffer + (m_bufferLength * asioSampleSize * asioCh);
-                if (usbBytesPerSample == 4)
-                {
-                    for (ULONG index = 0; index < samplesFirst; ++index)
-                    {
-                        *(float *)&(asioBuffer[(asioWriteStartIndex + index) * asioSampleSize + asioByteOffset]) = *(float *)&(inBuffer[index * bytesPerBlock + usbCh * usbBytesPerSample]);
-                    }
-                    for (ULONG index = samplesFirst; index < samples; ++index)
-                    {
-                        *(float *)&(asioBuffer[(index - samplesFirst) * asioSampleSize + asioByteOffset]) = *(float *)&(inBuffer[index * bytesPerBlock + usbCh * usbBytesPerSample]);
-                    }
-                }
+                SampleConverter::InterleavedToPlanar(
+                    m_recBuffer + span.Channel * planarChannelStride,
+                    planarChannelStride,
+                    asioSampleSize,
+                    span.Channels,
+                    ~0ULL,
+                    0,
+                    inBuffer + samplesFirst * bytesPerBlock + span.UsbChannel * usbBytesPerSample,
+                    bytesPerBlock,
+                    usbBytesPerSample,
+                    span.Channels,
+                    samples - samplesFirst
+                );
             }
         }
     }
@@ -832,20 +713,7 @@ bool AsioBufferObject::EvaluatePositionAndNotifyIfNeeded(
 
     curAsioMeasuredPeriodUs = 0;
 
-    if (hasInputIsochronousInterface && hasOutputIsochronousInterface)
-    {
-        asioNotify = ((m_writePosition - asioNotifyPosition) >= m_bufferPeriod) && ((m_readPosition - asioNotifyPosition) >= m_bufferPeriod);
-    }
-    else if (!hasInputIsochronousInterface)
-    {
-        // output only
-        asioNotify = ((m_readPosition - asioNotifyPosition) >= m_bufferPeriod);
-    }
-    else if (!hasOutputIsochronousInterface)
-    {
-        // input only
-        asioNotify = ((m_writePosition - asioNotifyPosition) >= m_bufferPeriod);
-    }
+    asioNotify = StreamTiming::IsAsioNotifyDue(m_writePosition, m_readPosition, asioNotifyPosition, m_bufferPeriod, hasInputIsochronousInterface, hasOutputIsochronousInterface);
 
     if (asioNotify)
     {
@@ -857,12 +725,7 @@ bool AsioBufferObject::EvaluatePositionAndNotifyIfNeeded(
         _InterlockedExchange64((volatile LONG64 *)&m_recHeader->NotifySystemTime, currentTimePCUs);
         KeSetEvent(m_userNotificationEvent, IO_SOUND_INCREMENT, FALSE);
         curAsioMeasuredPeriodUs = (LONG)(currentTimePCUs - lastAsioNotifyPCUs);
-        ULONG minimumPeriod = m_deviceContext->AudioProperty.SampleRate / 1000;
-        if (minimumPeriod < m_bufferPeriod)
-        {
-            minimumPeriod = m_bufferPeriod;
-        }
-        LONG thresholdUs = (LONG)((LONGLONG)(minimumPeriod + (m_deviceContext->UsbLatency.OutputDriverBuffer)) * 1000000LL / m_deviceContext->AudioProperty.SampleRate);
+        LONG thresholdUs = StreamTiming::CalculateCallbackPeriodThresholdUs(m_deviceContext->AudioProperty.SampleRate, m_bufferPeriod, m_deviceContext->UsbLatency.OutputDriverBuffer);
         if ((m_bufferLength * 1000 >= m_bufferPeriod) && (asioNotifyCount >= 2) && (curAsioMeasuredPeriodUs > thresholdUs))
         {
             TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_ASIO, "dropout detected. Callback period now %dus, last %dus, threshold %dus, processing %dus.", curAsioMeasuredPeriodUs, prevAsioMeasuredPeriodUs, thresholdUs, curClientProcessingTimeUs);
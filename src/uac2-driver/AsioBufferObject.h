@@ -27,6 +27,7 @@ Environment:
 
 #include <acx.h>
 #include "UAC_User.h"
+#include "SampleConverter.h"
 
 class AsioBufferObject
 {
@@ -185,6 +186,10 @@ class AsioBufferObject
     PKEVENT                               m_outputReadyEvent{nullptr};
     ULONGLONG                             m_playChannelsMap{0ULL};
     ULONGLONG                             m_recChannelsMap{0ULL};
+    CHANNEL_SPAN                          m_playSpans[UAC_MAX_ASIO_CHANNELS]{};
+    ULONG                                 m_playSpanCount{0};
+    CHANNEL_SPAN                          m_recSpans[UAC_MAX_ASIO_CHANNELS]{};
+    ULONG                                 m_recSpanCount{0};
 };
 
 #endif
@@ -0,0 +1,292 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+// ASIO is a trademark and software of Steinberg Media Technologies GmbH
+
+/*++
+
+Module Name:
+
+    DescriptorCache.cpp
+
+Abstract:
+
+    Implement a class that keeps the Control RANGE Parameter Blocks returned
+    by the device.
+
+Environment:
+
+    Kernel-mode Driver Framework
+
+--*/
+
+#ifdef UAC_HOST_BUILD
+#include "HostCompat.h"
+#else
+#include "Driver.h"
+#endif
+#include "DescriptorCache.h"
+
+#if !defined(__INTELLISENSE__) && !defined(UAC_HOST_BUILD)
+#include "DescriptorCache.tmh"
+#endif
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+DescriptorCache::DescriptorCache()
+{
+    PAGED_CODE();
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+DescriptorCache::~DescriptorCache()
+{
+    PAGED_CODE();
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+DescriptorCache *
+DescriptorCache::Create()
+{
+    PAGED_CODE();
+
+    return new (POOL_FLAG_NON_PAGED, DRIVER_TAG) DescriptorCache();
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+void DescriptorCache::Initialize(
+    USHORT        vendorId,
+    USHORT        productId,
+    USHORT        deviceRelease,
+    const UCHAR * descriptor,
+    ULONG         descriptorLength
+)
+{
+    PAGED_CODE();
+
+    DESCRIPTOR_CACHE_HEADER * header = (DESCRIPTOR_CACHE_HEADER *)m_data;
+
+    RtlZeroMemory(m_data, sizeof(m_data));
+    header->Magic = DESCRIPTOR_CACHE_MAGIC;
+    header->Version = DESCRIPTOR_CACHE_VERSION;
+    header->VendorId = vendorId;
+    header->ProductId = productId;
+    header->DeviceRelease = deviceRelease;
+    header->NumOfEntries = 0;
+    header->DescriptorLength = descriptorLength;
+    header->DescriptorHash = Hash(descriptor, descriptorLength);
+    header->Size = sizeof(DESCRIPTOR_CACHE_HEADER);
+    header->Checksum = Hash(nullptr, 0);
+    m_isModified = false;
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+bool DescriptorCache::Load(
+    const UCHAR * data,
+    ULONG         length
+)
+{
+    PAGED_CODE();
+
+    DESCRIPTOR_CACHE_HEADER * header = (DESCRIPTOR_CACHE_HEADER *)m_data;
+    DESCRIPTOR_CACHE_HEADER   loaded{};
+
+    if ((data == nullptr) || (length < sizeof(DESCRIPTOR_CACHE_HEADER)) || (length > sizeof(m_data)))
+    {
+        return false;
+    }
+    RtlCopyMemory(&loaded, data, sizeof(loaded));
+
+    if ((loaded.Magic != header->Magic) ||
+        (loaded.Version != header->Version) ||
+        (loaded.VendorId != header->VendorId) ||
+        (loaded.ProductId != header->ProductId) ||
+        (loaded.DeviceRelease != header->DeviceRelease) ||
+        (loaded.DescriptorLength != header->DescriptorLength) ||
+        (loaded.DescriptorHash != header->DescriptorHash) ||
+        (loaded.Size != length))
+    {
+        return false;
+    }
+
+    if (loaded.Checksum != Hash(data + sizeof(DESCRIPTOR_CACHE_HEADER), length - sizeof(DESCRIPTOR_CACHE_HEADER)))
+    {
+        return false;
+    }
+
+    //
+    // Walks the entries once so that FindRange never has to check the bounds.
+    //
+    ULONG offset = sizeof(DESCRIPTOR_CACHE_HEADER);
+    for (ULONG index = 0; index < loaded.NumOfEntries; index++)
+    {
+        DESCRIPTOR_CACHE_ENTRY entry{};
+        if (length - offset < sizeof(DESCRIPTOR_CACHE_ENTRY))
+        {
+            return false;
+        }
+        RtlCopyMemory(&entry, data + offset, sizeof(entry));
+        offset += sizeof(DESCRIPTOR_CACHE_ENTRY);
+        if ((entry.Length == 0) || (length - offset < entry.Length))
+        {
+            return false;
+        }
+        offset += entry.Length;
+    }
+    if (offset != length)
+    {
+        return false;
+    }
+
+    RtlCopyMemory(m_data, data, length);
+    m_isModified = false;
+
+    return true;
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+bool DescriptorCache::FindRange(
+    UCHAR          interfaceNumber,
+    UCHAR          entityID,
+    UCHAR          controlSelector,
+    UCHAR          channelNumber,
+    const UCHAR *& parameterBlock,
+    USHORT &       length
+) const
+{
+    PAGED_CODE();
+
+    const DESCRIPTOR_CACHE_HEADER * header = (const DESCRIPTOR_CACHE_HEADER *)m_data;
+
+    parameterBlock = nullptr;
+    length = 0;
+
+    ULONG offset = sizeof(DESCRIPTOR_CACHE_HEADER);
+    for (ULONG index = 0; index < header->NumOfEntries; index++)
+    {
+        DESCRIPTOR_CACHE_ENTRY entry{};
+        RtlCopyMemory(&entry, m_data + offset, sizeof(entry));
+        offset += sizeof(DESCRIPTOR_CACHE_ENTRY);
+        if ((entry.InterfaceNumber == interfaceNumber) &&
+            (entry.EntityID == entityID) &&
+            (entry.ControlSelector == controlSelector) &&
+            (entry.ChannelNumber == channelNumber))
+        {
+            parameterBlock = m_data + offset;
+            length = entry.Length;
+            return true;
+        }
+        offset += entry.Length;
+    }
+
+    return false;
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+bool DescriptorCache::AddRange(
+    UCHAR         interfaceNumber,
+    UCHAR         entityID,
+    UCHAR         controlSelector,
+    UCHAR         channelNumber,
+    const UCHAR * parameterBlock,
+    USHORT        length
+)
+{
+    PAGED_CODE();
+
+    DESCRIPTOR_CACHE_HEADER * header = (DESCRIPTOR_CACHE_HEADER *)m_data;
+    const UCHAR *             existingBlock = nullptr;
+    USHORT                    existingLength = 0;
+
+    if ((header->Magic != DESCRIPTOR_CACHE_MAGIC) || (parameterBlock == nullptr) || (length == 0) || (header->NumOfEntries == MAXUSHORT))
+    {
+        return false;
+    }
+    if (FindRange(interfaceNumber, entityID, controlSelector, channelNumber, existingBlock, existingLength))
+    {
+        return false;
+    }
+    if (sizeof(m_data) - header->Size < sizeof(DESCRIPTOR_CACHE_ENTRY) + length)
+    {
+        return false;
+    }
+
+    DESCRIPTOR_CACHE_ENTRY entry{interfaceNumber, entityID, controlSelector, channelNumber, length};
+    RtlCopyMemory(m_data + header->Size, &entry, sizeof(entry));
+    RtlCopyMemory(m_data + header->Size + sizeof(entry), parameterBlock, length);
+    header->Size += sizeof(entry) + length;
+    header->NumOfEntries++;
+    m_isModified = true;
+
+    return true;
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+const UCHAR * DescriptorCache::GetData(
+    ULONG & length
+)
+{
+    PAGED_CODE();
+
+    DESCRIPTOR_CACHE_HEADER * header = (DESCRIPTOR_CACHE_HEADER *)m_data;
+
+    length = 0;
+    if (header->Magic != DESCRIPTOR_CACHE_MAGIC)
+    {
+        return nullptr;
+    }
+
+    header->Checksum = Hash(m_data + sizeof(DESCRIPTOR_CACHE_HEADER), header->Size - sizeof(DESCRIPTOR_CACHE_HEADER));
+    m_isModified = false;
+    length = header->Size;
+
+    return m_data;
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+bool DescriptorCache::IsModified() const
+{
+    PAGED_CODE();
+
+    return m_isModified;
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+ULONG DescriptorCache::GetNumOfEntries() const
+{
+    PAGED_CODE();
+
+    return ((const DESCRIPTOR_CACHE_HEADER *)m_data)->NumOfEntries;
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+ULONG DescriptorCache::Hash(
+    const UCHAR * data,
+    ULONG         length
+)
+{
+    PAGED_CODE();
+
+    ULONG hash = DESCRIPTOR_CACHE_FNV_BASIS;
+
+    for (ULONG index = 0; (data != nullptr) && (index < length); index++)
+    {
+        hash ^= data[index];
+        hash *= DESCRIPTOR_CACHE_FNV_PRIME;
+    }
+
+    return hash;
+}
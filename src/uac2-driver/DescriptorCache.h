@@ -0,0 +1,166 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+// ASIO is a trademark and software of Steinberg Media Technologies GmbH
+
+/*++
+
+Module Name:
+
+    DescriptorCache.h
+
+Abstract:
+
+    Define a class that keeps the Control RANGE Parameter Blocks returned by
+    the device, so that they can be saved in the registry and reused the
+    next time the same device is prepared.
+
+Environment:
+
+    Kernel-mode Driver Framework
+
+--*/
+
+#ifndef _DESCRIPTOR_CACHE_H_
+#define _DESCRIPTOR_CACHE_H_
+
+#define DESCRIPTOR_CACHE_MAGIC    0x43444155 // 'UADC'
+#define DESCRIPTOR_CACHE_VERSION  1
+#define DESCRIPTOR_CACHE_MAX_SIZE 4096       // Header and entries. Ranges that do not fit are queried every time.
+#define DESCRIPTOR_CACHE_FNV_BASIS 0x811c9dc5
+#define DESCRIPTOR_CACHE_FNV_PRIME 0x01000193
+
+#pragma pack(push, 1)
+typedef struct DESCRIPTOR_CACHE_HEADER_
+{
+    ULONG  Magic;
+    USHORT Version;
+    USHORT Reserved;
+    USHORT VendorId;
+    USHORT ProductId;
+    USHORT DeviceRelease;          // bcdDevice
+    USHORT NumOfEntries;
+    ULONG  DescriptorLength;       // wTotalLength of the configuration descriptor
+    ULONG  DescriptorHash;         // FNV-1a of the whole configuration descriptor
+    ULONG  Size;                   // Header and entries in bytes
+    ULONG  Checksum;               // FNV-1a of the entries
+} DESCRIPTOR_CACHE_HEADER;
+
+typedef struct DESCRIPTOR_CACHE_ENTRY_
+{
+    UCHAR  InterfaceNumber;
+    UCHAR  EntityID;
+    UCHAR  ControlSelector;
+    UCHAR  ChannelNumber;
+    USHORT Length;                 // Bytes of the parameter block that follows the entry
+} DESCRIPTOR_CACHE_ENTRY;
+#pragma pack(pop)
+
+//
+// The cache is a flat blob of a header followed by entries, so that it is
+// saved and loaded as a single binary value. The header carries the
+// vendor ID, product ID, bcdDevice and a hash of the configuration
+// descriptor; a blob saved for a different device or firmware is
+// discarded on load without issuing any request. It does not depend on
+// the framework, so it can be driven with captured descriptors and
+// parameter blocks outside the driver.
+//
+class DescriptorCache
+{
+  public:
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    DescriptorCache();
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    virtual ~DescriptorCache();
+
+    static __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    DescriptorCache * Create();
+
+    //
+    // Sets the key of the device and forgets all entries.
+    //
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    void Initialize(
+        _In_ USHORT                                    vendorId,
+        _In_ USHORT                                    productId,
+        _In_ USHORT                                    deviceRelease,
+        _In_reads_bytes_(descriptorLength) const UCHAR * descriptor,
+        _In_ ULONG                                     descriptorLength
+    );
+
+    //
+    // Adopts the entries of a blob returned by GetData. Returns false and
+    // keeps the cache empty if the blob is malformed, its checksum does
+    // not match, or it was saved for a different key.
+    //
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    bool Load(
+        _In_reads_bytes_(length) const UCHAR * data,
+        _In_ ULONG                             length
+    );
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    bool FindRange(
+        _In_ UCHAR            interfaceNumber,
+        _In_ UCHAR            entityID,
+        _In_ UCHAR            controlSelector,
+        _In_ UCHAR            channelNumber,
+        _Out_ const UCHAR *&  parameterBlock,
+        _Out_ USHORT &        length
+    ) const;
+
+    //
+    // Appends a parameter block. Returns false if the entry already exists
+    // or does not fit.
+    //
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    bool AddRange(
+        _In_ UCHAR                             interfaceNumber,
+        _In_ UCHAR                             entityID,
+        _In_ UCHAR                             controlSelector,
+        _In_ UCHAR                             channelNumber,
+        _In_reads_bytes_(length) const UCHAR * parameterBlock,
+        _In_ USHORT                            length
+    );
+
+    //
+    // Returns the blob to be saved and clears the modified flag.
+    //
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    const UCHAR * GetData(
+        _Out_ ULONG & length
+    );
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    bool IsModified() const;
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    ULONG GetNumOfEntries() const;
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    static ULONG Hash(
+        _In_reads_bytes_(length) const UCHAR * data,
+        _In_ ULONG                             length
+    );
+
+  private:
+    UCHAR m_data[DESCRIPTOR_CACHE_MAX_SIZE]{}; // DESCRIPTOR_CACHE_HEADER followed by the entries
+    bool  m_isModified{false};
+};
+
+#endif
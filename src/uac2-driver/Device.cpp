@@ -37,8 +37,10 @@ Environment:
 #include "AsioBufferObject.h"
 #include "StreamEngine.h"
 #include "ErrorStatistics.h"
+#include "DescriptorCache.h"
 #include "CircuitHelper.h"
 #include "InterruptDataMessage.h"
+#include "DriverSettingsTable.h"
 
 #ifndef __INTELLISENSE__
 #include "Device.tmh"
@@ -65,53 +67,6 @@ static const UAC_SUPPORTED_CONTROL_LIST g_SupportedControlList[] = {
     {0xffff, 0xffff, 0x0000, 0x0000, true, true, true, false, 5000 /* 5sec */, 3, 1},
 };
 
-//
-// Latency offsets are defined according to the device's connection status.
-//
-static const UAC_LATENCY_OFFSET_LIST g_LatencyOffsetList[] = {
-    {
-        0,
-        0,
-        3,
-        2,
-    }, // for USB 1.1 device
-    {
-        0,
-        0,
-        3,
-        0,
-    }, // for USB 2.0 device
-};
-
-//
-// Defines internal parameters corresponding to the specified ASIO Period Frames.
-// These parameters affect not only ASIO but also USB isochronous transfer settings,
-// and therefore influence the behavior of the ACX audio driver as well.
-//
-static const UAC_DRIVER_FLAGS g_DriverSettingsTable[] = {
-    {8192, {4, 4, 0xb0000008, 0x90000000}},
-    {4096, {4, 4, 0xb0000008, 0x90000000}},
-    {2048, {4, 4, 0xb0000008, 0x90000000}},
-    {1536, {4, 4, 0xb0000008, 0x90000000}},
-    {1024, {4, 4, 0xb0000008, 0x90000000}},
-    {768, {4, 4, 0xb0000008, 0x90000000}},
-    {512, {4, 4, 0xb0000007, 0x90000000}},
-    {384, {3, 3, 0xb0000006, 0x90000000}},
-    {256, {3, 3, 0xb0000005, 0x90000000}},
-    {192, {3, 3, 0xb0000004, 0x90000000}},
-    {128, {3, 3, 0xb0000004, 0x90000000}},
-    {96, {3, 2, 0xb0000003, 0x90000000}},
-    {64, {3, 2, 0xb0000003, 0x90000000}},
-    {48, {3, 1, 0xb0000002, 0x90000000}},
-    {32, {3, 1, 0xb0000002, 0x90000000}},
-    {24, {3, 1, 0xb0000002, 0x90000000}},
-    {16, {3, 1, 0xb0000002, 0x90000000}},
-    {12, {3, 1, 0xb0000002, 0x90000000}},
-    {8, {3, 1, 0xb0000002, 0x90000000}},
-    {4, {3, 1, 0xb0000002, 0x90000000}},
-    {0, {4, 4, 0xb0000007, 0x90000000}},
-};
-
 static const int g_SettingsCount = sizeof(g_DriverSettingsTable) / sizeof(g_DriverSettingsTable[0]);
 
 // INTERNAL_PARAMETERS Registry Value Name
@@ -130,6 +85,9 @@ static const WCHAR c_ClassicFramesPerIrp2Name[] = L"ClassicFramesPerIrp2";
 static const WCHAR c_SuggestedBufferPeriodName[] = L"SuggestedBufferPeriod";
 static const WCHAR c_AsioDeviceName[] = L"AsioDevice";
 static const WCHAR c_SampleRateName[] = L"SampleRate";
+static const WCHAR c_AdaptiveSafetyOffsetName[] = L"AdaptiveSafetyOffset";
+static const WCHAR c_ParallelProcessingName[] = L"ParallelProcessing";
+static const WCHAR c_DescriptorCacheName[] = L"DescriptorCache";
 
 //
 //  Local function prototypes
@@ -282,6 +240,13 @@ static bool IsValidInternalParameters(
     _In_ const DEVICE_CONTEXT::INTERNAL_PARAMETERS & internalParameters
 );
 
+__drv_maxIRQL(PASSIVE_LEVEL)
+PAGED_CODE_SEG
+static bool IsValidChannelRouting(
+    _In_reads_(UAC_MAX_ASIO_CHANNELS) const LONG * routing,
+    _In_ bool                                     isOutput
+);
+
 __drv_maxIRQL(PASSIVE_LEVEL)
 PAGED_CODE_SEG
 static NTSTATUS UpdateFramePerIrp(
@@ -303,6 +268,12 @@ static NTSTATUS CalculateUsbLatency(
     _Out_ PUAC_USB_LATENCY usbLatency
 );
 
+__drv_maxIRQL(PASSIVE_LEVEL)
+PAGED_CODE_SEG
+static void UpdateUsbLatency(
+    _In_ PDEVICE_CONTEXT deviceContext
+);
+
 __drv_maxIRQL(PASSIVE_LEVEL)
 PAGED_CODE_SEG
 static void BuildChannelMap(
@@ -321,6 +292,15 @@ static NTSTATUS SetInterruptPipeInformation(
     _In_ PDEVICE_CONTEXT deviceContext
 );
 
+__drv_maxIRQL(PASSIVE_LEVEL)
+PAGED_CODE_SEG
+static void ResizePacketBuffer(
+    _Inout_ PUCHAR &                                         buffer,
+    _Inout_ ULONG &                                          bufferSize,
+    _In_ const DEVICE_CONTEXT::SelectedInterfaceAndPipe & interfaceAndPipe,
+    _In_ ULONG                                               maxBurst
+);
+
 #if 0
 __drv_maxIRQL(PASSIVE_LEVEL)
 PAGED_CODE_SEG
@@ -329,10 +309,14 @@ static NTSTATUS ResetPipeInformation(
 );
 #endif
 
+// Transfer objects of a stopped stream that the next stream takes over, indexed by IsoDirection and IRP index.
+typedef TransferObject * RETAINED_TRANSFER_OBJECTS[toULONG(IsoDirection::NumOfIsoDirection)][UAC_MAX_IRP_NUMBER];
+
 __drv_maxIRQL(PASSIVE_LEVEL)
 PAGED_CODE_SEG
 static NTSTATUS StartIsoStream(
-    _In_ PDEVICE_CONTEXT deviceContext
+    _In_ PDEVICE_CONTEXT                  deviceContext,
+    _Inout_opt_ RETAINED_TRANSFER_OBJECTS * retainedTransferObjects = nullptr
 );
 
 __drv_maxIRQL(PASSIVE_LEVEL)
@@ -341,6 +325,16 @@ static NTSTATUS FreeTransferObject(
     _In_ TransferObject * transferObject
 );
 
+__drv_maxIRQL(PASSIVE_LEVEL)
+PAGED_CODE_SEG
+static void GetTransferParameters(
+    _In_ PDEVICE_CONTEXT deviceContext,
+    _In_ IsoDirection    direction,
+    _Out_ ULONG &        numIsoPackets,
+    _Out_ ULONG &        isoPacketSize,
+    _Out_ ULONG &        maxXferSize
+);
+
 __drv_maxIRQL(PASSIVE_LEVEL)
 PAGED_CODE_SEG
 static NTSTATUS StartTransfer(
@@ -404,6 +398,14 @@ static NTSTATUS ProcessTransferFeedback(
 __drv_maxIRQL(PASSIVE_LEVEL)
 PAGED_CODE_SEG
 static NTSTATUS StopIsoStream(
+    _In_ PDEVICE_CONTEXT                  deviceContext,
+    _In_ bool                             keepAlternateSettings = false,
+    _Inout_opt_ RETAINED_TRANSFER_OBJECTS * retainedTransferObjects = nullptr
+);
+
+__drv_maxIRQL(PASSIVE_LEVEL)
+PAGED_CODE_SEG
+static NTSTATUS ReconfigureIsoStream(
     _In_ PDEVICE_CONTEXT deviceContext
 );
 
@@ -463,6 +465,34 @@ static NTSTATUS LoadSampleRateFromRegistry(
     _Out_ ULONG &  sampleRate
 );
 
+__drv_maxIRQL(PASSIVE_LEVEL)
+PAGED_CODE_SEG
+static NTSTATUS LoadAdaptiveSafetyOffsetFromRegistry(
+    _In_ WDFDEVICE device,
+    _Out_ ULONG &  quietPeriodSeconds
+);
+
+__drv_maxIRQL(PASSIVE_LEVEL)
+PAGED_CODE_SEG
+static NTSTATUS LoadParallelProcessingFromRegistry(
+    _In_ WDFDEVICE device,
+    _Out_ ULONG &  parallelProcessing
+);
+
+__drv_maxIRQL(PASSIVE_LEVEL)
+PAGED_CODE_SEG
+static NTSTATUS SaveDescriptorCacheToRegistry(
+    _In_ WDFDEVICE         device,
+    _In_ DescriptorCache * descriptorCache
+);
+
+__drv_maxIRQL(PASSIVE_LEVEL)
+PAGED_CODE_SEG
+static NTSTATUS LoadDescriptorCacheFromRegistry(
+    _In_ WDFDEVICE         device,
+    _In_ DescriptorCache * descriptorCache
+);
+
 __drv_maxIRQL(PASSIVE_LEVEL)
 PAGED_CODE_SEG
 static void ReportInternalParameters(
@@ -816,7 +846,11 @@ Return Value:
     // AsioWaitLock protects the AsioBufferObject within a narrower scope compared to StreamWaitLock.
     // Locking order: StreamWaitLock is acquired first, then AsioWaitLock.
     // This design ensures proper synchronization and avoids deadlocks.
+    // The mixing engine thread and the DPCs do not take AsioWaitLock. They hold AsioBufferRundown instead,
+    // and the control path waits for it before deleting the object.
     //
+    ExInitializeRundownProtection(&deviceContext->AsioBufferRundown);
+
     WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
     attributes.ParentObject = device;
 
@@ -843,6 +877,10 @@ Return Value:
             return status;
         }
 
+        // The adaptive safety offset is opt-in, so a missing value is not an error.
+        LoadAdaptiveSafetyOffsetFromRegistry(deviceContext->Device, deviceContext->AdaptiveSafetyOffset);
+        LoadParallelProcessingFromRegistry(deviceContext->Device, deviceContext->ParallelProcessing);
+
         deviceContext->SupportedControl = g_SupportedControlList[0];
         for (int i = 1; i < ARRAYSIZE(g_SupportedControlList); ++i)
         {
@@ -858,6 +896,19 @@ Return Value:
         }
 
         deviceContext->DesiredSampleFormat = UACSampleFormat::UAC_SAMPLE_FORMAT_PCM;
+
+        // The routing set by the user is kept across power transitions; only the first PrepareHardware of the device sets the identity.
+        if (!deviceContext->IsChannelRoutingInitialized)
+        {
+            for (LONG channel = 0; channel < UAC_MAX_ASIO_CHANNELS; ++channel)
+            {
+                deviceContext->ChannelRouting.AsioInput[channel] = channel;
+                deviceContext->ChannelRouting.AsioOutput[channel] = channel;
+                deviceContext->ChannelRouting.WdmInput[channel] = channel;
+                deviceContext->ChannelRouting.WdmOutput[channel] = channel;
+            }
+            deviceContext->IsChannelRoutingInitialized = true;
+        }
     }
 
     deviceContext->UsbAudioConfiguration = USBAudioConfiguration::Create(deviceContext, &deviceContext->UsbDeviceDescriptor);
@@ -935,6 +986,21 @@ Return Value:
         ULONG       retryCount = 0;
         const ULONG maxRetry = 30;
 
+        //
+        // Restores the ranges saved the last time this device was prepared,
+        // so that QueryDeviceFeatures does not have to request them again.
+        //
+        deviceContext->DescriptorCache = DescriptorCache::Create();
+        RETURN_NTSTATUS_IF_TRUE(deviceContext->DescriptorCache == nullptr, STATUS_INSUFFICIENT_RESOURCES);
+        deviceContext->DescriptorCache->Initialize(
+            deviceContext->UsbDeviceDescriptor.idVendor,
+            deviceContext->UsbDeviceDescriptor.idProduct,
+            deviceContext->UsbDeviceDescriptor.bcdDevice,
+            (const UCHAR *)deviceContext->UsbConfigurationDescriptor,
+            deviceContext->UsbConfigurationDescriptor->wTotalLength
+        );
+        LoadDescriptorCacheFromRegistry(deviceContext->Device, deviceContext->DescriptorCache);
+
         //
         // Parses USB CONFIGURATION DESCRIPTOR and holds the descriptors
         // required for creating an ACX Device and streaming USB Audio.
@@ -957,6 +1023,11 @@ Return Value:
         }
         RETURN_NTSTATUS_IF_FAILED(status);
 
+        if (deviceContext->DescriptorCache->IsModified())
+        {
+            SaveDescriptorCacheToRegistry(deviceContext->Device, deviceContext->DescriptorCache);
+        }
+
         ULONG desiredSampleRate = UAC_DEFAULT_SAMPLE_RATE;
         LoadSampleRateFromRegistry(deviceContext->Device, desiredSampleRate);
 
@@ -1002,6 +1073,7 @@ Return Value:
         ULONG numOfInputDevices = 0, numOfOutputDevices = 0;
         RETURN_NTSTATUS_IF_FAILED(deviceContext->UsbAudioConfiguration->GetStreamDevices(true, numOfInputDevices));
         RETURN_NTSTATUS_IF_FAILED(deviceContext->UsbAudioConfiguration->GetStreamDevices(false, numOfOutputDevices));
+        RETURN_NTSTATUS_IF_TRUE((numOfInputDevices > UAC_MAX_STREAM_DEVICES) || (numOfOutputDevices > UAC_MAX_STREAM_DEVICES), STATUS_NOT_SUPPORTED);
 
         RETURN_NTSTATUS_IF_FAILED(deviceContext->RtPacketObject->AssignDevices(numOfInputDevices, numOfOutputDevices));
 
@@ -1124,12 +1196,32 @@ Return Value:
         deviceContext->ContiguousMemory = nullptr;
     }
 
+    if (deviceContext->OutputMixBus != nullptr)
+    {
+        ExFreePoolWithTag(deviceContext->OutputMixBus, DRIVER_TAG);
+        deviceContext->OutputMixBus = nullptr;
+        deviceContext->OutputMixBusSize = 0;
+    }
+
+    if (deviceContext->InputStagingBuffer != nullptr)
+    {
+        ExFreePoolWithTag(deviceContext->InputStagingBuffer, DRIVER_TAG);
+        deviceContext->InputStagingBuffer = nullptr;
+        deviceContext->InputStagingBufferSize = 0;
+    }
+
     if (deviceContext->UsbAudioConfiguration != nullptr)
     {
         delete deviceContext->UsbAudioConfiguration;
         deviceContext->UsbAudioConfiguration = nullptr;
     }
 
+    if (deviceContext->DescriptorCache != nullptr)
+    {
+        delete deviceContext->DescriptorCache;
+        deviceContext->DescriptorCache = nullptr;
+    }
+
     if (deviceContext->RtPacketObject != nullptr)
     {
         delete deviceContext->RtPacketObject;
@@ -1142,11 +1234,10 @@ Return Value:
         deviceContext->StreamObject = nullptr;
     }
 
-    if (deviceContext->AsioBufferObject != nullptr)
-    {
-        delete deviceContext->AsioBufferObject;
-        deviceContext->AsioBufferObject = nullptr;
-    }
+    // The buffers of a client that did not unset them are unmapped before the object is deleted.
+    WdfWaitLockAcquire(deviceContext->AsioWaitLock, nullptr);
+    USBAudioAcxDriverDeleteAsioBufferObject(deviceContext);
+    WdfWaitLockRelease(deviceContext->AsioWaitLock);
 
     if (deviceContext->ErrorStatistics != nullptr)
     {
@@ -2544,11 +2635,8 @@ NTSTATUS SelectAlternateInterface(
     UCHAR                                   numberConfiguredPipes = 0;
     WDF_OBJECT_ATTRIBUTES                   pipeAttributes;
 
-    if (WdfUsbTargetDeviceGetNumInterfaces(deviceContext->UsbDevice) > 0)
-    {
-        status = RetrieveDeviceInformation(deviceContext->Device);
-        RETURN_NTSTATUS_IF_FAILED_MSG(status, "RetrieveDeviceInformation failed");
-    }
+    // The bus speed was retrieved in PrepareHardware and does not change without a new enumeration,
+    // so it is not queried again on each select, which runs twice on every start and stop of the stream.
     WDFUSBINTERFACE usbInterface = nullptr;
 
     UCHAR numInterfaces = WdfUsbTargetDeviceGetNumInterfaces(deviceContext->UsbDevice);
@@ -2665,11 +2753,7 @@ ActivateAudioInterface(
 
         TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, "<PID %04x>", audioProp->ProductId);
 
-        RtlZeroMemory(&deviceContext->UsbLatency, sizeof(UAC_USB_LATENCY));
-        CalculateUsbLatency(deviceContext, &deviceContext->UsbLatency);
-
-        audioProp->InputLatencyOffset = deviceContext->UsbLatency.InputLatency;
-        audioProp->OutputLatencyOffset = deviceContext->UsbLatency.OutputLatency;
+        UpdateUsbLatency(deviceContext);
 
         TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, "<PID %04x>", audioProp->ProductId);
         TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - Re-calculated Latency Offset In %d samples, Out %d samples", audioProp->InputLatencyOffset, audioProp->OutputLatencyOffset);
@@ -2858,6 +2942,21 @@ NTSTATUS CalculateUsbLatency(
     return STATUS_SUCCESS;
 }
 
+PAGED_CODE_SEG
+static _Use_decl_annotations_
+void UpdateUsbLatency(
+    PDEVICE_CONTEXT deviceContext
+)
+{
+    PAGED_CODE();
+
+    RtlZeroMemory(&deviceContext->UsbLatency, sizeof(UAC_USB_LATENCY));
+    CalculateUsbLatency(deviceContext, &deviceContext->UsbLatency);
+
+    deviceContext->AudioProperty.InputLatencyOffset = deviceContext->UsbLatency.InputLatency;
+    deviceContext->AudioProperty.OutputLatencyOffset = deviceContext->UsbLatency.OutputLatency;
+}
+
 PAGED_CODE_SEG
 static _Use_decl_annotations_
 void BuildChannelMap(
@@ -3020,12 +3119,62 @@ NTSTATUS SetPipeInformation(
     {
         deviceContext->ErrorStatistics->ClearBandWidthError();
         status = STATUS_SUCCESS;
+
+        // The packet buffers follow the pipes of the alternate settings just selected. The stream object only borrows them,
+        // so they are not replaced while one exists; StartIsoStream selects the settings again before it creates one.
+        if (deviceContext->StreamObject == nullptr)
+        {
+            ResizePacketBuffer(deviceContext->OutputMixBus, deviceContext->OutputMixBusSize, deviceContext->OutputInterfaceAndPipe, deviceContext->SupportedControl.MaxBurstOverride);
+            ResizePacketBuffer(deviceContext->InputStagingBuffer, deviceContext->InputStagingBufferSize, deviceContext->InputInterfaceAndPipe, deviceContext->SupportedControl.MaxBurstOverride);
+        }
     }
 
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit %!STATUS!", status);
     return status;
 }
 
+PAGED_CODE_SEG
+static _Use_decl_annotations_
+void ResizePacketBuffer(
+    PUCHAR &                                         buffer,
+    ULONG &                                          bufferSize,
+    const DEVICE_CONTEXT::SelectedInterfaceAndPipe & interfaceAndPipe,
+    ULONG                                            maxBurst
+)
+{
+    PAGED_CODE();
+
+    if (interfaceAndPipe.Pipe == nullptr)
+    {
+        return;
+    }
+
+    // The buffer holds a single packet of the selected alternate setting. It only grows,
+    // so that switching back and forth between formats does not reallocate it.
+    ULONG requiredSize = ALIGN_UP_BY(interfaceAndPipe.PipeInfo.MaximumPacketSize * max(maxBurst, 1UL), SYSTEM_CACHE_ALIGNMENT_SIZE);
+    if ((buffer != nullptr) && (requiredSize <= bufferSize))
+    {
+        return;
+    }
+
+    if (buffer != nullptr)
+    {
+        ExFreePoolWithTag(buffer, DRIVER_TAG);
+        buffer = nullptr;
+        bufferSize = 0;
+    }
+
+    buffer = static_cast<PUCHAR>(ExAllocatePool2(POOL_FLAG_NON_PAGED | POOL_FLAG_CACHE_ALIGNED, requiredSize, DRIVER_TAG));
+    if (buffer == nullptr)
+    {
+        TraceEvents(TRACE_LEVEL_WARNING, TRACE_DEVICE, " - packet buffer of %u bytes could not be allocated, packets are processed in the transfer buffer", requiredSize);
+        return;
+    }
+    bufferSize = requiredSize;
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, " - packet buffer %p, size %u", buffer, bufferSize);
+}
+
 PAGED_CODE_SEG
 static _Use_decl_annotations_
 NTSTATUS SetInterruptPipeInformation(
@@ -3334,6 +3483,7 @@ USBAudioAcxDriverStreamPrepareHardware(
     });
 
     WdfWaitLockAcquire(deviceContext->StreamEngineWaitLock, nullptr);
+    InterlockedIncrement(&deviceContext->StreamEngineLockCount);
     if (isInput)
     {
         RETURN_NTSTATUS_IF_TRUE(deviceContext->CaptureStreamEngine == nullptr, STATUS_UNSUCCESSFUL);
@@ -3375,16 +3525,19 @@ USBAudioAcxDriverStreamReleaseHardware(
     });
 
     WdfWaitLockAcquire(deviceContext->StreamEngineWaitLock, nullptr);
+    InterlockedIncrement(&deviceContext->StreamEngineLockCount);
     if (isInput)
     {
         RETURN_NTSTATUS_IF_TRUE(deviceContext->CaptureStreamEngine == nullptr, STATUS_UNSUCCESSFUL);
         RETURN_NTSTATUS_IF_TRUE(deviceIndex >= deviceContext->NumOfInputDevices, STATUS_INVALID_PARAMETER);
+        InterlockedAnd64(&deviceContext->ActiveStreamEngines.Capture[deviceIndex / 64], ~(1LL << (deviceIndex % 64)));
         deviceContext->CaptureStreamEngine[deviceIndex] = nullptr;
     }
     else
     {
         RETURN_NTSTATUS_IF_TRUE(deviceContext->RenderStreamEngine == nullptr, STATUS_UNSUCCESSFUL);
         RETURN_NTSTATUS_IF_TRUE(deviceIndex >= deviceContext->NumOfOutputDevices, STATUS_INVALID_PARAMETER);
+        InterlockedAnd64(&deviceContext->ActiveStreamEngines.Render[deviceIndex / 64], ~(1LL << (deviceIndex % 64)));
         deviceContext->RenderStreamEngine[deviceIndex] = nullptr;
     }
 
@@ -3421,6 +3574,12 @@ USBAudioAcxDriverStreamSetDataFormat(
         status = deviceContext->RtPacketObject->SetDataFormat(isInput, dataFormat);
         IF_FAILED_JUMP(status, Exit_BeforeWaitLockRelease);
 
+        // The stream sample rate may have changed. The engine lock keeps the mixing engine thread out of the resamplers while they are rebuilt.
+        WdfWaitLockAcquire(deviceContext->StreamEngineWaitLock, nullptr);
+        InterlockedIncrement(&deviceContext->StreamEngineLockCount);
+        deviceContext->RtPacketObject->PrepareResamplers(isInput);
+        WdfWaitLockRelease(deviceContext->StreamEngineWaitLock);
+
         ACXDATAFORMAT inputDataFormatBeforeChange = nullptr;
         ACXDATAFORMAT outputDataFormatBeforeChange = nullptr;
         ACXDATAFORMAT inputDataFormatAfterChange = nullptr;
@@ -3441,6 +3600,13 @@ USBAudioAcxDriverStreamSetDataFormat(
         status = ConvertAudioDataFormat(dataFormat, formatType, format);
         IF_FAILED_JUMP(status, Exit_BeforeWaitLockRelease);
 
+        // While an ASIO client owns the device, its sample rate is kept and a WDM PCM stream at another rate is resampled in RtPacketObject.
+        ULONG desiredSampleRate = AcxDataFormatGetSampleRate(dataFormat);
+        if ((deviceContext->AsioOwner != nullptr) && (formatType == NS_USBAudio0200::FORMAT_TYPE_I) && (format == NS_USBAudio0200::PCM) && (AcxDataFormatGetBitsPerSample(dataFormat) >= 16))
+        {
+            desiredSampleRate = deviceContext->AudioProperty.SampleRate;
+        }
+
         if (isInput)
         {
             desiredBytesPerSampleIn = AcxDataFormatGetBitsPerSample(dataFormat) / 8;
@@ -3460,7 +3626,7 @@ USBAudioAcxDriverStreamSetDataFormat(
 
         if (deviceContext->UsbAudioConfiguration->HasInputIsochronousInterface() && deviceContext->UsbAudioConfiguration->HasOutputIsochronousInterface())
         {
-            IF_TRUE_JUMP((deviceContext->AudioProperty.SampleRate == AcxDataFormatGetSampleRate(dataFormat)) &&
+            IF_TRUE_JUMP((deviceContext->AudioProperty.SampleRate == desiredSampleRate) &&
 						 (deviceContext->InputProperty.FormatType == formatType) && 
 						 (deviceContext->InputProperty.Format == format) && 
 						 (deviceContext->InputProperty.BytesPerSample == desiredBytesPerSampleIn) && 
@@ -3472,7 +3638,7 @@ USBAudioAcxDriverStreamSetDataFormat(
         }
         else if (deviceContext->UsbAudioConfiguration->HasInputIsochronousInterface())
         {
-            IF_TRUE_JUMP((deviceContext->AudioProperty.SampleRate == AcxDataFormatGetSampleRate(dataFormat)) && 
+            IF_TRUE_JUMP((deviceContext->AudioProperty.SampleRate == desiredSampleRate) && 
 						 (deviceContext->InputProperty.FormatType == formatType) && 
 						 (deviceContext->InputProperty.Format == format) && 
 						 (deviceContext->InputProperty.BytesPerSample == desiredBytesPerSampleIn) && 
@@ -3480,7 +3646,7 @@ USBAudioAcxDriverStreamSetDataFormat(
         }
         else if (deviceContext->UsbAudioConfiguration->HasOutputIsochronousInterface())
         {
-            IF_TRUE_JUMP((deviceContext->AudioProperty.SampleRate == AcxDataFormatGetSampleRate(dataFormat)) && 
+            IF_TRUE_JUMP((deviceContext->AudioProperty.SampleRate == desiredSampleRate) && 
 						 (deviceContext->OutputProperty.FormatType == formatType) && 
 						 (deviceContext->OutputProperty.Format == format) && 
 						 (deviceContext->OutputProperty.BytesPerSample == desiredBytesPerSampleOut) && 
@@ -3504,7 +3670,7 @@ USBAudioAcxDriverStreamSetDataFormat(
         {
             deviceContext->RtPacketObject->Pause();
         }
-        status = ActivateAudioInterface(deviceContext, AcxDataFormatGetSampleRate(dataFormat), formatType, format, desiredBytesPerSampleIn, desiredValidBitsPerSampleIn, desiredBytesPerSampleOut, desiredValidBitsPerSampleOut);
+        status = ActivateAudioInterface(deviceContext, desiredSampleRate, formatType, format, desiredBytesPerSampleIn, desiredValidBitsPerSampleIn, desiredBytesPerSampleOut, desiredValidBitsPerSampleOut);
         IF_FAILED_JUMP(status, Exit_BeforeWaitLockRelease);
 
         if (streamRunning && NT_SUCCESS(status))
@@ -3876,6 +4042,78 @@ USBAudioAcxDriverStreamGetCapturePacket_Exit:
     return status;
 }
 
+PAGED_CODE_SEG
+_Use_decl_annotations_
+void USBAudioAcxDriverStreamSetActive(
+    bool            isInput,
+    ULONG           deviceIndex,
+    PDEVICE_CONTEXT deviceContext,
+    bool            isActive
+)
+{
+    PAGED_CODE();
+
+    ASSERT(deviceIndex < UAC_MAX_STREAM_DEVICES);
+
+    LONG64 * activeStreamEngines = isInput ? &deviceContext->ActiveStreamEngines.Capture[deviceIndex / 64] : &deviceContext->ActiveStreamEngines.Render[deviceIndex / 64];
+    LONG64   deviceBit = 1LL << (deviceIndex % 64);
+
+    WdfWaitLockAcquire(deviceContext->StreamEngineWaitLock, nullptr);
+    InterlockedIncrement(&deviceContext->StreamEngineLockCount);
+    if (isActive)
+    {
+        InterlockedOr64(activeStreamEngines, deviceBit);
+    }
+    else
+    {
+        InterlockedAnd64(activeStreamEngines, ~deviceBit);
+    }
+    WdfWaitLockRelease(deviceContext->StreamEngineWaitLock);
+}
+
+PAGED_CODE_SEG
+_Use_decl_annotations_
+bool USBAudioAcxDriverStreamLockActiveEngines(
+    PDEVICE_CONTEXT         deviceContext,
+    ACTIVE_STREAM_ENGINES & activeStreamEngines
+)
+{
+    LONG64 activeEngines = 0;
+
+    PAGED_CODE();
+
+    RtlZeroMemory(&activeStreamEngines, sizeof(activeStreamEngines));
+
+    // While no WDM stream runs, the mixing engine thread does not touch the lock at all.
+    for (ULONG i = 0; i < UAC_MAX_STREAM_DEVICES / 64; i++)
+    {
+        activeEngines |= InterlockedCompareExchange64(&deviceContext->ActiveStreamEngines.Capture[i], 0, 0);
+        activeEngines |= InterlockedCompareExchange64(&deviceContext->ActiveStreamEngines.Render[i], 0, 0);
+    }
+    if (activeEngines == 0)
+    {
+        return false;
+    }
+
+    // The lock keeps the stream engines from being released while their packets are copied.
+    WdfWaitLockAcquire(deviceContext->StreamEngineWaitLock, nullptr);
+    InterlockedIncrement(&deviceContext->StreamEngineLockCount);
+    activeStreamEngines = deviceContext->ActiveStreamEngines;
+
+    return true;
+}
+
+PAGED_CODE_SEG
+_Use_decl_annotations_
+void USBAudioAcxDriverStreamUnlockActiveEngines(
+    PDEVICE_CONTEXT deviceContext
+)
+{
+    PAGED_CODE();
+
+    WdfWaitLockRelease(deviceContext->StreamEngineWaitLock);
+}
+
 PAGED_CODE_SEG
 _Use_decl_annotations_
 NTSTATUS USBAudioAcxDriverGetCurrentDataFormat(
@@ -3974,6 +4212,67 @@ bool USBAudioAcxDriverHasAsioOwnership(
     return hasAsioOwnership;
 }
 
+NONPAGED_CODE_SEG
+_Use_decl_annotations_
+AsioBufferObject * USBAudioAcxDriverAcquireAsioBufferObject(
+    PDEVICE_CONTEXT deviceContext
+)
+{
+    ASSERT(deviceContext != nullptr);
+
+    // Fails only while the control path is deleting the object, in which case the caller proceeds as if there were none.
+    if (!ExAcquireRundownProtection(&deviceContext->AsioBufferRundown))
+    {
+        return nullptr;
+    }
+
+    AsioBufferObject * asioBufferObject = static_cast<AsioBufferObject *>(InterlockedCompareExchangePointer(reinterpret_cast<PVOID volatile *>(&deviceContext->AsioBufferObject), nullptr, nullptr));
+    if (asioBufferObject == nullptr)
+    {
+        ExReleaseRundownProtection(&deviceContext->AsioBufferRundown);
+    }
+
+    return asioBufferObject;
+}
+
+NONPAGED_CODE_SEG
+_Use_decl_annotations_
+void USBAudioAcxDriverReleaseAsioBufferObject(
+    PDEVICE_CONTEXT deviceContext
+)
+{
+    ASSERT(deviceContext != nullptr);
+
+    ExReleaseRundownProtection(&deviceContext->AsioBufferRundown);
+}
+
+PAGED_CODE_SEG
+_Use_decl_annotations_
+NTSTATUS USBAudioAcxDriverDeleteAsioBufferObject(
+    PDEVICE_CONTEXT deviceContext
+)
+{
+    NTSTATUS status = STATUS_SUCCESS;
+
+    ASSERT(deviceContext != nullptr);
+
+    PAGED_CODE();
+
+    // Called with AsioWaitLock held.
+    AsioBufferObject * asioBufferObject = static_cast<AsioBufferObject *>(InterlockedExchangePointer(reinterpret_cast<PVOID volatile *>(&deviceContext->AsioBufferObject), nullptr));
+    if (asioBufferObject != nullptr)
+    {
+        // Users that picked up the pointer before it was cleared finish within one wake of the mixing engine thread.
+        ExWaitForRundownProtectionRelease(&deviceContext->AsioBufferRundown);
+        ExReInitializeRundownProtection(&deviceContext->AsioBufferRundown);
+
+        status = asioBufferObject->UnsetBuffer();
+        delete asioBufferObject;
+    }
+
+    return status;
+}
+
 PAGED_CODE_SEG
 static _Use_decl_annotations_
 NTSTATUS LoadInternalParametersFromDeviceRegistry(
@@ -4416,113 +4715,892 @@ NTSTATUS LoadSampleRateFromRegistry(
     return status;
 }
 
+// AdaptiveSafetyOffset is the number of seconds without a dropout after which the output safety offset is lowered by one packet.
+// The value is absent by default, which keeps the offset of the driver settings table.
 PAGED_CODE_SEG
 static _Use_decl_annotations_
-bool IsValidInternalParameters(
-    const DEVICE_CONTEXT::INTERNAL_PARAMETERS & internalParameters
+NTSTATUS LoadAdaptiveSafetyOffsetFromRegistry(
+    WDFDEVICE device,
+    ULONG &   quietPeriodSeconds
 )
 {
-    bool isValid = false;
-
     PAGED_CODE();
 
-    if ((internalParameters.FirstPacketLatency > USBD_ISO_START_FRAME_RANGE) ||
-        /* (internalParameters.ClassicFramesPerIrp < UAC_MIN_CLASSIC_FRAMES_PER_IRP) || */
-        (internalParameters.ClassicFramesPerIrp > UAC_MAX_CLASSIC_FRAMES_PER_IRP) ||
-        (internalParameters.MaxIrpNumber < UAC_MIN_MAX_IRP_NUMBER) ||
-        (internalParameters.MaxIrpNumber > UAC_MAX_IRP_NUMBER) ||
-        (internalParameters.PreSendFrames > UAC_MAX_PRE_SEND_FRAMES) ||
-        (internalParameters.OutputFrameDelay < UAC_MIN_OUTPUT_FRAME_DELAY) ||
-        (internalParameters.OutputFrameDelay > UAC_MAX_OUTPUT_FRAME_DELAY) ||
-        //(internalParameters.BufferOperationThread > UAC_MAX_BUFFER_OPERATION_THREAD) ||
-        ((internalParameters.InputBufferOperationOffset & 0xfffffff) > UAC_MAX_CLASSIC_FRAMES_PER_IRP * UAC_MAX_IRP_NUMBER * 8) ||
-        (internalParameters.InputHubOffset > UAC_MAX_CLASSIC_FRAMES_PER_IRP * UAC_MAX_IRP_NUMBER * 8) ||
-        ((internalParameters.OutputBufferOperationOffset & 0xfffffff) > UAC_MAX_CLASSIC_FRAMES_PER_IRP * UAC_MAX_IRP_NUMBER * 8) ||
-        (internalParameters.OutputHubOffset > UAC_MAX_CLASSIC_FRAMES_PER_IRP * UAC_MAX_IRP_NUMBER * 8) ||
-        (internalParameters.BufferThreadPriority > HIGH_PRIORITY))
-    {
-        isValid = false;
-    }
-    else
-    {
-        isValid = true;
-    }
-
-    return isValid;
-}
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Entry");
 
-PAGED_CODE_SEG
-static _Use_decl_annotations_
-NTSTATUS UpdateFramePerIrp(
-    PDEVICE_CONTEXT deviceContext,
-    ULONG           bufferPeriod
-)
-{
-    PAGED_CODE();
+    NTSTATUS status = STATUS_SUCCESS;
+    WDFKEY   registryKey = nullptr;
 
-    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC!");
+    quietPeriodSeconds = 0;
 
-    if (deviceContext == nullptr)
-    {
+    auto exitProcess = wil::scope_exit(
+        [&]() {
+            if (registryKey != nullptr)
+            {
+                WdfRegistryClose(registryKey);
+            }
+
+            TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit %!STATUS!, %u", status, quietPeriodSeconds);
+        }
+    );
+
+    if (device == nullptr)
+    {
+        status = STATUS_INVALID_PARAMETER;
+        return status;
+    }
+
+    status = WdfDeviceOpenRegistryKey(device, PLUGPLAY_REGKEY_DEVICE, KEY_READ, WDF_NO_OBJECT_ATTRIBUTES, &registryKey);
+
+    if (!NT_SUCCESS(status))
+    {
+        return status;
+    }
+
+    UNICODE_STRING valueName;
+    RtlInitUnicodeString(&valueName, c_AdaptiveSafetyOffsetName);
+
+    ULONG value = 0;
+    ULONG resultLength = 0;
+
+    status = WdfRegistryQueryValue(
+        registryKey,   // Key
+        &valueName,    // ValueName
+        sizeof(ULONG), // ValueLength
+        &value,        // Value
+        &resultLength, // ValueLengthQueried
+        nullptr        // ValueType
+    );
+
+    if (!NT_SUCCESS(status))
+    {
+        return status;
+    }
+
+    quietPeriodSeconds = value;
+
+    return status;
+}
+
+// ParallelProcessing selects whether the IN packets of a wake may be processed on a worker thread while the mixing engine
+// thread processes the OUT packets. It is UAC_PARALLEL_PROCESSING_AUTOMATIC when absent, which hands the IN side over only
+// when the copies take too large a share of the packet period.
+PAGED_CODE_SEG
+static _Use_decl_annotations_
+NTSTATUS LoadParallelProcessingFromRegistry(
+    WDFDEVICE device,
+    ULONG &   parallelProcessing
+)
+{
+    PAGED_CODE();
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Entry");
+
+    NTSTATUS status = STATUS_SUCCESS;
+    WDFKEY   registryKey = nullptr;
+
+    parallelProcessing = UAC_PARALLEL_PROCESSING_AUTOMATIC;
+
+    auto exitProcess = wil::scope_exit(
+        [&]() {
+            if (registryKey != nullptr)
+            {
+                WdfRegistryClose(registryKey);
+            }
+
+            TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit %!STATUS!, %u", status, parallelProcessing);
+        }
+    );
+
+    if (device == nullptr)
+    {
+        status = STATUS_INVALID_PARAMETER;
+        return status;
+    }
+
+    status = WdfDeviceOpenRegistryKey(device, PLUGPLAY_REGKEY_DEVICE, KEY_READ, WDF_NO_OBJECT_ATTRIBUTES, &registryKey);
+
+    if (!NT_SUCCESS(status))
+    {
+        return status;
+    }
+
+    UNICODE_STRING valueName;
+    RtlInitUnicodeString(&valueName, c_ParallelProcessingName);
+
+    ULONG value = 0;
+    ULONG resultLength = 0;
+
+    status = WdfRegistryQueryValue(
+        registryKey,   // Key
+        &valueName,    // ValueName
+        sizeof(ULONG), // ValueLength
+        &value,        // Value
+        &resultLength, // ValueLengthQueried
+        nullptr        // ValueType
+    );
+
+    if (!NT_SUCCESS(status))
+    {
+        return status;
+    }
+
+    if (value > UAC_PARALLEL_PROCESSING_ALWAYS)
+    {
+        status = STATUS_INVALID_PARAMETER;
+        return status;
+    }
+
+    parallelProcessing = value;
+
+    return status;
+}
+
+PAGED_CODE_SEG
+static _Use_decl_annotations_
+NTSTATUS SaveDescriptorCacheToRegistry(
+    WDFDEVICE         device,
+    DescriptorCache * descriptorCache
+)
+{
+    PAGED_CODE();
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Entry");
+
+    NTSTATUS status = STATUS_SUCCESS;
+    WDFKEY   registryKey = nullptr;
+
+    auto exitProcess = wil::scope_exit(
+        [&]() {
+            if (registryKey != nullptr)
+            {
+                WdfRegistryClose(registryKey);
+            }
+
+            TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit %!STATUS!", status);
+        }
+    );
+
+    if ((device == nullptr) || (descriptorCache == nullptr))
+    {
+        status = STATUS_INVALID_PARAMETER;
+        return status;
+    }
+
+    status = WdfDeviceOpenRegistryKey(device, PLUGPLAY_REGKEY_DEVICE, KEY_WRITE, WDF_NO_OBJECT_ATTRIBUTES, &registryKey);
+
+    if (!NT_SUCCESS(status))
+    {
+        return status;
+    }
+
+    UNICODE_STRING valueName;
+    RtlInitUnicodeString(&valueName, c_DescriptorCacheName);
+
+    ULONG         length = 0;
+    const UCHAR * data = descriptorCache->GetData(length);
+
+    if (data == nullptr)
+    {
+        status = STATUS_INVALID_DEVICE_STATE;
+        return status;
+    }
+
+    status = WdfRegistryAssignValue(
+        registryKey, // Key
+        &valueName,  // ValueName
+        REG_BINARY,  // ValueType
+        length,      // ValueLength
+        (PVOID)data  // Value
+    );
+
+    return status;
+}
+
+// DescriptorCache holds the Control RANGE Parameter Blocks of the device. It is discarded when the vendor ID, product ID,
+// bcdDevice or configuration descriptor differ from the ones it was saved with. Deleting the value makes the driver query
+// the ranges again.
+PAGED_CODE_SEG
+static _Use_decl_annotations_
+NTSTATUS LoadDescriptorCacheFromRegistry(
+    WDFDEVICE         device,
+    DescriptorCache * descriptorCache
+)
+{
+    PAGED_CODE();
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Entry");
+
+    NTSTATUS  status = STATUS_SUCCESS;
+    WDFKEY    registryKey = nullptr;
+    WDFMEMORY memory = nullptr;
+
+    auto exitProcess = wil::scope_exit(
+        [&]() {
+            if (memory != nullptr)
+            {
+                WdfObjectDelete(memory);
+            }
+
+            if (registryKey != nullptr)
+            {
+                WdfRegistryClose(registryKey);
+            }
+
+            TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit %!STATUS!", status);
+        }
+    );
+
+    if ((device == nullptr) || (descriptorCache == nullptr))
+    {
+        status = STATUS_INVALID_PARAMETER;
+        return status;
+    }
+
+    status = WdfDeviceOpenRegistryKey(device, PLUGPLAY_REGKEY_DEVICE, KEY_READ, WDF_NO_OBJECT_ATTRIBUTES, &registryKey);
+
+    if (!NT_SUCCESS(status))
+    {
+        return status;
+    }
+
+    UNICODE_STRING valueName;
+    RtlInitUnicodeString(&valueName, c_DescriptorCacheName);
+
+    ULONG valueType = REG_NONE;
+
+    status = WdfRegistryQueryMemory(
+        registryKey,              // Key
+        &valueName,               // ValueName
+        PagedPool,                // PoolType
+        WDF_NO_OBJECT_ATTRIBUTES, // MemoryAttributes
+        &memory,                  // Memory
+        &valueType                // ValueType
+    );
+
+    if (!NT_SUCCESS(status))
+    {
+        return status;
+    }
+
+    size_t        length = 0;
+    const UCHAR * data = (const UCHAR *)WdfMemoryGetBuffer(memory, &length);
+
+    if ((valueType != REG_BINARY) || (length > MAXULONG) || !descriptorCache->Load(data, (ULONG)length))
+    {
+        status = STATUS_OBJECT_TYPE_MISMATCH;
+        return status;
+    }
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, " - %u ranges loaded", descriptorCache->GetNumOfEntries());
+
+    return status;
+}
+
+PAGED_CODE_SEG
+static _Use_decl_annotations_
+bool IsValidInternalParameters(
+    const DEVICE_CONTEXT::INTERNAL_PARAMETERS & internalParameters
+)
+{
+    bool isValid = false;
+
+    PAGED_CODE();
+
+    if ((internalParameters.FirstPacketLatency > USBD_ISO_START_FRAME_RANGE) ||
+        /* (internalParameters.ClassicFramesPerIrp < UAC_MIN_CLASSIC_FRAMES_PER_IRP) || */
+        (internalParameters.ClassicFramesPerIrp > UAC_MAX_CLASSIC_FRAMES_PER_IRP) ||
+        (internalParameters.MaxIrpNumber < UAC_MIN_MAX_IRP_NUMBER) ||
+        (internalParameters.MaxIrpNumber > UAC_MAX_IRP_NUMBER) ||
+        (internalParameters.PreSendFrames > UAC_MAX_PRE_SEND_FRAMES) ||
+        (internalParameters.OutputFrameDelay < UAC_MIN_OUTPUT_FRAME_DELAY) ||
+        (internalParameters.OutputFrameDelay > UAC_MAX_OUTPUT_FRAME_DELAY) ||
+        //(internalParameters.BufferOperationThread > UAC_MAX_BUFFER_OPERATION_THREAD) ||
+        ((internalParameters.InputBufferOperationOffset & 0xfffffff) > UAC_MAX_CLASSIC_FRAMES_PER_IRP * UAC_MAX_IRP_NUMBER * 8) ||
+        (internalParameters.InputHubOffset > UAC_MAX_CLASSIC_FRAMES_PER_IRP * UAC_MAX_IRP_NUMBER * 8) ||
+        ((internalParameters.OutputBufferOperationOffset & 0xfffffff) > UAC_MAX_CLASSIC_FRAMES_PER_IRP * UAC_MAX_IRP_NUMBER * 8) ||
+        (internalParameters.OutputHubOffset > UAC_MAX_CLASSIC_FRAMES_PER_IRP * UAC_MAX_IRP_NUMBER * 8) ||
+        (internalParameters.BufferThreadPriority > HIGH_PRIORITY))
+    {
+        isValid = false;
+    }
+    else
+    {
+        isValid = true;
+    }
+
+    return isValid;
+}
+
+PAGED_CODE_SEG
+static _Use_decl_annotations_
+bool IsValidChannelRouting(
+    const LONG * routing,
+    bool         isOutput
+)
+{
+    ULONGLONG usedChannels = 0;
+
+    PAGED_CODE();
+
+    for (ULONG channel = 0; channel < UAC_MAX_ASIO_CHANNELS; ++channel)
+    {
+        if (routing[channel] == UAC_CHANNEL_NOT_ROUTED)
+        {
+            continue;
+        }
+        if ((routing[channel] < 0) || (routing[channel] >= UAC_MAX_ASIO_CHANNELS))
+        {
+            return false;
+        }
+
+        // Two output channels written to the same USB channel would overwrite each other.
+        ULONGLONG usbChannelBit = 1ULL << routing[channel];
+        if (isOutput && ((usedChannels & usbChannelBit) != 0))
+        {
+            return false;
+        }
+        usedChannels |= usbChannelBit;
+    }
+
+    return true;
+}
+
+PAGED_CODE_SEG
+static _Use_decl_annotations_
+NTSTATUS UpdateFramePerIrp(
+    PDEVICE_CONTEXT deviceContext,
+    ULONG           bufferPeriod
+)
+{
+    PAGED_CODE();
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC!");
+
+    if (deviceContext == nullptr)
+    {
         return STATUS_INVALID_PARAMETER;
     }
 
-    int bufferSizeIndex = 0;
-    for (; bufferSizeIndex < (ARRAYSIZE(g_DriverSettingsTable) - 1); ++bufferSizeIndex)
+    int bufferSizeIndex = 0;
+    for (; bufferSizeIndex < (ARRAYSIZE(g_DriverSettingsTable) - 1); ++bufferSizeIndex)
+    {
+        if (g_DriverSettingsTable[bufferSizeIndex].PeriodFrames == bufferPeriod)
+        {
+            break;
+        }
+    }
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "ClassicFramesPerIrp  %u -> %u", deviceContext->Params.ClassicFramesPerIrp, g_DriverSettingsTable[bufferSizeIndex].Parameter.ClassicFramesPerIrp);
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "ClassicFramesPerIrp2 %u -> %u", deviceContext->Params.ClassicFramesPerIrp2, g_DriverSettingsTable[bufferSizeIndex].Parameter.ClassicFramesPerIrp2);
+
+    deviceContext->Params.ClassicFramesPerIrp = g_DriverSettingsTable[bufferSizeIndex].Parameter.ClassicFramesPerIrp;
+    deviceContext->Params.ClassicFramesPerIrp2 = g_DriverSettingsTable[bufferSizeIndex].Parameter.ClassicFramesPerIrp2;
+
+    return STATUS_SUCCESS;
+}
+
+PAGED_CODE_SEG
+static _Use_decl_annotations_
+NTSTATUS UpdateBufferOperationOffset(
+    PDEVICE_CONTEXT deviceContext,
+    ULONG           bufferPeriod
+)
+{
+    PAGED_CODE();
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC!");
+
+    if (deviceContext == nullptr)
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    int bufferSizeIndex = 0;
+
+    for (; bufferSizeIndex < (ARRAYSIZE(g_DriverSettingsTable) - 1); ++bufferSizeIndex)
+    {
+        if (g_DriverSettingsTable[bufferSizeIndex].PeriodFrames == bufferPeriod)
+        {
+            break;
+        }
+    }
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "OutputBufferOperationOffset  0x%08x -> 0x%08x", deviceContext->Params.OutputBufferOperationOffset, g_DriverSettingsTable[bufferSizeIndex].Parameter.OutputBufferOperationOffset);
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "InputBufferOperationOffset   0x%08x -> 0x%08x", deviceContext->Params.InputBufferOperationOffset, g_DriverSettingsTable[bufferSizeIndex].Parameter.InputBufferOperationOffset);
+
+    deviceContext->Params.OutputBufferOperationOffset = g_DriverSettingsTable[bufferSizeIndex].Parameter.OutputBufferOperationOffset;
+    deviceContext->Params.InputBufferOperationOffset = g_DriverSettingsTable[bufferSizeIndex].Parameter.InputBufferOperationOffset;
+
+    return STATUS_SUCCESS;
+}
+
+PAGED_CODE_SEG
+_Use_decl_annotations_
+VOID EvtUSBAudioAcxDriverGetAudioProperty(
+    WDFOBJECT  object,
+    WDFREQUEST request
+)
+{
+    NTSTATUS               status = STATUS_NOT_SUPPORTED;
+    ACX_REQUEST_PARAMETERS params{};
+    ULONG_PTR              outDataCb = 0;
+    // ACXSTREAM              stream = static_cast<ACXSTREAM>(object);
+    // ASSERT(stream != nullptr);
+
+    WDFDEVICE device = AcxCircuitGetWdfDevice((ACXCIRCUIT)object);
+    ASSERT(device != nullptr);
+
+    PDEVICE_CONTEXT deviceContext = GetDeviceContext(device);
+    ASSERT(deviceContext != nullptr);
+
+    PAGED_CODE();
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Entry");
+
+    ACX_REQUEST_PARAMETERS_INIT(&params);
+    AcxRequestGetParameters(request, &params);
+
+    ASSERT(params.Type == AcxRequestTypeProperty);
+    ASSERT(params.Parameters.Property.Verb == AcxPropertyVerbGet);
+    ASSERT(params.Parameters.Property.Control == nullptr);
+    ASSERT(params.Parameters.Property.ControlCb == 0);
+    ASSERT(params.Parameters.Property.Value != nullptr);
+    ASSERT(params.Parameters.Property.ValueCb == sizeof(UAC_AUDIO_PROPERTY));
+
+    IF_TRUE_ACTION_JUMP(((params.Parameters.Property.Control != nullptr) ||
+                         (params.Parameters.Property.ControlCb != 0) ||
+                         (params.Parameters.Property.Value == nullptr) ||
+                         (params.Parameters.Property.ValueCb < sizeof(UAC_AUDIO_PROPERTY))),
+                        ASSERT(FALSE);
+                        outDataCb = 0; status = STATUS_INVALID_PARAMETER;,
+                                                                         Exit);
+
+    ULONG               minValueSize = sizeof(UAC_AUDIO_PROPERTY);
+    PUAC_AUDIO_PROPERTY audioProperty = static_cast<PUAC_AUDIO_PROPERTY>(params.Parameters.Property.Value);
+
+    deviceContext->AudioProperty.InputDriverBuffer = deviceContext->UsbLatency.InputDriverBuffer;
+    deviceContext->AudioProperty.OutputDriverBuffer = deviceContext->UsbLatency.OutputDriverBuffer;
+    // deviceContext->AudioProperty.CurrentSampleFormat = deviceContext->CurrentSampleFormat;
+
+    *audioProperty = deviceContext->AudioProperty;
+
+    TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - InputAsioChannels  %d", audioProperty->InputAsioChannels);
+    TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - OutputAsioChannels %d", audioProperty->OutputAsioChannels);
+    TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - IsAccessible    %!bool!", audioProperty->IsAccessible);
+    TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - PowerState      %d", WdfDeviceGetDevicePowerState(device));
+
+    outDataCb = minValueSize;
+
+    status = STATUS_SUCCESS;
+Exit:
+    WdfRequestCompleteWithInformation(request, status, outDataCb);
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit %!STATUS!", status);
+}
+
+PAGED_CODE_SEG
+_Use_decl_annotations_
+VOID EvtUSBAudioAcxDriverGetChannelInfo(
+    WDFOBJECT  object,
+    WDFREQUEST request
+)
+{
+    NTSTATUS               status = STATUS_NOT_SUPPORTED;
+    ACX_REQUEST_PARAMETERS params{};
+    ULONG_PTR              outDataCb = 0;
+    // ACXSTREAM              stream = static_cast<ACXSTREAM>(object);
+    // ASSERT(stream != nullptr);
+
+    WDFDEVICE device = AcxCircuitGetWdfDevice((ACXCIRCUIT)object);
+    ASSERT(device != nullptr);
+
+    PDEVICE_CONTEXT deviceContext = GetDeviceContext(device);
+    ASSERT(deviceContext != nullptr);
+
+    PAGED_CODE();
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Entry");
+
+    ACX_REQUEST_PARAMETERS_INIT(&params);
+    AcxRequestGetParameters(request, &params);
+
+    ASSERT(params.Type == AcxRequestTypeProperty);
+    ASSERT(params.Parameters.Property.Verb == AcxPropertyVerbGet);
+    ASSERT(params.Parameters.Property.Control == nullptr);
+    ASSERT(params.Parameters.Property.ControlCb == 0);
+
+    IF_TRUE_ACTION_JUMP(((params.Parameters.Property.Control != nullptr) ||
+                         (params.Parameters.Property.ControlCb != 0) ||
+                         ((params.Parameters.Property.ValueCb != 0) && (params.Parameters.Property.Value == nullptr))),
+                        ASSERT(FALSE);
+                        outDataCb = 0; status = STATUS_INVALID_PARAMETER;,
+                                                                         Exit);
+
+    ULONG numChannels = deviceContext->AudioProperty.InputAsioChannels + deviceContext->AudioProperty.OutputAsioChannels;
+    ULONG minValueSize = offsetof(UAC_GET_CHANNEL_INFO_CONTEXT, Channel) + (sizeof(UAC_CHANNEL_INFO) * numChannels);
+    if (params.Parameters.Property.ValueCb == 0)
+    {
+        outDataCb = minValueSize;
+        status = STATUS_BUFFER_OVERFLOW;
+    }
+    else if (params.Parameters.Property.ValueCb < minValueSize)
+    {
+        outDataCb = 0;
+        status = STATUS_BUFFER_TOO_SMALL;
+    }
+    else
+    {
+        PUAC_GET_CHANNEL_INFO_CONTEXT channelInfo = static_cast<PUAC_GET_CHANNEL_INFO_CONTEXT>(params.Parameters.Property.Value);
+        channelInfo->NumChannels = numChannels;
+        BOOL  input = deviceContext->UsbAudioConfiguration->HasInputIsochronousInterface() ? TRUE : FALSE;
+        ULONG asioCh = 0;
+        for (ULONG i = 0; i < numChannels; ++i)
+        {
+            RtlStringCchCopyW(channelInfo->Channel[i].Name, UAC_MAX_CHANNEL_NAME_LENGTH, input ? deviceContext->InputAsioChannelName[asioCh] : deviceContext->OutputAsioChannelName[asioCh]);
+            TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - channel info. channel name [%d] %ws", i, channelInfo->Channel[i].Name);
+            channelInfo->Channel[i].Index = asioCh;
+            channelInfo->Channel[i].IsInput = input;
+            channelInfo->Channel[i].IsActive = 0;     // not used
+            channelInfo->Channel[i].ChannelGroup = 0; // not used
+            ++asioCh;
+            if (input && asioCh >= deviceContext->AudioProperty.InputAsioChannels)
+            {
+                input = FALSE;
+                asioCh = 0;
+            }
+        }
+        outDataCb = minValueSize;
+        status = STATUS_SUCCESS;
+    }
+Exit:
+    WdfRequestCompleteWithInformation(request, status, outDataCb);
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit %!STATUS!", status);
+}
+
+PAGED_CODE_SEG
+_Use_decl_annotations_
+VOID EvtUSBAudioAcxDriverGetClockInfo(
+    WDFOBJECT  object,
+    WDFREQUEST request
+)
+{
+    NTSTATUS               status = STATUS_NOT_SUPPORTED;
+    ACX_REQUEST_PARAMETERS params{};
+    ULONG_PTR              outDataCb = 0;
+    // ACXSTREAM              stream = static_cast<ACXSTREAM>(object);
+    // ASSERT(stream != nullptr);
+
+    WDFDEVICE device = AcxCircuitGetWdfDevice((ACXCIRCUIT)object);
+    ASSERT(device != nullptr);
+
+    PDEVICE_CONTEXT deviceContext = GetDeviceContext(device);
+    ASSERT(deviceContext != nullptr);
+
+    PAGED_CODE();
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Entry");
+
+    ACX_REQUEST_PARAMETERS_INIT(&params);
+    AcxRequestGetParameters(request, &params);
+
+    ASSERT(params.Type == AcxRequestTypeProperty);
+    ASSERT(params.Parameters.Property.Verb == AcxPropertyVerbGet);
+    ASSERT(params.Parameters.Property.Control == nullptr);
+    ASSERT(params.Parameters.Property.ControlCb == 0);
+
+    IF_TRUE_ACTION_JUMP(((params.Parameters.Property.Control != nullptr) ||
+                         (params.Parameters.Property.ControlCb != 0) ||
+                         ((params.Parameters.Property.ValueCb != 0) && (params.Parameters.Property.Value == nullptr))),
+                        ASSERT(FALSE);
+                        outDataCb = 0; status = STATUS_INVALID_PARAMETER;,
+                                                                         Exit);
+
+    ULONG numClockSources = deviceContext->AcClockSources;
+    ULONG minValueSize = offsetof(UAC_GET_CLOCK_INFO_CONTEXT, ClockSource) + (sizeof(UAC_CLOCK_INFO) * numClockSources);
+
+    if (params.Parameters.Property.ValueCb == 0)
+    {
+        outDataCb = minValueSize;
+        status = STATUS_BUFFER_OVERFLOW;
+    }
+    else if (params.Parameters.Property.ValueCb < minValueSize)
+    {
+        outDataCb = 0;
+        status = STATUS_BUFFER_TOO_SMALL;
+    }
+    else
+    {
+        PUAC_GET_CLOCK_INFO_CONTEXT clockInfo = (PUAC_GET_CLOCK_INFO_CONTEXT)(params.Parameters.Property.Value);
+        clockInfo->NumClockSource = numClockSources;
+        for (ULONG i = 0; i < numClockSources; ++i)
+        {
+            clockInfo->ClockSource[i].Index = i;
+            clockInfo->ClockSource[i].AssociatedChannel = 0; // not used
+            clockInfo->ClockSource[i].AssociatedGroup = 0;   // not used
+            clockInfo->ClockSource[i].IsCurrentSource = (i == deviceContext->CurrentClockSource);
+            clockInfo->ClockSource[i].IsLocked = 0;          // not used
+            RtlStringCchCopyW(clockInfo->ClockSource[i].Name, UAC_MAX_CLOCK_SOURCE_NAME_LENGTH, deviceContext->ClockSourceName[i]);
+        }
+        outDataCb = minValueSize;
+        status = STATUS_SUCCESS;
+    }
+
+Exit:
+    WdfRequestCompleteWithInformation(request, status, outDataCb);
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit %!STATUS!", status);
+}
+
+PAGED_CODE_SEG
+_Use_decl_annotations_
+VOID EvtUSBAudioAcxDriverGetLatencyOffsetOfSampleRate(
+    WDFOBJECT /* object */,
+    WDFREQUEST request
+)
+{
+    NTSTATUS               status = STATUS_NOT_SUPPORTED;
+    ACX_REQUEST_PARAMETERS params{};
+    ULONG_PTR              outDataCb = 0;
+    // ACXSTREAM              stream = static_cast<ACXSTREAM>(object);
+    // ASSERT(stream != nullptr);
+
+    // WDFDEVICE device = AcxCircuitGetWdfDevice((ACXCIRCUIT)object);
+    // ASSERT(device != nullptr);
+
+    // PDEVICE_CONTEXT deviceContext = GetDeviceContext(device);
+    // ASSERT(deviceContext != nullptr);
+
+    PAGED_CODE();
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Entry");
+
+    ACX_REQUEST_PARAMETERS_INIT(&params);
+    AcxRequestGetParameters(request, &params);
+
+    ASSERT(params.Type == AcxRequestTypeProperty);
+    ASSERT(params.Parameters.Property.Verb == AcxPropertyVerbGet);
+    ASSERT(params.Parameters.Property.Control != nullptr);
+    ASSERT(params.Parameters.Property.ControlCb >= sizeof(UAC_SET_FLAGS_CONTEXT));
+
+    IF_TRUE_ACTION_JUMP(((params.Parameters.Property.Control == nullptr) ||
+                         (params.Parameters.Property.ControlCb < sizeof(UAC_SET_FLAGS_CONTEXT)) ||
+                         ((params.Parameters.Property.ValueCb != 0) && (params.Parameters.Property.Value == nullptr))),
+                        ASSERT(FALSE);
+                        outDataCb = 0; status = STATUS_INVALID_PARAMETER;,
+                                                                         Exit);
+
+#if false
+	// TBD
+    if ((deviceContext->LatencyOffsetList != nullptr) && (deviceContext->LatencyOffsetList->NumLatencyOffsetTable != 0))
     {
-        if (g_DriverSettingsTable[bufferSizeIndex].PeriodFrames == bufferPeriod)
+        ULONG minValueSize = sizeof(UAC_LATENCY_OFFSET_OF_SAMPLERATE_CONTEXT) * deviceContext->LatencyOffsetList->NumLatencyOffsetTable;
+        if (params.Parameters.Property.ValueCb == 0)
         {
-            break;
+            // 0 buffer length requests the buffer size needed.
+            outDataCb = minValueSize;
+            status    = STATUS_BUFFER_OVERFLOW;
+        }
+        else if (params.Parameters.Property.ValueCb < minValueSize)
+        {
+            outDataCb = 0;
+            status    = STATUS_BUFFER_TOO_SMALL;
         }
+        else
+        {
+            UAC_SET_FLAGS_CONTEXT flags = {0};
+            if (params.Parameters.Property.ControlCb >= sizeof(UAC_SET_FLAGS_CONTEXT))
+            {
+                PUAC_SET_FLAGS_CONTEXT flagsInput = (PUAC_SET_FLAGS_CONTEXT)params.Parameters.Property.Control;
+                if (IsValidFlags(flagsInput))
+                {
+                    flags = *flagsInput;
+                    ConvertFlags(&flags);
+                }
+            }
+            PUAC_LATENCY_OFFSET_OF_SAMPLERATE_CONTEXT latencyOffset = (PUAC_LATENCY_OFFSET_OF_SAMPLERATE_CONTEXT)params.Parameters.Property.Value;
+            const UAC_LATENCY_OFFSET_LIST *           list          = deviceContext->LatencyOffsetList;
+            for (int sampleRateIndex = 0; sampleRateIndex < list->NumLatencyOffsetTable; ++sampleRateIndex)
+            {
+                UAC_USB_LATENCY latency = {0};
+                CalculateUsbLatency(deviceContext, &flags, list->LatencyOffsetTable[sampleRateIndex].SampleRate, &latency);
+                latencyOffset[sampleRateIndex].SampleRate          = list->LatencyOffsetTable[sampleRateIndex].SampleRate;
+                latencyOffset[sampleRateIndex].InputLatencyOffset  = latency.InLatency;
+                latencyOffset[sampleRateIndex].OutputLatencyOffset = latency.OutputLatency;
+            }
+            outDataCb = minValueSize;
+            status    = STATUS_SUCCESS;
+        }
+        else
+        {
+            status = STATUS_INVALID_PARAMETER;
+        }
+    }
+    else
+#endif
+    {
+        status = STATUS_DEVICE_NOT_READY;
     }
 
-    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "ClassicFramesPerIrp  %u -> %u", deviceContext->Params.ClassicFramesPerIrp, g_DriverSettingsTable[bufferSizeIndex].Parameter.ClassicFramesPerIrp);
-    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "ClassicFramesPerIrp2 %u -> %u", deviceContext->Params.ClassicFramesPerIrp2, g_DriverSettingsTable[bufferSizeIndex].Parameter.ClassicFramesPerIrp2);
+Exit:
+    WdfRequestCompleteWithInformation(request, status, outDataCb);
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit %!STATUS!", status);
+}
 
-    deviceContext->Params.ClassicFramesPerIrp = g_DriverSettingsTable[bufferSizeIndex].Parameter.ClassicFramesPerIrp;
-    deviceContext->Params.ClassicFramesPerIrp2 = g_DriverSettingsTable[bufferSizeIndex].Parameter.ClassicFramesPerIrp2;
+PAGED_CODE_SEG
+_Use_decl_annotations_
+VOID EvtUSBAudioAcxDriverSetClockSource(
+    WDFOBJECT  object,
+    WDFREQUEST request
+)
+{
+    NTSTATUS               status = STATUS_NOT_SUPPORTED;
+    ACX_REQUEST_PARAMETERS params{};
+    ULONG_PTR              outDataCb = 0;
+    // ACXSTREAM              stream = static_cast<ACXSTREAM>(object);
+    // ASSERT(stream != nullptr);
 
-    return STATUS_SUCCESS;
+    WDFDEVICE device = AcxCircuitGetWdfDevice((ACXCIRCUIT)object);
+    ASSERT(device != nullptr);
+
+    PDEVICE_CONTEXT deviceContext = GetDeviceContext(device);
+    ASSERT(deviceContext != nullptr);
+
+    PAGED_CODE();
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Entry");
+
+    ACX_REQUEST_PARAMETERS_INIT(&params);
+    AcxRequestGetParameters(request, &params);
+
+    ASSERT(params.Type == AcxRequestTypeProperty);
+    ASSERT(params.Parameters.Property.Verb == AcxPropertyVerbSet);
+    ASSERT(params.Parameters.Property.Control == nullptr);
+    ASSERT(params.Parameters.Property.ControlCb == 0);
+    ASSERT(params.Parameters.Property.Value != nullptr);
+    ASSERT(params.Parameters.Property.ValueCb >= sizeof(UAC_SET_CLOCK_SOURCE_CONTEXT));
+
+    IF_TRUE_ACTION_JUMP(((params.Parameters.Property.Control != nullptr) ||
+                         (params.Parameters.Property.ControlCb != 0 ||
+                          (params.Parameters.Property.Value == nullptr) ||
+                          (params.Parameters.Property.ValueCb < sizeof(UAC_SET_CLOCK_SOURCE_CONTEXT)))),
+                        ASSERT(FALSE);
+                        outDataCb = 0; status = STATUS_INVALID_PARAMETER;,
+                                                                         Exit);
+
+    PUAC_SET_CLOCK_SOURCE_CONTEXT context = (PUAC_SET_CLOCK_SOURCE_CONTEXT)params.Parameters.Property.Value;
+    if (context->Index == deviceContext->CurrentClockSource)
+    {
+        status = STATUS_SUCCESS;
+    }
+    else if (deviceContext->AcClockSources > 1)
+    {
+        status = ControlRequestSetClockSelector(deviceContext, deviceContext->AudioControlInterfaceNumber, deviceContext->ClockSelectorId, deviceContext->AcClockSourceInfo[(USHORT)context->Index].ClockSelectorIndex);
+
+        WdfWaitLockAcquire(deviceContext->StreamWaitLock, nullptr);
+        if (deviceContext->ClockObservationThread != nullptr && NT_SUCCESS(status))
+        {
+            deviceContext->CurrentClockSource = context->Index;
+            ULONG newRate = deviceContext->AudioProperty.SampleRate;
+
+            TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_MULTICLIENT, " - start counter asio %ld, start counter acx audio %ld, start counter iso stream %ld", deviceContext->StartCounterAsio, deviceContext->StartCounterWdmAudio, deviceContext->StartCounterIsoStream);
+            if ((deviceContext->StartCounterAsio != 0) || (deviceContext->StartCounterWdmAudio != 0))
+            {
+                StopIsoStream(deviceContext);
+            }
+            deviceContext->ResetRequestOwner = deviceContext->AsioOwner;
+
+            ULONG desiredFormatType = NS_USBAudio0200::FORMAT_TYPE_I;
+            ULONG desiredFormat = NS_USBAudio0200::PCM;
+
+            USBAudioDataFormat::ConvertFormatToSampleFormat(deviceContext->AudioProperty.CurrentSampleFormat, desiredFormatType, desiredFormat);
+
+            status = ActivateAudioInterface(deviceContext, newRate, desiredFormatType, desiredFormat, deviceContext->InputProperty.BytesPerSample, deviceContext->InputProperty.ValidBitsPerSample, deviceContext->OutputProperty.BytesPerSample, deviceContext->OutputProperty.ValidBitsPerSample);
+            if ((deviceContext->StartCounterAsio != 0) || (deviceContext->StartCounterWdmAudio != 0))
+            {
+                StartIsoStream(deviceContext);
+            }
+            TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_MULTICLIENT, " - start counter asio %ld, start counter acx audio %ld, start counter iso stream %ld", deviceContext->StartCounterAsio, deviceContext->StartCounterWdmAudio, deviceContext->StartCounterIsoStream);
+        }
+        WdfWaitLockRelease(deviceContext->StreamWaitLock);
+    }
+    else
+    {
+    }
+Exit:
+    WdfRequestCompleteWithInformation(request, status, outDataCb);
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit %!STATUS!", status);
 }
 
 PAGED_CODE_SEG
-static _Use_decl_annotations_
-NTSTATUS UpdateBufferOperationOffset(
-    PDEVICE_CONTEXT deviceContext,
-    ULONG           bufferPeriod
+_Use_decl_annotations_
+VOID EvtUSBAudioAcxDriverSetSampleFormat(
+    WDFOBJECT  object,
+    WDFREQUEST request
 )
 {
+    NTSTATUS               status = STATUS_NOT_SUPPORTED;
+    ACX_REQUEST_PARAMETERS params{};
+    ULONG_PTR              outDataCb = 0;
+    // ACXSTREAM              stream = static_cast<ACXSTREAM>(object);
+    // ASSERT(stream != nullptr);
+
+    WDFDEVICE device = AcxCircuitGetWdfDevice((ACXCIRCUIT)object);
+    ASSERT(device != nullptr);
+
+    PDEVICE_CONTEXT deviceContext = GetDeviceContext(device);
+    ASSERT(deviceContext != nullptr);
+
     PAGED_CODE();
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Entry");
 
-    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC!");
+    ACX_REQUEST_PARAMETERS_INIT(&params);
+    AcxRequestGetParameters(request, &params);
+
+    ASSERT(params.Type == AcxRequestTypeProperty);
+    ASSERT(params.Parameters.Property.Verb == AcxPropertyVerbSet);
+    ASSERT(params.Parameters.Property.Control == nullptr);
+    ASSERT(params.Parameters.Property.ControlCb == 0);
+    ASSERT(params.Parameters.Property.Value != nullptr);
+    ASSERT(params.Parameters.Property.ValueCb >= sizeof(ULONG));
+
+    IF_TRUE_ACTION_JUMP(((params.Parameters.Property.Control != nullptr) ||
+                         (params.Parameters.Property.ControlCb != 0 ||
+                          (params.Parameters.Property.Value == nullptr) ||
+                          (params.Parameters.Property.ValueCb < sizeof(ULONG)))),
+                        ASSERT(FALSE);
+                        outDataCb = 0; status = STATUS_INVALID_PARAMETER;,
+                                                                         Exit);
 
-    if (deviceContext == nullptr)
+    UACSampleFormat sampleFormat = (UACSampleFormat)(*(PULONG)params.Parameters.Property.Value);
+    if ((deviceContext->AudioProperty.SupportedSampleFormats & (1 << toULong(sampleFormat))) == 0)
     {
-        return STATUS_INVALID_PARAMETER;
+        status = STATUS_INVALID_PARAMETER;
     }
+    else if (sampleFormat == deviceContext->AudioProperty.CurrentSampleFormat)
+    {
+        status = STATUS_SUCCESS;
+    }
+    else
+    {
+        ULONG formatType = 0;
+        ULONG format = 0;
 
-    int bufferSizeIndex = 0;
+        WdfWaitLockAcquire(deviceContext->StreamWaitLock, nullptr);
 
-    for (; bufferSizeIndex < (ARRAYSIZE(g_DriverSettingsTable) - 1); ++bufferSizeIndex)
-    {
-        if (g_DriverSettingsTable[bufferSizeIndex].PeriodFrames == bufferPeriod)
+        StopIsoStream(deviceContext);
+        deviceContext->DesiredSampleFormat = sampleFormat;
+        status = USBAudioDataFormat::ConvertFormatToSampleFormat(sampleFormat, formatType, format);
+        if (NT_SUCCESS(status))
         {
-            break;
+            status = ActivateAudioInterface(deviceContext, deviceContext->AudioProperty.SampleRate, formatType, format, deviceContext->InputProperty.BytesPerSample, deviceContext->InputProperty.ValidBitsPerSample, deviceContext->OutputProperty.BytesPerSample, deviceContext->OutputProperty.ValidBitsPerSample);
         }
+        WdfWaitLockRelease(deviceContext->StreamWaitLock);
+        status = STATUS_SUCCESS;
     }
 
-    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "OutputBufferOperationOffset  0x%08x -> 0x%08x", deviceContext->Params.OutputBufferOperationOffset, g_DriverSettingsTable[bufferSizeIndex].Parameter.OutputBufferOperationOffset);
-    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "InputBufferOperationOffset   0x%08x -> 0x%08x", deviceContext->Params.InputBufferOperationOffset, g_DriverSettingsTable[bufferSizeIndex].Parameter.InputBufferOperationOffset);
-
-    deviceContext->Params.OutputBufferOperationOffset = g_DriverSettingsTable[bufferSizeIndex].Parameter.OutputBufferOperationOffset;
-    deviceContext->Params.InputBufferOperationOffset = g_DriverSettingsTable[bufferSizeIndex].Parameter.InputBufferOperationOffset;
-
-    return STATUS_SUCCESS;
+Exit:
+    WdfRequestCompleteWithInformation(request, status, outDataCb);
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit %!STATUS!", status);
 }
 
 PAGED_CODE_SEG
 _Use_decl_annotations_
-VOID EvtUSBAudioAcxDriverGetAudioProperty(
+VOID EvtUSBAudioAcxDriverChangeSampleRate(
     WDFOBJECT  object,
     WDFREQUEST request
 )
@@ -4546,37 +5624,110 @@ VOID EvtUSBAudioAcxDriverGetAudioProperty(
     AcxRequestGetParameters(request, &params);
 
     ASSERT(params.Type == AcxRequestTypeProperty);
-    ASSERT(params.Parameters.Property.Verb == AcxPropertyVerbGet);
+    ASSERT(params.Parameters.Property.Verb == AcxPropertyVerbSet);
     ASSERT(params.Parameters.Property.Control == nullptr);
     ASSERT(params.Parameters.Property.ControlCb == 0);
     ASSERT(params.Parameters.Property.Value != nullptr);
-    ASSERT(params.Parameters.Property.ValueCb == sizeof(UAC_AUDIO_PROPERTY));
+    ASSERT(params.Parameters.Property.ValueCb >= sizeof(ULONG));
 
     IF_TRUE_ACTION_JUMP(((params.Parameters.Property.Control != nullptr) ||
-                         (params.Parameters.Property.ControlCb != 0) ||
-                         (params.Parameters.Property.Value == nullptr) ||
-                         (params.Parameters.Property.ValueCb < sizeof(UAC_AUDIO_PROPERTY))),
+                         (params.Parameters.Property.ControlCb != 0 ||
+                          (params.Parameters.Property.Value == nullptr) ||
+                          (params.Parameters.Property.ValueCb < sizeof(ULONG)))),
                         ASSERT(FALSE);
                         outDataCb = 0; status = STATUS_INVALID_PARAMETER;,
                                                                          Exit);
 
-    ULONG               minValueSize = sizeof(UAC_AUDIO_PROPERTY);
-    PUAC_AUDIO_PROPERTY audioProperty = static_cast<PUAC_AUDIO_PROPERTY>(params.Parameters.Property.Value);
+    ULONG    desiredRate = *((ULONG *)params.Parameters.Property.Value);
+    bool     streamRunning = false;
+    LONGLONG requestQpc = KeQueryPerformanceCounter(nullptr).QuadPart;
+    LONGLONG streamStoppedQpc = 0;
+    WdfWaitLockAcquire(deviceContext->StreamWaitLock, nullptr);
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_MULTICLIENT, " - start counter asio %ld, start counter acx audio %ld, start counter iso stream %ld", deviceContext->StartCounterAsio, deviceContext->StartCounterWdmAudio, deviceContext->StartCounterIsoStream);
 
-    deviceContext->AudioProperty.InputDriverBuffer = deviceContext->UsbLatency.InputDriverBuffer;
-    deviceContext->AudioProperty.OutputDriverBuffer = deviceContext->UsbLatency.OutputDriverBuffer;
-    // deviceContext->AudioProperty.CurrentSampleFormat = deviceContext->CurrentSampleFormat;
+    ACXDATAFORMAT inputDataFormatBeforeChange = nullptr;
+    ACXDATAFORMAT outputDataFormatBeforeChange = nullptr;
+    ACXDATAFORMAT inputDataFormatAfterChange = nullptr;
+    ACXDATAFORMAT outputDataFormatAfterChange = nullptr;
 
-    *audioProperty = deviceContext->AudioProperty;
+    // The current data formats are taken while the stream keeps running, so that the stream only stops for the requests to the device.
+    if (deviceContext->UsbAudioConfiguration->HasInputIsochronousInterface())
+    {
+        status = USBAudioAcxDriverGetCurrentDataFormat(deviceContext, true, inputDataFormatBeforeChange);
+        IF_FAILED_JUMP(status, Exit_BeforeWaitLockRelease);
+    }
+    if (deviceContext->UsbAudioConfiguration->HasOutputIsochronousInterface())
+    {
+        status = USBAudioAcxDriverGetCurrentDataFormat(deviceContext, false, outputDataFormatBeforeChange);
+        IF_FAILED_JUMP(status, Exit_BeforeWaitLockRelease);
+    }
 
-    TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - InputAsioChannels  %d", audioProperty->InputAsioChannels);
-    TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - OutputAsioChannels %d", audioProperty->OutputAsioChannels);
-    TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - IsAccessible    %!bool!", audioProperty->IsAccessible);
-    TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - PowerState      %d", WdfDeviceGetDevicePowerState(device));
+    if (deviceContext->StreamObject != nullptr)
+    {
+        WdfWaitLockAcquire(deviceContext->AsioWaitLock, nullptr);
+        if (deviceContext->AsioBufferObject == nullptr)
+        {
+            streamRunning = true;
+        }
+        WdfWaitLockRelease(deviceContext->AsioWaitLock);
+        if ((deviceContext->StartCounterAsio != 0) || (deviceContext->StartCounterWdmAudio != 0))
+        {
+            StopIsoStream(deviceContext);
+            streamStoppedQpc = KeQueryPerformanceCounter(nullptr).QuadPart;
+        }
+    }
 
-    outDataCb = minValueSize;
+    // The previous stream is stopped, so nothing else writes the phases any more.
+    RtlZeroMemory(&deviceContext->SampleRateSwitch, sizeof(UAC_SAMPLE_RATE_SWITCH_CONTEXT));
+    deviceContext->SampleRateSwitch.PreviousSampleRate = deviceContext->AudioProperty.SampleRate;
+    deviceContext->SampleRateSwitch.SampleRate = desiredRate;
+    deviceContext->SampleRateSwitch.PerformanceFrequency = deviceContext->PerformanceCounterFrequency.QuadPart;
+    deviceContext->SampleRateSwitch.RequestQpc = requestQpc;
+    deviceContext->SampleRateSwitch.StreamStoppedQpc = streamStoppedQpc;
+    deviceContext->IsSampleRateSwitching = true;
+
+    if (NT_SUCCESS(status))
+    {
+        ULONG desiredFormatType = NS_USBAudio0200::FORMAT_TYPE_I;
+        ULONG desiredFormat = NS_USBAudio0200::PCM;
 
+        USBAudioDataFormat::ConvertFormatToSampleFormat(deviceContext->AudioProperty.CurrentSampleFormat, desiredFormatType, desiredFormat);
+
+        status = ActivateAudioInterface(deviceContext, desiredRate, desiredFormatType, desiredFormat, deviceContext->InputProperty.BytesPerSample, deviceContext->InputProperty.ValidBitsPerSample, deviceContext->OutputProperty.BytesPerSample, deviceContext->OutputProperty.ValidBitsPerSample);
+        if (streamRunning && NT_SUCCESS(status))
+        {
+            if ((deviceContext->StartCounterAsio != 0) || (deviceContext->StartCounterWdmAudio != 0))
+            {
+                StartIsoStream(deviceContext);
+            }
+        }
+        TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_MULTICLIENT, " - start counter asio %ld, start counter acx audio %ld, start counter iso stream %ld", deviceContext->StartCounterAsio, deviceContext->StartCounterWdmAudio, deviceContext->StartCounterIsoStream);
+    }
+
+    IF_FAILED_JUMP(status, Exit_BeforeWaitLockRelease);
+
+    if (deviceContext->UsbAudioConfiguration->HasOutputIsochronousInterface() && (outputDataFormatBeforeChange != nullptr))
+    {
+        status = USBAudioAcxDriverGetCurrentDataFormat(deviceContext, false, outputDataFormatAfterChange);
+        IF_FAILED_JUMP(status, Exit_BeforeWaitLockRelease);
+
+        status = NotifyAllPinsDataFormatChange(false, deviceContext, outputDataFormatBeforeChange, outputDataFormatAfterChange);
+        IF_FAILED_JUMP(status, Exit_BeforeWaitLockRelease);
+    }
+    if (deviceContext->UsbAudioConfiguration->HasInputIsochronousInterface() && (inputDataFormatBeforeChange != nullptr))
+    {
+        status = USBAudioAcxDriverGetCurrentDataFormat(deviceContext, true, inputDataFormatAfterChange);
+        IF_FAILED_JUMP(status, Exit_BeforeWaitLockRelease);
+
+        status = NotifyAllPinsDataFormatChange(true, deviceContext, inputDataFormatBeforeChange, inputDataFormatAfterChange);
+        IF_FAILED_JUMP(status, Exit_BeforeWaitLockRelease);
+    }
     status = STATUS_SUCCESS;
+
+Exit_BeforeWaitLockRelease:
+    deviceContext->IsSampleRateSwitching = false;
+    WdfWaitLockRelease(deviceContext->StreamWaitLock);
+
 Exit:
     WdfRequestCompleteWithInformation(request, status, outDataCb);
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit %!STATUS!", status);
@@ -4584,14 +5735,26 @@ Exit:
 
 PAGED_CODE_SEG
 _Use_decl_annotations_
-VOID EvtUSBAudioAcxDriverGetChannelInfo(
+VOID EvtUSBAudioAcxDriverGetAsioOwnership(
     WDFOBJECT  object,
     WDFREQUEST request
 )
+/*++
+
+Routine Description:
+
+    This routine acquires ASIO ownership.
+
+Return Value:
+
+    VOID
+
+--*/
 {
     NTSTATUS               status = STATUS_NOT_SUPPORTED;
     ACX_REQUEST_PARAMETERS params{};
     ULONG_PTR              outDataCb = 0;
+    LARGE_INTEGER          systemTime = {0};
     // ACXSTREAM              stream = static_cast<ACXSTREAM>(object);
     // ASSERT(stream != nullptr);
 
@@ -4608,52 +5771,121 @@ VOID EvtUSBAudioAcxDriverGetChannelInfo(
     AcxRequestGetParameters(request, &params);
 
     ASSERT(params.Type == AcxRequestTypeProperty);
-    ASSERT(params.Parameters.Property.Verb == AcxPropertyVerbGet);
+    ASSERT(params.Parameters.Property.Verb == AcxPropertyVerbSet);
     ASSERT(params.Parameters.Property.Control == nullptr);
     ASSERT(params.Parameters.Property.ControlCb == 0);
+    ASSERT(params.Parameters.Property.Value == nullptr);
+    ASSERT(params.Parameters.Property.ValueCb == 0);
 
     IF_TRUE_ACTION_JUMP(((params.Parameters.Property.Control != nullptr) ||
                          (params.Parameters.Property.ControlCb != 0) ||
-                         ((params.Parameters.Property.ValueCb != 0) && (params.Parameters.Property.Value == nullptr))),
+                         (params.Parameters.Property.Value != nullptr) ||
+                         (params.Parameters.Property.ValueCb != 0)),
                         ASSERT(FALSE);
                         outDataCb = 0; status = STATUS_INVALID_PARAMETER;,
                                                                          Exit);
 
-    ULONG numChannels = deviceContext->AudioProperty.InputAsioChannels + deviceContext->AudioProperty.OutputAsioChannels;
-    ULONG minValueSize = offsetof(UAC_GET_CHANNEL_INFO_CONTEXT, Channel) + (sizeof(UAC_CHANNEL_INFO) * numChannels);
-    if (params.Parameters.Property.ValueCb == 0)
-    {
-        outDataCb = minValueSize;
-        status = STATUS_BUFFER_OVERFLOW;
-    }
-    else if (params.Parameters.Property.ValueCb < minValueSize)
+    KeQuerySystemTime(&systemTime);
+    if (deviceContext->AsioOwner != nullptr || systemTime.QuadPart < deviceContext->ResetEnableTime.QuadPart)
     {
-        outDataCb = 0;
-        status = STATUS_BUFFER_TOO_SMALL;
+        status = STATUS_ACCESS_DENIED;
     }
     else
     {
-        PUAC_GET_CHANNEL_INFO_CONTEXT channelInfo = static_cast<PUAC_GET_CHANNEL_INFO_CONTEXT>(params.Parameters.Property.Value);
-        channelInfo->NumChannels = numChannels;
-        BOOL  input = deviceContext->UsbAudioConfiguration->HasInputIsochronousInterface() ? TRUE : FALSE;
-        ULONG asioCh = 0;
-        for (ULONG i = 0; i < numChannels; ++i)
+        ULONG         inputBytesPerSample = 0;
+        ULONG         inputValidBitsPerSample = 0;
+        ULONG         outputBytesPerSample = 0;
+        ULONG         outputValidBitsPerSample = 0;
+        ULONG         desiredFormatType = NS_USBAudio0200::FORMAT_TYPE_I;
+        ULONG         desiredFormat = NS_USBAudio0200::PCM;
+        ACXDATAFORMAT inputDataFormatBeforeChange = nullptr;
+        ACXDATAFORMAT outputDataFormatBeforeChange = nullptr;
+        ACXDATAFORMAT inputDataFormatAfterChange = nullptr;
+        ACXDATAFORMAT outputDataFormatAfterChange = nullptr;
+
+        WdfWaitLockAcquire(deviceContext->StreamWaitLock, nullptr);
+
+        if (deviceContext->UsbAudioConfiguration->HasInputIsochronousInterface())
         {
-            RtlStringCchCopyW(channelInfo->Channel[i].Name, UAC_MAX_CHANNEL_NAME_LENGTH, input ? deviceContext->InputAsioChannelName[asioCh] : deviceContext->OutputAsioChannelName[asioCh]);
-            TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - channel info. channel name [%d] %ws", i, channelInfo->Channel[i].Name);
-            channelInfo->Channel[i].Index = asioCh;
-            channelInfo->Channel[i].IsInput = input;
-            channelInfo->Channel[i].IsActive = 0;     // not used
-            channelInfo->Channel[i].ChannelGroup = 0; // not used
-            ++asioCh;
-            if (input && asioCh >= deviceContext->AudioProperty.InputAsioChannels)
+            status = USBAudioAcxDriverGetCurrentDataFormat(deviceContext, true, inputDataFormatBeforeChange);
+            IF_FAILED_JUMP(status, Exit_BeforeWaitLockRelease);
+        }
+        if (deviceContext->UsbAudioConfiguration->HasOutputIsochronousInterface())
+        {
+            status = USBAudioAcxDriverGetCurrentDataFormat(deviceContext, false, outputDataFormatBeforeChange);
+            IF_FAILED_JUMP(status, Exit_BeforeWaitLockRelease);
+        }
+        status = USBAudioDataFormat::ConvertFormatToSampleFormat(deviceContext->AudioProperty.CurrentSampleFormat, desiredFormatType, desiredFormat);
+        IF_FAILED_JUMP(status, Exit_BeforeWaitLockRelease);
+
+        if (!deviceContext->UsbAudioConfiguration->IsEnableASIO())
+        {
+            status = STATUS_INVALID_DEVICE_REQUEST;
+            IF_FAILED_JUMP(status, Exit_BeforeWaitLockRelease);
+        }
+
+        if (deviceContext->AudioProperty.SupportedSampleFormats & (1 << toULong(UACSampleFormat::UAC_SAMPLE_FORMAT_IEEE_FLOAT)))
+        {
+            deviceContext->SampleFormatBackup = deviceContext->AudioProperty.CurrentSampleFormat;
+            desiredFormatType = NS_USBAudio0200::FORMAT_TYPE_I;
+            desiredFormat = NS_USBAudio0200::IEEE_FLOAT;
+        }
+        else if (deviceContext->AudioProperty.SupportedSampleFormats & (1 << toULong(UACSampleFormat::UAC_SAMPLE_FORMAT_PCM)))
+        {
+            deviceContext->SampleFormatBackup = deviceContext->AudioProperty.CurrentSampleFormat;
+            desiredFormatType = NS_USBAudio0200::FORMAT_TYPE_I;
+            desiredFormat = NS_USBAudio0200::PCM;
+        }
+
+        if (deviceContext->UsbAudioConfiguration->HasInputIsochronousInterface())
+        {
+            status = deviceContext->UsbAudioConfiguration->GetMaxSupportedValidBitsPerSample(true, desiredFormatType, desiredFormat, inputBytesPerSample, inputValidBitsPerSample);
+            IF_FAILED_JUMP(status, Exit_BeforeWaitLockRelease);
+        }
+        if (deviceContext->UsbAudioConfiguration->HasOutputIsochronousInterface())
+        {
+            status = deviceContext->UsbAudioConfiguration->GetMaxSupportedValidBitsPerSample(false, desiredFormatType, desiredFormat, outputBytesPerSample, outputValidBitsPerSample);
+            IF_FAILED_JUMP(status, Exit_BeforeWaitLockRelease);
+        }
+        //
+        // When using ASIO, the maximum bit depth is used independently for input and output.
+        //
+        status = ActivateAudioInterface(deviceContext, deviceContext->AudioProperty.SampleRate, desiredFormatType, desiredFormat, inputBytesPerSample, inputValidBitsPerSample, outputBytesPerSample, outputValidBitsPerSample);
+
+        WDFFILEOBJECT fileObject = WdfRequestGetFileObject(request);
+        if (fileObject != nullptr)
+        {
+            deviceContext->AsioOwner = fileObject;
+
+            PFILE_CONTEXT fileContext = GetFileContext(fileObject);
+            if (fileContext != nullptr)
             {
-                input = FALSE;
-                asioCh = 0;
+                fileContext->DeviceContext = deviceContext;
             }
+            status = STATUS_SUCCESS;
+        }
+        else
+        {
+            status = STATUS_INVALID_DEVICE_REQUEST;
+        }
+        if (deviceContext->UsbAudioConfiguration->HasOutputIsochronousInterface() && (outputDataFormatBeforeChange != nullptr))
+        {
+            status = USBAudioAcxDriverGetCurrentDataFormat(deviceContext, false, outputDataFormatAfterChange);
+            IF_FAILED_JUMP(status, Exit_BeforeWaitLockRelease);
+
+            status = NotifyAllPinsDataFormatChange(false, deviceContext, outputDataFormatBeforeChange, outputDataFormatAfterChange);
+            IF_FAILED_JUMP(status, Exit_BeforeWaitLockRelease);
         }
-        outDataCb = minValueSize;
-        status = STATUS_SUCCESS;
+        if (deviceContext->UsbAudioConfiguration->HasInputIsochronousInterface() && (inputDataFormatBeforeChange != nullptr))
+        {
+            status = USBAudioAcxDriverGetCurrentDataFormat(deviceContext, true, inputDataFormatAfterChange);
+            IF_FAILED_JUMP(status, Exit_BeforeWaitLockRelease);
+
+            status = NotifyAllPinsDataFormatChange(true, deviceContext, inputDataFormatBeforeChange, inputDataFormatAfterChange);
+            IF_FAILED_JUMP(status, Exit_BeforeWaitLockRelease);
+        }
+    Exit_BeforeWaitLockRelease:
+        WdfWaitLockRelease(deviceContext->StreamWaitLock);
     }
 Exit:
     WdfRequestCompleteWithInformation(request, status, outDataCb);
@@ -4662,7 +5894,7 @@ Exit:
 
 PAGED_CODE_SEG
 _Use_decl_annotations_
-VOID EvtUSBAudioAcxDriverGetClockInfo(
+VOID EvtUSBAudioAcxDriverStartAsioStream(
     WDFOBJECT  object,
     WDFREQUEST request
 )
@@ -4686,142 +5918,53 @@ VOID EvtUSBAudioAcxDriverGetClockInfo(
     AcxRequestGetParameters(request, &params);
 
     ASSERT(params.Type == AcxRequestTypeProperty);
-    ASSERT(params.Parameters.Property.Verb == AcxPropertyVerbGet);
+    ASSERT(params.Parameters.Property.Verb == AcxPropertyVerbSet);
     ASSERT(params.Parameters.Property.Control == nullptr);
-    ASSERT(params.Parameters.Property.ControlCb == 0);
+    ASSERT(params.Parameters.Property.ControlCb = 0);
+    ASSERT(params.Parameters.Property.Value == nullptr);
+    ASSERT(params.Parameters.Property.ValueCb == 0);
 
     IF_TRUE_ACTION_JUMP(((params.Parameters.Property.Control != nullptr) ||
                          (params.Parameters.Property.ControlCb != 0) ||
-                         ((params.Parameters.Property.ValueCb != 0) && (params.Parameters.Property.Value == nullptr))),
-                        ASSERT(FALSE);
-                        outDataCb = 0; status = STATUS_INVALID_PARAMETER;,
-                                                                         Exit);
-
-    ULONG numClockSources = deviceContext->AcClockSources;
-    ULONG minValueSize = offsetof(UAC_GET_CLOCK_INFO_CONTEXT, ClockSource) + (sizeof(UAC_CLOCK_INFO) * numClockSources);
-
-    if (params.Parameters.Property.ValueCb == 0)
-    {
-        outDataCb = minValueSize;
-        status = STATUS_BUFFER_OVERFLOW;
-    }
-    else if (params.Parameters.Property.ValueCb < minValueSize)
-    {
-        outDataCb = 0;
-        status = STATUS_BUFFER_TOO_SMALL;
-    }
-    else
-    {
-        PUAC_GET_CLOCK_INFO_CONTEXT clockInfo = (PUAC_GET_CLOCK_INFO_CONTEXT)(params.Parameters.Property.Value);
-        clockInfo->NumClockSource = numClockSources;
-        for (ULONG i = 0; i < numClockSources; ++i)
-        {
-            clockInfo->ClockSource[i].Index = i;
-            clockInfo->ClockSource[i].AssociatedChannel = 0; // not used
-            clockInfo->ClockSource[i].AssociatedGroup = 0;   // not used
-            clockInfo->ClockSource[i].IsCurrentSource = (i == deviceContext->CurrentClockSource);
-            clockInfo->ClockSource[i].IsLocked = 0;          // not used
-            RtlStringCchCopyW(clockInfo->ClockSource[i].Name, UAC_MAX_CLOCK_SOURCE_NAME_LENGTH, deviceContext->ClockSourceName[i]);
-        }
-        outDataCb = minValueSize;
-        status = STATUS_SUCCESS;
-    }
-
-Exit:
-    WdfRequestCompleteWithInformation(request, status, outDataCb);
-
-    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit %!STATUS!", status);
-}
-
-PAGED_CODE_SEG
-_Use_decl_annotations_
-VOID EvtUSBAudioAcxDriverGetLatencyOffsetOfSampleRate(
-    WDFOBJECT /* object */,
-    WDFREQUEST request
-)
-{
-    NTSTATUS               status = STATUS_NOT_SUPPORTED;
-    ACX_REQUEST_PARAMETERS params{};
-    ULONG_PTR              outDataCb = 0;
-    // ACXSTREAM              stream = static_cast<ACXSTREAM>(object);
-    // ASSERT(stream != nullptr);
-
-    // WDFDEVICE device = AcxCircuitGetWdfDevice((ACXCIRCUIT)object);
-    // ASSERT(device != nullptr);
-
-    // PDEVICE_CONTEXT deviceContext = GetDeviceContext(device);
-    // ASSERT(deviceContext != nullptr);
-
-    PAGED_CODE();
-    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Entry");
-
-    ACX_REQUEST_PARAMETERS_INIT(&params);
-    AcxRequestGetParameters(request, &params);
-
-    ASSERT(params.Type == AcxRequestTypeProperty);
-    ASSERT(params.Parameters.Property.Verb == AcxPropertyVerbGet);
-    ASSERT(params.Parameters.Property.Control != nullptr);
-    ASSERT(params.Parameters.Property.ControlCb >= sizeof(UAC_SET_FLAGS_CONTEXT));
-
-    IF_TRUE_ACTION_JUMP(((params.Parameters.Property.Control == nullptr) ||
-                         (params.Parameters.Property.ControlCb < sizeof(UAC_SET_FLAGS_CONTEXT)) ||
-                         ((params.Parameters.Property.ValueCb != 0) && (params.Parameters.Property.Value == nullptr))),
+                         (params.Parameters.Property.Value != nullptr) ||
+                         (params.Parameters.Property.ValueCb != 0)),
                         ASSERT(FALSE);
                         outDataCb = 0; status = STATUS_INVALID_PARAMETER;,
                                                                          Exit);
 
-#if false
-	// TBD
-    if ((deviceContext->LatencyOffsetList != nullptr) && (deviceContext->LatencyOffsetList->NumLatencyOffsetTable != 0))
+    WdfWaitLockAcquire(deviceContext->StreamWaitLock, nullptr);
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_MULTICLIENT, " - start counter asio %ld, start counter acx audio %ld, start counter iso stream %ld", deviceContext->StartCounterAsio, deviceContext->StartCounterWdmAudio, deviceContext->StartCounterIsoStream);
+    if (deviceContext->StartCounterAsio == 0)
     {
-        ULONG minValueSize = sizeof(UAC_LATENCY_OFFSET_OF_SAMPLERATE_CONTEXT) * deviceContext->LatencyOffsetList->NumLatencyOffsetTable;
-        if (params.Parameters.Property.ValueCb == 0)
-        {
-            // 0 buffer length requests the buffer size needed.
-            outDataCb = minValueSize;
-            status    = STATUS_BUFFER_OVERFLOW;
-        }
-        else if (params.Parameters.Property.ValueCb < minValueSize)
+        if (deviceContext->StartCounterWdmAudio == 0)
         {
-            outDataCb = 0;
-            status    = STATUS_BUFFER_TOO_SMALL;
+            status = StartIsoStream(deviceContext);
         }
         else
         {
-            UAC_SET_FLAGS_CONTEXT flags = {0};
-            if (params.Parameters.Property.ControlCb >= sizeof(UAC_SET_FLAGS_CONTEXT))
+            WdfWaitLockAcquire(deviceContext->AsioWaitLock, nullptr);
+            if (deviceContext->AsioBufferObject != nullptr)
             {
-                PUAC_SET_FLAGS_CONTEXT flagsInput = (PUAC_SET_FLAGS_CONTEXT)params.Parameters.Property.Control;
-                if (IsValidFlags(flagsInput))
-                {
-                    flags = *flagsInput;
-                    ConvertFlags(&flags);
-                }
+                deviceContext->AsioBufferObject->SetReady();
+                status = STATUS_SUCCESS;
             }
-            PUAC_LATENCY_OFFSET_OF_SAMPLERATE_CONTEXT latencyOffset = (PUAC_LATENCY_OFFSET_OF_SAMPLERATE_CONTEXT)params.Parameters.Property.Value;
-            const UAC_LATENCY_OFFSET_LIST *           list          = deviceContext->LatencyOffsetList;
-            for (int sampleRateIndex = 0; sampleRateIndex < list->NumLatencyOffsetTable; ++sampleRateIndex)
+            else
             {
-                UAC_USB_LATENCY latency = {0};
-                CalculateUsbLatency(deviceContext, &flags, list->LatencyOffsetTable[sampleRateIndex].SampleRate, &latency);
-                latencyOffset[sampleRateIndex].SampleRate          = list->LatencyOffsetTable[sampleRateIndex].SampleRate;
-                latencyOffset[sampleRateIndex].InputLatencyOffset  = latency.InLatency;
-                latencyOffset[sampleRateIndex].OutputLatencyOffset = latency.OutputLatency;
+                status = STATUS_UNSUCCESSFUL;
             }
-            outDataCb = minValueSize;
-            status    = STATUS_SUCCESS;
+            WdfWaitLockRelease(deviceContext->AsioWaitLock);
         }
-        else
+        if (NT_SUCCESS(status))
         {
-            status = STATUS_INVALID_PARAMETER;
+            InterlockedIncrement(&deviceContext->StartCounterAsio);
+            TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_MULTICLIENT, " - start counter asio %ld, start counter acx audio %ld, start counter iso stream %ld", deviceContext->StartCounterAsio, deviceContext->StartCounterWdmAudio, deviceContext->StartCounterIsoStream);
         }
     }
     else
-#endif
     {
-        status = STATUS_DEVICE_NOT_READY;
+        status = STATUS_SUCCESS;
     }
-
+    WdfWaitLockRelease(deviceContext->StreamWaitLock);
 Exit:
     WdfRequestCompleteWithInformation(request, status, outDataCb);
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit %!STATUS!", status);
@@ -4829,7 +5972,7 @@ Exit:
 
 PAGED_CODE_SEG
 _Use_decl_annotations_
-VOID EvtUSBAudioAcxDriverSetClockSource(
+VOID EvtUSBAudioAcxDriverStopAsioStream(
     WDFOBJECT  object,
     WDFREQUEST request
 )
@@ -4856,56 +5999,40 @@ VOID EvtUSBAudioAcxDriverSetClockSource(
     ASSERT(params.Parameters.Property.Verb == AcxPropertyVerbSet);
     ASSERT(params.Parameters.Property.Control == nullptr);
     ASSERT(params.Parameters.Property.ControlCb == 0);
-    ASSERT(params.Parameters.Property.Value != nullptr);
-    ASSERT(params.Parameters.Property.ValueCb >= sizeof(UAC_SET_CLOCK_SOURCE_CONTEXT));
+    ASSERT(params.Parameters.Property.Value == nullptr);
+    ASSERT(params.Parameters.Property.ValueCb == 0);
 
     IF_TRUE_ACTION_JUMP(((params.Parameters.Property.Control != nullptr) ||
-                         (params.Parameters.Property.ControlCb != 0 ||
-                          (params.Parameters.Property.Value == nullptr) ||
-                          (params.Parameters.Property.ValueCb < sizeof(UAC_SET_CLOCK_SOURCE_CONTEXT)))),
+                         (params.Parameters.Property.ControlCb != 0) ||
+                         (params.Parameters.Property.Value != nullptr) ||
+                         (params.Parameters.Property.ValueCb != 0)),
                         ASSERT(FALSE);
                         outDataCb = 0; status = STATUS_INVALID_PARAMETER;,
                                                                          Exit);
 
-    PUAC_SET_CLOCK_SOURCE_CONTEXT context = (PUAC_SET_CLOCK_SOURCE_CONTEXT)params.Parameters.Property.Value;
-    if (context->Index == deviceContext->CurrentClockSource)
-    {
-        status = STATUS_SUCCESS;
-    }
-    else if (deviceContext->AcClockSources > 1)
-    {
-        status = ControlRequestSetClockSelector(deviceContext, deviceContext->AudioControlInterfaceNumber, deviceContext->ClockSelectorId, deviceContext->AcClockSourceInfo[(USHORT)context->Index].ClockSelectorIndex);
+    WdfWaitLockAcquire(deviceContext->StreamWaitLock, nullptr);
 
-        WdfWaitLockAcquire(deviceContext->StreamWaitLock, nullptr);
-        if (deviceContext->ClockObservationThread != nullptr && NT_SUCCESS(status))
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_MULTICLIENT, " - start counter asio %ld, start counter acx audio %ld, start counter iso stream %ld", deviceContext->StartCounterAsio, deviceContext->StartCounterWdmAudio, deviceContext->StartCounterIsoStream);
+    if (deviceContext->StartCounterAsio)
+    {
+        InterlockedDecrement(&deviceContext->StartCounterAsio);
+        if ((deviceContext->StartCounterAsio == 0) && (deviceContext->StartCounterWdmAudio == 0))
         {
-            deviceContext->CurrentClockSource = context->Index;
-            ULONG newRate = deviceContext->AudioProperty.SampleRate;
-
-            TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_MULTICLIENT, " - start counter asio %ld, start counter acx audio %ld, start counter iso stream %ld", deviceContext->StartCounterAsio, deviceContext->StartCounterWdmAudio, deviceContext->StartCounterIsoStream);
-            if ((deviceContext->StartCounterAsio != 0) || (deviceContext->StartCounterWdmAudio != 0))
-            {
-                StopIsoStream(deviceContext);
-            }
-            deviceContext->ResetRequestOwner = deviceContext->AsioOwner;
-
-            ULONG desiredFormatType = NS_USBAudio0200::FORMAT_TYPE_I;
-            ULONG desiredFormat = NS_USBAudio0200::PCM;
-
-            USBAudioDataFormat::ConvertFormatToSampleFormat(deviceContext->AudioProperty.CurrentSampleFormat, desiredFormatType, desiredFormat);
-
-            status = ActivateAudioInterface(deviceContext, newRate, desiredFormatType, desiredFormat, deviceContext->InputProperty.BytesPerSample, deviceContext->InputProperty.ValidBitsPerSample, deviceContext->OutputProperty.BytesPerSample, deviceContext->OutputProperty.ValidBitsPerSample);
-            if ((deviceContext->StartCounterAsio != 0) || (deviceContext->StartCounterWdmAudio != 0))
-            {
-                StartIsoStream(deviceContext);
-            }
-            TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_MULTICLIENT, " - start counter asio %ld, start counter acx audio %ld, start counter iso stream %ld", deviceContext->StartCounterAsio, deviceContext->StartCounterWdmAudio, deviceContext->StartCounterIsoStream);
+            status = StopIsoStream(deviceContext);
         }
-        WdfWaitLockRelease(deviceContext->StreamWaitLock);
+        else
+        {
+            status = STATUS_SUCCESS;
+        }
+        TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_MULTICLIENT, " - start counter asio %ld, start counter acx audio %ld, start counter iso stream %ld", deviceContext->StartCounterAsio, deviceContext->StartCounterWdmAudio, deviceContext->StartCounterIsoStream);
     }
     else
     {
+        status = STATUS_SUCCESS;
     }
+
+    WdfWaitLockRelease(deviceContext->StreamWaitLock);
+
 Exit:
     WdfRequestCompleteWithInformation(request, status, outDataCb);
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit %!STATUS!", status);
@@ -4913,7 +6040,7 @@ Exit:
 
 PAGED_CODE_SEG
 _Use_decl_annotations_
-VOID EvtUSBAudioAcxDriverSetSampleFormat(
+VOID EvtUSBAudioAcxDriverSetAsioBuffer(
     WDFOBJECT  object,
     WDFREQUEST request
 )
@@ -4921,6 +6048,7 @@ VOID EvtUSBAudioAcxDriverSetSampleFormat(
     NTSTATUS               status = STATUS_NOT_SUPPORTED;
     ACX_REQUEST_PARAMETERS params{};
     ULONG_PTR              outDataCb = 0;
+    AsioBufferObject *     asioBufferObject = nullptr;
     // ACXSTREAM              stream = static_cast<ACXSTREAM>(object);
     // ASSERT(stream != nullptr);
 
@@ -4938,54 +6066,71 @@ VOID EvtUSBAudioAcxDriverSetSampleFormat(
 
     ASSERT(params.Type == AcxRequestTypeProperty);
     ASSERT(params.Parameters.Property.Verb == AcxPropertyVerbSet);
-    ASSERT(params.Parameters.Property.Control == nullptr);
-    ASSERT(params.Parameters.Property.ControlCb == 0);
+    ASSERT(params.Parameters.Property.Control != nullptr);
+    ASSERT(params.Parameters.Property.ControlCb >= sizeof(UAC_ASIO_PLAY_BUFFER_HEADER));
     ASSERT(params.Parameters.Property.Value != nullptr);
-    ASSERT(params.Parameters.Property.ValueCb >= sizeof(ULONG));
+    ASSERT(params.Parameters.Property.ValueCb >= sizeof(UAC_ASIO_REC_BUFFER_HEADER));
 
-    IF_TRUE_ACTION_JUMP(((params.Parameters.Property.Control != nullptr) ||
-                         (params.Parameters.Property.ControlCb != 0 ||
-                          (params.Parameters.Property.Value == nullptr) ||
-                          (params.Parameters.Property.ValueCb < sizeof(ULONG)))),
+    WdfWaitLockAcquire(deviceContext->AsioWaitLock, nullptr);
+
+    IF_TRUE_ACTION_JUMP(((params.Parameters.Property.Control == nullptr) ||
+                         (params.Parameters.Property.ControlCb < sizeof(UAC_ASIO_PLAY_BUFFER_HEADER)) ||
+                         (params.Parameters.Property.Value == nullptr) ||
+                         (params.Parameters.Property.ValueCb < sizeof(UAC_ASIO_REC_BUFFER_HEADER))),
                         ASSERT(FALSE);
                         outDataCb = 0; status = STATUS_INVALID_PARAMETER;,
                                                                          Exit);
 
-    UACSampleFormat sampleFormat = (UACSampleFormat)(*(PULONG)params.Parameters.Property.Value);
-    if ((deviceContext->AudioProperty.SupportedSampleFormats & (1 << toULong(sampleFormat))) == 0)
-    {
-        status = STATUS_INVALID_PARAMETER;
-    }
-    else if (sampleFormat == deviceContext->AudioProperty.CurrentSampleFormat)
-    {
-        status = STATUS_SUCCESS;
-    }
-    else
-    {
-        ULONG formatType = 0;
-        ULONG format = 0;
+    IF_TRUE_ACTION_JUMP((deviceContext->AsioBufferOwner != nullptr) || (deviceContext->AsioBufferObject != nullptr),
+                        outDataCb = 0;
+                        status = STATUS_DEVICE_BUSY;, Exit);
+
+    asioBufferObject = AsioBufferObject::Create(deviceContext);
+    IF_TRUE_ACTION_JUMP(asioBufferObject == nullptr,
+                        outDataCb = 0;
+                        status = STATUS_INSUFFICIENT_RESOURCES, Exit);
+
+    PIRP irp = WdfRequestWdmGetIrp(request);
+
+    IF_TRUE_ACTION_JUMP(irp == nullptr, ASSERT(FALSE); outDataCb = 0; status = STATUS_INVALID_PARAMETER;, Exit);
+
+    PIO_STACK_LOCATION irpStack = IoGetCurrentIrpStackLocation(irp);
+    PBYTE              inBuffer = (PBYTE)irpStack->Parameters.DeviceIoControl.Type3InputBuffer;
+    PBYTE              outBuffer = (PBYTE)irp->UserBuffer;
+    ULONG              inBufferLength = irpStack->Parameters.DeviceIoControl.InputBufferLength;
+    ULONG              outBufferLength = irpStack->Parameters.DeviceIoControl.OutputBufferLength;
 
-        WdfWaitLockAcquire(deviceContext->StreamWaitLock, nullptr);
+    outDataCb = params.Parameters.Property.ValueCb;
 
-        StopIsoStream(deviceContext);
-        deviceContext->DesiredSampleFormat = sampleFormat;
-        status = USBAudioDataFormat::ConvertFormatToSampleFormat(sampleFormat, formatType, format);
-        if (NT_SUCCESS(status))
-        {
-            status = ActivateAudioInterface(deviceContext, deviceContext->AudioProperty.SampleRate, formatType, format, deviceContext->InputProperty.BytesPerSample, deviceContext->InputProperty.ValidBitsPerSample, deviceContext->OutputProperty.BytesPerSample, deviceContext->OutputProperty.ValidBitsPerSample);
-        }
-        WdfWaitLockRelease(deviceContext->StreamWaitLock);
-        status = STATUS_SUCCESS;
-    }
+    status = asioBufferObject->SetBuffer(
+        static_cast<ULONG>(outBufferLength),
+        (PBYTE)outBuffer,
+        0,
+        static_cast<ULONG>(inBufferLength),
+        (PBYTE)inBuffer,
+        sizeof(KSPROPERTY)
+    );
+    IF_FAILED_ACTION_JUMP(status, outDataCb = 0, Exit);
 
+    // Publish the object only once its buffers are mapped, because the mixing engine thread reads it without AsioWaitLock.
+    InterlockedExchangePointer(reinterpret_cast<PVOID volatile *>(&deviceContext->AsioBufferObject), asioBufferObject);
+    asioBufferObject = nullptr;
 Exit:
+    if (asioBufferObject != nullptr)
+    {
+        // Never published, so no other thread can hold it.
+        asioBufferObject->UnsetBuffer();
+        delete asioBufferObject;
+    }
+    WdfWaitLockRelease(deviceContext->AsioWaitLock);
+
     WdfRequestCompleteWithInformation(request, status, outDataCb);
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit %!STATUS!", status);
 }
 
 PAGED_CODE_SEG
 _Use_decl_annotations_
-VOID EvtUSBAudioAcxDriverChangeSampleRate(
+VOID EvtUSBAudioAcxDriverUnsetAsioBuffer(
     WDFOBJECT  object,
     WDFREQUEST request
 )
@@ -5012,98 +6157,30 @@ VOID EvtUSBAudioAcxDriverChangeSampleRate(
     ASSERT(params.Parameters.Property.Verb == AcxPropertyVerbSet);
     ASSERT(params.Parameters.Property.Control == nullptr);
     ASSERT(params.Parameters.Property.ControlCb == 0);
-    ASSERT(params.Parameters.Property.Value != nullptr);
-    ASSERT(params.Parameters.Property.ValueCb >= sizeof(ULONG));
+    ASSERT(params.Parameters.Property.Value == nullptr);
+    ASSERT(params.Parameters.Property.ValueCb == 0);
+
+    WdfWaitLockAcquire(deviceContext->AsioWaitLock, nullptr);
 
     IF_TRUE_ACTION_JUMP(((params.Parameters.Property.Control != nullptr) ||
-                         (params.Parameters.Property.ControlCb != 0 ||
-                          (params.Parameters.Property.Value == nullptr) ||
-                          (params.Parameters.Property.ValueCb < sizeof(ULONG)))),
+                         (params.Parameters.Property.ControlCb != 0) ||
+                         (params.Parameters.Property.Value != nullptr) ||
+                         (params.Parameters.Property.ValueCb != 0)),
                         ASSERT(FALSE);
                         outDataCb = 0; status = STATUS_INVALID_PARAMETER;,
                                                                          Exit);
 
-    ULONG desiredRate = *((ULONG *)params.Parameters.Property.Value);
-    bool  streamRunning = false;
-    WdfWaitLockAcquire(deviceContext->StreamWaitLock, nullptr);
-    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_MULTICLIENT, " - start counter asio %ld, start counter acx audio %ld, start counter iso stream %ld", deviceContext->StartCounterAsio, deviceContext->StartCounterWdmAudio, deviceContext->StartCounterIsoStream);
-    if (deviceContext->StreamObject != nullptr)
-    {
-        WdfWaitLockAcquire(deviceContext->AsioWaitLock, nullptr);
-        if (deviceContext->AsioBufferObject == nullptr)
-        {
-            streamRunning = true;
-        }
-        WdfWaitLockRelease(deviceContext->AsioWaitLock);
-        if ((deviceContext->StartCounterAsio != 0) || (deviceContext->StartCounterWdmAudio != 0))
-        {
-            StopIsoStream(deviceContext);
-        }
-    }
-    ACXDATAFORMAT inputDataFormatBeforeChange = nullptr;
-    ACXDATAFORMAT outputDataFormatBeforeChange = nullptr;
-    ACXDATAFORMAT inputDataFormatAfterChange = nullptr;
-    ACXDATAFORMAT outputDataFormatAfterChange = nullptr;
-
-    if (deviceContext->UsbAudioConfiguration->HasInputIsochronousInterface())
-    {
-        status = USBAudioAcxDriverGetCurrentDataFormat(deviceContext, true, inputDataFormatBeforeChange);
-        IF_FAILED_JUMP(status, Exit_BeforeWaitLockRelease);
-    }
-    if (deviceContext->UsbAudioConfiguration->HasOutputIsochronousInterface())
-    {
-        status = USBAudioAcxDriverGetCurrentDataFormat(deviceContext, false, outputDataFormatBeforeChange);
-        IF_FAILED_JUMP(status, Exit_BeforeWaitLockRelease);
-    }
-    if (NT_SUCCESS(status))
-    {
-        ULONG desiredFormatType = NS_USBAudio0200::FORMAT_TYPE_I;
-        ULONG desiredFormat = NS_USBAudio0200::PCM;
-
-        USBAudioDataFormat::ConvertFormatToSampleFormat(deviceContext->AudioProperty.CurrentSampleFormat, desiredFormatType, desiredFormat);
-
-        status = ActivateAudioInterface(deviceContext, desiredRate, desiredFormatType, desiredFormat, deviceContext->InputProperty.BytesPerSample, deviceContext->InputProperty.ValidBitsPerSample, deviceContext->OutputProperty.BytesPerSample, deviceContext->OutputProperty.ValidBitsPerSample);
-        if (streamRunning && NT_SUCCESS(status))
-        {
-            if ((deviceContext->StartCounterAsio != 0) || (deviceContext->StartCounterWdmAudio != 0))
-            {
-                StartIsoStream(deviceContext);
-            }
-        }
-        TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_MULTICLIENT, " - start counter asio %ld, start counter acx audio %ld, start counter iso stream %ld", deviceContext->StartCounterAsio, deviceContext->StartCounterWdmAudio, deviceContext->StartCounterIsoStream);
-    }
-
-    IF_FAILED_JUMP(status, Exit_BeforeWaitLockRelease);
-
-    if (deviceContext->UsbAudioConfiguration->HasOutputIsochronousInterface() && (outputDataFormatBeforeChange != nullptr))
-    {
-        status = USBAudioAcxDriverGetCurrentDataFormat(deviceContext, false, outputDataFormatAfterChange);
-        IF_FAILED_JUMP(status, Exit_BeforeWaitLockRelease);
-
-        status = NotifyAllPinsDataFormatChange(false, deviceContext, outputDataFormatBeforeChange, outputDataFormatAfterChange);
-        IF_FAILED_JUMP(status, Exit_BeforeWaitLockRelease);
-    }
-    if (deviceContext->UsbAudioConfiguration->HasInputIsochronousInterface() && (inputDataFormatBeforeChange != nullptr))
-    {
-        status = USBAudioAcxDriverGetCurrentDataFormat(deviceContext, true, inputDataFormatAfterChange);
-        IF_FAILED_JUMP(status, Exit_BeforeWaitLockRelease);
-
-        status = NotifyAllPinsDataFormatChange(true, deviceContext, inputDataFormatBeforeChange, inputDataFormatAfterChange);
-        IF_FAILED_JUMP(status, Exit_BeforeWaitLockRelease);
-    }
-    status = STATUS_SUCCESS;
-
-Exit_BeforeWaitLockRelease:
-    WdfWaitLockRelease(deviceContext->StreamWaitLock);
-
+    status = USBAudioAcxDriverDeleteAsioBufferObject(deviceContext);
 Exit:
+    WdfWaitLockRelease(deviceContext->AsioWaitLock);
+
     WdfRequestCompleteWithInformation(request, status, outDataCb);
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit %!STATUS!", status);
 }
 
 PAGED_CODE_SEG
 _Use_decl_annotations_
-VOID EvtUSBAudioAcxDriverGetAsioOwnership(
+VOID EvtUSBAudioAcxDriverReleaseAsioOwnership(
     WDFOBJECT  object,
     WDFREQUEST request
 )
@@ -5111,7 +6188,7 @@ VOID EvtUSBAudioAcxDriverGetAsioOwnership(
 
 Routine Description:
 
-    This routine acquires ASIO ownership.
+    This routine releases ASIO ownership.
 
 Return Value:
 
@@ -5122,7 +6199,6 @@ Return Value:
     NTSTATUS               status = STATUS_NOT_SUPPORTED;
     ACX_REQUEST_PARAMETERS params{};
     ULONG_PTR              outDataCb = 0;
-    LARGE_INTEGER          systemTime = {0};
     // ACXSTREAM              stream = static_cast<ACXSTREAM>(object);
     // ASSERT(stream != nullptr);
 
@@ -5145,6 +6221,8 @@ Return Value:
     ASSERT(params.Parameters.Property.Value == nullptr);
     ASSERT(params.Parameters.Property.ValueCb == 0);
 
+    WdfWaitLockAcquire(deviceContext->StreamWaitLock, nullptr);
+
     IF_TRUE_ACTION_JUMP(((params.Parameters.Property.Control != nullptr) ||
                          (params.Parameters.Property.ControlCb != 0) ||
                          (params.Parameters.Property.Value != nullptr) ||
@@ -5153,125 +6231,166 @@ Return Value:
                         outDataCb = 0; status = STATUS_INVALID_PARAMETER;,
                                                                          Exit);
 
-    KeQuerySystemTime(&systemTime);
-    if (deviceContext->AsioOwner != nullptr || systemTime.QuadPart < deviceContext->ResetEnableTime.QuadPart)
+    if (deviceContext->AsioOwner != nullptr)
     {
-        status = STATUS_ACCESS_DENIED;
+        if (deviceContext->AsioOwner == WdfRequestGetFileObject(request))
+        {
+            TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, "clear asio owner");
+            deviceContext->AsioOwner = nullptr;
+        }
     }
-    else
+    status = STATUS_SUCCESS;
+
+    if ((deviceContext->AudioProperty.SupportedSampleFormats & (1 << toULong(UACSampleFormat::UAC_SAMPLE_FORMAT_IEEE_FLOAT))) && (deviceContext->SampleFormatBackup != deviceContext->AudioProperty.CurrentSampleFormat))
     {
+        ULONG         desiredFormatType = NS_USBAudio0200::FORMAT_TYPE_I;
+        ULONG         desiredFormat = NS_USBAudio0200::PCM;
         ULONG         inputBytesPerSample = 0;
         ULONG         inputValidBitsPerSample = 0;
         ULONG         outputBytesPerSample = 0;
         ULONG         outputValidBitsPerSample = 0;
-        ULONG         desiredFormatType = NS_USBAudio0200::FORMAT_TYPE_I;
-        ULONG         desiredFormat = NS_USBAudio0200::PCM;
         ACXDATAFORMAT inputDataFormatBeforeChange = nullptr;
         ACXDATAFORMAT outputDataFormatBeforeChange = nullptr;
         ACXDATAFORMAT inputDataFormatAfterChange = nullptr;
         ACXDATAFORMAT outputDataFormatAfterChange = nullptr;
 
-        WdfWaitLockAcquire(deviceContext->StreamWaitLock, nullptr);
-
         if (deviceContext->UsbAudioConfiguration->HasInputIsochronousInterface())
         {
             status = USBAudioAcxDriverGetCurrentDataFormat(deviceContext, true, inputDataFormatBeforeChange);
-            IF_FAILED_JUMP(status, Exit_BeforeWaitLockRelease);
+            IF_FAILED_JUMP(status, Exit);
         }
         if (deviceContext->UsbAudioConfiguration->HasOutputIsochronousInterface())
         {
             status = USBAudioAcxDriverGetCurrentDataFormat(deviceContext, false, outputDataFormatBeforeChange);
-            IF_FAILED_JUMP(status, Exit_BeforeWaitLockRelease);
-        }
-        status = USBAudioDataFormat::ConvertFormatToSampleFormat(deviceContext->AudioProperty.CurrentSampleFormat, desiredFormatType, desiredFormat);
-        IF_FAILED_JUMP(status, Exit_BeforeWaitLockRelease);
-
-        if (!deviceContext->UsbAudioConfiguration->IsEnableASIO())
-        {
-            status = STATUS_INVALID_DEVICE_REQUEST;
-            IF_FAILED_JUMP(status, Exit_BeforeWaitLockRelease);
-        }
-
-        if (deviceContext->AudioProperty.SupportedSampleFormats & (1 << toULong(UACSampleFormat::UAC_SAMPLE_FORMAT_IEEE_FLOAT)))
-        {
-            deviceContext->SampleFormatBackup = deviceContext->AudioProperty.CurrentSampleFormat;
-            desiredFormatType = NS_USBAudio0200::FORMAT_TYPE_I;
-            desiredFormat = NS_USBAudio0200::IEEE_FLOAT;
-        }
-        else if (deviceContext->AudioProperty.SupportedSampleFormats & (1 << toULong(UACSampleFormat::UAC_SAMPLE_FORMAT_PCM)))
-        {
-            deviceContext->SampleFormatBackup = deviceContext->AudioProperty.CurrentSampleFormat;
-            desiredFormatType = NS_USBAudio0200::FORMAT_TYPE_I;
-            desiredFormat = NS_USBAudio0200::PCM;
+            IF_FAILED_JUMP(status, Exit);
         }
+        status = USBAudioDataFormat::ConvertFormatToSampleFormat(deviceContext->SampleFormatBackup, desiredFormatType, desiredFormat);
+        IF_FAILED_JUMP(status, Exit);
 
         if (deviceContext->UsbAudioConfiguration->HasInputIsochronousInterface())
         {
             status = deviceContext->UsbAudioConfiguration->GetMaxSupportedValidBitsPerSample(true, desiredFormatType, desiredFormat, inputBytesPerSample, inputValidBitsPerSample);
-            IF_FAILED_JUMP(status, Exit_BeforeWaitLockRelease);
+            IF_FAILED_JUMP(status, Exit);
         }
         if (deviceContext->UsbAudioConfiguration->HasOutputIsochronousInterface())
         {
             status = deviceContext->UsbAudioConfiguration->GetMaxSupportedValidBitsPerSample(false, desiredFormatType, desiredFormat, outputBytesPerSample, outputValidBitsPerSample);
-            IF_FAILED_JUMP(status, Exit_BeforeWaitLockRelease);
+            IF_FAILED_JUMP(status, Exit);
         }
-        //
-        // When using ASIO, the maximum bit depth is used independently for input and output.
-        //
         status = ActivateAudioInterface(deviceContext, deviceContext->AudioProperty.SampleRate, desiredFormatType, desiredFormat, inputBytesPerSample, inputValidBitsPerSample, outputBytesPerSample, outputValidBitsPerSample);
+        IF_FAILED_JUMP(status, Exit);
 
-        WDFFILEOBJECT fileObject = WdfRequestGetFileObject(request);
-        if (fileObject != nullptr)
-        {
-            deviceContext->AsioOwner = fileObject;
-
-            PFILE_CONTEXT fileContext = GetFileContext(fileObject);
-            if (fileContext != nullptr)
-            {
-                fileContext->DeviceContext = deviceContext;
-            }
-            status = STATUS_SUCCESS;
-        }
-        else
-        {
-            status = STATUS_INVALID_DEVICE_REQUEST;
-        }
         if (deviceContext->UsbAudioConfiguration->HasOutputIsochronousInterface() && (outputDataFormatBeforeChange != nullptr))
         {
             status = USBAudioAcxDriverGetCurrentDataFormat(deviceContext, false, outputDataFormatAfterChange);
-            IF_FAILED_JUMP(status, Exit_BeforeWaitLockRelease);
+            IF_FAILED_JUMP(status, Exit);
 
             status = NotifyAllPinsDataFormatChange(false, deviceContext, outputDataFormatBeforeChange, outputDataFormatAfterChange);
-            IF_FAILED_JUMP(status, Exit_BeforeWaitLockRelease);
+            IF_FAILED_JUMP(status, Exit);
         }
         if (deviceContext->UsbAudioConfiguration->HasInputIsochronousInterface() && (inputDataFormatBeforeChange != nullptr))
         {
             status = USBAudioAcxDriverGetCurrentDataFormat(deviceContext, true, inputDataFormatAfterChange);
-            IF_FAILED_JUMP(status, Exit_BeforeWaitLockRelease);
+            IF_FAILED_JUMP(status, Exit);
 
             status = NotifyAllPinsDataFormatChange(true, deviceContext, inputDataFormatBeforeChange, inputDataFormatAfterChange);
-            IF_FAILED_JUMP(status, Exit_BeforeWaitLockRelease);
+            IF_FAILED_JUMP(status, Exit);
         }
-    Exit_BeforeWaitLockRelease:
-        WdfWaitLockRelease(deviceContext->StreamWaitLock);
     }
+
+Exit:
+    WdfWaitLockRelease(deviceContext->StreamWaitLock);
+
+    WdfRequestCompleteWithInformation(request, status, outDataCb);
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit %!STATUS!", status);
+}
+
+PAGED_CODE_SEG
+_Use_decl_annotations_
+VOID EvtUSBAudioAcxDriverGetBufferPeriod(
+    WDFOBJECT  object,
+    WDFREQUEST request
+)
+{
+    PAGED_CODE();
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Entry");
+
+    NTSTATUS  status = STATUS_NOT_SUPPORTED;
+    ULONG_PTR outDataCb = 0;
+
+    ACX_REQUEST_PARAMETERS params{};
+    ACX_REQUEST_PARAMETERS_INIT(&params);
+    AcxRequestGetParameters(request, &params);
+
+    ASSERT(params.Type == AcxRequestTypeProperty);
+    ASSERT(params.Parameters.Property.Verb == AcxPropertyVerbGet);
+    ASSERT(params.Parameters.Property.Control == nullptr);
+    ASSERT(params.Parameters.Property.ControlCb == 0);
+    ASSERT(params.Parameters.Property.Value != nullptr);
+    ASSERT(params.Parameters.Property.ValueCb == sizeof(ULONG));
+
+    WDFDEVICE device = AcxCircuitGetWdfDevice((ACXCIRCUIT)object);
+    ASSERT(device != nullptr);
+
+    PDEVICE_CONTEXT deviceContext = GetDeviceContext(device);
+    ASSERT(deviceContext != nullptr);
+
+    WdfWaitLockAcquire(deviceContext->StreamWaitLock, nullptr);
+
+    IF_TRUE_ACTION_JUMP(
+        (
+            (params.Parameters.Property.Control != nullptr) ||
+            (params.Parameters.Property.ControlCb != 0) ||
+            (params.Parameters.Property.Value == nullptr) ||
+            (params.Parameters.Property.ValueCb < sizeof(ULONG))
+        ),
+        ASSERT(FALSE);
+        outDataCb = 0;
+        status = STATUS_INVALID_PARAMETER;,
+                                          Exit
+    );
+
+    ULONG * bufferPeriod = static_cast<ULONG *>(params.Parameters.Property.Value);
+    outDataCb = sizeof(ULONG);
+    *bufferPeriod = deviceContext->Params.SuggestedBufferPeriod;
+    status = STATUS_SUCCESS;
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "BufferPeriod = %u", *bufferPeriod);
+
 Exit:
-    WdfRequestCompleteWithInformation(request, status, outDataCb);
+
+    WdfWaitLockRelease(deviceContext->StreamWaitLock);
+
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit %!STATUS!", status);
+
+    WdfRequestCompleteWithInformation(request, status, outDataCb);
 }
 
 PAGED_CODE_SEG
 _Use_decl_annotations_
-VOID EvtUSBAudioAcxDriverStartAsioStream(
+VOID EvtUSBAudioAcxDriverSetBufferPeriod(
     WDFOBJECT  object,
     WDFREQUEST request
 )
 {
-    NTSTATUS               status = STATUS_NOT_SUPPORTED;
+    PAGED_CODE();
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Entry");
+
+    NTSTATUS  status = STATUS_NOT_SUPPORTED;
+    ULONG_PTR outDataCb = 0;
+
     ACX_REQUEST_PARAMETERS params{};
-    ULONG_PTR              outDataCb = 0;
-    // ACXSTREAM              stream = static_cast<ACXSTREAM>(object);
-    // ASSERT(stream != nullptr);
+    ACX_REQUEST_PARAMETERS_INIT(&params);
+    AcxRequestGetParameters(request, &params);
+
+    ASSERT(params.Type == AcxRequestTypeProperty);
+    ASSERT(params.Parameters.Property.Verb == AcxPropertyVerbGet);
+    ASSERT(params.Parameters.Property.Control == nullptr);
+    ASSERT(params.Parameters.Property.ControlCb == 0);
+    ASSERT(params.Parameters.Property.Value != nullptr);
+    ASSERT(params.Parameters.Property.ValueCb == sizeof(ULONG));
 
     WDFDEVICE device = AcxCircuitGetWdfDevice((ACXCIRCUIT)object);
     ASSERT(device != nullptr);
@@ -5279,400 +6398,356 @@ VOID EvtUSBAudioAcxDriverStartAsioStream(
     PDEVICE_CONTEXT deviceContext = GetDeviceContext(device);
     ASSERT(deviceContext != nullptr);
 
-    PAGED_CODE();
-    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Entry");
+    ULONG * bufferPeriod = static_cast<ULONG *>(params.Parameters.Property.Value);
 
-    ACX_REQUEST_PARAMETERS_INIT(&params);
-    AcxRequestGetParameters(request, &params);
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "BufferPeriod = %u", *bufferPeriod);
 
-    ASSERT(params.Type == AcxRequestTypeProperty);
-    ASSERT(params.Parameters.Property.Verb == AcxPropertyVerbSet);
-    ASSERT(params.Parameters.Property.Control == nullptr);
-    ASSERT(params.Parameters.Property.ControlCb = 0);
-    ASSERT(params.Parameters.Property.Value == nullptr);
-    ASSERT(params.Parameters.Property.ValueCb == 0);
+    WdfWaitLockAcquire(deviceContext->StreamWaitLock, nullptr);
 
-    IF_TRUE_ACTION_JUMP(((params.Parameters.Property.Control != nullptr) ||
-                         (params.Parameters.Property.ControlCb != 0) ||
-                         (params.Parameters.Property.Value != nullptr) ||
-                         (params.Parameters.Property.ValueCb != 0)),
-                        ASSERT(FALSE);
-                        outDataCb = 0; status = STATUS_INVALID_PARAMETER;,
-                                                                         Exit);
+    IF_TRUE_ACTION_JUMP(
+        (
+            (params.Parameters.Property.Control != nullptr) ||
+            (params.Parameters.Property.ControlCb != 0) ||
+            (params.Parameters.Property.Value == nullptr) ||
+            (params.Parameters.Property.ValueCb < sizeof(ULONG))
+        ),
+        ASSERT(FALSE);
+        outDataCb = 0;
+        status = STATUS_INVALID_PARAMETER;,
+                                          Exit
+    );
 
-    WdfWaitLockAcquire(deviceContext->StreamWaitLock, nullptr);
-    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_MULTICLIENT, " - start counter asio %ld, start counter acx audio %ld, start counter iso stream %ld", deviceContext->StartCounterAsio, deviceContext->StartCounterWdmAudio, deviceContext->StartCounterIsoStream);
-    if (deviceContext->StartCounterAsio == 0)
+    if (*bufferPeriod != deviceContext->Params.SuggestedBufferPeriod)
     {
-        if (deviceContext->StartCounterWdmAudio == 0)
+        bool isStreaming = (deviceContext->StartCounterAsio != 0) || (deviceContext->StartCounterWdmAudio != 0);
+
+        status = UpdateFramePerIrp(deviceContext, *bufferPeriod);
+        ASSERT(NT_SUCCESS(status));
+
+        status = UpdateBufferOperationOffset(deviceContext, *bufferPeriod);
+        ASSERT(NT_SUCCESS(status));
+
+        RtlZeroMemory(&deviceContext->BufferPeriodSwitch, sizeof(UAC_BUFFER_PERIOD_SWITCH_CONTEXT));
+        deviceContext->BufferPeriodSwitch.PreviousBufferPeriod = deviceContext->Params.SuggestedBufferPeriod;
+        deviceContext->BufferPeriodSwitch.BufferPeriod = *bufferPeriod;
+
+        deviceContext->Params.SuggestedBufferPeriod = *bufferPeriod;
+
+        if (isStreaming && (deviceContext->StreamObject != nullptr))
         {
-            status = StartIsoStream(deviceContext);
+            // The sample rate and the format do not change, so the running stream is rebuilt without selecting the interfaces again.
+            status = ReconfigureIsoStream(deviceContext);
+            if (NT_SUCCESS(status))
+            {
+                goto Exit;
+            }
+            TraceEvents(TRACE_LEVEL_WARNING, TRACE_DEVICE, "ReconfigureIsoStream failed %!STATUS!, falling back to a full restart", status);
         }
-        else
+
+        if (isStreaming)
         {
-            WdfWaitLockAcquire(deviceContext->AsioWaitLock, nullptr);
-            if (deviceContext->AsioBufferObject != nullptr)
+            StopIsoStream(deviceContext);
+        }
+
+        status = ActivateAudioInterface(
+            deviceContext,
+            deviceContext->AudioProperty.SampleRate,
+            NS_USBAudio0200::FORMAT_TYPE_I,
+            NS_USBAudio0200::PCM,
+            deviceContext->InputProperty.BytesPerSample,
+            deviceContext->InputProperty.ValidBitsPerSample,
+            deviceContext->OutputProperty.BytesPerSample,
+            deviceContext->OutputProperty.ValidBitsPerSample
+        );
+
+        if (NT_SUCCESS(status))
+        {
+            deviceContext->BufferPeriodSwitch.ClassicFramesPerIrp = deviceContext->ClassicFramesPerIrp;
+            if ((deviceContext->StartCounterAsio != 0) || (deviceContext->StartCounterWdmAudio != 0))
             {
-                deviceContext->AsioBufferObject->SetReady();
-                status = STATUS_SUCCESS;
+                StartIsoStream(deviceContext);
             }
             else
             {
-                status = STATUS_UNSUCCESSFUL;
+                ASSERT(NT_SUCCESS(status));
             }
-            WdfWaitLockRelease(deviceContext->AsioWaitLock);
-        }
-        if (NT_SUCCESS(status))
-        {
-            InterlockedIncrement(&deviceContext->StartCounterAsio);
-            TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_MULTICLIENT, " - start counter asio %ld, start counter acx audio %ld, start counter iso stream %ld", deviceContext->StartCounterAsio, deviceContext->StartCounterWdmAudio, deviceContext->StartCounterIsoStream);
         }
     }
     else
     {
+        // Nothing is done because there is no change in flag.
         status = STATUS_SUCCESS;
     }
-    WdfWaitLockRelease(deviceContext->StreamWaitLock);
+
 Exit:
-    WdfRequestCompleteWithInformation(request, status, outDataCb);
+
+    WdfWaitLockRelease(deviceContext->StreamWaitLock);
+
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit %!STATUS!", status);
+
+    WdfRequestCompleteWithInformation(request, status, outDataCb);
 }
 
 PAGED_CODE_SEG
 _Use_decl_annotations_
-VOID EvtUSBAudioAcxDriverStopAsioStream(
+VOID EvtUSBAudioAcxDriverGetInputLatency(
     WDFOBJECT  object,
     WDFREQUEST request
 )
 {
-    NTSTATUS               status = STATUS_NOT_SUPPORTED;
-    ACX_REQUEST_PARAMETERS params{};
-    ULONG_PTR              outDataCb = 0;
-    // ACXSTREAM              stream = static_cast<ACXSTREAM>(object);
-    // ASSERT(stream != nullptr);
-
-    WDFDEVICE device = AcxCircuitGetWdfDevice((ACXCIRCUIT)object);
-    ASSERT(device != nullptr);
-
-    PDEVICE_CONTEXT deviceContext = GetDeviceContext(device);
-    ASSERT(deviceContext != nullptr);
-
     PAGED_CODE();
+
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Entry");
 
+    NTSTATUS  status = STATUS_NOT_SUPPORTED;
+    ULONG_PTR outDataCb = 0;
+
+    ACX_REQUEST_PARAMETERS params{};
     ACX_REQUEST_PARAMETERS_INIT(&params);
     AcxRequestGetParameters(request, &params);
 
     ASSERT(params.Type == AcxRequestTypeProperty);
-    ASSERT(params.Parameters.Property.Verb == AcxPropertyVerbSet);
+    ASSERT(params.Parameters.Property.Verb == AcxPropertyVerbGet);
     ASSERT(params.Parameters.Property.Control == nullptr);
     ASSERT(params.Parameters.Property.ControlCb == 0);
-    ASSERT(params.Parameters.Property.Value == nullptr);
-    ASSERT(params.Parameters.Property.ValueCb == 0);
+    ASSERT(params.Parameters.Property.Value != nullptr);
+    ASSERT(params.Parameters.Property.ValueCb == sizeof(LONG));
 
-    IF_TRUE_ACTION_JUMP(((params.Parameters.Property.Control != nullptr) ||
-                         (params.Parameters.Property.ControlCb != 0) ||
-                         (params.Parameters.Property.Value != nullptr) ||
-                         (params.Parameters.Property.ValueCb != 0)),
-                        ASSERT(FALSE);
-                        outDataCb = 0; status = STATUS_INVALID_PARAMETER;,
-                                                                         Exit);
+    WDFDEVICE device = AcxCircuitGetWdfDevice((ACXCIRCUIT)object);
+    ASSERT(device != nullptr);
+
+    PDEVICE_CONTEXT deviceContext = GetDeviceContext(device);
+    ASSERT(deviceContext != nullptr);
 
     WdfWaitLockAcquire(deviceContext->StreamWaitLock, nullptr);
 
-    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_MULTICLIENT, " - start counter asio %ld, start counter acx audio %ld, start counter iso stream %ld", deviceContext->StartCounterAsio, deviceContext->StartCounterWdmAudio, deviceContext->StartCounterIsoStream);
-    if (deviceContext->StartCounterAsio)
-    {
-        InterlockedDecrement(&deviceContext->StartCounterAsio);
-        if ((deviceContext->StartCounterAsio == 0) && (deviceContext->StartCounterWdmAudio == 0))
-        {
-            status = StopIsoStream(deviceContext);
-        }
-        else
-        {
-            status = STATUS_SUCCESS;
-        }
-        TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_MULTICLIENT, " - start counter asio %ld, start counter acx audio %ld, start counter iso stream %ld", deviceContext->StartCounterAsio, deviceContext->StartCounterWdmAudio, deviceContext->StartCounterIsoStream);
-    }
-    else
-    {
-        status = STATUS_SUCCESS;
-    }
+    IF_TRUE_ACTION_JUMP(
+        (
+            (params.Parameters.Property.Control != nullptr) ||
+            (params.Parameters.Property.ControlCb != 0) ||
+            (params.Parameters.Property.Value == nullptr) ||
+            (params.Parameters.Property.ValueCb < sizeof(LONG))
+        ),
+        ASSERT(FALSE);
+        outDataCb = 0;
+        status = STATUS_INVALID_PARAMETER;,
+                                          Exit
+    );
 
-    WdfWaitLockRelease(deviceContext->StreamWaitLock);
+    LONG * inputLatency = static_cast<LONG *>(params.Parameters.Property.Value);
+    outDataCb = sizeof(LONG);
+    *inputLatency = deviceContext->Params.SuggestedBufferPeriod + deviceContext->AudioProperty.InputLatencyOffset;
+    status = STATUS_SUCCESS;
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "InputLatency = %d", *inputLatency);
 
 Exit:
-    WdfRequestCompleteWithInformation(request, status, outDataCb);
+
+    WdfWaitLockRelease(deviceContext->StreamWaitLock);
+
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit %!STATUS!", status);
+
+    WdfRequestCompleteWithInformation(request, status, outDataCb);
 }
 
 PAGED_CODE_SEG
 _Use_decl_annotations_
-VOID EvtUSBAudioAcxDriverSetAsioBuffer(
+VOID EvtUSBAudioAcxDriverGetOutputLatency(
     WDFOBJECT  object,
     WDFREQUEST request
 )
 {
-    NTSTATUS               status = STATUS_NOT_SUPPORTED;
-    ACX_REQUEST_PARAMETERS params{};
-    ULONG_PTR              outDataCb = 0;
-    // ACXSTREAM              stream = static_cast<ACXSTREAM>(object);
-    // ASSERT(stream != nullptr);
-
-    WDFDEVICE device = AcxCircuitGetWdfDevice((ACXCIRCUIT)object);
-    ASSERT(device != nullptr);
-
-    PDEVICE_CONTEXT deviceContext = GetDeviceContext(device);
-    ASSERT(deviceContext != nullptr);
-
     PAGED_CODE();
+
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Entry");
 
+    NTSTATUS  status = STATUS_NOT_SUPPORTED;
+    ULONG_PTR outDataCb = 0;
+
+    ACX_REQUEST_PARAMETERS params{};
     ACX_REQUEST_PARAMETERS_INIT(&params);
     AcxRequestGetParameters(request, &params);
 
     ASSERT(params.Type == AcxRequestTypeProperty);
-    ASSERT(params.Parameters.Property.Verb == AcxPropertyVerbSet);
-    ASSERT(params.Parameters.Property.Control != nullptr);
-    ASSERT(params.Parameters.Property.ControlCb >= sizeof(UAC_ASIO_PLAY_BUFFER_HEADER));
+    ASSERT(params.Parameters.Property.Verb == AcxPropertyVerbGet);
+    ASSERT(params.Parameters.Property.Control == nullptr);
+    ASSERT(params.Parameters.Property.ControlCb == 0);
     ASSERT(params.Parameters.Property.Value != nullptr);
-    ASSERT(params.Parameters.Property.ValueCb >= sizeof(UAC_ASIO_REC_BUFFER_HEADER));
+    ASSERT(params.Parameters.Property.ValueCb == sizeof(LONG));
 
-    WdfWaitLockAcquire(deviceContext->AsioWaitLock, nullptr);
+    WDFDEVICE device = AcxCircuitGetWdfDevice((ACXCIRCUIT)object);
+    ASSERT(device != nullptr);
 
-    IF_TRUE_ACTION_JUMP(((params.Parameters.Property.Control == nullptr) ||
-                         (params.Parameters.Property.ControlCb < sizeof(UAC_ASIO_PLAY_BUFFER_HEADER)) ||
-                         (params.Parameters.Property.Value == nullptr) ||
-                         (params.Parameters.Property.ValueCb < sizeof(UAC_ASIO_REC_BUFFER_HEADER))),
-                        ASSERT(FALSE);
-                        outDataCb = 0; status = STATUS_INVALID_PARAMETER;,
-                                                                         Exit);
+    PDEVICE_CONTEXT deviceContext = GetDeviceContext(device);
+    ASSERT(deviceContext != nullptr);
 
-    IF_TRUE_ACTION_JUMP((deviceContext->AsioBufferOwner != nullptr) || (deviceContext->AsioBufferObject != nullptr),
-                        outDataCb = 0;
-                        status = STATUS_DEVICE_BUSY;, Exit);
+    WdfWaitLockAcquire(deviceContext->StreamWaitLock, nullptr);
 
-    deviceContext->AsioBufferObject = AsioBufferObject::Create(deviceContext);
-    IF_TRUE_ACTION_JUMP(deviceContext->AsioBufferObject == nullptr,
-                        outDataCb = 0;
-                        STATUS_INSUFFICIENT_RESOURCES, Exit);
+    IF_TRUE_ACTION_JUMP(
+        (
+            (params.Parameters.Property.Control != nullptr) ||
+            (params.Parameters.Property.ControlCb != 0) ||
+            (params.Parameters.Property.Value == nullptr) ||
+            (params.Parameters.Property.ValueCb < sizeof(LONG))
+        ),
+        ASSERT(FALSE);
+        outDataCb = 0;
+        status = STATUS_INVALID_PARAMETER;,
+                                          Exit
+    );
 
-    PIRP irp = WdfRequestWdmGetIrp(request);
+    LONG * outputLatency = static_cast<LONG *>(params.Parameters.Property.Value);
+    outDataCb = sizeof(LONG);
+    *outputLatency = deviceContext->Params.SuggestedBufferPeriod + deviceContext->AudioProperty.OutputLatencyOffset;
+    status = STATUS_SUCCESS;
 
-    IF_TRUE_ACTION_JUMP(irp == nullptr, ASSERT(FALSE); outDataCb = 0; status = STATUS_INVALID_PARAMETER;, Exit);
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "OutputLatency = %d", *outputLatency);
 
-    PIO_STACK_LOCATION irpStack = IoGetCurrentIrpStackLocation(irp);
-    PBYTE              inBuffer = (PBYTE)irpStack->Parameters.DeviceIoControl.Type3InputBuffer;
-    PBYTE              outBuffer = (PBYTE)irp->UserBuffer;
-    ULONG              inBufferLength = irpStack->Parameters.DeviceIoControl.InputBufferLength;
-    ULONG              outBufferLength = irpStack->Parameters.DeviceIoControl.OutputBufferLength;
+Exit:
 
-    outDataCb = params.Parameters.Property.ValueCb;
+    WdfWaitLockRelease(deviceContext->StreamWaitLock);
 
-    status = deviceContext->AsioBufferObject->SetBuffer(
-        static_cast<ULONG>(outBufferLength),
-        (PBYTE)outBuffer,
-        0,
-        static_cast<ULONG>(inBufferLength),
-        (PBYTE)inBuffer,
-        sizeof(KSPROPERTY)
-    );
-Exit:
-    WdfWaitLockRelease(deviceContext->AsioWaitLock);
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit %!STATUS!", status);
 
     WdfRequestCompleteWithInformation(request, status, outDataCb);
-    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit %!STATUS!", status);
 }
 
 PAGED_CODE_SEG
 _Use_decl_annotations_
-VOID EvtUSBAudioAcxDriverUnsetAsioBuffer(
+VOID EvtUSBAudioAcxDriverSetAsioDevice(
     WDFOBJECT  object,
     WDFREQUEST request
 )
 {
-    NTSTATUS               status = STATUS_NOT_SUPPORTED;
-    ACX_REQUEST_PARAMETERS params{};
-    ULONG_PTR              outDataCb = 0;
-    // ACXSTREAM              stream = static_cast<ACXSTREAM>(object);
-    // ASSERT(stream != nullptr);
-
-    WDFDEVICE device = AcxCircuitGetWdfDevice((ACXCIRCUIT)object);
-    ASSERT(device != nullptr);
-
-    PDEVICE_CONTEXT deviceContext = GetDeviceContext(device);
-    ASSERT(deviceContext != nullptr);
-
     PAGED_CODE();
+
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Entry");
 
+    ACX_REQUEST_PARAMETERS params{};
     ACX_REQUEST_PARAMETERS_INIT(&params);
     AcxRequestGetParameters(request, &params);
 
     ASSERT(params.Type == AcxRequestTypeProperty);
-    ASSERT(params.Parameters.Property.Verb == AcxPropertyVerbSet);
+    ASSERT(params.Parameters.Property.Verb == AcxPropertyVerbGet);
     ASSERT(params.Parameters.Property.Control == nullptr);
     ASSERT(params.Parameters.Property.ControlCb == 0);
-    ASSERT(params.Parameters.Property.Value == nullptr);
-    ASSERT(params.Parameters.Property.ValueCb == 0);
+    ASSERT(params.Parameters.Property.Value != nullptr);
+    ASSERT(0 < params.Parameters.Property.ValueCb);
 
-    WdfWaitLockAcquire(deviceContext->AsioWaitLock, nullptr);
+    WDFDEVICE device = AcxCircuitGetWdfDevice((ACXCIRCUIT)object);
+    ASSERT(device != nullptr);
 
-    IF_TRUE_ACTION_JUMP(((params.Parameters.Property.Control != nullptr) ||
-                         (params.Parameters.Property.ControlCb != 0) ||
-                         (params.Parameters.Property.Value != nullptr) ||
-                         (params.Parameters.Property.ValueCb != 0)),
-                        ASSERT(FALSE);
-                        outDataCb = 0; status = STATUS_INVALID_PARAMETER;,
-                                                                         Exit);
+    PDEVICE_CONTEXT deviceContext = GetDeviceContext(device);
+    ASSERT(deviceContext != nullptr);
+
+    WdfWaitLockAcquire(deviceContext->StreamWaitLock, nullptr);
+
+    NTSTATUS status = STATUS_NOT_SUPPORTED;
+
+    IF_TRUE_ACTION_JUMP(
+        (
+            (params.Parameters.Property.Control != nullptr) ||
+            (params.Parameters.Property.ControlCb != 0) ||
+            (params.Parameters.Property.Value == nullptr) ||
+            (params.Parameters.Property.ValueCb == 0)
+        ),
+        ASSERT(FALSE);
+        status = STATUS_INVALID_PARAMETER;,
+                                          Exit
+    );
+
+    UNICODE_STRING asioDevice;
+    RtlInitUnicodeString(&asioDevice, (PCWSTR)params.Parameters.Property.Value);
+    status = SaveAsioDeviceToRegistry(&asioDevice);
 
-    if (deviceContext->AsioBufferObject != nullptr)
-    {
-        status = deviceContext->AsioBufferObject->UnsetBuffer();
-        delete deviceContext->AsioBufferObject;
-        deviceContext->AsioBufferObject = nullptr;
-    }
-    else
-    {
-        status = STATUS_SUCCESS;
-    }
 Exit:
-    WdfWaitLockRelease(deviceContext->AsioWaitLock);
 
-    WdfRequestCompleteWithInformation(request, status, outDataCb);
+    WdfWaitLockRelease(deviceContext->StreamWaitLock);
+
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit %!STATUS!", status);
+
+    WdfRequestCompleteWithInformation(request, status, 0);
 }
 
 PAGED_CODE_SEG
 _Use_decl_annotations_
-VOID EvtUSBAudioAcxDriverReleaseAsioOwnership(
+VOID EvtUSBAudioAcxDriverGetAsioDevice(
     WDFOBJECT  object,
     WDFREQUEST request
 )
-/*++
-
-Routine Description:
-
-    This routine releases ASIO ownership.
-
-Return Value:
-
-    VOID
-
---*/
 {
-    NTSTATUS               status = STATUS_NOT_SUPPORTED;
-    ACX_REQUEST_PARAMETERS params{};
-    ULONG_PTR              outDataCb = 0;
-    // ACXSTREAM              stream = static_cast<ACXSTREAM>(object);
-    // ASSERT(stream != nullptr);
-
-    WDFDEVICE device = AcxCircuitGetWdfDevice((ACXCIRCUIT)object);
-    ASSERT(device != nullptr);
-
-    PDEVICE_CONTEXT deviceContext = GetDeviceContext(device);
-    ASSERT(deviceContext != nullptr);
-
     PAGED_CODE();
+
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Entry");
 
+    ULONG_PTR outDataCb = 0;
+
+    ACX_REQUEST_PARAMETERS params{};
     ACX_REQUEST_PARAMETERS_INIT(&params);
     AcxRequestGetParameters(request, &params);
 
     ASSERT(params.Type == AcxRequestTypeProperty);
-    ASSERT(params.Parameters.Property.Verb == AcxPropertyVerbSet);
+    ASSERT(params.Parameters.Property.Verb == AcxPropertyVerbGet);
     ASSERT(params.Parameters.Property.Control == nullptr);
     ASSERT(params.Parameters.Property.ControlCb == 0);
-    ASSERT(params.Parameters.Property.Value == nullptr);
-    ASSERT(params.Parameters.Property.ValueCb == 0);
+    ASSERT(params.Parameters.Property.Value != nullptr);
+    ASSERT(0 < params.Parameters.Property.ValueCb);
+
+    WDFDEVICE device = AcxCircuitGetWdfDevice((ACXCIRCUIT)object);
+    ASSERT(device != nullptr);
+
+    PDEVICE_CONTEXT deviceContext = GetDeviceContext(device);
+    ASSERT(deviceContext != nullptr);
 
     WdfWaitLockAcquire(deviceContext->StreamWaitLock, nullptr);
 
-    IF_TRUE_ACTION_JUMP(((params.Parameters.Property.Control != nullptr) ||
-                         (params.Parameters.Property.ControlCb != 0) ||
-                         (params.Parameters.Property.Value != nullptr) ||
-                         (params.Parameters.Property.ValueCb != 0)),
-                        ASSERT(FALSE);
-                        outDataCb = 0; status = STATUS_INVALID_PARAMETER;,
-                                                                         Exit);
+    NTSTATUS status = STATUS_NOT_SUPPORTED;
 
-    if (deviceContext->AsioOwner != nullptr)
-    {
-        if (deviceContext->AsioOwner == WdfRequestGetFileObject(request))
-        {
-            TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, "clear asio owner");
-            deviceContext->AsioOwner = nullptr;
-        }
-    }
-    status = STATUS_SUCCESS;
+    IF_TRUE_ACTION_JUMP(
+        (
+            (params.Parameters.Property.Control != nullptr) ||
+            (params.Parameters.Property.ControlCb != 0) ||
+            (params.Parameters.Property.Value == nullptr) ||
+            (params.Parameters.Property.ValueCb == 0)
+        ),
+        ASSERT(FALSE);
+        status = STATUS_INVALID_PARAMETER;,
+                                          Exit
+    );
 
-    if ((deviceContext->AudioProperty.SupportedSampleFormats & (1 << toULong(UACSampleFormat::UAC_SAMPLE_FORMAT_IEEE_FLOAT))) && (deviceContext->SampleFormatBackup != deviceContext->AudioProperty.CurrentSampleFormat))
-    {
-        ULONG         desiredFormatType = NS_USBAudio0200::FORMAT_TYPE_I;
-        ULONG         desiredFormat = NS_USBAudio0200::PCM;
-        ULONG         inputBytesPerSample = 0;
-        ULONG         inputValidBitsPerSample = 0;
-        ULONG         outputBytesPerSample = 0;
-        ULONG         outputValidBitsPerSample = 0;
-        ACXDATAFORMAT inputDataFormatBeforeChange = nullptr;
-        ACXDATAFORMAT outputDataFormatBeforeChange = nullptr;
-        ACXDATAFORMAT inputDataFormatAfterChange = nullptr;
-        ACXDATAFORMAT outputDataFormatAfterChange = nullptr;
+    UNICODE_STRING asioDevice;
+    status = LoadAsioDeviceFromRegistry(&asioDevice);
 
-        if (deviceContext->UsbAudioConfiguration->HasInputIsochronousInterface())
-        {
-            status = USBAudioAcxDriverGetCurrentDataFormat(deviceContext, true, inputDataFormatBeforeChange);
-            IF_FAILED_JUMP(status, Exit);
-        }
-        if (deviceContext->UsbAudioConfiguration->HasOutputIsochronousInterface())
-        {
-            status = USBAudioAcxDriverGetCurrentDataFormat(deviceContext, false, outputDataFormatBeforeChange);
-            IF_FAILED_JUMP(status, Exit);
-        }
-        status = USBAudioDataFormat::ConvertFormatToSampleFormat(deviceContext->SampleFormatBackup, desiredFormatType, desiredFormat);
-        IF_FAILED_JUMP(status, Exit);
+    IF_TRUE_ACTION_JUMP(
+        !NT_SUCCESS(status),
+        ASSERT(FALSE),
+        Exit
+    );
 
-        if (deviceContext->UsbAudioConfiguration->HasInputIsochronousInterface())
-        {
-            status = deviceContext->UsbAudioConfiguration->GetMaxSupportedValidBitsPerSample(true, desiredFormatType, desiredFormat, inputBytesPerSample, inputValidBitsPerSample);
-            IF_FAILED_JUMP(status, Exit);
-        }
-        if (deviceContext->UsbAudioConfiguration->HasOutputIsochronousInterface())
-        {
-            status = deviceContext->UsbAudioConfiguration->GetMaxSupportedValidBitsPerSample(false, desiredFormatType, desiredFormat, outputBytesPerSample, outputValidBitsPerSample);
-            IF_FAILED_JUMP(status, Exit);
-        }
-        status = ActivateAudioInterface(deviceContext, deviceContext->AudioProperty.SampleRate, desiredFormatType, desiredFormat, inputBytesPerSample, inputValidBitsPerSample, outputBytesPerSample, outputValidBitsPerSample);
-        IF_FAILED_JUMP(status, Exit);
+    IF_TRUE_ACTION_JUMP(
+        params.Parameters.Property.ValueCb < asioDevice.MaximumLength,
+        status = STATUS_BUFFER_TOO_SMALL,
+        Exit
+    );
 
-        if (deviceContext->UsbAudioConfiguration->HasOutputIsochronousInterface() && (outputDataFormatBeforeChange != nullptr))
-        {
-            status = USBAudioAcxDriverGetCurrentDataFormat(deviceContext, false, outputDataFormatAfterChange);
-            IF_FAILED_JUMP(status, Exit);
+    RtlZeroMemory(params.Parameters.Property.Value, params.Parameters.Property.ValueCb);
 
-            status = NotifyAllPinsDataFormatChange(false, deviceContext, outputDataFormatBeforeChange, outputDataFormatAfterChange);
-            IF_FAILED_JUMP(status, Exit);
-        }
-        if (deviceContext->UsbAudioConfiguration->HasInputIsochronousInterface() && (inputDataFormatBeforeChange != nullptr))
-        {
-            status = USBAudioAcxDriverGetCurrentDataFormat(deviceContext, true, inputDataFormatAfterChange);
-            IF_FAILED_JUMP(status, Exit);
+    RtlCopyMemory(params.Parameters.Property.Value, asioDevice.Buffer, asioDevice.MaximumLength);
 
-            status = NotifyAllPinsDataFormatChange(true, deviceContext, inputDataFormatBeforeChange, inputDataFormatAfterChange);
-            IF_FAILED_JUMP(status, Exit);
-        }
-    }
+    outDataCb = asioDevice.MaximumLength;
 
 Exit:
+
     WdfWaitLockRelease(deviceContext->StreamWaitLock);
 
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit %!STATUS! outDataCb = %llu", status, outDataCb);
+
     WdfRequestCompleteWithInformation(request, status, outDataCb);
-    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit %!STATUS!", status);
 }
 
 PAGED_CODE_SEG
 _Use_decl_annotations_
-VOID EvtUSBAudioAcxDriverGetBufferPeriod(
+VOID EvtUSBAudioAcxDriverSetChannelRouting(
     WDFOBJECT  object,
     WDFREQUEST request
 )
@@ -5681,19 +6756,18 @@ VOID EvtUSBAudioAcxDriverGetBufferPeriod(
 
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Entry");
 
-    NTSTATUS  status = STATUS_NOT_SUPPORTED;
-    ULONG_PTR outDataCb = 0;
+    NTSTATUS status = STATUS_NOT_SUPPORTED;
 
     ACX_REQUEST_PARAMETERS params{};
     ACX_REQUEST_PARAMETERS_INIT(&params);
     AcxRequestGetParameters(request, &params);
 
     ASSERT(params.Type == AcxRequestTypeProperty);
-    ASSERT(params.Parameters.Property.Verb == AcxPropertyVerbGet);
+    ASSERT(params.Parameters.Property.Verb == AcxPropertyVerbSet);
     ASSERT(params.Parameters.Property.Control == nullptr);
     ASSERT(params.Parameters.Property.ControlCb == 0);
     ASSERT(params.Parameters.Property.Value != nullptr);
-    ASSERT(params.Parameters.Property.ValueCb == sizeof(ULONG));
+    ASSERT(params.Parameters.Property.ValueCb == sizeof(UAC_CHANNEL_ROUTING_CONTEXT));
 
     WDFDEVICE device = AcxCircuitGetWdfDevice((ACXCIRCUIT)object);
     ASSERT(device != nullptr);
@@ -5708,20 +6782,29 @@ VOID EvtUSBAudioAcxDriverGetBufferPeriod(
             (params.Parameters.Property.Control != nullptr) ||
             (params.Parameters.Property.ControlCb != 0) ||
             (params.Parameters.Property.Value == nullptr) ||
-            (params.Parameters.Property.ValueCb < sizeof(ULONG))
+            (params.Parameters.Property.ValueCb < sizeof(UAC_CHANNEL_ROUTING_CONTEXT))
         ),
         ASSERT(FALSE);
-        outDataCb = 0;
         status = STATUS_INVALID_PARAMETER;,
                                           Exit
     );
 
-    ULONG * bufferPeriod = static_cast<ULONG *>(params.Parameters.Property.Value);
-    outDataCb = sizeof(ULONG);
-    *bufferPeriod = deviceContext->Params.SuggestedBufferPeriod;
-    status = STATUS_SUCCESS;
+    const UAC_CHANNEL_ROUTING_CONTEXT * channelRouting = static_cast<const UAC_CHANNEL_ROUTING_CONTEXT *>(params.Parameters.Property.Value);
 
-    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "BufferPeriod = %u", *bufferPeriod);
+    IF_TRUE_ACTION_JUMP(
+        (
+            !IsValidChannelRouting(channelRouting->AsioInput, false) ||
+            !IsValidChannelRouting(channelRouting->AsioOutput, true) ||
+            !IsValidChannelRouting(channelRouting->WdmInput, false) ||
+            !IsValidChannelRouting(channelRouting->WdmOutput, true)
+        ),
+        status = STATUS_INVALID_PARAMETER;,
+        Exit
+    );
+
+    // The routing takes effect the next time the ASIO buffer or the WDM packets are set up.
+    deviceContext->ChannelRouting = *channelRouting;
+    status = STATUS_SUCCESS;
 
 Exit:
 
@@ -5729,12 +6812,12 @@ Exit:
 
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit %!STATUS!", status);
 
-    WdfRequestCompleteWithInformation(request, status, outDataCb);
+    WdfRequestCompleteWithInformation(request, status, 0);
 }
 
 PAGED_CODE_SEG
 _Use_decl_annotations_
-VOID EvtUSBAudioAcxDriverSetBufferPeriod(
+VOID EvtUSBAudioAcxDriverGetChannelRouting(
     WDFOBJECT  object,
     WDFREQUEST request
 )
@@ -5755,7 +6838,7 @@ VOID EvtUSBAudioAcxDriverSetBufferPeriod(
     ASSERT(params.Parameters.Property.Control == nullptr);
     ASSERT(params.Parameters.Property.ControlCb == 0);
     ASSERT(params.Parameters.Property.Value != nullptr);
-    ASSERT(params.Parameters.Property.ValueCb == sizeof(ULONG));
+    ASSERT(params.Parameters.Property.ValueCb == sizeof(UAC_CHANNEL_ROUTING_CONTEXT));
 
     WDFDEVICE device = AcxCircuitGetWdfDevice((ACXCIRCUIT)object);
     ASSERT(device != nullptr);
@@ -5763,10 +6846,6 @@ VOID EvtUSBAudioAcxDriverSetBufferPeriod(
     PDEVICE_CONTEXT deviceContext = GetDeviceContext(device);
     ASSERT(deviceContext != nullptr);
 
-    ULONG * bufferPeriod = static_cast<ULONG *>(params.Parameters.Property.Value);
-
-    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "BufferPeriod = %u", *bufferPeriod);
-
     WdfWaitLockAcquire(deviceContext->StreamWaitLock, nullptr);
 
     IF_TRUE_ACTION_JUMP(
@@ -5774,7 +6853,7 @@ VOID EvtUSBAudioAcxDriverSetBufferPeriod(
             (params.Parameters.Property.Control != nullptr) ||
             (params.Parameters.Property.ControlCb != 0) ||
             (params.Parameters.Property.Value == nullptr) ||
-            (params.Parameters.Property.ValueCb < sizeof(ULONG))
+            (params.Parameters.Property.ValueCb < sizeof(UAC_CHANNEL_ROUTING_CONTEXT))
         ),
         ASSERT(FALSE);
         outDataCb = 0;
@@ -5782,50 +6861,9 @@ VOID EvtUSBAudioAcxDriverSetBufferPeriod(
                                           Exit
     );
 
-    if (*bufferPeriod != deviceContext->Params.SuggestedBufferPeriod)
-    {
-
-        if ((deviceContext->StartCounterAsio != 0) || (deviceContext->StartCounterWdmAudio != 0))
-        {
-            StopIsoStream(deviceContext);
-        }
-
-        status = UpdateFramePerIrp(deviceContext, *bufferPeriod);
-        ASSERT(NT_SUCCESS(status));
-
-        status = UpdateBufferOperationOffset(deviceContext, *bufferPeriod);
-        ASSERT(NT_SUCCESS(status));
-
-        deviceContext->Params.SuggestedBufferPeriod = *bufferPeriod;
-
-        status = ActivateAudioInterface(
-            deviceContext,
-            deviceContext->AudioProperty.SampleRate,
-            NS_USBAudio0200::FORMAT_TYPE_I,
-            NS_USBAudio0200::PCM,
-            deviceContext->InputProperty.BytesPerSample,
-            deviceContext->InputProperty.ValidBitsPerSample,
-            deviceContext->OutputProperty.BytesPerSample,
-            deviceContext->OutputProperty.ValidBitsPerSample
-        );
-
-        if (NT_SUCCESS(status))
-        {
-            if ((deviceContext->StartCounterAsio != 0) || (deviceContext->StartCounterWdmAudio != 0))
-            {
-                StartIsoStream(deviceContext);
-            }
-            else
-            {
-                ASSERT(NT_SUCCESS(status));
-            }
-        }
-    }
-    else
-    {
-        // Nothing is done because there is no change in flag.
-        status = STATUS_SUCCESS;
-    }
+    *static_cast<UAC_CHANNEL_ROUTING_CONTEXT *>(params.Parameters.Property.Value) = deviceContext->ChannelRouting;
+    outDataCb = sizeof(UAC_CHANNEL_ROUTING_CONTEXT);
+    status = STATUS_SUCCESS;
 
 Exit:
 
@@ -5838,7 +6876,7 @@ Exit:
 
 PAGED_CODE_SEG
 _Use_decl_annotations_
-VOID EvtUSBAudioAcxDriverGetInputLatency(
+VOID EvtUSBAudioAcxDriverGetMeters(
     WDFOBJECT  object,
     WDFREQUEST request
 )
@@ -5859,7 +6897,7 @@ VOID EvtUSBAudioAcxDriverGetInputLatency(
     ASSERT(params.Parameters.Property.Control == nullptr);
     ASSERT(params.Parameters.Property.ControlCb == 0);
     ASSERT(params.Parameters.Property.Value != nullptr);
-    ASSERT(params.Parameters.Property.ValueCb == sizeof(LONG));
+    ASSERT(params.Parameters.Property.ValueCb == sizeof(UAC_METERS_CONTEXT));
 
     WDFDEVICE device = AcxCircuitGetWdfDevice((ACXCIRCUIT)object);
     ASSERT(device != nullptr);
@@ -5867,14 +6905,12 @@ VOID EvtUSBAudioAcxDriverGetInputLatency(
     PDEVICE_CONTEXT deviceContext = GetDeviceContext(device);
     ASSERT(deviceContext != nullptr);
 
-    WdfWaitLockAcquire(deviceContext->StreamWaitLock, nullptr);
-
     IF_TRUE_ACTION_JUMP(
         (
             (params.Parameters.Property.Control != nullptr) ||
             (params.Parameters.Property.ControlCb != 0) ||
             (params.Parameters.Property.Value == nullptr) ||
-            (params.Parameters.Property.ValueCb < sizeof(LONG))
+            (params.Parameters.Property.ValueCb < sizeof(UAC_METERS_CONTEXT))
         ),
         ASSERT(FALSE);
         outDataCb = 0;
@@ -5882,16 +6918,31 @@ VOID EvtUSBAudioAcxDriverGetInputLatency(
                                           Exit
     );
 
-    LONG * inputLatency = static_cast<LONG *>(params.Parameters.Property.Value);
-    outDataCb = sizeof(LONG);
-    *inputLatency = deviceContext->Params.SuggestedBufferPeriod + deviceContext->AudioProperty.InputLatencyOffset;
-    status = STATUS_SUCCESS;
+    {
+        // The stream thread adds to the meters with interlocked operations, so each field is taken and cleared on its own without a lock.
+        // A packet that is published between the fields of one channel is reported in parts across two requests.
+        auto takeMeters = [](PUAC_CHANNEL_METER dst, PUAC_CHANNEL_METER src) noexcept -> void {
+            for (ULONG channel = 0; channel < UAC_MAX_ASIO_CHANNELS; ++channel)
+            {
+                dst[channel].Peak = (ULONG)InterlockedExchange((PLONG)&src[channel].Peak, 0);
+                dst[channel].Samples = (ULONG)InterlockedExchange((PLONG)&src[channel].Samples, 0);
+                dst[channel].SumOfSquares = (ULONGLONG)InterlockedExchange64((PLONG64)&src[channel].SumOfSquares, 0);
+            }
+        };
 
-    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "InputLatency = %d", *inputLatency);
+        PUAC_METERS_CONTEXT meters = static_cast<PUAC_METERS_CONTEXT>(params.Parameters.Property.Value);
+        takeMeters(meters->Input, deviceContext->Meters.Input);
+        takeMeters(meters->Output, deviceContext->Meters.Output);
+        meters->InputUncachedPackets = (ULONG)InterlockedExchange((PLONG)&deviceContext->Meters.InputUncachedPackets, 0);
+        meters->OutputUncachedPackets = (ULONG)InterlockedExchange((PLONG)&deviceContext->Meters.OutputUncachedPackets, 0);
 
-Exit:
+        // Metering is off until the meters are read, and stops again when nobody has read them for UAC_METERING_HOLD_US.
+        InterlockedExchange64((PLONG64)&deviceContext->MeteringExpiryPCUs, (LONG64)(USBAudioAcxDriverStreamGetCurrentTimeUs(deviceContext, nullptr) + UAC_METERING_HOLD_US));
+    }
+    outDataCb = sizeof(UAC_METERS_CONTEXT);
+    status = STATUS_SUCCESS;
 
-    WdfWaitLockRelease(deviceContext->StreamWaitLock);
+Exit:
 
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit %!STATUS!", status);
 
@@ -5900,7 +6951,7 @@ Exit:
 
 PAGED_CODE_SEG
 _Use_decl_annotations_
-VOID EvtUSBAudioAcxDriverGetOutputLatency(
+VOID EvtUSBAudioAcxDriverGetSafetyOffset(
     WDFOBJECT  object,
     WDFREQUEST request
 )
@@ -5921,7 +6972,7 @@ VOID EvtUSBAudioAcxDriverGetOutputLatency(
     ASSERT(params.Parameters.Property.Control == nullptr);
     ASSERT(params.Parameters.Property.ControlCb == 0);
     ASSERT(params.Parameters.Property.Value != nullptr);
-    ASSERT(params.Parameters.Property.ValueCb == sizeof(LONG));
+    ASSERT(params.Parameters.Property.ValueCb == sizeof(UAC_SAFETY_OFFSET_CONTEXT));
 
     WDFDEVICE device = AcxCircuitGetWdfDevice((ACXCIRCUIT)object);
     ASSERT(device != nullptr);
@@ -5936,7 +6987,7 @@ VOID EvtUSBAudioAcxDriverGetOutputLatency(
             (params.Parameters.Property.Control != nullptr) ||
             (params.Parameters.Property.ControlCb != 0) ||
             (params.Parameters.Property.Value == nullptr) ||
-            (params.Parameters.Property.ValueCb < sizeof(LONG))
+            (params.Parameters.Property.ValueCb < sizeof(UAC_SAFETY_OFFSET_CONTEXT))
         ),
         ASSERT(FALSE);
         outDataCb = 0;
@@ -5944,13 +6995,25 @@ VOID EvtUSBAudioAcxDriverGetOutputLatency(
                                           Exit
     );
 
-    LONG * outputLatency = static_cast<LONG *>(params.Parameters.Property.Value);
-    outDataCb = sizeof(LONG);
-    *outputLatency = deviceContext->Params.SuggestedBufferPeriod + deviceContext->AudioProperty.OutputLatencyOffset;
+    {
+        PUAC_SAFETY_OFFSET_CONTEXT safetyOffset = static_cast<PUAC_SAFETY_OFFSET_CONTEXT>(params.Parameters.Property.Value);
+        if (deviceContext->StreamObject != nullptr)
+        {
+            deviceContext->StreamObject->GetSafetyOffsetContext(safetyOffset);
+        }
+        else
+        {
+            // Without a stream, report the offset the next stream starts with.
+            RtlZeroMemory(safetyOffset, sizeof(UAC_SAFETY_OFFSET_CONTEXT));
+            safetyOffset->QuietPeriodSeconds = deviceContext->AdaptiveSafetyOffset;
+            safetyOffset->ConfiguredOffsetFrame = deviceContext->UsbLatency.OutputOffsetFrame;
+            safetyOffset->MinimumOffsetFrame = deviceContext->UsbLatency.OutputMinOffsetFrame;
+            safetyOffset->CurrentOffsetFrame = deviceContext->UsbLatency.OutputOffsetFrame;
+        }
+    }
+    outDataCb = sizeof(UAC_SAFETY_OFFSET_CONTEXT);
     status = STATUS_SUCCESS;
 
-    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "OutputLatency = %d", *outputLatency);
-
 Exit:
 
     WdfWaitLockRelease(deviceContext->StreamWaitLock);
@@ -5962,7 +7025,7 @@ Exit:
 
 PAGED_CODE_SEG
 _Use_decl_annotations_
-VOID EvtUSBAudioAcxDriverSetAsioDevice(
+VOID EvtUSBAudioAcxDriverGetBufferPeriodSwitch(
     WDFOBJECT  object,
     WDFREQUEST request
 )
@@ -5971,6 +7034,9 @@ VOID EvtUSBAudioAcxDriverSetAsioDevice(
 
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Entry");
 
+    NTSTATUS  status = STATUS_NOT_SUPPORTED;
+    ULONG_PTR outDataCb = 0;
+
     ACX_REQUEST_PARAMETERS params{};
     ACX_REQUEST_PARAMETERS_INIT(&params);
     AcxRequestGetParameters(request, &params);
@@ -5980,7 +7046,7 @@ VOID EvtUSBAudioAcxDriverSetAsioDevice(
     ASSERT(params.Parameters.Property.Control == nullptr);
     ASSERT(params.Parameters.Property.ControlCb == 0);
     ASSERT(params.Parameters.Property.Value != nullptr);
-    ASSERT(0 < params.Parameters.Property.ValueCb);
+    ASSERT(params.Parameters.Property.ValueCb == sizeof(UAC_BUFFER_PERIOD_SWITCH_CONTEXT));
 
     WDFDEVICE device = AcxCircuitGetWdfDevice((ACXCIRCUIT)object);
     ASSERT(device != nullptr);
@@ -5990,23 +7056,23 @@ VOID EvtUSBAudioAcxDriverSetAsioDevice(
 
     WdfWaitLockAcquire(deviceContext->StreamWaitLock, nullptr);
 
-    NTSTATUS status = STATUS_NOT_SUPPORTED;
-
     IF_TRUE_ACTION_JUMP(
         (
             (params.Parameters.Property.Control != nullptr) ||
             (params.Parameters.Property.ControlCb != 0) ||
             (params.Parameters.Property.Value == nullptr) ||
-            (params.Parameters.Property.ValueCb == 0)
+            (params.Parameters.Property.ValueCb < sizeof(UAC_BUFFER_PERIOD_SWITCH_CONTEXT))
         ),
         ASSERT(FALSE);
+        outDataCb = 0;
         status = STATUS_INVALID_PARAMETER;,
                                           Exit
     );
 
-    UNICODE_STRING asioDevice;
-    RtlInitUnicodeString(&asioDevice, (PCWSTR)params.Parameters.Property.Value);
-    status = SaveAsioDeviceToRegistry(&asioDevice);
+    // SetBufferPeriod writes the context under the same lock.
+    RtlCopyMemory(params.Parameters.Property.Value, &deviceContext->BufferPeriodSwitch, sizeof(UAC_BUFFER_PERIOD_SWITCH_CONTEXT));
+    outDataCb = sizeof(UAC_BUFFER_PERIOD_SWITCH_CONTEXT);
+    status = STATUS_SUCCESS;
 
 Exit:
 
@@ -6014,12 +7080,12 @@ Exit:
 
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit %!STATUS!", status);
 
-    WdfRequestCompleteWithInformation(request, status, 0);
+    WdfRequestCompleteWithInformation(request, status, outDataCb);
 }
 
 PAGED_CODE_SEG
 _Use_decl_annotations_
-VOID EvtUSBAudioAcxDriverGetAsioDevice(
+VOID EvtUSBAudioAcxDriverGetSampleRateSwitch(
     WDFOBJECT  object,
     WDFREQUEST request
 )
@@ -6028,6 +7094,7 @@ VOID EvtUSBAudioAcxDriverGetAsioDevice(
 
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Entry");
 
+    NTSTATUS  status = STATUS_NOT_SUPPORTED;
     ULONG_PTR outDataCb = 0;
 
     ACX_REQUEST_PARAMETERS params{};
@@ -6039,7 +7106,7 @@ VOID EvtUSBAudioAcxDriverGetAsioDevice(
     ASSERT(params.Parameters.Property.Control == nullptr);
     ASSERT(params.Parameters.Property.ControlCb == 0);
     ASSERT(params.Parameters.Property.Value != nullptr);
-    ASSERT(0 < params.Parameters.Property.ValueCb);
+    ASSERT(params.Parameters.Property.ValueCb == sizeof(UAC_SAMPLE_RATE_SWITCH_CONTEXT));
 
     WDFDEVICE device = AcxCircuitGetWdfDevice((ACXCIRCUIT)object);
     ASSERT(device != nullptr);
@@ -6049,46 +7116,35 @@ VOID EvtUSBAudioAcxDriverGetAsioDevice(
 
     WdfWaitLockAcquire(deviceContext->StreamWaitLock, nullptr);
 
-    NTSTATUS status = STATUS_NOT_SUPPORTED;
-
     IF_TRUE_ACTION_JUMP(
         (
             (params.Parameters.Property.Control != nullptr) ||
             (params.Parameters.Property.ControlCb != 0) ||
             (params.Parameters.Property.Value == nullptr) ||
-            (params.Parameters.Property.ValueCb == 0)
+            (params.Parameters.Property.ValueCb < sizeof(UAC_SAMPLE_RATE_SWITCH_CONTEXT))
         ),
         ASSERT(FALSE);
+        outDataCb = 0;
         status = STATUS_INVALID_PARAMETER;,
                                           Exit
     );
 
-    UNICODE_STRING asioDevice;
-    status = LoadAsioDeviceFromRegistry(&asioDevice);
-
-    IF_TRUE_ACTION_JUMP(
-        !NT_SUCCESS(status),
-        ASSERT(FALSE),
-        Exit
-    );
-
-    IF_TRUE_ACTION_JUMP(
-        params.Parameters.Property.ValueCb < asioDevice.MaximumLength,
-        status = STATUS_BUFFER_TOO_SMALL,
-        Exit
-    );
-
-    RtlZeroMemory(params.Parameters.Property.Value, params.Parameters.Property.ValueCb);
-
-    RtlCopyMemory(params.Parameters.Property.Value, asioDevice.Buffer, asioDevice.MaximumLength);
+    {
+        PUAC_SAMPLE_RATE_SWITCH_CONTEXT sampleRateSwitch = static_cast<PUAC_SAMPLE_RATE_SWITCH_CONTEXT>(params.Parameters.Property.Value);
 
-    outDataCb = asioDevice.MaximumLength;
+        // The first completions are written by the running stream, so they are read atomically.
+        RtlCopyMemory(sampleRateSwitch, &deviceContext->SampleRateSwitch, sizeof(UAC_SAMPLE_RATE_SWITCH_CONTEXT));
+        sampleRateSwitch->FirstInputQpc = InterlockedCompareExchange64(&deviceContext->SampleRateSwitch.FirstInputQpc, 0, 0);
+        sampleRateSwitch->FirstAudibleOutputQpc = InterlockedCompareExchange64(&deviceContext->SampleRateSwitch.FirstAudibleOutputQpc, 0, 0);
+    }
+    outDataCb = sizeof(UAC_SAMPLE_RATE_SWITCH_CONTEXT);
+    status = STATUS_SUCCESS;
 
 Exit:
 
     WdfWaitLockRelease(deviceContext->StreamWaitLock);
 
-    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit %!STATUS! outDataCb = %llu", status, outDataCb);
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit %!STATUS!", status);
 
     WdfRequestCompleteWithInformation(request, status, outDataCb);
 }
@@ -6290,7 +7346,8 @@ USBAudioAcxDriverEvtIsoRequestCompletionRoutine_Exit:
 PAGED_CODE_SEG
 static _Use_decl_annotations_
 NTSTATUS StartIsoStream(
-    PDEVICE_CONTEXT deviceContext
+    PDEVICE_CONTEXT             deviceContext,
+    RETAINED_TRANSFER_OBJECTS * retainedTransferObjects /* = nullptr */
 )
 {
     NTSTATUS status = STATUS_SUCCESS;
@@ -6328,6 +7385,9 @@ NTSTATUS StartIsoStream(
     RETURN_NTSTATUS_IF_TRUE_ACTION(deviceContext->StreamObject != nullptr, status = STATUS_DEVICE_BUSY, status);
     InterlockedExchange(&deviceContext->StartCounterIsoStream, 0);
 
+    deviceContext->StreamStartRequestUs = USBAudioAcxDriverStreamGetCurrentTimeUs(deviceContext, nullptr);
+    InterlockedExchange(&deviceContext->LastTimeToFirstAudioUs, 0);
+
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_MULTICLIENT, " - start counter asio %ld, start counter acx audio %ld, start counter iso stream %ld", deviceContext->StartCounterAsio, deviceContext->StartCounterWdmAudio, deviceContext->StartCounterIsoStream);
     status = SetPipeInformation(deviceContext);
     RETURN_NTSTATUS_IF_FAILED_MSG(status, "SetPipeInformation failed");
@@ -6409,6 +7469,13 @@ NTSTATUS StartIsoStream(
     deviceContext->InputProperty.MeasuredSampleRate = deviceContext->AudioProperty.SampleRate;
     deviceContext->OutputProperty.MeasuredSampleRate = deviceContext->AudioProperty.SampleRate;
 
+    // The device sample rate may have changed since the RtPackets were set. The resamplers are rebuilt before the mixing engine thread exists.
+    if (deviceContext->RtPacketObject != nullptr)
+    {
+        deviceContext->RtPacketObject->PrepareResamplers(true);
+        deviceContext->RtPacketObject->PrepareResamplers(false);
+    }
+
     status = deviceContext->StreamObject->CreateMixingEngineThread(HIGH_PRIORITY, 100);
     RETURN_NTSTATUS_IF_FAILED(status);
 
@@ -6423,6 +7490,30 @@ NTSTATUS StartIsoStream(
     deviceContext->StreamObject->ResetIsoRequestCompletionTime();
     deviceContext->StreamObject->SaveStartPCUs();
 
+    if (deviceContext->IsSampleRateSwitching)
+    {
+        deviceContext->SampleRateSwitch.StreamStartQpc = KeQueryPerformanceCounter(nullptr).QuadPart;
+        deviceContext->StreamObject->SetSampleRateSwitchContext(&deviceContext->SampleRateSwitch);
+    }
+
+    if (retainedTransferObjects != nullptr)
+    {
+        // The transfer objects kept from the previous stream are taken over, so StartTransfer only resets them.
+        for (ULONG direction = 0; direction < toULONG(IsoDirection::NumOfIsoDirection); ++direction)
+        {
+            for (ULONG index = 0; index < UAC_MAX_IRP_NUMBER; ++index)
+            {
+                TransferObject * transferObject = (*retainedTransferObjects)[direction][index];
+                if (transferObject != nullptr)
+                {
+                    transferObject->SetStreamObject(deviceContext->StreamObject);
+                    deviceContext->StreamObject->SetTransferObject(index, static_cast<IsoDirection>(direction), transferObject);
+                    (*retainedTransferObjects)[direction][index] = nullptr;
+                }
+            }
+        }
+    }
+
     for (ULONG i = 0; i < deviceContext->Params.MaxIrpNumber; i++)
     {
         if (deviceContext->FeedbackInterfaceAndPipe.Pipe != nullptr)
@@ -6464,24 +7555,19 @@ NTSTATUS FreeTransferObject(
 
 PAGED_CODE_SEG
 static _Use_decl_annotations_
-NTSTATUS StartTransfer(
+void GetTransferParameters(
     PDEVICE_CONTEXT deviceContext,
-    StreamObject *  streamObject,
-    ULONG           index,
-    IsoDirection    direction
+    IsoDirection    direction,
+    ULONG &         numIsoPackets,
+    ULONG &         isoPacketSize,
+    ULONG &         maxXferSize
 )
 {
-    NTSTATUS status = STATUS_SUCCESS;
-    ULONG    maxXferSize = 0;
-    ULONG    isoPacketSize = 0;
-    ULONG    numIsoPackets = 0;
-
     PAGED_CODE();
-    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Entry");
 
-    IF_TRUE_ACTION_JUMP(streamObject == nullptr, status = STATUS_INVALID_PARAMETER, StartTransfer_Exit);
-    IF_TRUE_ACTION_JUMP(deviceContext->ContiguousMemory == nullptr, status = STATUS_INVALID_PARAMETER, StartTransfer_Exit);
-    IF_TRUE_ACTION_JUMP(!deviceContext->ContiguousMemory->IsValid(index, direction), status = STATUS_INVALID_PARAMETER, StartTransfer_Exit);
+    numIsoPackets = 0;
+    isoPacketSize = 0;
+    maxXferSize = 0;
 
     switch (direction)
     {
@@ -6513,6 +7599,30 @@ NTSTATUS StartTransfer(
         ASSERT(false);
         break;
     }
+}
+
+PAGED_CODE_SEG
+static _Use_decl_annotations_
+NTSTATUS StartTransfer(
+    PDEVICE_CONTEXT deviceContext,
+    StreamObject *  streamObject,
+    ULONG           index,
+    IsoDirection    direction
+)
+{
+    NTSTATUS status = STATUS_SUCCESS;
+    ULONG    maxXferSize = 0;
+    ULONG    isoPacketSize = 0;
+    ULONG    numIsoPackets = 0;
+
+    PAGED_CODE();
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Entry");
+
+    IF_TRUE_ACTION_JUMP(streamObject == nullptr, status = STATUS_INVALID_PARAMETER, StartTransfer_Exit);
+    IF_TRUE_ACTION_JUMP(deviceContext->ContiguousMemory == nullptr, status = STATUS_INVALID_PARAMETER, StartTransfer_Exit);
+    IF_TRUE_ACTION_JUMP(!deviceContext->ContiguousMemory->IsValid(index, direction), status = STATUS_INVALID_PARAMETER, StartTransfer_Exit);
+
+    GetTransferParameters(deviceContext, direction, numIsoPackets, isoPacketSize, maxXferSize);
 
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "num packets = %u, Classic frames per irp = %u, frames per ms = %u", numIsoPackets, deviceContext->ClassicFramesPerIrp, deviceContext->FramesPerMs);
 
@@ -6783,7 +7893,7 @@ NTSTATUS ProcessTransferIn(
 NONPAGED_CODE_SEG
 static _Use_decl_annotations_
 NTSTATUS ProcessTransferOut(
-    PDEVICE_CONTEXT /* deviceContext */,
+    PDEVICE_CONTEXT  deviceContext,
     StreamObject *   streamObject,
     TransferObject * transferObject
 )
@@ -6827,7 +7937,15 @@ NTSTATUS ProcessTransferOut(
 
     if (NT_SUCCESS(status))
     {
-        streamObject->WakeupMixingEngineThread();
+        // OUT packets are processed in step with the IN packets, so with an IN pipe the OUT completion brings no work of its own.
+        if (deviceContext->UsbAudioConfiguration->HasInputIsochronousInterface())
+        {
+            streamObject->SkipWakeupMixingEngineThread();
+        }
+        else
+        {
+            streamObject->WakeupMixingEngineThread();
+        }
     }
 
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit %!STATUS!", status);
@@ -6884,7 +8002,9 @@ NTSTATUS ProcessTransferFeedback(
 PAGED_CODE_SEG
 static _Use_decl_annotations_
 NTSTATUS StopIsoStream(
-    PDEVICE_CONTEXT deviceContext
+    PDEVICE_CONTEXT             deviceContext,
+    bool                        keepAlternateSettings /* = false */,
+    RETAINED_TRANSFER_OBJECTS * retainedTransferObjects /* = nullptr */
 )
 {
     NTSTATUS status = STATUS_SUCCESS;
@@ -6902,14 +8022,26 @@ NTSTATUS StopIsoStream(
         AbortPipes(IsoDirection::Feedback, deviceContext->Device);
 
         deviceContext->StreamObject->TerminateMixingEngineThread();
+        if (retainedTransferObjects != nullptr)
+        {
+            // The cancelled transfer objects are handed to the caller instead of being deleted with the stream object.
+            for (ULONG direction = 0; direction < toULONG(IsoDirection::NumOfIsoDirection); ++direction)
+            {
+                for (ULONG index = 0; index < UAC_MAX_IRP_NUMBER; ++index)
+                {
+                    (*retainedTransferObjects)[direction][index] = deviceContext->StreamObject->GetTransferObject(index, static_cast<IsoDirection>(direction));
+                    deviceContext->StreamObject->SetTransferObject(index, static_cast<IsoDirection>(direction), nullptr);
+                }
+            }
+        }
         deviceContext->StreamObject->Cleanup();
         delete deviceContext->StreamObject;
         deviceContext->StreamObject = nullptr;
-        if (deviceContext->OutputProperty.InterfaceNumber != 0)
+        if (!keepAlternateSettings && (deviceContext->OutputProperty.InterfaceNumber != 0))
         {
             SelectAlternateInterface(IsoDirection::Out, deviceContext, deviceContext->OutputProperty.InterfaceNumber, 0);
         }
-        if (deviceContext->InputProperty.InterfaceNumber != 0)
+        if (!keepAlternateSettings && (deviceContext->InputProperty.InterfaceNumber != 0))
         {
             SelectAlternateInterface(IsoDirection::In, deviceContext, deviceContext->InputProperty.InterfaceNumber, 0);
         }
@@ -6932,6 +8064,106 @@ NTSTATUS StopIsoStream(
     return status;
 }
 
+PAGED_CODE_SEG
+static _Use_decl_annotations_
+NTSTATUS ReconfigureIsoStream(
+    PDEVICE_CONTEXT deviceContext
+)
+{
+    NTSTATUS status = STATUS_SUCCESS;
+    PAGED_CODE();
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Entry");
+
+    // The sample rate, the format and therefore the alternate settings and the pipes stay as they are.
+    // Only the URBs are drained and the stream object is rebuilt for the new frames per IRP.
+    // The transfer objects whose packet count does not change keep their MDL and are handed over to the new stream object.
+    // The contiguous memory is allocated for UAC_MAX_CLASSIC_FRAMES_PER_IRP and UAC_MAX_IRP_NUMBER, so it is reused.
+    RETURN_NTSTATUS_IF_TRUE_ACTION(deviceContext->StreamObject == nullptr, status = STATUS_INVALID_DEVICE_STATE, status);
+    RETURN_NTSTATUS_IF_TRUE_ACTION(deviceContext->UsbAudioConfiguration == nullptr, status = STATUS_INVALID_DEVICE_STATE, status);
+
+    RETAINED_TRANSFER_OBJECTS retainedTransferObjects{};
+    ULONG                     reusedTransferObjects = 0;
+    ULONG                     rebuiltTransferObjects = 0;
+
+    auto reconfigureIsoStreamScope = wil::scope_exit([&]() {
+        // Transfer objects that the new stream object did not take over are released here.
+        for (ULONG direction = 0; direction < toULONG(IsoDirection::NumOfIsoDirection); ++direction)
+        {
+            for (ULONG index = 0; index < UAC_MAX_IRP_NUMBER; ++index)
+            {
+                if (retainedTransferObjects[direction][index] != nullptr)
+                {
+                    delete retainedTransferObjects[direction][index];
+                    retainedTransferObjects[direction][index] = nullptr;
+                }
+            }
+        }
+    });
+
+    ULONGLONG drainTimeUs = USBAudioAcxDriverStreamGetCurrentTimeUs(deviceContext, nullptr);
+    ULONG     drainFrame = GetCurrentFrame(deviceContext);
+
+    status = StopIsoStream(deviceContext, true, &retainedTransferObjects);
+    RETURN_NTSTATUS_IF_FAILED_MSG(status, "StopIsoStream failed");
+
+    deviceContext->UsbAudioConfiguration->SelectClassicFramesPerIrp();
+    UpdateUsbLatency(deviceContext);
+
+    for (ULONG direction = 0; direction < toULONG(IsoDirection::NumOfIsoDirection); ++direction)
+    {
+        for (ULONG index = 0; index < UAC_MAX_IRP_NUMBER; ++index)
+        {
+            TransferObject * transferObject = retainedTransferObjects[direction][index];
+            if (transferObject == nullptr)
+            {
+                continue;
+            }
+
+            ULONG numIsoPackets = 0;
+            ULONG isoPacketSize = 0;
+            ULONG maxXferSize = 0;
+            GetTransferParameters(deviceContext, static_cast<IsoDirection>(direction), numIsoPackets, isoPacketSize, maxXferSize);
+
+            if ((index < deviceContext->Params.MaxIrpNumber) && (transferObject->GetNumPackets() == numIsoPackets))
+            {
+                // The cancelled request and its URB belong to the previous stream; the next submission creates them again.
+                transferObject->FreeUrb();
+                transferObject->FreeRequest();
+                reusedTransferObjects++;
+            }
+            else
+            {
+                delete transferObject;
+                retainedTransferObjects[direction][index] = nullptr;
+                if (index < deviceContext->Params.MaxIrpNumber)
+                {
+                    rebuiltTransferObjects++;
+                }
+            }
+        }
+    }
+
+    status = StartIsoStream(deviceContext, &retainedTransferObjects);
+    RETURN_NTSTATUS_IF_FAILED_MSG(status, "StartIsoStream failed");
+
+    // The first URB is scheduled OutputFrameDelay frames after the restart, which bounds the gap on the bus.
+    PUAC_BUFFER_PERIOD_SWITCH_CONTEXT bufferPeriodSwitch = &deviceContext->BufferPeriodSwitch;
+    bufferPeriodSwitch->ClassicFramesPerIrp = deviceContext->ClassicFramesPerIrp;
+    bufferPeriodSwitch->GapUs = (ULONG)(USBAudioAcxDriverStreamGetCurrentTimeUs(deviceContext, nullptr) - drainTimeUs);
+    bufferPeriodSwitch->GapFrames = GetCurrentFrame(deviceContext) - drainFrame;
+    if (deviceContext->Params.OutputFrameDelay > 0)
+    {
+        bufferPeriodSwitch->GapFrames += (ULONG)deviceContext->Params.OutputFrameDelay;
+    }
+    bufferPeriodSwitch->ReusedTransferObjects = reusedTransferObjects;
+    bufferPeriodSwitch->RebuiltTransferObjects = rebuiltTransferObjects;
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, " - reconfiguration gap %u us, %u frames, classic frames per irp %u, max irp number %u, reused %u, rebuilt %u", bufferPeriodSwitch->GapUs, bufferPeriodSwitch->GapFrames, deviceContext->ClassicFramesPerIrp, deviceContext->Params.MaxIrpNumber, reusedTransferObjects, rebuiltTransferObjects);
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit %!STATUS!", status);
+    return status;
+}
+
 PAGED_CODE_SEG
 static _Use_decl_annotations_
 NTSTATUS NotifyDataFormatChange(
@@ -7076,12 +8308,7 @@ Return Value:
             StopIsoStream(deviceContext);
 
             WdfWaitLockAcquire(deviceContext->AsioWaitLock, nullptr);
-            if (deviceContext->AsioBufferObject != nullptr)
-            {
-                status = deviceContext->AsioBufferObject->UnsetBuffer();
-                delete deviceContext->AsioBufferObject;
-                deviceContext->AsioBufferObject = nullptr;
-            }
+            status = USBAudioAcxDriverDeleteAsioBufferObject(deviceContext);
             WdfWaitLockRelease(deviceContext->AsioWaitLock);
 
             TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, "clear asio owner");
@@ -31,6 +31,7 @@ Environment:
 
 #include "public.h"
 #include "UAC_User.h"
+#include "DriverSettings.h"
 
 #define UAC_MAX_IRP_NUMBER                  8
 #define UAC_MAX_FRAMES_PER_MS               8    // USBAudioAcxDriver original
@@ -38,6 +39,7 @@ Environment:
 #define UAC_DEFAULT_SUGGESTED_BUFFER_PERIOD UAC_DEFAULT_ASIO_BUFFER_SIZE
 #define UAC_DEFAULT_MAX_PACKET_SIZE         1024 // The minimum size is USB3 packet size * UAC_MAX_CLASSIC_FRAMES_PER_IRP * FramesPerMs.
 #define UAC_DEFAULT_LOCK_DELAY              10
+#define UAC_METERING_HOLD_US                1000000 // Metering stops when the meters have not been read for this long.
 
 class CStreamEngine;
 class ContiguousMemory;
@@ -48,6 +50,7 @@ class StreamObject;
 class TransferObject;
 class AsioBufferObject;
 class ErrorStatistics;
+class DescriptorCache;
 class USBAudioConfiguration;
 
 EXTERN_C_START
@@ -73,14 +76,6 @@ constexpr ULONG toULONG(IsoDirection direction)
     return static_cast<ULONG>(direction);
 }
 
-typedef struct UAC_LATENCY_OFFSET_LIST_
-{
-    ULONG InputBufferOperationOffset;
-    ULONG InputHubOffset;
-    ULONG OutputBufferOperationOffset;
-    ULONG OutputHubOffset;
-} UAC_LATENCY_OFFSET_LIST, *PUAC_LATENCY_OFFSET_LIST;
-
 typedef struct UAC_SUPPORTED_CONTROL_LIST_
 {
     USHORT VendorId;
@@ -120,19 +115,11 @@ typedef struct AC_CLOCK_SOURCE_INFO_
     UCHAR iClockSource;
 } AC_CLOCK_SOURCE_INFO, *PAC_CLOCK_SOURCE_INFO;
 
-typedef struct _UAC_DRIVER_PARAMETER
+typedef struct ACTIVE_STREAM_ENGINES_
 {
-    ULONG ClassicFramesPerIrp;
-    ULONG ClassicFramesPerIrp2;
-    ULONG OutputBufferOperationOffset;
-    ULONG InputBufferOperationOffset;
-} UAC_DRIVER_PARAMETER;
-
-typedef struct _UAC_DRIVER_FLAGS
-{
-    ULONG                PeriodFrames;
-    UAC_DRIVER_PARAMETER Parameter;
-} UAC_DRIVER_FLAGS;
+    LONG64 Capture[UAC_MAX_STREAM_DEVICES / 64]; // One bit per device index
+    LONG64 Render[UAC_MAX_STREAM_DEVICES / 64];
+} ACTIVE_STREAM_ENGINES, *PACTIVE_STREAM_ENGINES;
 
 //
 // The device context performs the same job as
@@ -181,7 +168,7 @@ typedef struct _DEVICE_CONTEXT
         ULONG          Format;
         ULONG          BytesPerSample;      // Bytes per sample
         ULONG          ValidBitsPerSample;  // Valid bits per sample
-        volatile ULONG MeasuredSampleRate;  // Measured input sampling rate (1-second average)
+        volatile ULONG MeasuredSampleRate;  // Measured sampling rate, averaged over about one second and updated every URB
         ULONG          PacketsPerSec;       // ISO (Micro) Frames per second
         ULONG          SamplesPerPacket;    // Number of samples per ISO Frame (truncated)
         ULONG          DeviceLatency;
@@ -228,10 +215,17 @@ typedef struct _DEVICE_CONTEXT
     UCHAR                              NumberOfConfiguredInterfaces;
     USBAudioConfiguration *            UsbAudioConfiguration;
     ContiguousMemory *                 ContiguousMemory;
+    PUCHAR                             OutputMixBus;     // Cached buffer in which one OUT packet is mixed, sized for the selected alternate setting
+    ULONG                              OutputMixBusSize;
+    PUCHAR                             InputStagingBuffer; // Cached copy of one IN packet, sized for the selected alternate setting
+    ULONG                              InputStagingBufferSize;
     RtPacketObject *                   RtPacketObject;
     WDFWAITLOCK                        StreamWaitLock;
     WDFWAITLOCK                        StreamEngineWaitLock;
+    ACTIVE_STREAM_ENGINES              ActiveStreamEngines;  // Stream engines in the Run state, written under StreamEngineWaitLock
+    LONG                               StreamEngineLockCount; // StreamEngineWaitLock acquisitions, reported with the wake-up statistics
     WDFWAITLOCK                        AsioWaitLock;
+    EX_RUNDOWN_REF                     AsioBufferRundown; // Held by the mixing engine thread and the DPCs while they use AsioBufferObject
     CStreamEngine **                   RenderStreamEngine;
     CStreamEngine **                   CaptureStreamEngine;
     ULONG                              NumOfInputDevices;
@@ -273,8 +267,20 @@ typedef struct _DEVICE_CONTEXT
     WDFFILEOBJECT                      ResetRequestOwner;
     UACSampleFormat                    SampleFormatBackup;
     ErrorStatistics *                  ErrorStatistics;
+    DescriptorCache *                  DescriptorCache;      // Control RANGE Parameter Blocks, saved in the device registry key
     UAC_USB_LATENCY                    UsbLatency;
     UACSampleFormat                    DesiredSampleFormat;
+    UAC_CHANNEL_ROUTING_CONTEXT        ChannelRouting;
+    bool                               IsChannelRoutingInitialized; // ChannelRouting is set to identity once, so that a user route survives PrepareHardware
+    UAC_METERS_CONTEXT                 Meters;               // Accumulated by the stream thread, read and cleared by GetMeters
+    ULONGLONG                          MeteringExpiryPCUs;   // Metering runs while the stream time is below this value
+    ULONG                              AdaptiveSafetyOffset; // Seconds without dropout per step of the output safety offset, 0 to keep it fixed
+    ULONG                              ParallelProcessing;   // UAC_PARALLEL_PROCESSING_*, whether the IN side may be processed on a worker thread
+    UAC_BUFFER_PERIOD_SWITCH_CONTEXT   BufferPeriodSwitch;           // Result of the last SetBufferPeriod, read by GetBufferPeriodSwitch
+    UAC_SAMPLE_RATE_SWITCH_CONTEXT     SampleRateSwitch;             // Phases of the last ChangeSampleRate, read by GetSampleRateSwitch
+    ULONGLONG                          StreamStartRequestUs;         // Time StartIsoStream was entered
+    LONG                               LastTimeToFirstAudioUs;       // From StreamStartRequestUs to the first audible OUT completion, or the first IN one without OUT
+    bool                               IsSampleRateSwitching;        // True while ChangeSampleRate runs, so that its phases are recorded
     UCHAR                              ClockSelectorId;
     ULONG                              AcClockSources;
     AC_CLOCK_SOURCE_INFO               AcClockSourceInfo[UAC_MAX_CLOCK_SOURCE];
@@ -557,6 +563,28 @@ USBAudioAcxDriverStreamGetPresentationPosition(
     _Out_ PULONGLONG     qpcPosition
 );
 
+__drv_maxIRQL(PASSIVE_LEVEL)
+PAGED_CODE_SEG
+void USBAudioAcxDriverStreamSetActive(
+    _In_ bool            isInput,
+    _In_ ULONG           deviceIndex,
+    _In_ PDEVICE_CONTEXT deviceContext,
+    _In_ bool            isActive
+);
+
+__drv_maxIRQL(PASSIVE_LEVEL)
+PAGED_CODE_SEG
+bool USBAudioAcxDriverStreamLockActiveEngines(
+    _In_ PDEVICE_CONTEXT          deviceContext,
+    _Out_ ACTIVE_STREAM_ENGINES & activeStreamEngines
+);
+
+__drv_maxIRQL(PASSIVE_LEVEL)
+PAGED_CODE_SEG
+void USBAudioAcxDriverStreamUnlockActiveEngines(
+    _In_ PDEVICE_CONTEXT deviceContext
+);
+
 __drv_maxIRQL(PASSIVE_LEVEL)
 PAGED_CODE_SEG
 NTSTATUS USBAudioAcxDriverGetCurrentDataFormat(
@@ -571,6 +599,24 @@ bool USBAudioAcxDriverHasAsioOwnership(
     _In_ PDEVICE_CONTEXT deviceContext
 );
 
+__drv_maxIRQL(DISPATCH_LEVEL)
+NONPAGED_CODE_SEG
+AsioBufferObject * USBAudioAcxDriverAcquireAsioBufferObject(
+    _In_ PDEVICE_CONTEXT deviceContext
+);
+
+__drv_maxIRQL(DISPATCH_LEVEL)
+NONPAGED_CODE_SEG
+void USBAudioAcxDriverReleaseAsioBufferObject(
+    _In_ PDEVICE_CONTEXT deviceContext
+);
+
+__drv_maxIRQL(PASSIVE_LEVEL)
+PAGED_CODE_SEG
+NTSTATUS USBAudioAcxDriverDeleteAsioBufferObject(
+    _In_ PDEVICE_CONTEXT deviceContext
+);
+
 __drv_maxIRQL(PASSIVE_LEVEL)
 PAGED_CODE_SEG
 VOID EvtUSBAudioAcxDriverGetAudioProperty(
@@ -704,6 +750,48 @@ VOID EvtUSBAudioAcxDriverGetAsioDevice(
     _In_ WDFREQUEST request
 );
 
+__drv_maxIRQL(PASSIVE_LEVEL)
+PAGED_CODE_SEG
+VOID EvtUSBAudioAcxDriverSetChannelRouting(
+    _In_ WDFOBJECT  object,
+    _In_ WDFREQUEST request
+);
+
+__drv_maxIRQL(PASSIVE_LEVEL)
+PAGED_CODE_SEG
+VOID EvtUSBAudioAcxDriverGetChannelRouting(
+    _In_ WDFOBJECT  object,
+    _In_ WDFREQUEST request
+);
+
+__drv_maxIRQL(PASSIVE_LEVEL)
+PAGED_CODE_SEG
+VOID EvtUSBAudioAcxDriverGetMeters(
+    _In_ WDFOBJECT  object,
+    _In_ WDFREQUEST request
+);
+
+__drv_maxIRQL(PASSIVE_LEVEL)
+PAGED_CODE_SEG
+VOID EvtUSBAudioAcxDriverGetSafetyOffset(
+    _In_ WDFOBJECT  object,
+    _In_ WDFREQUEST request
+);
+
+__drv_maxIRQL(PASSIVE_LEVEL)
+PAGED_CODE_SEG
+VOID EvtUSBAudioAcxDriverGetBufferPeriodSwitch(
+    _In_ WDFOBJECT  object,
+    _In_ WDFREQUEST request
+);
+
+__drv_maxIRQL(PASSIVE_LEVEL)
+PAGED_CODE_SEG
+VOID EvtUSBAudioAcxDriverGetSampleRateSwitch(
+    _In_ WDFOBJECT  object,
+    _In_ WDFREQUEST request
+);
+
 __drv_maxIRQL(DISPATCH_LEVEL)
 NONPAGED_CODE_SEG
 EVT_WDF_REQUEST_COMPLETION_ROUTINE USBAudioAcxDriverEvtIsoRequestCompletionRoutine;
@@ -32,6 +32,7 @@ Environment:
 #include "USBAudio.h"
 #include "USBAudioConfiguration.h"
 #include "ErrorStatistics.h"
+#include "DescriptorCache.h"
 
 #ifndef __INTELLISENSE__
 #include "DeviceControl.tmh"
@@ -644,6 +645,54 @@ Return Value:
     return status;
 }
 
+//
+// The ranges are fixed by the firmware, so a parameter block that was saved
+// for the same device and configuration descriptor is returned without
+// issuing the two RANGE requests.
+//
+__drv_maxIRQL(PASSIVE_LEVEL)
+PAGED_CODE_SEG
+static _Success_(return)
+bool GetRangeFromCache(
+    _In_ WDFOBJECT       parentObject,
+    _In_ PDEVICE_CONTEXT deviceContext,
+    _In_ UCHAR           interfaceNumber,
+    _In_ UCHAR           entityID,
+    _In_ UCHAR           controlSelector,
+    _In_ UCHAR           channelNumber,
+    _Out_ WDFMEMORY &    memory,
+    _Out_ PVOID &        parameterBlock
+)
+{
+    const UCHAR *         cachedBlock = nullptr;
+    USHORT                length = 0;
+    WDF_OBJECT_ATTRIBUTES attributes;
+
+    PAGED_CODE();
+
+    memory = nullptr;
+    parameterBlock = nullptr;
+
+    if ((deviceContext->DescriptorCache == nullptr) ||
+        !deviceContext->DescriptorCache->FindRange(interfaceNumber, entityID, controlSelector, channelNumber, cachedBlock, length))
+    {
+        return false;
+    }
+
+    WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+    attributes.ParentObject = parentObject;
+    if (!NT_SUCCESS(WdfMemoryCreate(&attributes, NonPagedPoolNx, DRIVER_TAG, length, &memory, &parameterBlock)))
+    {
+        memory = nullptr;
+        parameterBlock = nullptr;
+        return false;
+    }
+    RtlCopyMemory(parameterBlock, cachedBlock, length);
+
+    TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_CTRLREQUEST, "%!FUNC! interface %u, entity id 0x%02x, control selector 0x%02x, channel 0x%02x, %u bytes", interfaceNumber, entityID, controlSelector, channelNumber, length);
+    return true;
+}
+
 __drv_maxIRQL(PASSIVE_LEVEL)
 PAGED_CODE_SEG
 static _Success_(NT_SUCCESS(return))
@@ -655,10 +704,12 @@ NTSTATUS GetRangeWithAllocate(
     _In_ UCHAR           controlSelector,
     _In_ UCHAR           channelNumber,
     _Out_ WDFMEMORY &    memory,
-    _Out_ NS_USBAudio0200::PCONTROL_RANGE_PARAMETER_BLOCK_LAYOUT2 & parameterBlock
+    _Out_ NS_USBAudio0200::PCONTROL_RANGE_PARAMETER_BLOCK_LAYOUT2 & parameterBlock,
+    _In_ bool            useCache
 )
 {
     USHORT                length = 0;
+    PVOID                 cachedBlock = nullptr;
     WDF_OBJECT_ATTRIBUTES attributes;
 
     PAGED_CODE();
@@ -669,6 +720,12 @@ NTSTATUS GetRangeWithAllocate(
     memory = nullptr;
     parameterBlock = nullptr;
 
+    if (useCache && GetRangeFromCache(parentObject, deviceContext, interfaceNumber, entityID, controlSelector, channelNumber, memory, cachedBlock))
+    {
+        parameterBlock = (NS_USBAudio0200::PCONTROL_RANGE_PARAMETER_BLOCK_LAYOUT2)cachedBlock;
+        return STATUS_SUCCESS;
+    }
+
     NTSTATUS status = GetRangeParameterBlockLayout2(deviceContext, interfaceNumber, entityID, controlSelector, channelNumber, length, nullptr);
 
     if (status != STATUS_BUFFER_TOO_SMALL)
@@ -685,6 +742,10 @@ NTSTATUS GetRangeWithAllocate(
     RETURN_NTSTATUS_IF_FAILED(WdfMemoryCreate(&attributes, NonPagedPoolNx, DRIVER_TAG, length, &memory, (PVOID *)&parameterBlock));
 
     status = GetRangeParameterBlockLayout2(deviceContext, interfaceNumber, entityID, controlSelector, channelNumber, length, parameterBlock);
+    if (NT_SUCCESS(status) && useCache && (deviceContext->DescriptorCache != nullptr))
+    {
+        deviceContext->DescriptorCache->AddRange(interfaceNumber, entityID, controlSelector, channelNumber, (const UCHAR *)parameterBlock, length);
+    }
 
     TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_CTRLREQUEST, "%!FUNC! %!STATUS!", status);
     return status;
@@ -701,10 +762,12 @@ NTSTATUS GetRangeWithAllocate(
     _In_ UCHAR           controlSelector,
     _In_ UCHAR           channelNumber,
     _Out_ WDFMEMORY &    memory,
-    _Out_ NS_USBAudio0200::PCONTROL_RANGE_PARAMETER_BLOCK_LAYOUT3 & parameterBlock
+    _Out_ NS_USBAudio0200::PCONTROL_RANGE_PARAMETER_BLOCK_LAYOUT3 & parameterBlock,
+    _In_ bool            useCache
 )
 {
     USHORT                length = 0;
+    PVOID                 cachedBlock = nullptr;
     WDF_OBJECT_ATTRIBUTES attributes;
 
     PAGED_CODE();
@@ -715,6 +778,12 @@ NTSTATUS GetRangeWithAllocate(
     memory = nullptr;
     parameterBlock = nullptr;
 
+    if (useCache && GetRangeFromCache(parentObject, deviceContext, interfaceNumber, entityID, controlSelector, channelNumber, memory, cachedBlock))
+    {
+        parameterBlock = (NS_USBAudio0200::PCONTROL_RANGE_PARAMETER_BLOCK_LAYOUT3)cachedBlock;
+        return STATUS_SUCCESS;
+    }
+
     NTSTATUS status = GetRangeParameterBlockLayout3(deviceContext, interfaceNumber, entityID, controlSelector, channelNumber, length, nullptr);
 
     if (status != STATUS_BUFFER_TOO_SMALL)
@@ -731,6 +800,10 @@ NTSTATUS GetRangeWithAllocate(
     RETURN_NTSTATUS_IF_FAILED(WdfMemoryCreate(&attributes, NonPagedPoolNx, DRIVER_TAG, length, &memory, (PVOID *)&parameterBlock));
 
     status = GetRangeParameterBlockLayout3(deviceContext, interfaceNumber, entityID, controlSelector, channelNumber, length, parameterBlock);
+    if (NT_SUCCESS(status) && useCache && (deviceContext->DescriptorCache != nullptr))
+    {
+        deviceContext->DescriptorCache->AddRange(interfaceNumber, entityID, controlSelector, channelNumber, (const UCHAR *)parameterBlock, length);
+    }
 
     TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_CTRLREQUEST, "%!FUNC! %!STATUS!", status);
     return status;
@@ -797,7 +870,8 @@ NTSTATUS ControlRequestGetSampleFrequencyRange(
     UCHAR                                                     interfaceNumber,
     UCHAR                                                     entityID,
     WDFMEMORY &                                               memory,
-    NS_USBAudio0200::PCONTROL_RANGE_PARAMETER_BLOCK_LAYOUT3 & parameterBlock
+    NS_USBAudio0200::PCONTROL_RANGE_PARAMETER_BLOCK_LAYOUT3 & parameterBlock,
+    bool                                                      useCache
 )
 {
     PAGED_CODE();
@@ -813,7 +887,8 @@ NTSTATUS ControlRequestGetSampleFrequencyRange(
         NS_USBAudio0200::CS_SAM_FREQ_CONTROL,
         0,
         memory,
-        parameterBlock
+        parameterBlock,
+        useCache
     );
 
     TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_CTRLREQUEST, "%!FUNC! %!STATUS!", status);
@@ -1197,7 +1272,8 @@ NTSTATUS ControlRequestGetVolumeRange(
         NS_USBAudio0200::FU_VOLUME_CONTROL,
         channel,
         memory,
-        parameterBlock
+        parameterBlock,
+        true
     );
 
     TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_CTRLREQUEST, "%!FUNC! %!STATUS!", status);
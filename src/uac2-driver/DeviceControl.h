@@ -64,7 +64,8 @@ NTSTATUS ControlRequestGetSampleFrequencyRange(
     _In_ UCHAR           interfaceNumber,
     _In_ UCHAR           entityID,
     _Out_ WDFMEMORY &    memory,
-    _Out_ NS_USBAudio0200::PCONTROL_RANGE_PARAMETER_BLOCK_LAYOUT3 & parameterBlock
+    _Out_ NS_USBAudio0200::PCONTROL_RANGE_PARAMETER_BLOCK_LAYOUT3 & parameterBlock,
+    _In_ bool            useCache
 );
 
 __drv_maxIRQL(PASSIVE_LEVEL)
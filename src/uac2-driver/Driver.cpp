@@ -25,6 +25,8 @@ Environment:
 #include "Driver.h"
 #include "Public.h"
 #include "Device.h"
+#include "SampleConverter.h"
+#include "SampleRateConverter.h"
 #ifndef __INTELLISENSE__
 #include "Driver.tmh"
 #endif
@@ -114,6 +116,9 @@ Return Value:
 
     RETURN_NTSTATUS_IF_FAILED(CopyRegistrySettingsPath(registryPath));
 
+    SampleConverter::Initialize();
+    SampleRateConverter::Initialize();
+
     //
     // Register a cleanup callback so that we can call WPP_CLEANUP when
     // the framework driver object is deleted during driver unload.
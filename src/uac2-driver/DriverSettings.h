@@ -0,0 +1,52 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+// ASIO is a trademark and software of Steinberg Media Technologies GmbH
+
+/*++
+
+Module Name:
+
+    DriverSettings.h
+
+Abstract:
+
+    Define the types of the driver settings table, which selects the USB
+    transfer parameters for each ASIO buffer period, and of the latency
+    offset list.
+
+Environment:
+
+    Kernel-mode Driver Framework
+
+--*/
+
+#ifndef _DRIVER_SETTINGS_H_
+#define _DRIVER_SETTINGS_H_
+
+typedef struct UAC_LATENCY_OFFSET_LIST_
+{
+    ULONG InputBufferOperationOffset;
+    ULONG InputHubOffset;
+    ULONG OutputBufferOperationOffset;
+    ULONG OutputHubOffset;
+} UAC_LATENCY_OFFSET_LIST, *PUAC_LATENCY_OFFSET_LIST;
+
+typedef struct _UAC_DRIVER_PARAMETER
+{
+    ULONG ClassicFramesPerIrp;
+    ULONG ClassicFramesPerIrp2;
+    ULONG OutputBufferOperationOffset;
+    ULONG InputBufferOperationOffset;
+} UAC_DRIVER_PARAMETER;
+
+typedef struct _UAC_DRIVER_FLAGS
+{
+    ULONG                PeriodFrames;
+    UAC_DRIVER_PARAMETER Parameter;
+} UAC_DRIVER_FLAGS;
+
+#endif
@@ -0,0 +1,79 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+// ASIO is a trademark and software of Steinberg Media Technologies GmbH
+
+/*++
+
+Module Name:
+
+    DriverSettingsTable.h
+
+Abstract:
+
+    Define the driver settings table and the latency offset list. They are
+    only included by Device.cpp and by the host simulator in the test
+    directory, which replays the table rows against synthetic USB timing.
+
+Environment:
+
+    Kernel-mode Driver Framework
+
+--*/
+
+#ifndef _DRIVER_SETTINGS_TABLE_H_
+#define _DRIVER_SETTINGS_TABLE_H_
+
+#include "DriverSettings.h"
+
+//
+// Latency offsets are defined according to the device's connection status.
+//
+static const UAC_LATENCY_OFFSET_LIST g_LatencyOffsetList[] = {
+    {
+        0,
+        0,
+        3,
+        2,
+    }, // for USB 1.1 device
+    {
+        0,
+        0,
+        3,
+        0,
+    }, // for USB 2.0 device
+};
+
+//
+// Defines internal parameters corresponding to the specified ASIO Period Frames.
+// These parameters affect not only ASIO but also USB isochronous transfer settings,
+// and therefore influence the behavior of the ACX audio driver as well.
+//
+static const UAC_DRIVER_FLAGS g_DriverSettingsTable[] = {
+    {8192, {4, 4, 0xb0000008, 0x90000000}},
+    {4096, {4, 4, 0xb0000008, 0x90000000}},
+    {2048, {4, 4, 0xb0000008, 0x90000000}},
+    {1536, {4, 4, 0xb0000008, 0x90000000}},
+    {1024, {4, 4, 0xb0000008, 0x90000000}},
+    {768, {4, 4, 0xb0000008, 0x90000000}},
+    {512, {4, 4, 0xb0000007, 0x90000000}},
+    {384, {3, 3, 0xb0000006, 0x90000000}},
+    {256, {3, 3, 0xb0000005, 0x90000000}},
+    {192, {3, 3, 0xb0000004, 0x90000000}},
+    {128, {3, 3, 0xb0000004, 0x90000000}},
+    {96, {3, 2, 0xb0000003, 0x90000000}},
+    {64, {3, 2, 0xb0000003, 0x90000000}},
+    {48, {3, 1, 0xb0000002, 0x90000000}},
+    {32, {3, 1, 0xb0000002, 0x90000000}},
+    {24, {3, 1, 0xb0000002, 0x90000000}},
+    {16, {3, 1, 0xb0000002, 0x90000000}},
+    {12, {3, 1, 0xb0000002, 0x90000000}},
+    {8, {3, 1, 0xb0000002, 0x90000000}},
+    {4, {3, 1, 0xb0000002, 0x90000000}},
+    {0, {4, 4, 0xb0000007, 0x90000000}},
+};
+
+#endif
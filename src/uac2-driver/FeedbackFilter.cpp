@@ -0,0 +1,168 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+// ASIO is a trademark and software of Steinberg Media Technologies GmbH
+
+/*++
+
+Module Name:
+
+    FeedbackFilter.cpp
+
+Abstract:
+
+    Implement a class that filters the values of the explicit feedback
+    endpoint and converts them into the number of samples to send.
+
+Environment:
+
+    Kernel-mode Driver Framework
+
+--*/
+
+#ifdef UAC_HOST_BUILD
+#include "HostCompat.h"
+#else
+#include "Driver.h"
+#endif
+#include "FeedbackFilter.h"
+
+#if !defined(__INTELLISENSE__) && !defined(UAC_HOST_BUILD)
+#include "FeedbackFilter.tmh"
+#endif
+
+_Use_decl_annotations_
+NONPAGED_CODE_SEG
+void FeedbackFilter::Reset(
+    ULONG fractionBits,
+    ULONG valueShift,
+    ULONG nominalValue
+)
+{
+    m_fractionBits = fractionBits;
+    m_valueShift = valueShift;
+    m_nominalRate = (LONGLONG)nominalValue << FEEDBACK_FILTER_RATE_BITS;
+    m_rate = m_nominalRate;
+    m_rawPosition = 0LL;
+    m_filteredPosition = 0LL;
+    m_outlierRate = 0LL;
+    m_consecutiveOutliers = 0;
+    m_outlierCount = 0;
+    m_relockCount = 0;
+    m_isLocked = false;
+}
+
+_Use_decl_annotations_
+NONPAGED_CODE_SEG
+bool FeedbackFilter::Add(
+    ULONG value
+)
+{
+    LONGLONG rate = (LONGLONG)value << FEEDBACK_FILTER_RATE_BITS;
+    LONGLONG deviation = rate - m_rate;
+    LONGLONG maxDeviation = m_isLocked ? (m_rate >> FEEDBACK_FILTER_OUTLIER_SHIFT) : (m_nominalRate >> FEEDBACK_FILTER_NOMINAL_SHIFT);
+
+    if ((m_nominalRate != 0) && ((deviation > maxDeviation) || (deviation < -maxDeviation)))
+    {
+        ++m_outlierCount;
+        LONGLONG outlierDeviation = rate - m_outlierRate;
+        LONGLONG maxOutlierDeviation = m_outlierRate >> FEEDBACK_FILTER_OUTLIER_SHIFT;
+        if ((m_consecutiveOutliers != 0) && (outlierDeviation <= maxOutlierDeviation) && (outlierDeviation >= -maxOutlierDeviation))
+        {
+            ++m_consecutiveOutliers;
+        }
+        else
+        {
+            m_outlierRate = rate;
+            m_consecutiveOutliers = 1;
+        }
+        if ((rate == 0) || (m_consecutiveOutliers < FEEDBACK_FILTER_MAX_OUTLIERS))
+        {
+            // A stray value, such as a zero or a value of the previous sample rate, stands in for the smoothed rate.
+            m_rawPosition += m_rate << m_valueShift;
+            return false;
+        }
+
+        // The outliers agree with each other, so the device clock really is there: it has moved, or it never was
+        // close enough to the nominal rate to lock on the first value. The earlier ones are counted at the new rate too.
+        m_rawPosition += ((rate - m_rate) << m_valueShift) * (m_consecutiveOutliers - 1);
+        m_rate = rate;
+        m_consecutiveOutliers = 0;
+        if (m_isLocked)
+        {
+            ++m_relockCount;
+        }
+        m_isLocked = true;
+        m_rawPosition += rate << m_valueShift;
+        return true;
+    }
+    m_consecutiveOutliers = 0;
+
+    if (!m_isLocked)
+    {
+        m_rate = rate;
+        m_isLocked = true;
+    }
+    else
+    {
+        m_rate += deviation / (1LL << FEEDBACK_FILTER_RATE_SHIFT);
+    }
+    m_rawPosition += rate << m_valueShift;
+
+    return true;
+}
+
+_Use_decl_annotations_
+NONPAGED_CODE_SEG
+ULONG FeedbackFilter::GetSamples(
+    ULONG values
+)
+{
+    // The raw values are followed on average, so the samples sent do not drift from the device clock,
+    // while the smoothed rate keeps the quantization of the single values out of the packet sizes.
+    m_filteredPosition += (m_rate << m_valueShift) * values;
+    m_filteredPosition += (m_rawPosition - m_filteredPosition) / (1LL << FEEDBACK_FILTER_PHASE_SHIFT);
+    if (m_filteredPosition < 0)
+    {
+        m_filteredPosition = 0;
+    }
+
+    ULONG    sampleBits = m_fractionBits + FEEDBACK_FILTER_RATE_BITS;
+    LONGLONG samples = m_filteredPosition >> sampleBits;
+
+    m_filteredPosition -= samples << sampleBits;
+    m_rawPosition -= samples << sampleBits;
+
+    return (ULONG)samples;
+}
+
+_Use_decl_annotations_
+NONPAGED_CODE_SEG
+bool FeedbackFilter::IsLocked() const
+{
+    return m_isLocked;
+}
+
+_Use_decl_annotations_
+NONPAGED_CODE_SEG
+ULONG FeedbackFilter::GetRateMilliSamples() const
+{
+    return (ULONG)((m_rate * 1000) >> (m_fractionBits + FEEDBACK_FILTER_RATE_BITS));
+}
+
+_Use_decl_annotations_
+NONPAGED_CODE_SEG
+ULONG FeedbackFilter::GetOutlierCount() const
+{
+    return m_outlierCount;
+}
+
+_Use_decl_annotations_
+NONPAGED_CODE_SEG
+ULONG FeedbackFilter::GetRelockCount() const
+{
+    return m_relockCount;
+}
@@ -0,0 +1,120 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+// ASIO is a trademark and software of Steinberg Media Technologies GmbH
+
+/*++
+
+Module Name:
+
+    FeedbackFilter.h
+
+Abstract:
+
+    Define a class that filters the values of the explicit feedback endpoint
+    and converts them into the number of samples to send, carrying the
+    fraction of a sample from one URB to the next.
+
+Environment:
+
+    Kernel-mode Driver Framework
+
+--*/
+
+#ifndef _FEEDBACK_FILTER_H_
+#define _FEEDBACK_FILTER_H_
+
+#define FEEDBACK_FILTER_RATE_BITS         16 // Fractional bits kept below those of the feedback format
+#define FEEDBACK_FILTER_RATE_SHIFT        5  // Rate gain 1/32 per feedback value
+#define FEEDBACK_FILTER_PHASE_SHIFT       6  // Samples owed to the raw feedback are paid back by 1/64 per URB
+#define FEEDBACK_FILTER_OUTLIER_SHIFT     5  // Values more than 1/32 of the rate away from the rate are outliers
+#define FEEDBACK_FILTER_NOMINAL_SHIFT     3  // A value within 1/8 of the nominal rate locks the filter at once
+#define FEEDBACK_FILTER_MAX_OUTLIERS      8  // Consecutive outliers within 1/32 of each other after which the rate follows them
+
+//
+// The filter keeps a smoothed rate in samples per (micro)frame, and two
+// positions: the samples reported by the raw feedback values and the
+// samples already handed out. Each URB is sized from the smoothed rate plus
+// a small share of the difference between the positions, so the packet
+// sizes do not follow the quantization of every value while the total
+// still does not drift from the device clock. Both positions drop the
+// samples handed out, so they only hold the fraction and the difference.
+// It does not depend on the framework, so it can be driven with recorded
+// feedback values outside the driver.
+//
+class FeedbackFilter
+{
+  public:
+    //
+    // Forgets the rate. fractionBits is 16 for the 16.16 format and 14 for
+    // the 10.14 format, valueShift scales a value to the number of
+    // (micro)frames it stands for, and nominalValue is the nominal rate in
+    // the feedback format.
+    //
+    __drv_maxIRQL(DISPATCH_LEVEL)
+    NONPAGED_CODE_SEG
+    void Reset(
+        _In_ ULONG fractionBits,
+        _In_ ULONG valueShift,
+        _In_ ULONG nominalValue
+    );
+
+    //
+    // Feeds one feedback value. An outlier is replaced by the smoothed rate
+    // and false is returned, unless consistent outliers keep coming, in
+    // which case the rate is locked or relocked to them. This also locks a
+    // device whose rate is far from the nominal rate.
+    //
+    __drv_maxIRQL(DISPATCH_LEVEL)
+    NONPAGED_CODE_SEG
+    bool Add(
+        _In_ ULONG value
+    );
+
+    //
+    // Returns the number of samples for the next URB, which stands for the
+    // given number of feedback values.
+    //
+    __drv_maxIRQL(DISPATCH_LEVEL)
+    NONPAGED_CODE_SEG
+    ULONG GetSamples(
+        _In_ ULONG values
+    );
+
+    __drv_maxIRQL(DISPATCH_LEVEL)
+    NONPAGED_CODE_SEG
+    bool IsLocked() const;
+
+    //
+    // Returns the smoothed rate in millisamples per (micro)frame.
+    //
+    __drv_maxIRQL(DISPATCH_LEVEL)
+    NONPAGED_CODE_SEG
+    ULONG GetRateMilliSamples() const;
+
+    __drv_maxIRQL(DISPATCH_LEVEL)
+    NONPAGED_CODE_SEG
+    ULONG GetOutlierCount() const;
+
+    __drv_maxIRQL(DISPATCH_LEVEL)
+    NONPAGED_CODE_SEG
+    ULONG GetRelockCount() const;
+
+  private:
+    ULONG    m_fractionBits{16};
+    ULONG    m_valueShift{0};
+    LONGLONG m_nominalRate{0LL};      // Feedback format plus FEEDBACK_FILTER_RATE_BITS fixed point
+    LONGLONG m_rate{0LL};             // Feedback format plus FEEDBACK_FILTER_RATE_BITS fixed point
+    LONGLONG m_rawPosition{0LL};      // Same fixed point, samples of the values less the samples handed out
+    LONGLONG m_filteredPosition{0LL}; // Same fixed point, fraction of a sample not handed out yet
+    LONGLONG m_outlierRate{0LL};      // Same fixed point, first of the consecutive outliers
+    ULONG    m_consecutiveOutliers{0};
+    ULONG    m_outlierCount{0};
+    ULONG    m_relockCount{0};
+    bool     m_isLocked{false};
+};
+
+#endif
@@ -27,6 +27,7 @@ Environment:
 #include "Public.h"
 #include "Common.h"
 #include "MixingEngineThread.h"
+#include "StreamTiming.h"
 
 #ifndef __INTELLISENSE__
 #include "MixingEngineThread.tmh"
@@ -56,6 +57,11 @@ MixingEngineThread::MixingEngineThread(
     PAGED_CODE();
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Entry");
 
+    if (deviceContext->FramesPerMs != 0)
+    {
+        m_busIntervalUs = 1000 / (LONG)deviceContext->FramesPerMs;
+    }
+
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit");
 }
 
@@ -124,6 +130,7 @@ void MixingEngineThread::ThreadMain()
 
     PEX_TIMER exTimer = ExAllocateTimer(nullptr, nullptr, EX_TIMER_HIGH_RESOLUTION);
     m_waitEvents[toInt(MixingEngineWaitEventsNumber::TimerEvent)] = exTimer;
+    m_timer = exTimer;
     m_waitEventsCount = toInt(MixingEngineWaitEventsNumber::NumOfWaitEventsWithoutOutputReady);
 
 #if 0
@@ -161,6 +168,7 @@ void MixingEngineThread::ThreadMain()
     deleteParameters.DeleteCallback = nullptr;
     deleteParameters.DeleteContext = nullptr;
 
+    m_timer = nullptr;
     ExDeleteTimer(exTimer, FALSE, FALSE, &deleteParameters);
 
 ThreadMain_Exit:
@@ -200,3 +208,30 @@ NTSTATUS MixingEngineThread::Wait()
 
     return wakeUpReason;
 }
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+void MixingEngineThread::ScheduleWakeUp(
+    LONG intervalUs
+)
+{
+    PAGED_CODE();
+
+    // Only the mixing engine thread itself re-arms the timer, while it is between ThreadMain's ExSetTimer and ExDeleteTimer.
+    if (m_timer == nullptr)
+    {
+        return;
+    }
+
+    intervalUs = StreamTiming::ClampWakeUpIntervalUs(intervalUs, m_wakeUpIntervalUs, m_busIntervalUs);
+
+    LONGLONG duetime = 0ll - (LONGLONG)intervalUs * 10LL;
+    LONGLONG period = (LONGLONG)m_busIntervalUs * 10LL;
+
+    EXT_SET_PARAMETERS setParameters;
+
+    ExInitializeSetTimerParameters(&setParameters);
+    setParameters.NoWakeTolerance = 10LL * 10LL;
+
+    ExSetTimer(m_timer, duetime, period, &setParameters);
+}
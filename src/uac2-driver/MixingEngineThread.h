@@ -73,6 +73,18 @@ class MixingEngineThread : public WorkerThread
     PAGED_CODE_SEG
     NTSTATUS Wait();
 
+    //
+    // Re-arms the timer to expire once after intervalUs, clamped between the
+    // wake-up interval given to CreateThread and one bus interval, which is a
+    // frame at full speed and a microframe at high speed. The timer keeps a
+    // period of one bus interval as a backstop until it is re-armed.
+    //
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    void ScheduleWakeUp(
+        _In_ LONG intervalUs
+    );
+
     static __drv_maxIRQL(PASSIVE_LEVEL)
     PAGED_CODE_SEG
     MixingEngineThread * CreateMixingEngineThread(
@@ -90,6 +102,8 @@ class MixingEngineThread : public WorkerThread
     const ULONG m_newTimerResolution;
     ULONG       m_currentTimerResolution{0};
     LONG        m_wakeUpIntervalUs{0};
+    LONG        m_busIntervalUs{1000}; // One USB (micro)frame
+    PEX_TIMER   m_timer{nullptr};
 
   protected:
     KWAIT_BLOCK m_waitBlock[toInt(MixingEngineWaitEventsNumber::NumOfWaitEvents)]{};
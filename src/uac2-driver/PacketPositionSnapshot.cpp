@@ -0,0 +1,79 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+// ASIO is a trademark and software of Steinberg Media Technologies GmbH
+
+/*++
+
+Module Name:
+
+    PacketPositionSnapshot.cpp
+
+Abstract:
+
+    Implement a class that publishes the completed packet counters from the
+    URB completion routines to the mixing engine thread through a sequence
+    counter.
+
+Environment:
+
+    Kernel-mode Driver Framework
+
+--*/
+
+#ifdef UAC_HOST_BUILD
+#include "HostCompat.h"
+#else
+#include "Driver.h"
+#endif
+#include "PacketPositionSnapshot.h"
+
+#if !defined(__INTELLISENSE__) && !defined(UAC_HOST_BUILD)
+#include "PacketPositionSnapshot.tmh"
+#endif
+
+_Use_decl_annotations_
+NONPAGED_CODE_SEG
+PACKET_POSITION & PacketPositionSnapshot::BeginUpdate()
+{
+    // The interlocked operation is a full barrier, so the odd sequence is visible before any field changes.
+    InterlockedIncrement(&m_sequence);
+    return m_position;
+}
+
+_Use_decl_annotations_
+NONPAGED_CODE_SEG
+void PacketPositionSnapshot::EndUpdate()
+{
+    InterlockedIncrement(&m_sequence);
+}
+
+_Use_decl_annotations_
+NONPAGED_CODE_SEG
+void PacketPositionSnapshot::Read(
+    PACKET_POSITION & position
+) const
+{
+    volatile LONG * sequenceAddress = const_cast<volatile LONG *>(&m_sequence);
+
+    for (;;)
+    {
+        LONG sequence = InterlockedCompareExchange(sequenceAddress, 0, 0);
+        if ((sequence & 1) != 0)
+        {
+            YieldProcessor();
+            continue;
+        }
+
+        position = m_position;
+
+        // The interlocked operations are full barriers, so the copy cannot move out of the window between them.
+        if (InterlockedCompareExchange(sequenceAddress, 0, 0) == sequence)
+        {
+            break;
+        }
+    }
+}
@@ -0,0 +1,72 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+// ASIO is a trademark and software of Steinberg Media Technologies GmbH
+
+/*++
+
+Module Name:
+
+    PacketPositionSnapshot.h
+
+Abstract:
+
+    Define a class that publishes the completed packet counters from the
+    URB completion routines to the mixing engine thread through a sequence
+    counter, so that the thread reads a consistent set without a lock.
+
+Environment:
+
+    Kernel-mode Driver Framework
+
+--*/
+
+#ifndef _PACKET_POSITION_SNAPSHOT_H_
+#define _PACKET_POSITION_SNAPSHOT_H_
+
+typedef struct PACKET_POSITION_
+{
+    LONGLONG  InputCompletedPacket;
+    LONGLONG  OutputCompletedPacket;
+    ULONGLONG InputCompletedTimeUs; // Completion time of the IRP that brought InputCompletedPacket up to date
+} PACKET_POSITION, *PPACKET_POSITION;
+
+//
+// The writer makes the sequence odd while it updates the position and even
+// again afterwards. The reader copies the position between two reads of the
+// sequence and retries when the sequence was odd or changed in between.
+// Writers are not serialized here; the input and output completions run in
+// separate DPCs, so the caller holds its spin lock around an update. It does
+// not depend on the framework, so it is also built on the host and stressed
+// by test/PacketPositionSnapshotTest.cpp.
+//
+class PacketPositionSnapshot
+{
+  public:
+    //
+    // Starts an update and returns the position to be modified. Must be
+    // followed by EndUpdate.
+    //
+    __drv_maxIRQL(DISPATCH_LEVEL)
+    NONPAGED_CODE_SEG
+    PACKET_POSITION & BeginUpdate();
+
+    __drv_maxIRQL(DISPATCH_LEVEL)
+    NONPAGED_CODE_SEG
+    void EndUpdate();
+
+    __drv_maxIRQL(DISPATCH_LEVEL)
+    NONPAGED_CODE_SEG
+    void Read(
+        _Out_ PACKET_POSITION & position
+    ) const;
+
+  private:
+    volatile LONG   m_sequence{0};
+    PACKET_POSITION m_position{};
+};
+
+#endif
@@ -63,7 +63,12 @@ EXTERN_C_START
 #define UAC_MAX_DROPOUT_DETECTION            1
 #define UAC_MAX_USE_DEVICE_SAMPLE_FORMAT     1
 
+#define UAC_PARALLEL_PROCESSING_DISABLED     0
+#define UAC_PARALLEL_PROCESSING_AUTOMATIC    1
+#define UAC_PARALLEL_PROCESSING_ALWAYS       2
+
 #define UAC_MAX_ASIO_CHANNEL                 64
+#define UAC_MAX_STREAM_DEVICES               128
 #define UAC_MAX_CLOCK_SOURCE                 32
 
 #define UAC_11025HZ_SUPPORTED                0x00000001
@@ -218,6 +218,60 @@ static ACX_PROPERTY_ITEM s_PropertyItems[] = {
         0,                                                // PVOID Reserved;
         0,                                                // ULONG ControlCb;
         0,                                                // ULONG ValueCb;
+    },
+    {
+        &KSPROPSETID_LowLatencyAudio,                     // const GUID * Set;
+        toInt(KsPropertyUACLowLatencyAudio::SetChannelRouting),
+        ACX_PROPERTY_ITEM_FLAG_SET,                       // ULONG Flags;
+        EvtUSBAudioAcxDriverSetChannelRouting,            // PFN_ACX_OBJECT_PROCESS_REQUEST EvtAcxObjectProcessRequest;
+        0,                                                // PVOID Reserved;
+        0,                                                // ULONG ControlCb;
+        sizeof(UAC_CHANNEL_ROUTING_CONTEXT),              // ULONG ValueCb;
+    },
+    {
+        &KSPROPSETID_LowLatencyAudio,                     // const GUID * Set;
+        toInt(KsPropertyUACLowLatencyAudio::GetChannelRouting),
+        ACX_PROPERTY_ITEM_FLAG_GET,                       // ULONG Flags;
+        EvtUSBAudioAcxDriverGetChannelRouting,            // PFN_ACX_OBJECT_PROCESS_REQUEST EvtAcxObjectProcessRequest;
+        0,                                                // PVOID Reserved;
+        0,                                                // ULONG ControlCb;
+        sizeof(UAC_CHANNEL_ROUTING_CONTEXT),              // ULONG ValueCb;
+    },
+    {
+        &KSPROPSETID_LowLatencyAudio,                     // const GUID * Set;
+        toInt(KsPropertyUACLowLatencyAudio::GetMeters),
+        ACX_PROPERTY_ITEM_FLAG_GET,                       // ULONG Flags;
+        EvtUSBAudioAcxDriverGetMeters,                    // PFN_ACX_OBJECT_PROCESS_REQUEST EvtAcxObjectProcessRequest;
+        0,                                                // PVOID Reserved;
+        0,                                                // ULONG ControlCb;
+        sizeof(UAC_METERS_CONTEXT),                       // ULONG ValueCb;
+    },
+    {
+        &KSPROPSETID_LowLatencyAudio,                     // const GUID * Set;
+        toInt(KsPropertyUACLowLatencyAudio::GetSafetyOffset),
+        ACX_PROPERTY_ITEM_FLAG_GET,                       // ULONG Flags;
+        EvtUSBAudioAcxDriverGetSafetyOffset,              // PFN_ACX_OBJECT_PROCESS_REQUEST EvtAcxObjectProcessRequest;
+        0,                                                // PVOID Reserved;
+        0,                                                // ULONG ControlCb;
+        sizeof(UAC_SAFETY_OFFSET_CONTEXT),                // ULONG ValueCb;
+    },
+    {
+        &KSPROPSETID_LowLatencyAudio,                     // const GUID * Set;
+        toInt(KsPropertyUACLowLatencyAudio::GetBufferPeriodSwitch),
+        ACX_PROPERTY_ITEM_FLAG_GET,                       // ULONG Flags;
+        EvtUSBAudioAcxDriverGetBufferPeriodSwitch,        // PFN_ACX_OBJECT_PROCESS_REQUEST EvtAcxObjectProcessRequest;
+        0,                                                // PVOID Reserved;
+        0,                                                // ULONG ControlCb;
+        sizeof(UAC_BUFFER_PERIOD_SWITCH_CONTEXT),         // ULONG ValueCb;
+    },
+    {
+        &KSPROPSETID_LowLatencyAudio,                     // const GUID * Set;
+        toInt(KsPropertyUACLowLatencyAudio::GetSampleRateSwitch),
+        ACX_PROPERTY_ITEM_FLAG_GET,                       // ULONG Flags;
+        EvtUSBAudioAcxDriverGetSampleRateSwitch,          // PFN_ACX_OBJECT_PROCESS_REQUEST EvtAcxObjectProcessRequest;
+        0,                                                // PVOID Reserved;
+        0,                                                // ULONG ControlCb;
+        sizeof(UAC_SAMPLE_RATE_SWITCH_CONTEXT),           // ULONG ValueCb;
     }
 };
 
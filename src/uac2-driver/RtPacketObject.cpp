@@ -30,6 +30,8 @@ Environment:
 #include "ContiguousMemory.h"
 #include "TransferObject.h"
 #include "StreamEngine.h"
+#include "SampleConverter.h"
+#include "SampleRateConverter.h"
 
 #ifndef __INTELLISENSE__
 #include "RtPacketObject.tmh"
@@ -85,6 +87,17 @@ RtPacketObject::~RtPacketObject()
         m_outputWaveFormat = nullptr;
     }
 
+    auto deleteResamplers = [](RT_PACKET_INFO * rtPacketInfo, ULONG numOfDevices) noexcept -> void {
+        for (ULONG deviceIndex = 0; (rtPacketInfo != nullptr) && (deviceIndex < numOfDevices); deviceIndex++)
+        {
+            delete rtPacketInfo[deviceIndex].Resampler;
+            rtPacketInfo[deviceIndex].Resampler = nullptr;
+        }
+    };
+
+    deleteResamplers(m_inputRtPacketInfo, m_numOfInputDevices);
+    deleteResamplers(m_outputRtPacketInfo, m_numOfOutputDevices);
+
     if (m_inputRtPacketInfoMemory != nullptr)
     {
         WdfObjectDelete(m_inputRtPacketInfoMemory);
@@ -145,15 +158,29 @@ RtPacketObject::SetDataFormat(
         avgBytesPerSec = waveFormatEx->nAvgBytesPerSec;
     }
 
+    // The per-sample kernels are selected here so that the copy loops do not depend on the sample format.
+    bool isFloat = IsEqualGUIDAligned(subFormat, KSDATAFORMAT_SUBTYPE_IEEE_FLOAT);
+
+    // Only integer PCM streams can run at a sample rate other than the device sample rate.
+    ULONG sampleRate = 0;
+    if (!isFloat && (waveFormatExtensibleIEC61937 == nullptr) && (bytesPerSample >= 2) && (bytesPerSample <= 4))
+    {
+        sampleRate = AcxDataFormatGetSampleRate(dataFormat);
+    }
+
     if (isInput)
     {
         m_inputBytesPerSample = bytesPerSample;
         m_inputAvgBytesPerSec = avgBytesPerSec;
+        m_inputCopySamples = SampleConverter::GetCopyFunction(isFloat, bytesPerSample);
+        m_inputSampleRate = sampleRate;
     }
     else
     {
         m_outputBytesPerSample = bytesPerSample;
         m_outputAvgBytesPerSec = avgBytesPerSec;
+        m_outputMixSamples = SampleConverter::GetMixFunction(isFloat, bytesPerSample);
+        m_outputSampleRate = sampleRate;
     }
 
     TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - waveFormatEx = %p, waveFormatExtensible = %p, waveFormatExtensibleIEC61937 = %p", waveFormatEx, waveFormatExtensible, waveFormatExtensibleIEC61937);
@@ -222,6 +249,10 @@ void RtPacketObject::ResetInternal(
     {
         InterlockedExchange64((LONG64 *)&rtPacketInfo[deviceIndex].RtPacketEstimatedPosition, 0);
         InterlockedExchange64((LONG64 *)&rtPacketInfo[deviceIndex].LastPacketStartQpcPosition, 0);
+        if (rtPacketInfo[deviceIndex].Resampler != nullptr)
+        {
+            rtPacketInfo[deviceIndex].Resampler->Reset();
+        }
         TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - index, estimatedQPCPosition, lastPacketStartQpcPosition, %d, %llu, %llu", deviceIndex, rtPacketInfo[deviceIndex].RtPacketEstimatedPosition, rtPacketInfo[deviceIndex].LastPacketStartQpcPosition);
     }
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit");
@@ -364,6 +395,18 @@ RtPacketObject::SetRtPackets(
     rtPacketInfo[deviceIndex].UsbChannel = channel;
     rtPacketInfo[deviceIndex].Channels = numOfChannelsPerDevice;
 
+    // A WDM channel is looked up in the routing table by its default USB position.
+    const LONG * routing = isInput ? m_deviceContext->ChannelRouting.WdmInput : m_deviceContext->ChannelRouting.WdmOutput;
+    const ULONG  usbChannels = isInput ? m_deviceContext->InputProperty.UsbChannels : m_deviceContext->OutputProperty.UsbChannels;
+    rtPacketInfo[deviceIndex].SpanCount = 0;
+    if (channel < UAC_MAX_ASIO_CHANNELS)
+    {
+        rtPacketInfo[deviceIndex].SpanCount = SampleConverter::BuildChannelSpans(rtPacketInfo[deviceIndex].Spans, routing + channel, min(numOfChannelsPerDevice, UAC_MAX_ASIO_CHANNELS - channel), ~0ULL, usbChannels);
+    }
+
+    // The resampler is built here, on the PASSIVE path, so that the copy paths never allocate or compute coefficients.
+    (void)PrepareResampler(isInput, &rtPacketInfo[deviceIndex]);
+
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DRIVER, "%!FUNC! Exit %!STATUS!", status);
 
     return status;
@@ -397,6 +440,93 @@ void RtPacketObject::UnsetRtPackets(
         rtPacketInfo[deviceIndex].RtPackets = nullptr;
         rtPacketInfo[deviceIndex].RtPacketsCount = 0;
         rtPacketInfo[deviceIndex].RtPacketSize = 0;
+        delete rtPacketInfo[deviceIndex].Resampler;
+        rtPacketInfo[deviceIndex].Resampler = nullptr;
+        rtPacketInfo[deviceIndex].ResamplerLoad = nullptr;
+        rtPacketInfo[deviceIndex].ResamplerStore = nullptr;
+    }
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+SampleRateConverter * RtPacketObject::PrepareResampler(
+    bool             isInput,
+    RT_PACKET_INFO * rtPacketInfo
+)
+{
+    PAGED_CODE();
+
+    const ULONG streamSampleRate = isInput ? m_inputSampleRate : m_outputSampleRate;
+    const ULONG deviceSampleRate = m_deviceContext->AudioProperty.SampleRate;
+
+    const ULONG usbBytesPerSample = isInput ? m_deviceContext->InputProperty.BytesPerSample : m_deviceContext->OutputProperty.BytesPerSample;
+
+    // The copy paths resample exactly when rtPacketInfo->Resampler is set, so it is released whenever the rates match or the format cannot be resampled.
+    auto releaseResampler = [&]() {
+        delete rtPacketInfo->Resampler;
+        rtPacketInfo->Resampler = nullptr;
+        rtPacketInfo->ResamplerLoad = nullptr;
+        rtPacketInfo->ResamplerStore = nullptr;
+        return nullptr;
+    };
+
+    if ((streamSampleRate == 0) || (deviceSampleRate == 0) || (streamSampleRate == deviceSampleRate) ||
+        (m_deviceContext->AudioProperty.CurrentSampleFormat != UACSampleFormat::UAC_SAMPLE_FORMAT_PCM) ||
+        (rtPacketInfo->Channels == 0) || (rtPacketInfo->Channels > UAC_MAX_ASIO_CHANNELS))
+    {
+        return releaseResampler();
+    }
+
+    // The width of each side is fixed while the resampler exists, so the kernels are selected here rather than per sample.
+    const SRC_LOAD_FUNCTION  load = SampleRateConverter::GetLoadFunction(isInput ? usbBytesPerSample : m_outputBytesPerSample);
+    const SRC_STORE_FUNCTION store = isInput ? SampleRateConverter::GetStoreFunction(m_inputBytesPerSample) : SampleRateConverter::GetMixFunction(usbBytesPerSample);
+    if ((load == nullptr) || (store == nullptr))
+    {
+        return releaseResampler();
+    }
+
+    if (rtPacketInfo->Resampler == nullptr)
+    {
+        rtPacketInfo->Resampler = SampleRateConverter::Create(rtPacketInfo->Channels);
+        if (rtPacketInfo->Resampler == nullptr)
+        {
+            TraceEvents(TRACE_LEVEL_ERROR, TRACE_DEVICE, "%!FUNC! failed to allocate the resampler");
+            return releaseResampler();
+        }
+    }
+
+    const ULONG inputRate = isInput ? deviceSampleRate : streamSampleRate;
+    const ULONG outputRate = isInput ? streamSampleRate : deviceSampleRate;
+    if ((rtPacketInfo->Resampler->GetInputRate() != inputRate) || (rtPacketInfo->Resampler->GetOutputRate() != outputRate))
+    {
+        if (!NT_SUCCESS(rtPacketInfo->Resampler->SetRates(inputRate, outputRate)))
+        {
+            return releaseResampler();
+        }
+    }
+    rtPacketInfo->ResamplerLoad = load;
+    rtPacketInfo->ResamplerStore = store;
+
+    return rtPacketInfo->Resampler;
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+void RtPacketObject::PrepareResamplers(
+    bool isInput
+)
+{
+    RT_PACKET_INFO * rtPacketInfo = isInput ? m_inputRtPacketInfo : m_outputRtPacketInfo;
+    ULONG            numOfDevices = isInput ? m_numOfInputDevices : m_numOfOutputDevices;
+
+    PAGED_CODE();
+
+    for (ULONG deviceIndex = 0; deviceIndex < numOfDevices; deviceIndex++)
+    {
+        if (rtPacketInfo[deviceIndex].RtPackets != nullptr)
+        {
+            (void)PrepareResampler(isInput, &rtPacketInfo[deviceIndex]);
+        }
     }
 }
 
@@ -452,153 +582,107 @@ RtPacketObject::CopyFromRtPacketToOutputData(
 
     switch (m_deviceContext->AudioProperty.CurrentSampleFormat)
     {
-    case UACSampleFormat::UAC_SAMPLE_FORMAT_PCM: {
-        for (ULONG acxCh = 0; acxCh < rtPacketInfo->Channels; acxCh++)
+    case UACSampleFormat::UAC_SAMPLE_FORMAT_PCM:
+    case UACSampleFormat::UAC_SAMPLE_FORMAT_IEEE_FLOAT: {
+        // The resampler is built on the PASSIVE path by SetRtPackets and PrepareResamplers, never on this thread.
+        SampleRateConverter * resampler = rtPacketInfo->Resampler;
+        if (resampler != nullptr)
         {
-            ULONG rtPacketIndex = (rtPacketInfo->RtPacketPosition / rtPacketInfo->RtPacketSize) % rtPacketInfo->RtPacketsCount;
-            ULONG srcIndexInRtPacket = rtPacketInfo->RtPacketPosition % rtPacketInfo->RtPacketSize + acxCh * m_outputBytesPerSample;
-            PBYTE srcData = (PBYTE)rtPacketInfo->RtPackets[rtPacketIndex];
-            PBYTE dstData = (PBYTE)buffer;
-
-            TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - acxCh, rtPacketIndex, srcIndexInRtPacket, %u, %u, %u", acxCh, rtPacketIndex, srcIndexInRtPacket);
-            TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - dstData, buffer, length = %p, %p, %u", dstData, buffer, length);
-
-            for (ULONG dstIndex = (acxCh + rtPacketInfo->UsbChannel) * usbBytesPerSample; dstIndex < length;)
+            ASSERT(usbBytesPerSample == m_deviceContext->OutputProperty.BytesPerSample);
+            const SRC_LOAD_FUNCTION  loadSamples = rtPacketInfo->ResamplerLoad;
+            const SRC_STORE_FUNCTION mixSamples = rtPacketInfo->ResamplerStore;
+
+            // The stream runs at another rate than the device. Every USB frame is pulled from the resampler, which is fed from the RtPacket ring frame by frame as it
+            // needs input, so bytesCopiedSrcData counts the RtPacket bytes that were consumed rather than the USB bytes that were produced.
+            const ULONG          channels = rtPacketInfo->Channels;
+            const ULONG          dstFrameBytes = usbBytesPerSample * usbChannels;
+            const ULONG          srcFrameBytes = m_outputBytesPerSample * channels;
+            const ULONG          frames = length / dstFrameBytes;
+            const CHANNEL_SPAN * channelSpans = rtPacketInfo->Spans;
+            const ULONG          channelSpanCount = rtPacketInfo->SpanCount;
+            ULONG                rtPacketIndex = (rtPacketInfo->RtPacketPosition / rtPacketInfo->RtPacketSize) % rtPacketInfo->RtPacketsCount;
+            ULONG                srcIndexInRtPacket = rtPacketInfo->RtPacketPosition % rtPacketInfo->RtPacketSize;
+            PBYTE                srcData = (PBYTE)rtPacketInfo->RtPackets[rtPacketIndex];
+            LONG                 frameSamples[UAC_MAX_ASIO_CHANNELS];
+
+            TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - resampling %u -> %u, rtPacketIndex, srcIndexInRtPacket, frames, %u, %u, %u", resampler->GetInputRate(), resampler->GetOutputRate(), rtPacketIndex, srcIndexInRtPacket, frames);
+
+            for (ULONG frame = 0; frame < frames; ++frame)
             {
-                // TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - srcIndexInRtPacket, dstIndex = %u, %u", srcIndexInRtPacket, dstIndex);
-
-                // To accommodate differing specifications between the bytesPerSample of the device and ACX audio, the following code modifications are necessary.
-                if (m_outputBytesPerSample == 2)
+                while (resampler->IsInputNeeded())
                 {
-                    PSHORT outSample = (PSHORT)(dstData + dstIndex);
-                    LONG   thisSample = (LONG)(*outSample) + *(PSHORT)(srcData + srcIndexInRtPacket);
-                    if (thisSample > 0x7fff)
-                    {
-                        *outSample = 0x7fff;
-                    }
-                    else if (thisSample < -0x8000)
-                    {
-                        *outSample = -0x8000;
-                    }
-
-                    {
-                        *outSample = (SHORT)thisSample;
-                    }
-                }
-                else if (m_outputBytesPerSample == 3)
-                {
-                    PUCHAR          outSample = (PUCHAR)(dstData + dstIndex);
-                    volatile BYTE * wdmSample = (volatile BYTE *)(srcData + srcIndexInRtPacket);
-                    LONG            thisSample = (LONG)((ULONG)outSample[0] + ((ULONG)outSample[1] << 8)) + ((LONG)((PCHAR)outSample)[2] << 16) + (LONG)((ULONG)wdmSample[0] + ((ULONG)wdmSample[1] << 8)) + ((LONG)((PCHAR)wdmSample)[2] << 16);
-                    if (thisSample > 0x7fffff)
-                    {
-                        outSample[0] = 0xff;
-                        outSample[1] = 0xff;
-                        outSample[2] = 0x7f;
-                    }
-                    else if (thisSample < -0x800000)
-                    {
-                        outSample[0] = 0x00;
-                        outSample[1] = 0x00;
-                        outSample[2] = 0x80;
-                    }
-                    else
+                    loadSamples(frameSamples, srcData + srcIndexInRtPacket, m_outputBytesPerSample, channels);
+                    resampler->PushFrame(frameSamples);
+                    srcIndexInRtPacket += srcFrameBytes;
+                    bytesCopiedSrcData += srcFrameBytes;
+                    if (srcIndexInRtPacket >= rtPacketInfo->RtPacketSize)
                     {
-                        outSample[0] = ((PUCHAR)(&thisSample))[0];
-                        outSample[1] = ((PUCHAR)(&thisSample))[1];
-                        outSample[2] = ((PUCHAR)(&thisSample))[2];
+                        bytesCopiedUpToBoundary = totalProcessedBytesSoFar + bytesCopiedDstData;
+                        bytesCopiedSrcDataUpToBoundary = bytesCopiedSrcData;
+                        fedRtPacket = true;
+                        srcIndexInRtPacket = 0;
+                        rtPacketIndex++;
+                        rtPacketIndex %= rtPacketInfo->RtPacketsCount;
+                        srcData = ((PBYTE)rtPacketInfo->RtPackets[rtPacketIndex]);
+                        TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - rtPacketIndex, srcIndexInRtPacket, %u, %u", rtPacketIndex, srcIndexInRtPacket);
                     }
                 }
-                else if (m_outputBytesPerSample == 4)
-                {
-                    PUCHAR          outSample = (PUCHAR)(dstData + dstIndex);
-                    volatile BYTE * wdmSample = (volatile BYTE *)(srcData + srcIndexInRtPacket);
-                    LONGLONG        thisSample = (LONGLONG) * ((LONG *)outSample) + (LONGLONG) * ((LONG *)wdmSample);
+                resampler->PullFrame(frameSamples);
 
-                    if (thisSample > 0x7fffffffLL)
-                    {
-                        outSample[0] = 0xff;
-                        outSample[1] = 0xff;
-                        outSample[2] = 0xff;
-                        outSample[3] = 0x7f;
-                    }
-                    else if (thisSample < -0x80000000LL)
-                    {
-                        outSample[0] = 0x00;
-                        outSample[1] = 0x00;
-                        outSample[2] = 0x00;
-                        outSample[3] = 0x80;
-                    }
-                    else
+                for (ULONG spanIndex = 0; spanIndex < channelSpanCount; ++spanIndex)
+                {
+                    const CHANNEL_SPAN & channelSpan = channelSpans[spanIndex];
+                    if (channelSpan.UsbChannel + channelSpan.Channels <= usbChannels)
                     {
-                        outSample[0] = ((PUCHAR)(&thisSample))[0];
-                        outSample[1] = ((PUCHAR)(&thisSample))[1];
-                        outSample[2] = ((PUCHAR)(&thisSample))[2];
-                        outSample[3] = ((PUCHAR)(&thisSample))[3];
+                        mixSamples(buffer + frame * dstFrameBytes + channelSpan.UsbChannel * usbBytesPerSample, usbBytesPerSample, frameSamples + channelSpan.Channel, channelSpan.Channels);
                     }
                 }
-                dstIndex += (usbBytesPerSample * usbChannels);
-                srcIndexInRtPacket += m_outputBytesPerSample * rtPacketInfo->Channels;
-                bytesCopiedDstData += m_outputBytesPerSample;
-                bytesCopiedSrcData += m_outputBytesPerSample;
-                if (srcIndexInRtPacket >= rtPacketInfo->RtPacketSize)
-                {
-                    // {
-                    // 	CHAR outputString[100] = "";
-                    // 	sprintf_s(outputString, sizeof(outputString), "DumpByteArray rtPackets[%d]", rtPacketIndex);
-                    // 	DumpByteArray(outputString, (UCHAR*)rtPacketInfo->RtPackets[rtPacketIndex], rtPacketInfo->RtPacketSize);
-                    // }
-                    bytesCopiedUpToBoundary = totalProcessedBytesSoFar + bytesCopiedDstData;
-                    bytesCopiedSrcDataUpToBoundary = bytesCopiedSrcData;
-                    fedRtPacket = true;
-                    srcIndexInRtPacket = acxCh * m_outputBytesPerSample;
-                    rtPacketIndex++;
-                    rtPacketIndex %= rtPacketInfo->RtPacketsCount;
-                    srcData = ((PBYTE)rtPacketInfo->RtPackets[rtPacketIndex]);
-                    TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - acxCh, rtPacketIndex, srcIndexInRtPacket, %u, %u, %u", acxCh, rtPacketIndex, srcIndexInRtPacket);
-                }
+                bytesCopiedDstData += dstFrameBytes;
             }
+            break;
         }
-    }
-    break;
-    case UACSampleFormat::UAC_SAMPLE_FORMAT_IEEE_FLOAT: {
-        for (ULONG acxCh = 0; acxCh < rtPacketInfo->Channels; acxCh++)
-        {
-            ULONG rtPacketIndex = (rtPacketInfo->RtPacketPosition / rtPacketInfo->RtPacketSize) % rtPacketInfo->RtPacketsCount;
-            ULONG srcIndexInRtPacket = rtPacketInfo->RtPacketPosition % rtPacketInfo->RtPacketSize + acxCh * m_outputBytesPerSample;
-            PBYTE srcData = (PBYTE)rtPacketInfo->RtPackets[rtPacketIndex];
-            PBYTE dstData = (PBYTE)buffer;
 
-            TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - acxCh, rtPacketIndex, srcIndexInRtPacket, %u, %u, %u", acxCh, rtPacketIndex, srcIndexInRtPacket);
-            TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - dstData, buffer, length = %p, %p, %u", dstData, buffer, length);
+        // The USB buffer and the RtPacket ring are walked once, span by span. A span ends at the end of the USB buffer or of the current RtPacket, whichever comes first,
+        // so that the RtPacket boundary is handled once per span rather than once per channel. Within a span, each run of channels in rtPacketInfo->Spans is mixed
+        // into the USB channels it is routed to.
+        const SAMPLE_MIX_FUNCTION mixSamples = m_outputMixSamples;
+        const ULONG               channels = rtPacketInfo->Channels;
+        const ULONG               dstFrameBytes = usbBytesPerSample * usbChannels;
+        const ULONG               srcFrameBytes = m_outputBytesPerSample * channels;
+        const ULONG               frames = length / dstFrameBytes;
+        const CHANNEL_SPAN *      channelSpans = rtPacketInfo->Spans;
+        const ULONG               channelSpanCount = rtPacketInfo->SpanCount;
+        ULONG                     rtPacketIndex = (rtPacketInfo->RtPacketPosition / rtPacketInfo->RtPacketSize) % rtPacketInfo->RtPacketsCount;
+        ULONG                     srcIndexInRtPacket = rtPacketInfo->RtPacketPosition % rtPacketInfo->RtPacketSize;
+        PBYTE                     srcData = (PBYTE)rtPacketInfo->RtPackets[rtPacketIndex];
+        PBYTE                     dstData = (PBYTE)buffer;
+
+        TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - rtPacketIndex, srcIndexInRtPacket, frames, %u, %u, %u", rtPacketIndex, srcIndexInRtPacket, frames);
+        TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - dstData, buffer, length = %p, %p, %u", dstData, buffer, length);
 
-            for (ULONG dstIndex = (acxCh + rtPacketInfo->UsbChannel) * usbBytesPerSample; dstIndex < length;)
+        for (ULONG frame = 0; frame < frames;)
+        {
+            ULONG        srcFrames = (srcIndexInRtPacket < rtPacketInfo->RtPacketSize) ? (rtPacketInfo->RtPacketSize - srcIndexInRtPacket + srcFrameBytes - 1) / srcFrameBytes : 1;
+            ULONG        spanFrames = min(frames - frame, srcFrames);
+            PUCHAR       dstSpan = dstData + frame * dstFrameBytes;
+            const BYTE * srcSpan = srcData + srcIndexInRtPacket;
+
+            SampleConverter::MixChannelSpansToUsb(dstSpan, usbBytesPerSample, usbChannels, srcSpan, m_outputBytesPerSample, channels, channelSpans, channelSpanCount, spanFrames, mixSamples);
+
+            frame += spanFrames;
+            srcIndexInRtPacket += srcFrameBytes * spanFrames;
+            bytesCopiedDstData += dstFrameBytes * spanFrames;
+            bytesCopiedSrcData += srcFrameBytes * spanFrames;
+            if (srcIndexInRtPacket >= rtPacketInfo->RtPacketSize)
             {
-                // TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - srcIndexInRtPacket, dstIndex = %u, %u", srcIndexInRtPacket, dstIndex);
-
-                float * outSample = (float *)(dstData + dstIndex);
-                *outSample = *outSample + *(float *)(srcData + srcIndexInRtPacket);
-
-                dstIndex += (usbBytesPerSample * usbChannels);
-                srcIndexInRtPacket += m_outputBytesPerSample * rtPacketInfo->Channels;
-                bytesCopiedDstData += m_outputBytesPerSample;
-                bytesCopiedSrcData += m_outputBytesPerSample;
-                if (srcIndexInRtPacket >= rtPacketInfo->RtPacketSize)
-                {
-                    // {
-                    // 	CHAR outputString[100] = "";
-                    // 	sprintf_s(outputString, sizeof(outputString), "DumpByteArray rtPackets[%d]", rtPacketIndex);
-                    // 	DumpByteArray(outputString, (UCHAR*)rtPacketInfo->RtPackets[rtPacketIndex], rtPacketInfo->RtPacketSize);
-                    // }
-                    bytesCopiedUpToBoundary = totalProcessedBytesSoFar + bytesCopiedDstData;
-                    bytesCopiedSrcDataUpToBoundary = bytesCopiedSrcData;
-                    fedRtPacket = true;
-                    srcIndexInRtPacket = acxCh * m_outputBytesPerSample;
-                    rtPacketIndex++;
-                    rtPacketIndex %= rtPacketInfo->RtPacketsCount;
-                    srcData = ((PBYTE)rtPacketInfo->RtPackets[rtPacketIndex]);
-                    TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - acxCh, rtPacketIndex, srcIndexInRtPacket, %u, %u, %u", acxCh, rtPacketIndex, srcIndexInRtPacket);
-                }
+                bytesCopiedUpToBoundary = totalProcessedBytesSoFar + bytesCopiedDstData;
+                bytesCopiedSrcDataUpToBoundary = bytesCopiedSrcData;
+                fedRtPacket = true;
+                srcIndexInRtPacket = 0;
+                rtPacketIndex++;
+                rtPacketIndex %= rtPacketInfo->RtPacketsCount;
+                srcData = ((PBYTE)rtPacketInfo->RtPackets[rtPacketIndex]);
+                TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - rtPacketIndex, srcIndexInRtPacket, %u, %u", rtPacketIndex, srcIndexInRtPacket);
             }
         }
     }
@@ -741,85 +825,107 @@ RtPacketObject::CopyToRtPacketFromInputData(
 
     switch (m_deviceContext->AudioProperty.CurrentSampleFormat)
     {
-    case UACSampleFormat::UAC_SAMPLE_FORMAT_PCM: {
-        for (ULONG acxCh = 0; acxCh < rtPacketInfo->Channels; acxCh++)
+    case UACSampleFormat::UAC_SAMPLE_FORMAT_PCM:
+    case UACSampleFormat::UAC_SAMPLE_FORMAT_IEEE_FLOAT: {
+        // The resampler is built on the PASSIVE path by SetRtPackets and PrepareResamplers, never on this thread.
+        SampleRateConverter * resampler = rtPacketInfo->Resampler;
+        if (resampler != nullptr)
         {
-            ULONG rtPacketIndex = (rtPacketInfo->RtPacketPosition / rtPacketInfo->RtPacketSize) % rtPacketInfo->RtPacketsCount;
-            ULONG dstIndexInRtPacket = rtPacketInfo->RtPacketPosition % rtPacketInfo->RtPacketSize + acxCh * m_inputBytesPerSample;
-            PBYTE srcData = (PBYTE)buffer;
-            PBYTE dstData = (PBYTE)rtPacketInfo->RtPackets[rtPacketIndex];
-
-            TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - acxCh, rtPacketIndex, dstIndexInRtPacket, %u, %u, %u", acxCh, rtPacketIndex, dstIndexInRtPacket);
-            TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - srcData, buffer, length = %p, %p, %u", srcData, buffer, length);
-
-            for (ULONG srcIndex = (acxCh + rtPacketInfo->UsbChannel) * usbBytesPerSample; srcIndex < length;)
+            ASSERT(usbBytesPerSample == m_deviceContext->InputProperty.BytesPerSample);
+            const SRC_LOAD_FUNCTION  loadSamples = rtPacketInfo->ResamplerLoad;
+            const SRC_STORE_FUNCTION storeSamples = rtPacketInfo->ResamplerStore;
+
+            // The device runs at another rate than the stream. Every USB frame is pushed into the resampler after the RtPacket frames that are already available
+            // have been pulled, so that the history never grows beyond one filter length. Channels that are not routed are written as silence.
+            const ULONG          channels = rtPacketInfo->Channels;
+            const ULONG          srcFrameBytes = usbBytesPerSample * usbChannels;
+            const ULONG          dstFrameBytes = m_inputBytesPerSample * channels;
+            const ULONG          frames = length / srcFrameBytes;
+            const CHANNEL_SPAN * channelSpans = rtPacketInfo->Spans;
+            const ULONG          channelSpanCount = rtPacketInfo->SpanCount;
+            ULONG                rtPacketIndex = (rtPacketInfo->RtPacketPosition / rtPacketInfo->RtPacketSize) % rtPacketInfo->RtPacketsCount;
+            ULONG                dstIndexInRtPacket = rtPacketInfo->RtPacketPosition % rtPacketInfo->RtPacketSize;
+            PBYTE                dstData = (PBYTE)rtPacketInfo->RtPackets[rtPacketIndex];
+            LONG                 frameSamples[UAC_MAX_ASIO_CHANNELS];
+
+            TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - resampling %u -> %u, rtPacketIndex, dstIndexInRtPacket, frames, %u, %u, %u", resampler->GetInputRate(), resampler->GetOutputRate(), rtPacketIndex, dstIndexInRtPacket, frames);
+
+            for (ULONG frame = 0; frame < frames; ++frame)
             {
-                // TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - dstIndexInRtPacket, dstIndex = %u, %u", dstIndexInRtPacket, srcIndex);
-
-                // To accommodate differing specifications between the bytesPerSample of the device and ACX audio, the following code modifications are necessary.
-                if (m_inputBytesPerSample == 2)
-                {
-                    *(PSHORT)(dstData + dstIndexInRtPacket) = *(PSHORT)(srcData + srcIndex);
-                }
-                else if (m_inputBytesPerSample == 3)
+                while (!resampler->IsInputNeeded())
                 {
-                    *(dstData + dstIndexInRtPacket) = *(srcData + srcIndex);
-                    *(dstData + dstIndexInRtPacket + 1) = *(srcData + srcIndex + 1);
-                    *(dstData + dstIndexInRtPacket + 2) = *(srcData + srcIndex + 2);
-                }
-                else if (m_inputBytesPerSample == 4)
-                {
-                    *((LONG *)(dstData + dstIndexInRtPacket)) = *((LONG *)(srcData + srcIndex));
+                    resampler->PullFrame(frameSamples);
+                    storeSamples(dstData + dstIndexInRtPacket, m_inputBytesPerSample, frameSamples, channels);
+                    dstIndexInRtPacket += dstFrameBytes;
+                    bytesCopiedDstData += dstFrameBytes;
+                    if (dstIndexInRtPacket >= rtPacketInfo->RtPacketSize)
+                    {
+                        bytesCopiedUpToBoundary = totalProcessedBytesSoFar + bytesCopiedSrcData;
+                        bytesCopiedDstDataUpToBoundary = bytesCopiedDstData;
+                        filledRtPacket = true;
+                        dstIndexInRtPacket = 0;
+                        rtPacketIndex++;
+                        rtPacketIndex %= rtPacketInfo->RtPacketsCount;
+                        dstData = ((PBYTE)rtPacketInfo->RtPackets[rtPacketIndex]);
+                        TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - rtPacketIndex, dstIndexInRtPacket, %u, %u", rtPacketIndex, dstIndexInRtPacket);
+                    }
                 }
-                srcIndex += (usbBytesPerSample * usbChannels);
-                dstIndexInRtPacket += m_inputBytesPerSample * rtPacketInfo->Channels;
-                bytesCopiedDstData += m_inputBytesPerSample;
-                bytesCopiedSrcData += m_inputBytesPerSample;
-                if (dstIndexInRtPacket >= rtPacketInfo->RtPacketSize)
+
+                RtlZeroMemory(frameSamples, channels * sizeof(LONG));
+                for (ULONG spanIndex = 0; spanIndex < channelSpanCount; ++spanIndex)
                 {
-                    bytesCopiedUpToBoundary = totalProcessedBytesSoFar + bytesCopiedSrcData;
-                    bytesCopiedDstDataUpToBoundary = bytesCopiedDstData;
-                    filledRtPacket = true;
-                    dstIndexInRtPacket = acxCh * m_inputBytesPerSample;
-                    rtPacketIndex++;
-                    rtPacketIndex %= rtPacketInfo->RtPacketsCount;
-                    dstData = ((PBYTE)rtPacketInfo->RtPackets[rtPacketIndex]);
-                    TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - acxCh, rtPacketIndex, dstIndexInRtPacket, %u, %u, %u", acxCh, rtPacketIndex, dstIndexInRtPacket);
+                    const CHANNEL_SPAN & channelSpan = channelSpans[spanIndex];
+                    if (channelSpan.UsbChannel + channelSpan.Channels <= usbChannels)
+                    {
+                        loadSamples(frameSamples + channelSpan.Channel, buffer + frame * srcFrameBytes + channelSpan.UsbChannel * usbBytesPerSample, usbBytesPerSample, channelSpan.Channels);
+                    }
                 }
+                resampler->PushFrame(frameSamples);
+                bytesCopiedSrcData += srcFrameBytes;
             }
+            break;
         }
-    }
-    break;
-    case UACSampleFormat::UAC_SAMPLE_FORMAT_IEEE_FLOAT: {
-        for (ULONG acxCh = 0; acxCh < rtPacketInfo->Channels; acxCh++)
+
+        // The USB buffer and the RtPacket ring are walked once, span by span, in the same way as CopyFromRtPacketToOutputData. Channels that are not routed are
+        // written as silence, as in the resampled path.
+        const SAMPLE_COPY_FUNCTION copySamples = m_inputCopySamples;
+        const ULONG                channels = rtPacketInfo->Channels;
+        const ULONG                srcFrameBytes = usbBytesPerSample * usbChannels;
+        const ULONG                dstFrameBytes = m_inputBytesPerSample * channels;
+        const ULONG                frames = length / srcFrameBytes;
+        const CHANNEL_SPAN *       channelSpans = rtPacketInfo->Spans;
+        const ULONG                channelSpanCount = rtPacketInfo->SpanCount;
+        ULONG                      rtPacketIndex = (rtPacketInfo->RtPacketPosition / rtPacketInfo->RtPacketSize) % rtPacketInfo->RtPacketsCount;
+        ULONG                      dstIndexInRtPacket = rtPacketInfo->RtPacketPosition % rtPacketInfo->RtPacketSize;
+        PBYTE                      srcData = (PBYTE)buffer;
+        PBYTE                      dstData = (PBYTE)rtPacketInfo->RtPackets[rtPacketIndex];
+
+        TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - rtPacketIndex, dstIndexInRtPacket, frames, %u, %u, %u", rtPacketIndex, dstIndexInRtPacket, frames);
+        TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - srcData, buffer, length = %p, %p, %u", srcData, buffer, length);
+
+        for (ULONG frame = 0; frame < frames;)
         {
-            ULONG rtPacketIndex = (rtPacketInfo->RtPacketPosition / rtPacketInfo->RtPacketSize) % rtPacketInfo->RtPacketsCount;
-            ULONG dstIndexInRtPacket = rtPacketInfo->RtPacketPosition % rtPacketInfo->RtPacketSize + acxCh * m_inputBytesPerSample;
-            PBYTE srcData = (PBYTE)buffer;
-            PBYTE dstData = (PBYTE)rtPacketInfo->RtPackets[rtPacketIndex];
-
-            TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - acxCh, rtPacketIndex, dstIndexInRtPacket, %u, %u, %u", acxCh, rtPacketIndex, dstIndexInRtPacket);
-            TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - srcData, buffer, length = %p, %p, %u", srcData, buffer, length);
-            for (ULONG srcIndex = (acxCh + rtPacketInfo->UsbChannel) * usbBytesPerSample; srcIndex < length;)
+            ULONG        dstFrames = (dstIndexInRtPacket < rtPacketInfo->RtPacketSize) ? (rtPacketInfo->RtPacketSize - dstIndexInRtPacket + dstFrameBytes - 1) / dstFrameBytes : 1;
+            ULONG        spanFrames = min(frames - frame, dstFrames);
+            const BYTE * srcSpan = srcData + frame * srcFrameBytes;
+            PUCHAR       dstSpan = dstData + dstIndexInRtPacket;
+
+            SampleConverter::CopyChannelSpansFromUsb(dstSpan, m_inputBytesPerSample, channels, srcSpan, usbBytesPerSample, usbChannels, channelSpans, channelSpanCount, spanFrames, copySamples);
+
+            frame += spanFrames;
+            dstIndexInRtPacket += dstFrameBytes * spanFrames;
+            bytesCopiedSrcData += srcFrameBytes * spanFrames;
+            bytesCopiedDstData += dstFrameBytes * spanFrames;
+            if (dstIndexInRtPacket >= rtPacketInfo->RtPacketSize)
             {
-                // TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - dstIndexInRtPacket, dstIndex = %u, %u", dstIndexInRtPacket, srcIndex);
-
-                *((float *)(dstData + dstIndexInRtPacket)) = *((float *)(srcData + srcIndex));
-                srcIndex += (usbBytesPerSample * usbChannels);
-                dstIndexInRtPacket += m_inputBytesPerSample * rtPacketInfo->Channels;
-                bytesCopiedDstData += m_inputBytesPerSample;
-                bytesCopiedSrcData += m_inputBytesPerSample;
-                if (dstIndexInRtPacket >= rtPacketInfo->RtPacketSize)
-                {
-                    bytesCopiedUpToBoundary = totalProcessedBytesSoFar + bytesCopiedSrcData;
-                    bytesCopiedDstDataUpToBoundary = bytesCopiedDstData;
-                    filledRtPacket = true;
-                    dstIndexInRtPacket = acxCh * m_inputBytesPerSample;
-                    rtPacketIndex++;
-                    rtPacketIndex %= rtPacketInfo->RtPacketsCount;
-                    dstData = ((PBYTE)rtPacketInfo->RtPackets[rtPacketIndex]);
-                    TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - acxCh, rtPacketIndex, dstIndexInRtPacket, %u, %u, %u", acxCh, rtPacketIndex, dstIndexInRtPacket);
-                }
+                bytesCopiedUpToBoundary = totalProcessedBytesSoFar + bytesCopiedSrcData;
+                bytesCopiedDstDataUpToBoundary = bytesCopiedDstData;
+                filledRtPacket = true;
+                dstIndexInRtPacket = 0;
+                rtPacketIndex++;
+                rtPacketIndex %= rtPacketInfo->RtPacketsCount;
+                dstData = ((PBYTE)rtPacketInfo->RtPackets[rtPacketIndex]);
+                TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - rtPacketIndex, dstIndexInRtPacket, %u, %u", rtPacketIndex, dstIndexInRtPacket);
             }
         }
     }
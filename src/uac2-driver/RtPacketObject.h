@@ -25,8 +25,10 @@ Environment:
 #define _RTPACKETOBJECT_H_
 
 #include <acx.h>
+#include "SampleConverter.h"
 
 class ContiguousMemory;
+class SampleRateConverter;
 class TransferObject;
 
 class RtPacketObject
@@ -93,6 +95,17 @@ class RtPacketObject
         _In_ ULONG                                                                  numOfChannelsPerDevice
     );
 
+    //
+    // Builds, rebuilds or releases the resamplers of every device whose
+    // RtPackets are set, for the current stream and device sample rates.
+    // The copy paths only use what was built here or in SetRtPackets.
+    //
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    void PrepareResamplers(
+        _In_ bool isInput
+    );
+
     __drv_maxIRQL(PASSIVE_LEVEL)
     PAGED_CODE_SEG
     void UnsetRtPackets(
@@ -181,18 +194,30 @@ class RtPacketObject
   private:
     typedef struct _RT_PACKET_INFO
     {
-        PVOID *   RtPackets{nullptr}; // This is retained regardless of Run/Stop.
-        ULONG     RtPacketsCount{0};  // This is retained regardless of Run/Stop.
-        ULONG     RtPacketSize{0};    // This is retained regardless of Run/Stop.
-        ULONGLONG RtPacketPosition{0ULL};
-        ULONGLONG RtPacketEstimatedPosition{0ULL};
-        ULONG     RtPacketCurrentPacket{0};
-        ULONGLONG LastPacketStartQpcPosition{0ULL};
-        ULONG     UsbChannel{0}; // stereo 2nd stream will be 2
-        ULONG     Channels{0};   // Number of channels in Acx Audio
-        bool      Pause{false};
+        PVOID *               RtPackets{nullptr};             // This is retained regardless of Run/Stop.
+        ULONG                 RtPacketsCount{0};              // This is retained regardless of Run/Stop.
+        ULONG                 RtPacketSize{0};                // This is retained regardless of Run/Stop.
+        ULONGLONG             RtPacketPosition{0ULL};
+        ULONGLONG             RtPacketEstimatedPosition{0ULL};
+        ULONG                 RtPacketCurrentPacket{0};
+        ULONGLONG             LastPacketStartQpcPosition{0ULL};
+        ULONG                 UsbChannel{0};                  // stereo 2nd stream will be 2
+        ULONG                 Channels{0};                    // Number of channels in Acx Audio
+        bool                  Pause{false};
+        CHANNEL_SPAN          Spans[UAC_MAX_ASIO_CHANNELS]{}; // Routing of the Acx Audio channels to the USB channels, built in SetRtPackets.
+        ULONG                 SpanCount{0};
+        SampleRateConverter * Resampler{nullptr};             // Allocated while the Acx Audio sample rate differs from the device sample rate.
+        SRC_LOAD_FUNCTION     ResamplerLoad{nullptr};         // Selected with the resampler for the width of its input side.
+        SRC_STORE_FUNCTION    ResamplerStore{nullptr};        // Selected with the resampler; mixes into the USB buffer for output.
     } RT_PACKET_INFO;
 
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    SampleRateConverter * PrepareResampler(
+        _In_ bool               isInput,
+        _Inout_ RT_PACKET_INFO * rtPacketInfo
+    );
+
     const PDEVICE_CONTEXT m_deviceContext;
     RT_PACKET_INFO *      m_inputRtPacketInfo{nullptr};
     RT_PACKET_INFO *      m_outputRtPacketInfo{nullptr};
@@ -209,6 +234,11 @@ class RtPacketObject
     ULONG         m_outputPaddingBytes{0};
     DWORD         m_inputAvgBytesPerSec{0};
     DWORD         m_outputAvgBytesPerSec{0};
+    ULONG         m_inputSampleRate{0};        // The sample rate of Acx Audio, or 0 if it cannot be resampled.
+    ULONG         m_outputSampleRate{0};       // The sample rate of Acx Audio, or 0 if it cannot be resampled.
+
+    SAMPLE_COPY_FUNCTION m_inputCopySamples{nullptr}; // Selected in SetDataFormat according to the Acx Audio format.
+    SAMPLE_MIX_FUNCTION  m_outputMixSamples{nullptr}; // Selected in SetDataFormat according to the Acx Audio format.
 };
 
 #endif
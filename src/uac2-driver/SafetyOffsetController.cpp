@@ -0,0 +1,224 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+// ASIO is a trademark and software of Steinberg Media Technologies GmbH
+
+/*++
+
+Module Name:
+
+    SafetyOffsetController.cpp
+
+Abstract:
+
+    Implement a class that records the output safety offset and the wake
+    latency of the mixing engine thread, and adapts the output offset.
+
+Environment:
+
+    Kernel-mode Driver Framework
+
+--*/
+
+#ifdef UAC_HOST_BUILD
+#include "HostCompat.h"
+#else
+#include "Driver.h"
+#include "Device.h"
+#endif
+#include "SafetyOffsetController.h"
+
+#if !defined(__INTELLISENSE__) && !defined(UAC_HOST_BUILD)
+#include "SafetyOffsetController.tmh"
+#endif
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+void SafetyOffsetController::Reset(
+    ULONG     configuredOffsetFrame,
+    ULONG     minimumOffsetFrame,
+    ULONG     framesPerMs,
+    ULONG     quietPeriodSeconds,
+    ULONGLONG currentTimeUs
+)
+{
+    PAGED_CODE();
+
+    m_configuredOffsetFrame = configuredOffsetFrame;
+    m_minimumOffsetFrame = (minimumOffsetFrame < configuredOffsetFrame) ? minimumOffsetFrame : configuredOffsetFrame;
+    m_framesPerMs = (framesPerMs != 0) ? framesPerMs : 1;
+    m_quietPeriodSeconds = quietPeriodSeconds;
+    m_offsetFrame = configuredOffsetFrame;
+    m_failedOffsetFrame = 0;
+    m_dropouts = 0;
+    m_wakeLatencies = 0;
+    m_lastChangeUs = currentTimeUs;
+    m_lastBackOffUs = 0ULL;
+    RtlZeroMemory(m_safetyOffsetHistogram, sizeof(m_safetyOffsetHistogram));
+    RtlZeroMemory(m_wakeLatencyHistogram, sizeof(m_wakeLatencyHistogram));
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+void SafetyOffsetController::RecordSafetyOffset(
+    LONG safetyOffsetFrame
+)
+{
+    PAGED_CODE();
+
+    ULONG bucket = (safetyOffsetFrame < 0) ? 0 : (ULONG)safetyOffsetFrame;
+    if (bucket >= UAC_SAFETY_OFFSET_HISTOGRAM_SIZE)
+    {
+        bucket = UAC_SAFETY_OFFSET_HISTOGRAM_SIZE - 1;
+    }
+    m_safetyOffsetHistogram[bucket]++;
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+void SafetyOffsetController::RecordWakeLatency(
+    LONG wakeLatencyUs
+)
+{
+    PAGED_CODE();
+
+    ULONG bucket = (wakeLatencyUs < 0) ? 0 : (ULONG)wakeLatencyUs / UAC_WAKE_LATENCY_BUCKET_US;
+    if (bucket >= UAC_WAKE_LATENCY_HISTOGRAM_SIZE)
+    {
+        bucket = UAC_WAKE_LATENCY_HISTOGRAM_SIZE - 1;
+    }
+    m_wakeLatencyHistogram[bucket]++;
+    m_wakeLatencies++;
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+ULONG SafetyOffsetController::CalculateLowerLimitFrame() const
+{
+    PAGED_CODE();
+
+    ULONG lowerLimitFrame = m_minimumOffsetFrame;
+
+    if ((m_failedOffsetFrame != 0) && (lowerLimitFrame <= m_failedOffsetFrame))
+    {
+        lowerLimitFrame = m_failedOffsetFrame + 1;
+    }
+
+    // The offset has to cover the time the thread may take to get to the packets after they become due.
+    // The quantile is taken at the upper edge of its bucket, and nothing is lowered before there are enough samples to have one.
+    if (m_wakeLatencies < (1000 / (1000 - SAFETY_OFFSET_LATENCY_PERMILLE)))
+    {
+        return m_configuredOffsetFrame;
+    }
+    ULONG requiredLatencies = (ULONG)((ULONGLONG)m_wakeLatencies * SAFETY_OFFSET_LATENCY_PERMILLE / 1000);
+
+    ULONG latencies = 0;
+    for (ULONG bucket = 0; bucket < UAC_WAKE_LATENCY_HISTOGRAM_SIZE; ++bucket)
+    {
+        latencies += m_wakeLatencyHistogram[bucket];
+        if (latencies >= requiredLatencies)
+        {
+            ULONG latencyFrame = ((bucket + 1) * UAC_WAKE_LATENCY_BUCKET_US * m_framesPerMs + 999) / 1000;
+            if (lowerLimitFrame < latencyFrame)
+            {
+                lowerLimitFrame = latencyFrame;
+            }
+            break;
+        }
+    }
+
+    return lowerLimitFrame;
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+bool SafetyOffsetController::Update(
+    ULONGLONG currentTimeUs
+)
+{
+    PAGED_CODE();
+
+    if ((m_quietPeriodSeconds == 0) || ((currentTimeUs - m_lastChangeUs) < (ULONGLONG)m_quietPeriodSeconds * 1000000ULL))
+    {
+        return false;
+    }
+
+    m_lastChangeUs = currentTimeUs;
+
+    if (m_offsetFrame <= CalculateLowerLimitFrame())
+    {
+        return false;
+    }
+
+    m_offsetFrame--;
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "safety offset lowered to %u frames, configured %u, minimum %u, failed %u", m_offsetFrame, m_configuredOffsetFrame, m_minimumOffsetFrame, m_failedOffsetFrame);
+
+    return true;
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+bool SafetyOffsetController::BackOff(
+    ULONGLONG currentTimeUs
+)
+{
+    PAGED_CODE();
+
+    m_dropouts++;
+
+    if ((m_quietPeriodSeconds == 0) || ((m_lastBackOffUs != 0ULL) && ((currentTimeUs - m_lastBackOffUs) < SAFETY_OFFSET_BACK_OFF_HOLD_US)))
+    {
+        return false;
+    }
+
+    m_lastBackOffUs = currentTimeUs;
+    m_lastChangeUs = currentTimeUs;
+
+    if (m_offsetFrame >= m_configuredOffsetFrame)
+    {
+        // A dropout at the configured offset is not caused by the controller, so it does not limit later steps.
+        return false;
+    }
+
+    if (m_failedOffsetFrame < m_offsetFrame)
+    {
+        m_failedOffsetFrame = m_offsetFrame;
+    }
+    m_offsetFrame += m_framesPerMs;
+    if (m_offsetFrame > m_configuredOffsetFrame)
+    {
+        m_offsetFrame = m_configuredOffsetFrame;
+    }
+    TraceEvents(TRACE_LEVEL_WARNING, TRACE_DEVICE, "safety offset raised to %u frames after a dropout at %u frames", m_offsetFrame, m_failedOffsetFrame);
+
+    return true;
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+ULONG SafetyOffsetController::GetOffsetFrame() const
+{
+    PAGED_CODE();
+
+    return m_offsetFrame;
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+void SafetyOffsetController::GetContext(
+    PUAC_SAFETY_OFFSET_CONTEXT context
+) const
+{
+    PAGED_CODE();
+
+    context->QuietPeriodSeconds = m_quietPeriodSeconds;
+    context->ConfiguredOffsetFrame = m_configuredOffsetFrame;
+    context->MinimumOffsetFrame = m_minimumOffsetFrame;
+    context->CurrentOffsetFrame = m_offsetFrame;
+    context->Dropouts = m_dropouts;
+    RtlCopyMemory(context->SafetyOffsetHistogram, m_safetyOffsetHistogram, sizeof(context->SafetyOffsetHistogram));
+    RtlCopyMemory(context->WakeLatencyHistogram, m_wakeLatencyHistogram, sizeof(context->WakeLatencyHistogram));
+}
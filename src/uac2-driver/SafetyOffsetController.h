@@ -0,0 +1,114 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+// ASIO is a trademark and software of Steinberg Media Technologies GmbH
+
+/*++
+
+Module Name:
+
+    SafetyOffsetController.h
+
+Abstract:
+
+    Define a class that records the output safety offset and the wake latency
+    of the mixing engine thread, and optionally lowers the output offset while
+    no dropout is detected.
+
+Environment:
+
+    Kernel-mode Driver Framework
+
+--*/
+
+#ifndef _SAFETY_OFFSET_CONTROLLER_H_
+#define _SAFETY_OFFSET_CONTROLLER_H_
+
+#define SAFETY_OFFSET_BACK_OFF_HOLD_US 100000 // Dropouts reported while the margin recovers from a back off count once
+#define SAFETY_OFFSET_LATENCY_PERMILLE 999    // Wake latency quantile that the offset has to cover
+
+//
+// The offset starts at the value of the driver settings table. While the
+// controller is enabled, it is lowered by one packet each quiet period
+// without a dropout, down to the largest of the minimum offset, the wake
+// latency quantile and one packet above any offset that dropped out. A
+// dropout raises it by 1 ms at once, up to the configured offset.
+//
+class SafetyOffsetController
+{
+  public:
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    void Reset(
+        _In_ ULONG     configuredOffsetFrame,
+        _In_ ULONG     minimumOffsetFrame,
+        _In_ ULONG     framesPerMs,
+        _In_ ULONG     quietPeriodSeconds,
+        _In_ ULONGLONG currentTimeUs
+    );
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    void RecordSafetyOffset(
+        _In_ LONG safetyOffsetFrame
+    );
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    void RecordWakeLatency(
+        _In_ LONG wakeLatencyUs
+    );
+
+    //
+    // Lowers the offset if a quiet period has passed since the last change.
+    // Returns true if the offset changed.
+    //
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    bool Update(
+        _In_ ULONGLONG currentTimeUs
+    );
+
+    //
+    // Called when the safety offset falls below the current offset.
+    // Returns true if the offset changed.
+    //
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    bool BackOff(
+        _In_ ULONGLONG currentTimeUs
+    );
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    ULONG GetOffsetFrame() const;
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    void GetContext(
+        _Out_ PUAC_SAFETY_OFFSET_CONTEXT context
+    ) const;
+
+  private:
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    ULONG CalculateLowerLimitFrame() const;
+
+    ULONG     m_configuredOffsetFrame{0};
+    ULONG     m_minimumOffsetFrame{0};
+    ULONG     m_framesPerMs{1};
+    ULONG     m_quietPeriodSeconds{0};
+    ULONG     m_offsetFrame{0};
+    ULONG     m_failedOffsetFrame{0}; // Largest lowered offset that dropped out, 0 if none
+    ULONG     m_dropouts{0};
+    ULONG     m_wakeLatencies{0};
+    ULONGLONG m_lastChangeUs{0ULL};
+    ULONGLONG m_lastBackOffUs{0ULL};
+    ULONG     m_safetyOffsetHistogram[UAC_SAFETY_OFFSET_HISTOGRAM_SIZE]{};
+    ULONG     m_wakeLatencyHistogram[UAC_WAKE_LATENCY_HISTOGRAM_SIZE]{};
+};
+
+#endif
@@ -0,0 +1,1615 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+// ASIO is a trademark and software of Steinberg Media Technologies GmbH
+
+/*++
+
+Module Name:
+
+    SampleConverter.cpp
+
+Abstract:
+
+    Implement a class that converts audio samples between the non-interleaved
+    ASIO buffer layout and the interleaved USB isochronous buffer layout.
+
+    Channels are processed in groups whose samples are loaded into 32-bit
+    lanes, transposed so that one vector holds one frame (or one channel) of
+    the group, and then packed to the destination sample width before being
+    stored.
+
+Environment:
+
+    Kernel-mode Driver Framework
+
+--*/
+
+#ifdef UAC_HOST_BUILD
+#include "HostCompat.h"
+#else
+#include "Driver.h"
+#include "Device.h"
+#include "Public.h"
+#include "Common.h"
+#endif
+#include "SampleConverter.h"
+
+#if defined(_M_X64)
+#include <immintrin.h>
+#elif defined(_M_ARM64)
+#include <arm_neon.h>
+#endif
+
+#if !defined(__INTELLISENSE__) && !defined(UAC_HOST_BUILD)
+#include "SampleConverter.tmh"
+#endif
+
+//
+// Number of frames deinterleaved for all channel groups before moving on to
+// the next frames, so that each USB frame is fetched from memory only once.
+//
+#define DEINTERLEAVE_BLOCK_FRAMES 16
+
+//
+// Streams with at least this many channels are mixed frame by frame, so that
+// each kernel call covers the contiguous channels of one frame. Narrower
+// streams are mixed channel by channel over all the frames.
+//
+#define FRAME_MAJOR_MIX_MIN_CHANNELS 4
+
+bool SampleConverter::s_isSsse3Available = false;
+bool SampleConverter::s_isAvxAvailable = false;
+
+typedef void (*PLANAR_TO_INTERLEAVED_GROUP)(
+    _Out_ PUCHAR      interleaved,
+    _In_ ULONG        bytesPerBlock,
+    _In_ const BYTE * planar,
+    _In_ ULONG        planarChannelStride,
+    _In_ ULONG        samples
+);
+
+typedef void (*INTERLEAVED_TO_PLANAR_GROUP)(
+    _Out_ PBYTE        planar,
+    _In_ ULONG         planarChannelStride,
+    _In_ const UCHAR * interleaved,
+    _In_ ULONG         bytesPerBlock,
+    _In_ ULONG         samples
+);
+
+static __forceinline void CopyPlanarChannelToInterleaved(
+    _Out_ PUCHAR      interleaved,
+    _In_ ULONG        bytesPerBlock,
+    _In_ ULONG        usbBytesPerSample,
+    _In_ const BYTE * planar,
+    _In_ ULONG        asioSampleSize,
+    _In_ ULONG        samples
+)
+{
+    switch (usbBytesPerSample)
+    {
+    case 1:
+        for (ULONG index = 0; index < samples; ++index)
+        {
+            interleaved[index * bytesPerBlock] = planar[index * asioSampleSize];
+        }
+        break;
+    case 2:
+        for (ULONG index = 0; index < samples; ++index)
+        {
+            *(UNALIGNED USHORT *)&(interleaved[index * bytesPerBlock]) = *(const UNALIGNED USHORT *)&(planar[index * asioSampleSize]);
+        }
+        break;
+    case 3:
+        for (ULONG index = 0; index < samples; ++index)
+        {
+            const BYTE * src = &(planar[index * asioSampleSize]);
+            BYTE *       dst = &(interleaved[index * bytesPerBlock]);
+            *dst++ = *src++;
+            *dst++ = *src++;
+            *dst++ = *src++;
+        }
+        break;
+    case 4:
+        for (ULONG index = 0; index < samples; ++index)
+        {
+            *(UNALIGNED ULONG *)&(interleaved[index * bytesPerBlock]) = *(const UNALIGNED ULONG *)&(planar[index * asioSampleSize]);
+        }
+        break;
+    default:
+        break; // max 32bit
+    }
+}
+
+//
+// The USB sample is stored in the upper bytes of the ASIO sample and the
+// remaining lower bytes are cleared.
+//
+static __forceinline void CopyInterleavedChannelToPlanar(
+    _Out_ PBYTE        planar,
+    _In_ ULONG         asioSampleSize,
+    _In_ const UCHAR * interleaved,
+    _In_ ULONG         bytesPerBlock,
+    _In_ ULONG         usbBytesPerSample,
+    _In_ ULONG         samples
+)
+{
+    const ULONG asioByteOffset = asioSampleSize - usbBytesPerSample;
+
+    if ((asioSampleSize == 4) && (usbBytesPerSample != 4))
+    {
+        const ULONG shift = asioByteOffset * 8;
+        for (ULONG index = 0; index < samples; ++index)
+        {
+            const UCHAR * src = &(interleaved[index * bytesPerBlock]);
+            ULONG         value = src[0];
+            for (ULONG byte = 1; byte < usbBytesPerSample; ++byte)
+            {
+                value |= (ULONG)src[byte] << (byte * 8);
+            }
+            *(UNALIGNED ULONG *)&(planar[index * 4]) = value << shift;
+        }
+        return;
+    }
+
+    switch (usbBytesPerSample)
+    {
+    case 2:
+        if (asioByteOffset == 0)
+        {
+            for (ULONG index = 0; index < samples; ++index)
+            {
+                *(UNALIGNED USHORT *)&(planar[index * asioSampleSize]) = *(const UNALIGNED USHORT *)&(interleaved[index * bytesPerBlock]);
+            }
+            return;
+        }
+        break;
+    case 3:
+        if (asioByteOffset == 0)
+        {
+            for (ULONG index = 0; index < samples; ++index)
+            {
+                const UCHAR * src = &(interleaved[index * bytesPerBlock]);
+                BYTE *        dst = &(planar[index * asioSampleSize]);
+                *dst++ = *src++;
+                *dst++ = *src++;
+                *dst++ = *src++;
+            }
+            return;
+        }
+        break;
+    case 4:
+        for (ULONG index = 0; index < samples; ++index)
+        {
+            *(UNALIGNED ULONG *)&(planar[index * asioSampleSize]) = *(const UNALIGNED ULONG *)&(interleaved[index * bytesPerBlock]);
+        }
+        return;
+    default:
+        break;
+    }
+
+    for (ULONG index = 0; index < samples; ++index)
+    {
+        const UCHAR * src = &(interleaved[index * bytesPerBlock]);
+        BYTE *        dst = &(planar[index * asioSampleSize]);
+        for (ULONG byte = 0; byte < asioByteOffset; ++byte)
+        {
+            *dst++ = 0;
+        }
+        for (ULONG byte = 0; byte < usbBytesPerSample; ++byte)
+        {
+            *dst++ = *src++;
+        }
+    }
+}
+
+#if defined(_M_X64) || defined(_M_ARM64)
+
+//
+// Byte index table that spreads four packed sampleBytes-wide samples into
+// 32-bit lanes, placing each sample at laneOffset and clearing the rest.
+//
+static __forceinline void BuildSpreadTable(
+    _Out_writes_(16) UCHAR table[16],
+    _In_ ULONG             sampleBytes,
+    _In_ ULONG             laneOffset
+)
+{
+    for (ULONG lane = 0; lane < 4; ++lane)
+    {
+        for (ULONG byte = 0; byte < 4; ++byte)
+        {
+            bool isSampleByte = (byte >= laneOffset) && (byte < laneOffset + sampleBytes);
+            table[lane * 4 + byte] = isSampleByte ? (UCHAR)(lane * sampleBytes + byte - laneOffset) : 0x80;
+        }
+    }
+}
+
+//
+// Byte index table that moves sampleBytes bytes starting at laneOffset of
+// each 32-bit lane to the front of the vector, packed back to back.
+//
+static __forceinline void BuildPackTable(
+    _Out_writes_(16) UCHAR table[16],
+    _In_ ULONG             laneOffset,
+    _In_ ULONG             sampleBytes
+)
+{
+    ULONG pos = 0;
+
+    for (ULONG lane = 0; lane < 4; ++lane)
+    {
+        for (ULONG byte = 0; byte < sampleBytes; ++byte)
+        {
+            table[pos++] = (UCHAR)(lane * 4 + laneOffset + byte);
+        }
+    }
+    while (pos < 16)
+    {
+        table[pos++] = 0x80;
+    }
+}
+
+#if defined(_M_X64)
+
+typedef __m128i LANES;
+
+static __forceinline LANES LoadTable(
+    _In_reads_(16) const UCHAR table[16]
+)
+{
+    return _mm_loadu_si128((const __m128i *)table);
+}
+
+template <ULONG Bytes>
+static __forceinline LANES LoadBytes(
+    _In_reads_bytes_(Bytes) const BYTE * src
+)
+{
+    if (Bytes == 16)
+    {
+        return _mm_loadu_si128((const __m128i *)src);
+    }
+    else if (Bytes == 12)
+    {
+        return _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *)src), _mm_cvtsi32_si128(*(const UNALIGNED LONG *)(src + 8)));
+    }
+    else if (Bytes == 8)
+    {
+        return _mm_loadl_epi64((const __m128i *)src);
+    }
+    else
+    {
+        return _mm_cvtsi32_si128(*(const UNALIGNED LONG *)src);
+    }
+}
+
+static __forceinline void TransposeLanes(
+    _Inout_ LANES & r0,
+    _Inout_ LANES & r1,
+    _Inout_ LANES & r2,
+    _Inout_ LANES & r3
+)
+{
+    __m128i t0 = _mm_unpacklo_epi32(r0, r1);
+    __m128i t1 = _mm_unpacklo_epi32(r2, r3);
+    __m128i t2 = _mm_unpackhi_epi32(r0, r1);
+    __m128i t3 = _mm_unpackhi_epi32(r2, r3);
+    r0 = _mm_unpacklo_epi64(t0, t1);
+    r1 = _mm_unpackhi_epi64(t0, t1);
+    r2 = _mm_unpacklo_epi64(t2, t3);
+    r3 = _mm_unpackhi_epi64(t2, t3);
+}
+
+static __forceinline LANES ShuffleBytes(
+    _In_ LANES lanes,
+    _In_ LANES table
+)
+{
+    return _mm_shuffle_epi8(lanes, table);
+}
+
+template <ULONG Bytes>
+static __forceinline void StoreBytes(
+    _Out_writes_bytes_(Bytes) PUCHAR dst,
+    _In_ LANES                       lanes
+)
+{
+    if (Bytes == 16)
+    {
+        _mm_storeu_si128((__m128i *)dst, lanes);
+    }
+    else if (Bytes == 12)
+    {
+        _mm_storel_epi64((__m128i *)dst, lanes);
+        *(UNALIGNED LONG *)(dst + 8) = _mm_cvtsi128_si32(_mm_srli_si128(lanes, 8));
+    }
+    else if (Bytes == 8)
+    {
+        _mm_storel_epi64((__m128i *)dst, lanes);
+    }
+    else
+    {
+        *(UNALIGNED LONG *)dst = _mm_cvtsi128_si32(lanes);
+    }
+}
+
+#elif defined(_M_ARM64)
+
+typedef uint8x16_t LANES;
+
+static __forceinline LANES LoadTable(
+    _In_reads_(16) const UCHAR table[16]
+)
+{
+    return vld1q_u8(table);
+}
+
+template <ULONG Bytes>
+static __forceinline LANES LoadBytes(
+    _In_reads_bytes_(Bytes) const BYTE * src
+)
+{
+    if (Bytes == 16)
+    {
+        return vld1q_u8(src);
+    }
+    else if (Bytes == 12)
+    {
+        uint32x2_t hi = vld1_lane_u32((const uint32_t *)(src + 8), vdup_n_u32(0), 0);
+        return vcombine_u8(vld1_u8(src), vreinterpret_u8_u32(hi));
+    }
+    else if (Bytes == 8)
+    {
+        return vcombine_u8(vld1_u8(src), vdup_n_u8(0));
+    }
+    else
+    {
+        return vreinterpretq_u8_u32(vld1q_lane_u32((const uint32_t *)src, vdupq_n_u32(0), 0));
+    }
+}
+
+static __forceinline void TransposeLanes(
+    _Inout_ LANES & r0,
+    _Inout_ LANES & r1,
+    _Inout_ LANES & r2,
+    _Inout_ LANES & r3
+)
+{
+    uint32x4x2_t t0 = vtrnq_u32(vreinterpretq_u32_u8(r0), vreinterpretq_u32_u8(r1));
+    uint32x4x2_t t1 = vtrnq_u32(vreinterpretq_u32_u8(r2), vreinterpretq_u32_u8(r3));
+    r0 = vreinterpretq_u8_u32(vcombine_u32(vget_low_u32(t0.val[0]), vget_low_u32(t1.val[0])));
+    r1 = vreinterpretq_u8_u32(vcombine_u32(vget_low_u32(t0.val[1]), vget_low_u32(t1.val[1])));
+    r2 = vreinterpretq_u8_u32(vcombine_u32(vget_high_u32(t0.val[0]), vget_high_u32(t1.val[0])));
+    r3 = vreinterpretq_u8_u32(vcombine_u32(vget_high_u32(t0.val[1]), vget_high_u32(t1.val[1])));
+}
+
+static __forceinline LANES ShuffleBytes(
+    _In_ LANES lanes,
+    _In_ LANES table
+)
+{
+    return vqtbl1q_u8(lanes, table);
+}
+
+template <ULONG Bytes>
+static __forceinline void StoreBytes(
+    _Out_writes_bytes_(Bytes) PUCHAR dst,
+    _In_ LANES                       lanes
+)
+{
+    if (Bytes == 16)
+    {
+        vst1q_u8(dst, lanes);
+    }
+    else if (Bytes == 12)
+    {
+        vst1_u8(dst, vget_low_u8(lanes));
+        vst1q_lane_u32((uint32_t *)(dst + 8), vreinterpretq_u32_u8(lanes), 2);
+    }
+    else if (Bytes == 8)
+    {
+        vst1_u8(dst, vget_low_u8(lanes));
+    }
+    else
+    {
+        vst1q_lane_u32((uint32_t *)dst, vreinterpretq_u32_u8(lanes), 0);
+    }
+}
+
+#endif
+
+//
+// Converts four adjacent channels. Each iteration loads four samples of
+// every channel, transposes the 4x4 block so that each vector holds one
+// frame, and stores 4 * UsbBytes bytes per frame.
+//
+template <ULONG AsioBytes, ULONG UsbBytes>
+PAGED_CODE_SEG
+static void PlanarToInterleavedGroup4(
+    PUCHAR       interleaved,
+    ULONG        bytesPerBlock,
+    const BYTE * planar,
+    ULONG        planarChannelStride,
+    ULONG        samples
+)
+{
+    UCHAR spread[16];
+    UCHAR pack[16];
+    ULONG index = 0;
+
+    BuildSpreadTable(spread, AsioBytes, 0);
+    BuildPackTable(pack, AsioBytes - UsbBytes, UsbBytes);
+
+    const LANES  spreadTable = LoadTable(spread);
+    const LANES  packTable = LoadTable(pack);
+    const BYTE * src0 = planar;
+    const BYTE * src1 = planar + planarChannelStride;
+    const BYTE * src2 = planar + planarChannelStride * 2;
+    const BYTE * src3 = planar + planarChannelStride * 3;
+
+    for (; index + 4 <= samples; index += 4)
+    {
+        const ULONG srcOffset = index * AsioBytes;
+        LANES       r0 = LoadBytes<AsioBytes * 4>(src0 + srcOffset);
+        LANES       r1 = LoadBytes<AsioBytes * 4>(src1 + srcOffset);
+        LANES       r2 = LoadBytes<AsioBytes * 4>(src2 + srcOffset);
+        LANES       r3 = LoadBytes<AsioBytes * 4>(src3 + srcOffset);
+
+        if (AsioBytes != 4)
+        {
+            r0 = ShuffleBytes(r0, spreadTable);
+            r1 = ShuffleBytes(r1, spreadTable);
+            r2 = ShuffleBytes(r2, spreadTable);
+            r3 = ShuffleBytes(r3, spreadTable);
+        }
+
+        TransposeLanes(r0, r1, r2, r3);
+
+        if ((AsioBytes != 4) || (UsbBytes != 4))
+        {
+            r0 = ShuffleBytes(r0, packTable);
+            r1 = ShuffleBytes(r1, packTable);
+            r2 = ShuffleBytes(r2, packTable);
+            r3 = ShuffleBytes(r3, packTable);
+        }
+
+        PUCHAR dst = interleaved + index * bytesPerBlock;
+        StoreBytes<UsbBytes * 4>(dst, r0);
+        StoreBytes<UsbBytes * 4>(dst + bytesPerBlock, r1);
+        StoreBytes<UsbBytes * 4>(dst + bytesPerBlock * 2, r2);
+        StoreBytes<UsbBytes * 4>(dst + bytesPerBlock * 3, r3);
+    }
+
+    if (index < samples)
+    {
+        for (ULONG ch = 0; ch < 4; ++ch)
+        {
+            CopyPlanarChannelToInterleaved(
+                interleaved + index * bytesPerBlock + ch * UsbBytes,
+                bytesPerBlock,
+                UsbBytes,
+                planar + ch * planarChannelStride + index * AsioBytes + (AsioBytes - UsbBytes),
+                AsioBytes,
+                samples - index
+            );
+        }
+    }
+}
+
+//
+// Converts four adjacent channels. Each iteration loads four frames of the
+// group, transposes the 4x4 block so that each vector holds one channel,
+// and stores 4 * AsioBytes bytes per channel. The lower bytes of each ASIO
+// sample that the USB sample does not cover are cleared.
+//
+template <ULONG AsioBytes, ULONG UsbBytes>
+PAGED_CODE_SEG
+static void InterleavedToPlanarGroup4(
+    PBYTE         planar,
+    ULONG         planarChannelStride,
+    const UCHAR * interleaved,
+    ULONG         bytesPerBlock,
+    ULONG         samples
+)
+{
+    UCHAR spread[16];
+    UCHAR pack[16];
+    ULONG index = 0;
+
+    BuildSpreadTable(spread, UsbBytes, AsioBytes - UsbBytes);
+    BuildPackTable(pack, 0, AsioBytes);
+
+    const LANES spreadTable = LoadTable(spread);
+    const LANES packTable = LoadTable(pack);
+    PBYTE       dst0 = planar;
+    PBYTE       dst1 = planar + planarChannelStride;
+    PBYTE       dst2 = planar + planarChannelStride * 2;
+    PBYTE       dst3 = planar + planarChannelStride * 3;
+
+    for (; index + 4 <= samples; index += 4)
+    {
+        const UCHAR * src = interleaved + index * bytesPerBlock;
+        LANES         r0 = LoadBytes<UsbBytes * 4>(src);
+        LANES         r1 = LoadBytes<UsbBytes * 4>(src + bytesPerBlock);
+        LANES         r2 = LoadBytes<UsbBytes * 4>(src + bytesPerBlock * 2);
+        LANES         r3 = LoadBytes<UsbBytes * 4>(src + bytesPerBlock * 3);
+
+        if ((AsioBytes != 4) || (UsbBytes != 4))
+        {
+            r0 = ShuffleBytes(r0, spreadTable);
+            r1 = ShuffleBytes(r1, spreadTable);
+            r2 = ShuffleBytes(r2, spreadTable);
+            r3 = ShuffleBytes(r3, spreadTable);
+        }
+
+        TransposeLanes(r0, r1, r2, r3);
+
+        if (AsioBytes != 4)
+        {
+            r0 = ShuffleBytes(r0, packTable);
+            r1 = ShuffleBytes(r1, packTable);
+            r2 = ShuffleBytes(r2, packTable);
+            r3 = ShuffleBytes(r3, packTable);
+        }
+
+        const ULONG dstOffset = index * AsioBytes;
+        StoreBytes<AsioBytes * 4>(dst0 + dstOffset, r0);
+        StoreBytes<AsioBytes * 4>(dst1 + dstOffset, r1);
+        StoreBytes<AsioBytes * 4>(dst2 + dstOffset, r2);
+        StoreBytes<AsioBytes * 4>(dst3 + dstOffset, r3);
+    }
+
+    if (index < samples)
+    {
+        for (ULONG ch = 0; ch < 4; ++ch)
+        {
+            CopyInterleavedChannelToPlanar(
+                planar + ch * planarChannelStride + index * AsioBytes,
+                AsioBytes,
+                interleaved + index * bytesPerBlock + ch * UsbBytes,
+                bytesPerBlock,
+                UsbBytes,
+                samples - index
+            );
+        }
+    }
+}
+
+static PLANAR_TO_INTERLEAVED_GROUP SelectPlanarToInterleavedGroup4(
+    _In_ ULONG asioSampleSize,
+    _In_ ULONG usbBytesPerSample
+)
+{
+    switch ((asioSampleSize << 4) | usbBytesPerSample)
+    {
+    case 0x44:
+        return PlanarToInterleavedGroup4<4, 4>;
+    case 0x43:
+        return PlanarToInterleavedGroup4<4, 3>;
+    case 0x42:
+        return PlanarToInterleavedGroup4<4, 2>;
+    case 0x41:
+        return PlanarToInterleavedGroup4<4, 1>;
+    case 0x33:
+        return PlanarToInterleavedGroup4<3, 3>;
+    case 0x32:
+        return PlanarToInterleavedGroup4<3, 2>;
+    case 0x31:
+        return PlanarToInterleavedGroup4<3, 1>;
+    case 0x22:
+        return PlanarToInterleavedGroup4<2, 2>;
+    case 0x21:
+        return PlanarToInterleavedGroup4<2, 1>;
+    default:
+        return nullptr;
+    }
+}
+
+static INTERLEAVED_TO_PLANAR_GROUP SelectInterleavedToPlanarGroup4(
+    _In_ ULONG asioSampleSize,
+    _In_ ULONG usbBytesPerSample
+)
+{
+    switch ((asioSampleSize << 4) | usbBytesPerSample)
+    {
+    case 0x44:
+        return InterleavedToPlanarGroup4<4, 4>;
+    case 0x43:
+        return InterleavedToPlanarGroup4<4, 3>;
+    case 0x42:
+        return InterleavedToPlanarGroup4<4, 2>;
+    case 0x41:
+        return InterleavedToPlanarGroup4<4, 1>;
+    case 0x33:
+        return InterleavedToPlanarGroup4<3, 3>;
+    case 0x32:
+        return InterleavedToPlanarGroup4<3, 2>;
+    case 0x31:
+        return InterleavedToPlanarGroup4<3, 1>;
+    case 0x22:
+        return InterleavedToPlanarGroup4<2, 2>;
+    case 0x21:
+        return InterleavedToPlanarGroup4<2, 1>;
+    default:
+        return nullptr;
+    }
+}
+
+#endif
+
+#if defined(_M_X64)
+
+//
+// 8x8 transpose of 32-bit elements. The shuffles only move bits, so float
+// samples pass through without any value change.
+//
+static __forceinline void TransposeLanes8(
+    _Inout_updates_(8) __m256 r[8]
+)
+{
+    __m256 t0 = _mm256_unpacklo_ps(r[0], r[1]);
+    __m256 t1 = _mm256_unpackhi_ps(r[0], r[1]);
+    __m256 t2 = _mm256_unpacklo_ps(r[2], r[3]);
+    __m256 t3 = _mm256_unpackhi_ps(r[2], r[3]);
+    __m256 t4 = _mm256_unpacklo_ps(r[4], r[5]);
+    __m256 t5 = _mm256_unpackhi_ps(r[4], r[5]);
+    __m256 t6 = _mm256_unpacklo_ps(r[6], r[7]);
+    __m256 t7 = _mm256_unpackhi_ps(r[6], r[7]);
+
+    __m256 u0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 u1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+    __m256 u2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 u3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+    __m256 u4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 u5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+    __m256 u6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 u7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+
+    r[0] = _mm256_permute2f128_ps(u0, u4, 0x20);
+    r[1] = _mm256_permute2f128_ps(u1, u5, 0x20);
+    r[2] = _mm256_permute2f128_ps(u2, u6, 0x20);
+    r[3] = _mm256_permute2f128_ps(u3, u7, 0x20);
+    r[4] = _mm256_permute2f128_ps(u0, u4, 0x31);
+    r[5] = _mm256_permute2f128_ps(u1, u5, 0x31);
+    r[6] = _mm256_permute2f128_ps(u2, u6, 0x31);
+    r[7] = _mm256_permute2f128_ps(u3, u7, 0x31);
+}
+
+//
+// Converts eight adjacent channels of 32-bit samples (PCM or IEEE float).
+//
+PAGED_CODE_SEG
+static void PlanarToInterleavedGroup8Avx(
+    PUCHAR       interleaved,
+    ULONG        bytesPerBlock,
+    const BYTE * planar,
+    ULONG        planarChannelStride,
+    ULONG        samples
+)
+{
+    ULONG index = 0;
+
+    for (; index + 8 <= samples; index += 8)
+    {
+        const BYTE * src = planar + index * sizeof(ULONG);
+        PUCHAR       dst = interleaved + index * bytesPerBlock;
+        __m256       r[8];
+
+        for (ULONG ch = 0; ch < 8; ++ch)
+        {
+            r[ch] = _mm256_loadu_ps((const float *)(src + planarChannelStride * ch));
+        }
+        TransposeLanes8(r);
+        for (ULONG frame = 0; frame < 8; ++frame)
+        {
+            _mm256_storeu_ps((float *)(dst + bytesPerBlock * frame), r[frame]);
+        }
+    }
+
+    if (index < samples)
+    {
+        for (ULONG ch = 0; ch < 8; ++ch)
+        {
+            CopyPlanarChannelToInterleaved(
+                interleaved + index * bytesPerBlock + ch * sizeof(ULONG),
+                bytesPerBlock,
+                sizeof(ULONG),
+                planar + ch * planarChannelStride + index * sizeof(ULONG),
+                sizeof(ULONG),
+                samples - index
+            );
+        }
+    }
+}
+
+PAGED_CODE_SEG
+static void InterleavedToPlanarGroup8Avx(
+    PBYTE         planar,
+    ULONG         planarChannelStride,
+    const UCHAR * interleaved,
+    ULONG         bytesPerBlock,
+    ULONG         samples
+)
+{
+    ULONG index = 0;
+
+    for (; index + 8 <= samples; index += 8)
+    {
+        const UCHAR * src = interleaved + index * bytesPerBlock;
+        PBYTE         dst = planar + index * sizeof(ULONG);
+        __m256        r[8];
+
+        for (ULONG frame = 0; frame < 8; ++frame)
+        {
+            r[frame] = _mm256_loadu_ps((const float *)(src + bytesPerBlock * frame));
+        }
+        TransposeLanes8(r);
+        for (ULONG ch = 0; ch < 8; ++ch)
+        {
+            _mm256_storeu_ps((float *)(dst + planarChannelStride * ch), r[ch]);
+        }
+    }
+
+    if (index < samples)
+    {
+        for (ULONG ch = 0; ch < 8; ++ch)
+        {
+            CopyInterleavedChannelToPlanar(
+                planar + ch * planarChannelStride + index * sizeof(ULONG),
+                sizeof(ULONG),
+                interleaved + index * bytesPerBlock + ch * sizeof(ULONG),
+                bytesPerBlock,
+                sizeof(ULONG),
+                samples - index
+            );
+        }
+    }
+}
+
+#endif
+
+//
+// Integer samples are mixed left-aligned in 32-bit lanes, so a single
+// saturating 32-bit addition clamps 16-, 24- and 32-bit samples to their
+// own range.
+//
+template <ULONG Bytes>
+static __forceinline LONG LoadSampleLeftAligned(
+    _In_reads_bytes_(Bytes) const BYTE * src
+)
+{
+    if (Bytes == 2)
+    {
+        return (LONG)((ULONG)(*(const UNALIGNED USHORT *)src) << 16);
+    }
+    else if (Bytes == 3)
+    {
+        return (LONG)(((ULONG)src[0] << 8) | ((ULONG)src[1] << 16) | ((ULONG)src[2] << 24));
+    }
+    else
+    {
+        return *(const UNALIGNED LONG *)src;
+    }
+}
+
+template <ULONG Bytes>
+static __forceinline void StoreSampleLeftAligned(
+    _Out_writes_bytes_(Bytes) PUCHAR dst,
+    _In_ LONG                        sample
+)
+{
+    if (Bytes == 2)
+    {
+        *(UNALIGNED USHORT *)dst = (USHORT)((ULONG)sample >> 16);
+    }
+    else if (Bytes == 3)
+    {
+        dst[0] = (UCHAR)((ULONG)sample >> 8);
+        dst[1] = (UCHAR)((ULONG)sample >> 16);
+        dst[2] = (UCHAR)((ULONG)sample >> 24);
+    }
+    else
+    {
+        *(UNALIGNED LONG *)dst = sample;
+    }
+}
+
+static __forceinline LONG AddSaturate32(
+    _In_ LONG a,
+    _In_ LONG b
+)
+{
+    LONGLONG sum = (LONGLONG)a + (LONGLONG)b;
+
+    if (sum > MAXLONG)
+    {
+        return MAXLONG;
+    }
+    if (sum < MINLONG)
+    {
+        return MINLONG;
+    }
+    return (LONG)sum;
+}
+
+static __forceinline void AddSaturate32x4(
+    _Inout_updates_(4) LONG a[4],
+    _In_reads_(4) const LONG b[4]
+)
+{
+#if defined(_M_X64)
+    __m128i va = _mm_loadu_si128((const __m128i *)a);
+    __m128i vb = _mm_loadu_si128((const __m128i *)b);
+    __m128i sum = _mm_add_epi32(va, vb);
+    // Overflow only when both operands have the same sign and the sign of the sum differs.
+    __m128i overflow = _mm_srai_epi32(_mm_andnot_si128(_mm_xor_si128(va, vb), _mm_xor_si128(va, sum)), 31);
+    __m128i saturated = _mm_xor_si128(_mm_srai_epi32(va, 31), _mm_set1_epi32(MAXLONG));
+    _mm_storeu_si128((__m128i *)a, _mm_or_si128(_mm_and_si128(overflow, saturated), _mm_andnot_si128(overflow, sum)));
+#elif defined(_M_ARM64)
+    vst1q_s32((int32_t *)a, vqaddq_s32(vld1q_s32((const int32_t *)a), vld1q_s32((const int32_t *)b)));
+#else
+    for (ULONG lane = 0; lane < 4; ++lane)
+    {
+        a[lane] = AddSaturate32(a[lane], b[lane]);
+    }
+#endif
+}
+
+static __forceinline void AddSaturate16x8(
+    _Inout_updates_(8) SHORT a[8],
+    _In_reads_(8) const SHORT b[8]
+)
+{
+#if defined(_M_X64)
+    _mm_storeu_si128((__m128i *)a, _mm_adds_epi16(_mm_loadu_si128((const __m128i *)a), _mm_loadu_si128((const __m128i *)b)));
+#elif defined(_M_ARM64)
+    vst1q_s16((int16_t *)a, vqaddq_s16(vld1q_s16((const int16_t *)a), vld1q_s16((const int16_t *)b)));
+#else
+    for (ULONG lane = 0; lane < 8; ++lane)
+    {
+        LONG sum = (LONG)a[lane] + (LONG)b[lane];
+        a[lane] = (SHORT)((sum > MAXSHORT) ? MAXSHORT : ((sum < MINSHORT) ? MINSHORT : sum));
+    }
+#endif
+}
+
+static __forceinline void AddFloat32x4(
+    _Inout_updates_(4) float a[4],
+    _In_reads_(4) const float b[4]
+)
+{
+#if defined(_M_X64)
+    _mm_storeu_ps(a, _mm_add_ps(_mm_loadu_ps(a), _mm_loadu_ps(b)));
+#elif defined(_M_ARM64)
+    vst1q_f32(a, vaddq_f32(vld1q_f32(a), vld1q_f32(b)));
+#else
+    for (ULONG lane = 0; lane < 4; ++lane)
+    {
+        a[lane] = a[lane] + b[lane];
+    }
+#endif
+}
+
+//
+// Adds a strided run of 24- or 32-bit samples into the destination with
+// saturation. Four samples are gathered per iteration and added as one
+// packed vector.
+//
+template <ULONG Bytes>
+PAGED_CODE_SEG
+static void MixSamplesInt(
+    PUCHAR       dst,
+    ULONG        dstStride,
+    const BYTE * src,
+    ULONG        srcStride,
+    ULONG        samples
+)
+{
+    ULONG index = 0;
+
+    for (; index + 4 <= samples; index += 4)
+    {
+        PUCHAR       dstSample = dst + index * dstStride;
+        const BYTE * srcSample = src + index * srcStride;
+        LONG         a[4];
+        LONG         b[4];
+
+        for (ULONG lane = 0; lane < 4; ++lane)
+        {
+            a[lane] = LoadSampleLeftAligned<Bytes>(dstSample + lane * dstStride);
+            b[lane] = LoadSampleLeftAligned<Bytes>(srcSample + lane * srcStride);
+        }
+        AddSaturate32x4(a, b);
+        for (ULONG lane = 0; lane < 4; ++lane)
+        {
+            StoreSampleLeftAligned<Bytes>(dstSample + lane * dstStride, a[lane]);
+        }
+    }
+
+    for (; index < samples; ++index)
+    {
+        PUCHAR dstSample = dst + index * dstStride;
+        StoreSampleLeftAligned<Bytes>(dstSample, AddSaturate32(LoadSampleLeftAligned<Bytes>(dstSample), LoadSampleLeftAligned<Bytes>(src + index * srcStride)));
+    }
+}
+
+PAGED_CODE_SEG
+static void MixSamplesInt16(
+    PUCHAR       dst,
+    ULONG        dstStride,
+    const BYTE * src,
+    ULONG        srcStride,
+    ULONG        samples
+)
+{
+    ULONG index = 0;
+
+    for (; index + 8 <= samples; index += 8)
+    {
+        PUCHAR       dstSample = dst + index * dstStride;
+        const BYTE * srcSample = src + index * srcStride;
+        SHORT        a[8];
+        SHORT        b[8];
+
+        for (ULONG lane = 0; lane < 8; ++lane)
+        {
+            a[lane] = *(const UNALIGNED SHORT *)(dstSample + lane * dstStride);
+            b[lane] = *(const UNALIGNED SHORT *)(srcSample + lane * srcStride);
+        }
+        AddSaturate16x8(a, b);
+        for (ULONG lane = 0; lane < 8; ++lane)
+        {
+            *(UNALIGNED SHORT *)(dstSample + lane * dstStride) = a[lane];
+        }
+    }
+
+    for (; index < samples; ++index)
+    {
+        PUCHAR dstSample = dst + index * dstStride;
+        StoreSampleLeftAligned<2>(dstSample, AddSaturate32(LoadSampleLeftAligned<2>(dstSample), LoadSampleLeftAligned<2>(src + index * srcStride)));
+    }
+}
+
+PAGED_CODE_SEG
+static void MixSamplesFloat(
+    PUCHAR       dst,
+    ULONG        dstStride,
+    const BYTE * src,
+    ULONG        srcStride,
+    ULONG        samples
+)
+{
+    ULONG index = 0;
+
+    for (; index + 4 <= samples; index += 4)
+    {
+        PUCHAR       dstSample = dst + index * dstStride;
+        const BYTE * srcSample = src + index * srcStride;
+        float        a[4];
+        float        b[4];
+
+        for (ULONG lane = 0; lane < 4; ++lane)
+        {
+            a[lane] = *(const UNALIGNED float *)(dstSample + lane * dstStride);
+            b[lane] = *(const UNALIGNED float *)(srcSample + lane * srcStride);
+        }
+        AddFloat32x4(a, b);
+        for (ULONG lane = 0; lane < 4; ++lane)
+        {
+            *(UNALIGNED float *)(dstSample + lane * dstStride) = a[lane];
+        }
+    }
+
+    for (; index < samples; ++index)
+    {
+        UNALIGNED float * dstSample = (UNALIGNED float *)(dst + index * dstStride);
+        *dstSample = *dstSample + *(const UNALIGNED float *)(src + index * srcStride);
+    }
+}
+
+//
+// Copies a strided run of samples of the given width. The samples are moved
+// as raw bytes, so the same kernel serves integer and float formats.
+//
+template <ULONG Bytes>
+PAGED_CODE_SEG
+static void CopySamples(
+    PUCHAR       dst,
+    ULONG        dstStride,
+    const BYTE * src,
+    ULONG        srcStride,
+    ULONG        samples
+)
+{
+    ULONG index = 0;
+
+    for (; index + 4 <= samples; index += 4)
+    {
+        PUCHAR       dstSample = dst + index * dstStride;
+        const BYTE * srcSample = src + index * srcStride;
+
+        for (ULONG lane = 0; lane < 4; ++lane)
+        {
+            StoreSampleLeftAligned<Bytes>(dstSample + lane * dstStride, LoadSampleLeftAligned<Bytes>(srcSample + lane * srcStride));
+        }
+    }
+
+    for (; index < samples; ++index)
+    {
+        StoreSampleLeftAligned<Bytes>(dst + index * dstStride, LoadSampleLeftAligned<Bytes>(src + index * srcStride));
+    }
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+void SampleConverter::Initialize()
+{
+    PAGED_CODE();
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DRIVER, "%!FUNC! Entry");
+
+#if defined(_M_X64)
+    s_isSsse3Available = (ExIsProcessorFeaturePresent(PF_SSSE3_INSTRUCTIONS_AVAILABLE) != FALSE);
+    s_isAvxAvailable = (ExIsProcessorFeaturePresent(PF_AVX_INSTRUCTIONS_AVAILABLE) != FALSE) && ((RtlGetEnabledExtendedFeatures(XSTATE_MASK_AVX) & XSTATE_MASK_AVX) != 0);
+#endif
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DRIVER, "%!FUNC! Exit, SSSE3 %!bool!, AVX %!bool!", s_isSsse3Available, s_isAvxAvailable);
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+void SampleConverter::PlanarToInterleaved(
+    PUCHAR       interleaved,
+    ULONG        bytesPerBlock,
+    ULONG        usbBytesPerSample,
+    ULONG        usbChannels,
+    const BYTE * planar,
+    ULONG        planarChannelStride,
+    ULONG        asioSampleSize,
+    ULONG        asioChannels,
+    ULONGLONG    channelsMap,
+    ULONG        planarStartIndex,
+    ULONG        samples
+)
+{
+    PAGED_CODE();
+
+    if ((samples == 0) || (usbBytesPerSample == 0) || (usbBytesPerSample > 4) || (asioSampleSize < usbBytesPerSample))
+    {
+        return;
+    }
+
+    const ULONG  channels = min(min(asioChannels, usbChannels), UAC_MAX_ASIO_CHANNELS);
+    const ULONG  asioByteOffset = asioSampleSize - usbBytesPerSample;
+    const BYTE * planarStart = planar + planarStartIndex * asioSampleSize;
+    ULONG        ch = 0;
+
+#if defined(_M_X64) || defined(_M_ARM64)
+#if defined(_M_X64)
+    PLANAR_TO_INTERLEAVED_GROUP group4 = s_isSsse3Available ? SelectPlanarToInterleavedGroup4(asioSampleSize, usbBytesPerSample) : nullptr;
+    XSTATE_SAVE                 xstateSave;
+    bool                        useAvx = false;
+
+    if (s_isAvxAvailable && (asioSampleSize == 4) && (usbBytesPerSample == 4) && (samples >= 8))
+    {
+        useAvx = NT_SUCCESS(KeSaveExtendedProcessorState(XSTATE_MASK_AVX, &xstateSave));
+    }
+#else
+    PLANAR_TO_INTERLEAVED_GROUP group4 = SelectPlanarToInterleavedGroup4(asioSampleSize, usbBytesPerSample);
+#endif
+
+    while (ch < channels)
+    {
+#if defined(_M_X64)
+        if (useAvx && (ch + 8 <= channels) && (((channelsMap >> ch) & 0xff) == 0xff))
+        {
+            PlanarToInterleavedGroup8Avx(interleaved + ch * usbBytesPerSample, bytesPerBlock, planarStart + ch * planarChannelStride, planarChannelStride, samples);
+            ch += 8;
+            continue;
+        }
+#endif
+        if ((group4 != nullptr) && (ch + 4 <= channels) && (((channelsMap >> ch) & 0xf) == 0xf))
+        {
+            group4(interleaved + ch * usbBytesPerSample, bytesPerBlock, planarStart + ch * planarChannelStride, planarChannelStride, samples);
+            ch += 4;
+            continue;
+        }
+        if ((channelsMap & (1ULL << ch)) != 0)
+        {
+            CopyPlanarChannelToInterleaved(interleaved + ch * usbBytesPerSample, bytesPerBlock, usbBytesPerSample, planarStart + ch * planarChannelStride + asioByteOffset, asioSampleSize, samples);
+        }
+        ++ch;
+    }
+
+#if defined(_M_X64)
+    if (useAvx)
+    {
+        _mm256_zeroupper();
+        KeRestoreExtendedProcessorState(&xstateSave);
+    }
+#endif
+#else
+    for (; ch < channels; ++ch)
+    {
+        if ((channelsMap & (1ULL << ch)) != 0)
+        {
+            CopyPlanarChannelToInterleaved(interleaved + ch * usbBytesPerSample, bytesPerBlock, usbBytesPerSample, planarStart + ch * planarChannelStride + asioByteOffset, asioSampleSize, samples);
+        }
+    }
+#endif
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+void SampleConverter::InterleavedToPlanar(
+    PBYTE         planar,
+    ULONG         planarChannelStride,
+    ULONG         asioSampleSize,
+    ULONG         asioChannels,
+    ULONGLONG     channelsMap,
+    ULONG         planarStartIndex,
+    const UCHAR * interleaved,
+    ULONG         bytesPerBlock,
+    ULONG         usbBytesPerSample,
+    ULONG         usbChannels,
+    ULONG         samples
+)
+{
+    PAGED_CODE();
+
+    if ((samples == 0) || (usbBytesPerSample == 0) || (usbBytesPerSample > 4) || (asioSampleSize < usbBytesPerSample))
+    {
+        return;
+    }
+
+    const ULONG channels = min(min(asioChannels, usbChannels), UAC_MAX_ASIO_CHANNELS);
+    PBYTE       planarStart = planar + planarStartIndex * asioSampleSize;
+
+#if defined(_M_X64) || defined(_M_ARM64)
+#if defined(_M_X64)
+    INTERLEAVED_TO_PLANAR_GROUP group4 = s_isSsse3Available ? SelectInterleavedToPlanarGroup4(asioSampleSize, usbBytesPerSample) : nullptr;
+    XSTATE_SAVE                 xstateSave;
+    bool                        useAvx = false;
+
+    if (s_isAvxAvailable && (asioSampleSize == 4) && (usbBytesPerSample == 4) && (samples >= 8))
+    {
+        useAvx = NT_SUCCESS(KeSaveExtendedProcessorState(XSTATE_MASK_AVX, &xstateSave));
+    }
+#else
+    INTERLEAVED_TO_PLANAR_GROUP group4 = SelectInterleavedToPlanarGroup4(asioSampleSize, usbBytesPerSample);
+#endif
+
+    //
+    // The frames are processed in small blocks so that all channel groups of
+    // a block are written while its USB frames are still in the cache.
+    //
+    for (ULONG block = 0; block < samples; block += DEINTERLEAVE_BLOCK_FRAMES)
+    {
+        const ULONG   blockSamples = min(samples - block, DEINTERLEAVE_BLOCK_FRAMES);
+        const UCHAR * src = interleaved + block * bytesPerBlock;
+        PBYTE         dst = planarStart + block * asioSampleSize;
+        ULONG         ch = 0;
+
+        while (ch < channels)
+        {
+#if defined(_M_X64)
+            if (useAvx && (ch + 8 <= channels) && (((channelsMap >> ch) & 0xff) == 0xff))
+            {
+                InterleavedToPlanarGroup8Avx(dst + ch * planarChannelStride, planarChannelStride, src + ch * usbBytesPerSample, bytesPerBlock, blockSamples);
+                ch += 8;
+                continue;
+            }
+#endif
+            if ((group4 != nullptr) && (ch + 4 <= channels) && (((channelsMap >> ch) & 0xf) == 0xf))
+            {
+                group4(dst + ch * planarChannelStride, planarChannelStride, src + ch * usbBytesPerSample, bytesPerBlock, blockSamples);
+                ch += 4;
+                continue;
+            }
+            if ((channelsMap & (1ULL << ch)) != 0)
+            {
+                CopyInterleavedChannelToPlanar(dst + ch * planarChannelStride, asioSampleSize, src + ch * usbBytesPerSample, bytesPerBlock, usbBytesPerSample, blockSamples);
+            }
+            ++ch;
+        }
+    }
+
+#if defined(_M_X64)
+    if (useAvx)
+    {
+        _mm256_zeroupper();
+        KeRestoreExtendedProcessorState(&xstateSave);
+    }
+#endif
+#else
+    for (ULONG ch = 0; ch < channels; ++ch)
+    {
+        if ((channelsMap & (1ULL << ch)) != 0)
+        {
+            CopyInterleavedChannelToPlanar(planarStart + ch * planarChannelStride, asioSampleSize, interleaved + ch * usbBytesPerSample, bytesPerBlock, usbBytesPerSample, samples);
+        }
+    }
+#endif
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+SAMPLE_MIX_FUNCTION
+SampleConverter::GetMixFunction(
+    bool  isFloat,
+    ULONG bytesPerSample
+)
+{
+    PAGED_CODE();
+
+    if (isFloat)
+    {
+        return (bytesPerSample == 4) ? MixSamplesFloat : nullptr;
+    }
+
+    switch (bytesPerSample)
+    {
+    case 2:
+        return MixSamplesInt16;
+    case 3:
+        return MixSamplesInt<3>;
+    case 4:
+        return MixSamplesInt<4>;
+    default:
+        return nullptr;
+    }
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+void SampleConverter::StreamCopy(
+    PUCHAR       dst,
+    const BYTE * src,
+    ULONG        bytes
+)
+{
+    PAGED_CODE();
+
+#if defined(_M_X64)
+    //
+    // The destination is written once and never read back by the CPU, so it
+    // is filled with full 16-byte non-temporal stores. Only the unaligned head
+    // and the tail are written with ordinary stores.
+    //
+    ULONG head = (ULONG)((16 - ((ULONG_PTR)dst & 15)) & 15);
+    if (head > bytes)
+    {
+        head = bytes;
+    }
+    RtlCopyMemory(dst, src, head);
+    dst += head;
+    src += head;
+    bytes -= head;
+
+    for (; bytes >= 64; bytes -= 64, dst += 64, src += 64)
+    {
+        __m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+        __m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 16));
+        __m128i v2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 32));
+        __m128i v3 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 48));
+        _mm_stream_si128(reinterpret_cast<__m128i *>(dst), v0);
+        _mm_stream_si128(reinterpret_cast<__m128i *>(dst + 16), v1);
+        _mm_stream_si128(reinterpret_cast<__m128i *>(dst + 32), v2);
+        _mm_stream_si128(reinterpret_cast<__m128i *>(dst + 48), v3);
+    }
+    for (; bytes >= 16; bytes -= 16, dst += 16, src += 16)
+    {
+        _mm_stream_si128(reinterpret_cast<__m128i *>(dst), _mm_loadu_si128(reinterpret_cast<const __m128i *>(src)));
+    }
+    RtlCopyMemory(dst, src, bytes);
+
+    // Make the non-temporal stores globally visible before the URB is submitted.
+    _mm_sfence();
+#else
+    RtlCopyMemory(dst, src, bytes);
+#endif
+}
+
+//
+// The meters are accumulated channel by channel so that the peak and the sum
+// stay in registers. The buffer has just been written or is about to be
+// stored, so the strided reads hit the cache.
+//
+template <ULONG Bytes>
+static void AccumulateMetersInt(
+    _Inout_updates_(channels) PULONG                         peaks,
+    _Inout_updates_(channels) PULONGLONG                     sumsOfSquares,
+    _In_reads_bytes_(samples * bytesPerBlock) const BYTE * interleaved,
+    _In_ ULONG                                             bytesPerBlock,
+    _In_ ULONG                                             channels,
+    _In_ ULONG                                             samples
+)
+{
+    for (ULONG channel = 0; channel < channels; ++channel)
+    {
+        const BYTE * src = interleaved + channel * Bytes;
+        ULONG        peak = peaks[channel];
+        ULONGLONG    sumOfSquares = 0;
+
+        for (ULONG index = 0; index < samples; ++index, src += bytesPerBlock)
+        {
+            LONG  sample = LoadSampleLeftAligned<Bytes>(src);
+            ULONG magnitude = (sample < 0) ? (0UL - (ULONG)sample) : (ULONG)sample;
+            ULONG upper = magnitude >> 16;
+
+            peak = (magnitude > peak) ? magnitude : peak;
+            sumOfSquares += upper * upper;
+        }
+        peaks[channel] = peak;
+        sumsOfSquares[channel] += sumOfSquares;
+    }
+}
+
+static void AccumulateMetersFloat(
+    _Inout_updates_(channels) PULONG                         peaks,
+    _Inout_updates_(channels) PULONGLONG                     sumsOfSquares,
+    _In_reads_bytes_(samples * bytesPerBlock) const BYTE * interleaved,
+    _In_ ULONG                                             bytesPerBlock,
+    _In_ ULONG                                             channels,
+    _In_ ULONG                                             samples
+)
+{
+    for (ULONG channel = 0; channel < channels; ++channel)
+    {
+        const BYTE * src = interleaved + channel * sizeof(float);
+        ULONG        peak = peaks[channel];
+        ULONGLONG    sumOfSquares = 0;
+
+        for (ULONG index = 0; index < samples; ++index, src += bytesPerBlock)
+        {
+            float sample = *(const UNALIGNED float *)src;
+            float absolute = (sample < 0.0f) ? -sample : sample;
+            // Full scale and NaN are reported as the largest magnitude.
+            ULONG magnitude = (absolute < 1.0f) ? (ULONG)(absolute * 2147483648.0f) : 0x80000000UL;
+            ULONG upper = magnitude >> 16;
+
+            peak = (magnitude > peak) ? magnitude : peak;
+            sumOfSquares += upper * upper;
+        }
+        peaks[channel] = peak;
+        sumsOfSquares[channel] += sumOfSquares;
+    }
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+void SampleConverter::AccumulateMeters(
+    PULONG       peaks,
+    PULONGLONG   sumsOfSquares,
+    const BYTE * interleaved,
+    ULONG        bytesPerBlock,
+    ULONG        bytesPerSample,
+    ULONG        channels,
+    bool         isFloat,
+    ULONG        samples
+)
+{
+    PAGED_CODE();
+
+    if (isFloat)
+    {
+        if (bytesPerSample == 4)
+        {
+            AccumulateMetersFloat(peaks, sumsOfSquares, interleaved, bytesPerBlock, channels, samples);
+        }
+        return;
+    }
+
+    switch (bytesPerSample)
+    {
+    case 2:
+        AccumulateMetersInt<2>(peaks, sumsOfSquares, interleaved, bytesPerBlock, channels, samples);
+        break;
+    case 3:
+        AccumulateMetersInt<3>(peaks, sumsOfSquares, interleaved, bytesPerBlock, channels, samples);
+        break;
+    case 4:
+        AccumulateMetersInt<4>(peaks, sumsOfSquares, interleaved, bytesPerBlock, channels, samples);
+        break;
+    default:
+        break;
+    }
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+SAMPLE_COPY_FUNCTION
+SampleConverter::GetCopyFunction(
+    bool  isFloat,
+    ULONG bytesPerSample
+)
+{
+    PAGED_CODE();
+
+    if (isFloat)
+    {
+        return (bytesPerSample == 4) ? CopySamples<4> : nullptr;
+    }
+
+    switch (bytesPerSample)
+    {
+    case 2:
+        return CopySamples<2>;
+    case 3:
+        return CopySamples<3>;
+    case 4:
+        return CopySamples<4>;
+    default:
+        return nullptr;
+    }
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+ULONG SampleConverter::BuildChannelSpans(
+    PCHANNEL_SPAN spans,
+    const LONG *  routing,
+    ULONG         channels,
+    ULONGLONG     channelsMap,
+    ULONG         usbChannels
+)
+{
+    ULONG spanCount = 0;
+
+    PAGED_CODE();
+
+    for (ULONG ch = 0; ch < min(channels, (ULONG)UAC_MAX_ASIO_CHANNELS); ++ch)
+    {
+        if (((channelsMap & (1ULL << ch)) == 0) || (routing[ch] < 0) || ((ULONG)routing[ch] >= usbChannels))
+        {
+            continue;
+        }
+        if ((spanCount != 0) &&
+            (spans[spanCount - 1].Channel + spans[spanCount - 1].Channels == ch) &&
+            (spans[spanCount - 1].UsbChannel + spans[spanCount - 1].Channels == (ULONG)routing[ch]))
+        {
+            ++spans[spanCount - 1].Channels;
+            continue;
+        }
+        spans[spanCount].Channel = ch;
+        spans[spanCount].UsbChannel = (ULONG)routing[ch];
+        spans[spanCount].Channels = 1;
+        ++spanCount;
+    }
+
+    return spanCount;
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+void SampleConverter::MixChannelSpansToUsb(
+    PUCHAR               usb,
+    ULONG                usbBytesPerSample,
+    ULONG                usbChannels,
+    const BYTE *         src,
+    ULONG                srcBytesPerSample,
+    ULONG                srcChannels,
+    const CHANNEL_SPAN * spans,
+    ULONG                spanCount,
+    ULONG                frames,
+    SAMPLE_MIX_FUNCTION  mixSamples
+)
+{
+    const ULONG usbFrameBytes = usbBytesPerSample * usbChannels;
+    const ULONG srcFrameBytes = srcBytesPerSample * srcChannels;
+
+    PAGED_CODE();
+
+    if (mixSamples == nullptr)
+    {
+        return;
+    }
+
+    if (srcChannels >= FRAME_MAJOR_MIX_MIN_CHANNELS)
+    {
+        for (ULONG frame = 0; frame < frames; ++frame)
+        {
+            for (ULONG spanIndex = 0; spanIndex < spanCount; ++spanIndex)
+            {
+                const CHANNEL_SPAN & span = spans[spanIndex];
+                if (span.UsbChannel + span.Channels <= usbChannels)
+                {
+                    mixSamples(usb + frame * usbFrameBytes + span.UsbChannel * usbBytesPerSample, usbBytesPerSample, src + frame * srcFrameBytes + span.Channel * srcBytesPerSample, srcBytesPerSample, span.Channels);
+                }
+            }
+        }
+    }
+    else
+    {
+        for (ULONG spanIndex = 0; spanIndex < spanCount; ++spanIndex)
+        {
+            const CHANNEL_SPAN & span = spans[spanIndex];
+            if (span.UsbChannel + span.Channels > usbChannels)
+            {
+                continue;
+            }
+            for (ULONG ch = 0; ch < span.Channels; ++ch)
+            {
+                mixSamples(usb + (span.UsbChannel + ch) * usbBytesPerSample, usbFrameBytes, src + (span.Channel + ch) * srcBytesPerSample, srcFrameBytes, frames);
+            }
+        }
+    }
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+void SampleConverter::CopyChannelSpansFromUsb(
+    PUCHAR               dst,
+    ULONG                dstBytesPerSample,
+    ULONG                dstChannels,
+    const BYTE *         usb,
+    ULONG                usbBytesPerSample,
+    ULONG                usbChannels,
+    const CHANNEL_SPAN * spans,
+    ULONG                spanCount,
+    ULONG                frames,
+    SAMPLE_COPY_FUNCTION copySamples
+)
+{
+    const ULONG dstFrameBytes = dstBytesPerSample * dstChannels;
+    const ULONG usbFrameBytes = usbBytesPerSample * usbChannels;
+    ULONG       routedChannels = 0;
+
+    PAGED_CODE();
+
+    if (copySamples != nullptr)
+    {
+        for (ULONG spanIndex = 0; spanIndex < spanCount; ++spanIndex)
+        {
+            if (spans[spanIndex].UsbChannel + spans[spanIndex].Channels <= usbChannels)
+            {
+                routedChannels += spans[spanIndex].Channels;
+            }
+        }
+    }
+
+    // The spans never overlap, so the stream is fully written when they cover every channel.
+    // Otherwise the whole range is cleared first, which is cheaper than clearing the gaps sample by sample.
+    if (routedChannels < dstChannels)
+    {
+        RtlZeroMemory(dst, dstFrameBytes * frames);
+    }
+    if (routedChannels == 0)
+    {
+        return;
+    }
+
+    if (dstChannels >= FRAME_MAJOR_MIX_MIN_CHANNELS)
+    {
+        for (ULONG frame = 0; frame < frames; ++frame)
+        {
+            for (ULONG spanIndex = 0; spanIndex < spanCount; ++spanIndex)
+            {
+                const CHANNEL_SPAN & span = spans[spanIndex];
+                if (span.UsbChannel + span.Channels <= usbChannels)
+                {
+                    copySamples(dst + frame * dstFrameBytes + span.Channel * dstBytesPerSample, dstBytesPerSample, usb + frame * usbFrameBytes + span.UsbChannel * usbBytesPerSample, usbBytesPerSample, span.Channels);
+                }
+            }
+        }
+    }
+    else
+    {
+        for (ULONG spanIndex = 0; spanIndex < spanCount; ++spanIndex)
+        {
+            const CHANNEL_SPAN & span = spans[spanIndex];
+            if (span.UsbChannel + span.Channels > usbChannels)
+            {
+                continue;
+            }
+            for (ULONG ch = 0; ch < span.Channels; ++ch)
+            {
+                copySamples(dst + (span.Channel + ch) * dstBytesPerSample, dstFrameBytes, usb + (span.UsbChannel + ch) * usbBytesPerSample, usbFrameBytes, frames);
+            }
+        }
+    }
+}
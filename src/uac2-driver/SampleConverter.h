@@ -0,0 +1,231 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+// ASIO is a trademark and software of Steinberg Media Technologies GmbH
+
+/*++
+
+Module Name:
+
+    SampleConverter.h
+
+Abstract:
+
+    Define a class that converts audio samples between the non-interleaved
+    ASIO buffer layout and the interleaved USB isochronous buffer layout.
+
+Environment:
+
+    Kernel-mode Driver Framework
+
+--*/
+
+#ifndef _SAMPLE_CONVERTER_H_
+#define _SAMPLE_CONVERTER_H_
+
+typedef void (*SAMPLE_MIX_FUNCTION)(
+    _Inout_ PUCHAR    dst,
+    _In_ ULONG        dstStride,
+    _In_ const BYTE * src,
+    _In_ ULONG        srcStride,
+    _In_ ULONG        samples
+);
+
+typedef void (*SAMPLE_COPY_FUNCTION)(
+    _Out_ PUCHAR      dst,
+    _In_ ULONG        dstStride,
+    _In_ const BYTE * src,
+    _In_ ULONG        srcStride,
+    _In_ ULONG        samples
+);
+
+//
+// A run of consecutive logical channels that are routed to consecutive USB
+// channels, so that it can be converted with a single kernel call.
+//
+typedef struct CHANNEL_SPAN_
+{
+    ULONG Channel;
+    ULONG UsbChannel;
+    ULONG Channels;
+} CHANNEL_SPAN, *PCHANNEL_SPAN;
+
+class SampleConverter
+{
+  public:
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    static void Initialize();
+
+    //
+    // Copies `samples` frames from the non-interleaved buffer, starting at
+    // planarStartIndex of every channel, into consecutive frames of the
+    // interleaved buffer. Only the upper usbBytesPerSample bytes of each
+    // planar sample are copied. Channels whose bit in channelsMap is clear
+    // are left untouched. The caller is responsible for splitting the copy
+    // at the end of the planar ring buffer.
+    //
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    static void PlanarToInterleaved(
+        _Out_writes_bytes_(samples * bytesPerBlock) PUCHAR interleaved,
+        _In_ ULONG                                        bytesPerBlock,
+        _In_ ULONG                                        usbBytesPerSample,
+        _In_ ULONG                                        usbChannels,
+        _In_ const BYTE *                                 planar,
+        _In_ ULONG                                        planarChannelStride,
+        _In_ ULONG                                        asioSampleSize,
+        _In_ ULONG                                        asioChannels,
+        _In_ ULONGLONG                                    channelsMap,
+        _In_ ULONG                                        planarStartIndex,
+        _In_ ULONG                                        samples
+    );
+
+    //
+    // Copies `samples` frames from the interleaved buffer into the
+    // non-interleaved buffer, starting at planarStartIndex of every channel.
+    // Each USB sample is stored in the upper usbBytesPerSample bytes of the
+    // planar sample and the remaining lower bytes are cleared. Channels whose
+    // bit in channelsMap is clear are left untouched. The caller is
+    // responsible for splitting the copy at the end of the planar ring buffer.
+    //
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    static void InterleavedToPlanar(
+        _Out_ PBYTE                                      planar,
+        _In_ ULONG                                       planarChannelStride,
+        _In_ ULONG                                       asioSampleSize,
+        _In_ ULONG                                       asioChannels,
+        _In_ ULONGLONG                                   channelsMap,
+        _In_ ULONG                                       planarStartIndex,
+        _In_reads_bytes_(samples * bytesPerBlock) const UCHAR * interleaved,
+        _In_ ULONG                                       bytesPerBlock,
+        _In_ ULONG                                       usbBytesPerSample,
+        _In_ ULONG                                       usbChannels,
+        _In_ ULONG                                       samples
+    );
+
+    //
+    // Returns the kernel that adds a strided run of samples into the
+    // destination, saturating integer samples, or nullptr if the sample
+    // width is not supported. The kernel is meant to be selected when the
+    // data format is set rather than per buffer or per sample.
+    //
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    static SAMPLE_MIX_FUNCTION GetMixFunction(
+        _In_ bool  isFloat,
+        _In_ ULONG bytesPerSample
+    );
+
+    //
+    // Returns the kernel that copies a strided run of samples, or nullptr if
+    // the sample width is not supported. Like GetMixFunction, it is meant to
+    // be selected when the data format is set.
+    //
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    static SAMPLE_COPY_FUNCTION GetCopyFunction(
+        _In_ bool  isFloat,
+        _In_ ULONG bytesPerSample
+    );
+
+    //
+    // Copies a fully mixed buffer into memory that the CPU only writes, such
+    // as a non-cached isochronous transfer buffer, using streaming stores
+    // where the processor supports them.
+    //
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    static void StreamCopy(
+        _Out_writes_bytes_(bytes) PUCHAR dst,
+        _In_reads_bytes_(bytes) const BYTE * src,
+        _In_ ULONG                          bytes
+    );
+
+    //
+    // Adds the peak magnitude and the sum of squares of every channel of an
+    // interleaved buffer to peaks and sumsOfSquares. Magnitudes are measured
+    // left-aligned to 32 bits and squares are taken of their upper 16 bits,
+    // so the results do not depend on the sample width.
+    //
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    static void AccumulateMeters(
+        _Inout_updates_(channels) PULONG                         peaks,
+        _Inout_updates_(channels) PULONGLONG                     sumsOfSquares,
+        _In_reads_bytes_(samples * bytesPerBlock) const BYTE * interleaved,
+        _In_ ULONG                                             bytesPerBlock,
+        _In_ ULONG                                             bytesPerSample,
+        _In_ ULONG                                             channels,
+        _In_ bool                                              isFloat,
+        _In_ ULONG                                             samples
+    );
+
+    //
+    // Builds the span table for a routing table that maps each logical
+    // channel to a USB channel or UAC_CHANNEL_NOT_ROUTED. Channels whose bit
+    // in channelsMap is clear, and channels routed outside usbChannels, are
+    // left out. Returns the number of spans written.
+    //
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    static ULONG BuildChannelSpans(
+        _Out_writes_to_(channels, return) PCHANNEL_SPAN spans,
+        _In_reads_(channels) const LONG *              routing,
+        _In_ ULONG                                     channels,
+        _In_ ULONGLONG                                 channelsMap,
+        _In_ ULONG                                     usbChannels
+    );
+
+    //
+    // Mixes `frames` frames of an interleaved stream into the interleaved
+    // USB buffer with mixSamples, one span at a time. CHANNEL_SPAN::Channel
+    // indexes the stream and CHANNEL_SPAN::UsbChannel the USB buffer. Spans
+    // that do not fit in usbChannels are skipped.
+    //
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    static void MixChannelSpansToUsb(
+        _Inout_ PUCHAR                         usb,
+        _In_ ULONG                             usbBytesPerSample,
+        _In_ ULONG                             usbChannels,
+        _In_ const BYTE *                      src,
+        _In_ ULONG                             srcBytesPerSample,
+        _In_ ULONG                             srcChannels,
+        _In_reads_(spanCount) const CHANNEL_SPAN * spans,
+        _In_ ULONG                             spanCount,
+        _In_ ULONG                             frames,
+        _In_ SAMPLE_MIX_FUNCTION               mixSamples
+    );
+
+    //
+    // Copies `frames` frames of the interleaved USB buffer into an
+    // interleaved stream with copySamples, one span at a time. Stream
+    // channels that no fitting span covers are written as silence, so that
+    // they never keep older audio.
+    //
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    static void CopyChannelSpansFromUsb(
+        _Out_ PUCHAR                           dst,
+        _In_ ULONG                             dstBytesPerSample,
+        _In_ ULONG                             dstChannels,
+        _In_ const BYTE *                      usb,
+        _In_ ULONG                             usbBytesPerSample,
+        _In_ ULONG                             usbChannels,
+        _In_reads_(spanCount) const CHANNEL_SPAN * spans,
+        _In_ ULONG                             spanCount,
+        _In_ ULONG                             frames,
+        _In_ SAMPLE_COPY_FUNCTION              copySamples
+    );
+
+  private:
+    static bool s_isSsse3Available;
+    static bool s_isAvxAvailable;
+};
+
+#endif
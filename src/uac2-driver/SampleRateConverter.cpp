@@ -0,0 +1,521 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+// ASIO is a trademark and software of Steinberg Media Technologies GmbH
+
+/*++
+
+Module Name:
+
+    SampleRateConverter.cpp
+
+Abstract:
+
+    Implement a class that converts the sample rate of an interleaved PCM
+    stream with a polyphase windowed-sinc filter.
+
+Environment:
+
+    Kernel-mode Driver Framework
+
+--*/
+
+#ifdef UAC_HOST_BUILD
+#include "HostCompat.h"
+#else
+#include "Driver.h"
+#include "Device.h"
+#include "Public.h"
+#include "Common.h"
+#endif
+#include "SampleRateConverter.h"
+
+#if defined(_M_X64)
+#include <immintrin.h>
+#elif defined(_M_ARM64)
+#include <arm_neon.h>
+#endif
+
+#if !defined(__INTELLISENSE__) && !defined(UAC_HOST_BUILD)
+#include "SampleRateConverter.tmh"
+#endif
+
+//
+// Filter coefficients are stored in Q24, so that a full scale 32-bit sample
+// times the sum of the absolute coefficients stays within 64 bits.
+//
+#define SRC_COEFFICIENT_BITS 24
+
+//
+// Cutoff of the filter relative to the Nyquist frequency of the lower rate.
+//
+#define SRC_CUTOFF_RATIO 0.85
+
+#define SRC_PI 3.14159265358979323846
+
+bool SampleRateConverter::s_isSse41Available = false;
+
+//
+// sin(x) for the coefficient calculation, which runs once per rate change.
+// The argument is reduced to [-pi/2, pi/2] and evaluated with a Taylor
+// series that is accurate to about 1e-11 there.
+//
+PAGED_CODE_SEG
+static double SrcSin(
+    _In_ double x
+)
+{
+    PAGED_CODE();
+
+    x -= 2.0 * SRC_PI * (double)(LONGLONG)(x / (2.0 * SRC_PI));
+    if (x > SRC_PI)
+    {
+        x -= 2.0 * SRC_PI;
+    }
+    else if (x < -SRC_PI)
+    {
+        x += 2.0 * SRC_PI;
+    }
+    if (x > SRC_PI / 2.0)
+    {
+        x = SRC_PI - x;
+    }
+    else if (x < -SRC_PI / 2.0)
+    {
+        x = -SRC_PI - x;
+    }
+
+    double x2 = x * x;
+    double term = x;
+    double sum = x;
+    for (int n = 1; n <= 8; ++n)
+    {
+        term *= -x2 / (double)((2 * n) * (2 * n + 1));
+        sum += term;
+    }
+    return sum;
+}
+
+PAGED_CODE_SEG
+static double SrcCos(
+    _In_ double x
+)
+{
+    PAGED_CODE();
+
+    return SrcSin(x + SRC_PI / 2.0);
+}
+
+static __forceinline LONGLONG DotProduct(
+    _In_reads_(SRC_FILTER_TAPS) const LONG * history,
+    _In_reads_(SRC_FILTER_TAPS) const LONG * coefficients,
+    _In_ bool                                 isSse41Available
+)
+{
+#if defined(_M_X64)
+    if (isSse41Available)
+    {
+        __m128i sum = _mm_setzero_si128();
+        for (ULONG tap = 0; tap < SRC_FILTER_TAPS; tap += 4)
+        {
+            __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(history + tap));
+            __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i *>(coefficients + tap));
+            sum = _mm_add_epi64(sum, _mm_mul_epi32(x, h));
+            sum = _mm_add_epi64(sum, _mm_mul_epi32(_mm_srli_epi64(x, 32), _mm_srli_epi64(h, 32)));
+        }
+        return _mm_cvtsi128_si64(sum) + _mm_cvtsi128_si64(_mm_unpackhi_epi64(sum, sum));
+    }
+#elif defined(_M_ARM64)
+    UNREFERENCED_PARAMETER(isSse41Available);
+
+    int64x2_t sum = vdupq_n_s64(0);
+    for (ULONG tap = 0; tap < SRC_FILTER_TAPS; tap += 4)
+    {
+        int32x4_t x = vld1q_s32(history + tap);
+        int32x4_t h = vld1q_s32(coefficients + tap);
+        sum = vmlal_s32(sum, vget_low_s32(x), vget_low_s32(h));
+        sum = vmlal_high_s32(sum, x, h);
+    }
+    return vaddvq_s64(sum);
+#else
+    UNREFERENCED_PARAMETER(isSse41Available);
+#endif
+
+    LONGLONG sum0 = 0;
+    LONGLONG sum1 = 0;
+    for (ULONG tap = 0; tap < SRC_FILTER_TAPS; tap += 2)
+    {
+        sum0 += (LONGLONG)history[tap] * coefficients[tap];
+        sum1 += (LONGLONG)history[tap + 1] * coefficients[tap + 1];
+    }
+    return sum0 + sum1;
+}
+
+static __forceinline LONG SaturateToLong(
+    _In_ LONGLONG value
+)
+{
+    if (value > MAXLONG)
+    {
+        return MAXLONG;
+    }
+    if (value < MINLONG)
+    {
+        return MINLONG;
+    }
+    return (LONG)value;
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+void SampleRateConverter::Initialize()
+{
+    PAGED_CODE();
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DRIVER, "%!FUNC! Entry");
+
+#if defined(_M_X64)
+    s_isSse41Available = (ExIsProcessorFeaturePresent(PF_SSE4_1_INSTRUCTIONS_AVAILABLE) != FALSE);
+#endif
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DRIVER, "%!FUNC! Exit, SSE4.1 %!bool!", s_isSse41Available);
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+SampleRateConverter * SampleRateConverter::Create(
+    ULONG channels
+)
+{
+    PAGED_CODE();
+
+    SampleRateConverter * sampleRateConverter = new (POOL_FLAG_NON_PAGED, DRIVER_TAG) SampleRateConverter(channels);
+    if ((sampleRateConverter != nullptr) && (sampleRateConverter->m_history == nullptr))
+    {
+        delete sampleRateConverter;
+        sampleRateConverter = nullptr;
+    }
+    return sampleRateConverter;
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+SampleRateConverter::SampleRateConverter(
+    ULONG channels
+)
+    : m_channels(channels)
+{
+    PAGED_CODE();
+
+    if (m_channels != 0)
+    {
+        m_history = (LONG *)ExAllocatePool2(POOL_FLAG_NON_PAGED, sizeof(LONG) * SRC_FILTER_TAPS * 2 * m_channels, DRIVER_TAG);
+    }
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+SampleRateConverter::~SampleRateConverter()
+{
+    PAGED_CODE();
+
+    if (m_history != nullptr)
+    {
+        ExFreePoolWithTag(m_history, DRIVER_TAG);
+        m_history = nullptr;
+    }
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+NTSTATUS
+SampleRateConverter::SetRates(
+    ULONG inputRate,
+    ULONG outputRate
+)
+{
+    NTSTATUS       status = STATUS_SUCCESS;
+    KFLOATING_SAVE floatingSave;
+
+    PAGED_CODE();
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Entry, %u -> %u", inputRate, outputRate);
+
+    RETURN_NTSTATUS_IF_TRUE((inputRate == 0) || (outputRate == 0), STATUS_INVALID_PARAMETER);
+
+    status = KeSaveFloatingPointState(&floatingSave);
+    RETURN_NTSTATUS_IF_FAILED(status);
+
+    //
+    // Each row is the windowed-sinc response sampled at one fractional
+    // position, normalized to unity gain at DC. One extra row lets the
+    // output be interpolated between adjacent phases.
+    //
+    const double cutoff = 0.5 * SRC_CUTOFF_RATIO * ((outputRate < inputRate) ? (double)outputRate / (double)inputRate : 1.0);
+    for (ULONG phase = 0; phase <= SRC_FILTER_PHASES; ++phase)
+    {
+        double taps[SRC_FILTER_TAPS];
+        double sum = 0.0;
+
+        for (ULONG tap = 0; tap < SRC_FILTER_TAPS; ++tap)
+        {
+            double t = (double)tap - (double)(SRC_FILTER_TAPS / 2 - 1) - (double)phase / (double)SRC_FILTER_PHASES;
+            double x = 2.0 * SRC_PI * cutoff * t;
+            double sinc = (t == 0.0) ? 1.0 : SrcSin(x) / x;
+            double w = 2.0 * SRC_PI * t / (double)SRC_FILTER_TAPS;
+            double window = 0.42 + 0.5 * SrcCos(w) + 0.08 * SrcCos(2.0 * w);
+
+            taps[tap] = sinc * window;
+            sum += taps[tap];
+        }
+        for (ULONG tap = 0; tap < SRC_FILTER_TAPS; ++tap)
+        {
+            double coefficient = taps[tap] / sum * (double)(1 << SRC_COEFFICIENT_BITS);
+            m_coefficients[phase * SRC_FILTER_TAPS + tap] = (LONG)((coefficient >= 0.0) ? coefficient + 0.5 : coefficient - 0.5);
+        }
+    }
+
+    KeRestoreFloatingPointState(&floatingSave);
+
+    m_inputRate = inputRate;
+    m_outputRate = outputRate;
+    m_step = ((ULONGLONG)inputRate << 32) / outputRate;
+    Reset();
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit %!STATUS!", status);
+
+    return status;
+}
+
+_Use_decl_annotations_
+NONPAGED_CODE_SEG
+void SampleRateConverter::Reset()
+{
+    if (m_history != nullptr)
+    {
+        RtlZeroMemory(m_history, sizeof(LONG) * SRC_FILTER_TAPS * 2 * m_channels);
+    }
+    m_phase = 0ULL;
+    m_writeIndex = 0;
+}
+
+_Use_decl_annotations_
+NONPAGED_CODE_SEG
+ULONG SampleRateConverter::GetInputRate() const
+{
+    return m_inputRate;
+}
+
+_Use_decl_annotations_
+NONPAGED_CODE_SEG
+ULONG SampleRateConverter::GetOutputRate() const
+{
+    return m_outputRate;
+}
+
+_Use_decl_annotations_
+NONPAGED_CODE_SEG
+bool SampleRateConverter::IsInputNeeded() const
+{
+    return m_phase >= SRC_PHASE_ONE;
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+void SampleRateConverter::PushFrame(
+    const LONG * samples
+)
+{
+    PAGED_CODE();
+
+    ASSERT(IsInputNeeded());
+
+    LONG * history = m_history + m_writeIndex;
+    for (ULONG ch = 0; ch < m_channels; ++ch)
+    {
+        history[0] = samples[ch];
+        history[SRC_FILTER_TAPS] = samples[ch];
+        history += SRC_FILTER_TAPS * 2;
+    }
+    m_writeIndex = (m_writeIndex + 1) % SRC_FILTER_TAPS;
+    m_phase -= SRC_PHASE_ONE;
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+void SampleRateConverter::PullFrame(
+    LONG * samples
+)
+{
+    PAGED_CODE();
+
+    ASSERT(!IsInputNeeded());
+
+    //
+    // The output is interpolated between the two nearest phases, so that
+    // the phase table can stay small.
+    //
+    const ULONG    phase = (ULONG)(m_phase >> (32 - SRC_FILTER_PHASE_BITS));
+    const LONGLONG fraction = (LONGLONG)((m_phase >> (32 - SRC_FILTER_PHASE_BITS - 16)) & 0xffff);
+    const LONG *   coefficients0 = m_coefficients + phase * SRC_FILTER_TAPS;
+    const LONG *   coefficients1 = coefficients0 + SRC_FILTER_TAPS;
+    const LONG *   history = m_history + m_writeIndex;
+
+    for (ULONG ch = 0; ch < m_channels; ++ch)
+    {
+        LONGLONG y0 = DotProduct(history, coefficients0, s_isSse41Available) >> SRC_COEFFICIENT_BITS;
+        LONGLONG y1 = DotProduct(history, coefficients1, s_isSse41Available) >> SRC_COEFFICIENT_BITS;
+        samples[ch] = SaturateToLong(y0 + (((y1 - y0) * fraction) >> 16));
+        history += SRC_FILTER_TAPS * 2;
+    }
+    m_phase += m_step;
+}
+
+template <ULONG Bytes>
+static __forceinline LONG LoadSample(
+    _In_reads_bytes_(Bytes) const BYTE * src
+)
+{
+    if (Bytes == 2)
+    {
+        return (LONG)(*(const SHORT UNALIGNED *)src) << 16;
+    }
+    else if (Bytes == 3)
+    {
+        return (LONG)(((ULONG)src[0] << 8) | ((ULONG)src[1] << 16) | ((ULONG)src[2] << 24));
+    }
+    else
+    {
+        return *(const LONG UNALIGNED *)src;
+    }
+}
+
+template <ULONG Bytes>
+static __forceinline void StoreSample(
+    _Out_writes_bytes_(Bytes) PUCHAR dst,
+    _In_ LONG                        sample
+)
+{
+    if (Bytes == 2)
+    {
+        *(SHORT UNALIGNED *)dst = (SHORT)(sample >> 16);
+    }
+    else if (Bytes == 3)
+    {
+        dst[0] = (UCHAR)(sample >> 8);
+        dst[1] = (UCHAR)(sample >> 16);
+        dst[2] = (UCHAR)(sample >> 24);
+    }
+    else
+    {
+        *(LONG UNALIGNED *)dst = sample;
+    }
+}
+
+template <ULONG Bytes>
+static void LoadSamplesInt(
+    _Out_writes_(samples) LONG * dst,
+    _In_ const BYTE *            src,
+    _In_ ULONG                   srcStride,
+    _In_ ULONG                   samples
+)
+{
+    for (ULONG index = 0; index < samples; ++index, src += srcStride)
+    {
+        dst[index] = LoadSample<Bytes>(src);
+    }
+}
+
+template <ULONG Bytes>
+static void StoreSamplesInt(
+    _Inout_ PUCHAR                   dst,
+    _In_ ULONG                       dstStride,
+    _In_reads_(samples) const LONG * src,
+    _In_ ULONG                       samples
+)
+{
+    for (ULONG index = 0; index < samples; ++index, dst += dstStride)
+    {
+        StoreSample<Bytes>(dst, src[index]);
+    }
+}
+
+template <ULONG Bytes>
+static void MixSamplesInt(
+    _Inout_ PUCHAR                   dst,
+    _In_ ULONG                       dstStride,
+    _In_reads_(samples) const LONG * src,
+    _In_ ULONG                       samples
+)
+{
+    for (ULONG index = 0; index < samples; ++index, dst += dstStride)
+    {
+        StoreSample<Bytes>(dst, SaturateToLong((LONGLONG)LoadSample<Bytes>(dst) + src[index]));
+    }
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+SRC_LOAD_FUNCTION SampleRateConverter::GetLoadFunction(
+    ULONG bytesPerSample
+)
+{
+    PAGED_CODE();
+
+    switch (bytesPerSample)
+    {
+    case 2:
+        return LoadSamplesInt<2>;
+    case 3:
+        return LoadSamplesInt<3>;
+    case 4:
+        return LoadSamplesInt<4>;
+    default:
+        return nullptr;
+    }
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+SRC_STORE_FUNCTION SampleRateConverter::GetStoreFunction(
+    ULONG bytesPerSample
+)
+{
+    PAGED_CODE();
+
+    switch (bytesPerSample)
+    {
+    case 2:
+        return StoreSamplesInt<2>;
+    case 3:
+        return StoreSamplesInt<3>;
+    case 4:
+        return StoreSamplesInt<4>;
+    default:
+        return nullptr;
+    }
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+SRC_STORE_FUNCTION SampleRateConverter::GetMixFunction(
+    ULONG bytesPerSample
+)
+{
+    PAGED_CODE();
+
+    switch (bytesPerSample)
+    {
+    case 2:
+        return MixSamplesInt<2>;
+    case 3:
+        return MixSamplesInt<3>;
+    case 4:
+        return MixSamplesInt<4>;
+    default:
+        return nullptr;
+    }
+}
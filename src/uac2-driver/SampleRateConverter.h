@@ -0,0 +1,162 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+// ASIO is a trademark and software of Steinberg Media Technologies GmbH
+
+/*++
+
+Module Name:
+
+    SampleRateConverter.h
+
+Abstract:
+
+    Define a class that converts the sample rate of an interleaved PCM stream
+    with a polyphase windowed-sinc filter, so that an Acx Audio stream can run
+    at a rate other than the device sample rate.
+
+Environment:
+
+    Kernel-mode Driver Framework
+
+--*/
+
+#ifndef _SAMPLE_RATE_CONVERTER_H_
+#define _SAMPLE_RATE_CONVERTER_H_
+
+#define SRC_FILTER_TAPS       32
+#define SRC_FILTER_PHASE_BITS 6
+#define SRC_FILTER_PHASES     (1 << SRC_FILTER_PHASE_BITS)
+#define SRC_PHASE_ONE         (1ULL << 32)
+
+typedef void (*SRC_LOAD_FUNCTION)(
+    _Out_writes_(samples) LONG * dst,
+    _In_ const BYTE *            src,
+    _In_ ULONG                   srcStride,
+    _In_ ULONG                   samples
+);
+
+typedef void (*SRC_STORE_FUNCTION)(
+    _Inout_ PUCHAR                   dst,
+    _In_ ULONG                       dstStride,
+    _In_reads_(samples) const LONG * src,
+    _In_ ULONG                       samples
+);
+
+class SampleRateConverter
+{
+  public:
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    static void Initialize();
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    SampleRateConverter(
+        _In_ ULONG channels
+    );
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    virtual ~SampleRateConverter();
+
+    //
+    // Builds the filter for the given rates and clears the filter history.
+    // The filter cutoff follows the lower of the two rates.
+    //
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    NTSTATUS SetRates(
+        _In_ ULONG inputRate,
+        _In_ ULONG outputRate
+    );
+
+    __drv_maxIRQL(DISPATCH_LEVEL)
+    NONPAGED_CODE_SEG
+    void Reset();
+
+    __drv_maxIRQL(DISPATCH_LEVEL)
+    NONPAGED_CODE_SEG
+    ULONG GetInputRate() const;
+
+    __drv_maxIRQL(DISPATCH_LEVEL)
+    NONPAGED_CODE_SEG
+    ULONG GetOutputRate() const;
+
+    //
+    // Returns true if an input frame has to be pushed before the next output
+    // frame can be pulled. The history never holds more than one filter
+    // length of input frames.
+    //
+    __drv_maxIRQL(DISPATCH_LEVEL)
+    NONPAGED_CODE_SEG
+    bool IsInputNeeded() const;
+
+    //
+    // Pushes one frame of left-aligned 32-bit samples. Must only be called
+    // when IsInputNeeded() returns true.
+    //
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    void PushFrame(
+        _In_reads_(m_channels) const LONG * samples
+    );
+
+    //
+    // Pulls one frame of left-aligned 32-bit samples. Must only be called
+    // when IsInputNeeded() returns false.
+    //
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    void PullFrame(
+        _Out_writes_(m_channels) LONG * samples
+    );
+
+    //
+    // Return the kernels that convert a strided run of PCM samples of 2, 3 or
+    // 4 bytes to and from left-aligned 32-bit samples, or nullptr if the
+    // sample width is not supported. The mix kernel adds with saturation.
+    // Like SampleConverter::GetMixFunction, they are meant to be selected
+    // when the resampler is built rather than per sample.
+    //
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    static SRC_LOAD_FUNCTION GetLoadFunction(
+        _In_ ULONG bytesPerSample
+    );
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    static SRC_STORE_FUNCTION GetStoreFunction(
+        _In_ ULONG bytesPerSample
+    );
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    static SRC_STORE_FUNCTION GetMixFunction(
+        _In_ ULONG bytesPerSample
+    );
+
+    static __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    SampleRateConverter * Create(
+        _In_ ULONG channels
+    );
+
+  private:
+    const ULONG m_channels;
+    ULONG       m_inputRate{0};
+    ULONG       m_outputRate{0};
+    ULONGLONG   m_step{0ULL};  // Input frames per output frame, 32.32 fixed point
+    ULONGLONG   m_phase{0ULL}; // Position of the next output frame past the center of the history, 32.32 fixed point
+    ULONG       m_writeIndex{0};
+    LONG *      m_history{nullptr}; // SRC_FILTER_TAPS frames per channel, stored twice so that the filter window is contiguous
+    LONG        m_coefficients[(SRC_FILTER_PHASES + 1) * SRC_FILTER_TAPS]{};
+
+    static bool s_isSse41Available;
+};
+
+#endif
@@ -0,0 +1,129 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+// ASIO is a trademark and software of Steinberg Media Technologies GmbH
+
+/*++
+
+Module Name:
+
+    SampleRateEstimator.cpp
+
+Abstract:
+
+    Implement a class that estimates the sample rate of an isochronous
+    stream from the samples and packets of each completed URB.
+
+Environment:
+
+    Kernel-mode Driver Framework
+
+--*/
+
+#ifdef UAC_HOST_BUILD
+#include "HostCompat.h"
+#else
+#include "Driver.h"
+#endif
+#include "SampleRateEstimator.h"
+
+#if !defined(__INTELLISENSE__) && !defined(UAC_HOST_BUILD)
+#include "SampleRateEstimator.tmh"
+#endif
+
+_Use_decl_annotations_
+NONPAGED_CODE_SEG
+void SampleRateEstimator::Reset(
+    ULONG packetsPerSec
+)
+{
+    m_packetsPerSec = packetsPerSec;
+    m_windowPackets = (LONGLONG)packetsPerSec * SAMPLE_RATE_WINDOW_MS / 1000;
+    m_samples = 0LL;
+    m_packets = 0LL;
+    m_steps = 0;
+    m_restartCount = 0;
+}
+
+_Use_decl_annotations_
+NONPAGED_CODE_SEG
+void SampleRateEstimator::Update(
+    ULONG samples,
+    ULONG packets
+)
+{
+    if ((packets == 0) || (m_windowPackets == 0))
+    {
+        return;
+    }
+
+    if (IsConfident())
+    {
+        LONGLONG expectedSamples = m_samples * ((LONGLONG)packets << SAMPLE_RATE_COUNT_BITS) / m_packets;
+        LONGLONG difference = ((LONGLONG)samples << SAMPLE_RATE_COUNT_BITS) - expectedSamples;
+        LONGLONG maxDifference = max(expectedSamples >> SAMPLE_RATE_STEP_SHIFT, (LONGLONG)SAMPLE_RATE_STEP_MIN_SAMPLES << SAMPLE_RATE_COUNT_BITS);
+
+        if ((difference > maxDifference) || (difference < -maxDifference))
+        {
+            ++m_steps;
+            if (m_steps < SAMPLE_RATE_MAX_STEPS)
+            {
+                return;
+            }
+            m_samples = 0LL;
+            m_packets = 0LL;
+            ++m_restartCount;
+        }
+        m_steps = 0;
+    }
+
+    if (((m_packets >> SAMPLE_RATE_COUNT_BITS) + packets) > m_windowPackets)
+    {
+        // Once the counts span the window, each URB takes the share of the window it stands for from them.
+        m_samples -= m_samples * packets / m_windowPackets;
+        m_packets -= m_packets * packets / m_windowPackets;
+    }
+    m_samples += (LONGLONG)samples << SAMPLE_RATE_COUNT_BITS;
+    m_packets += (LONGLONG)packets << SAMPLE_RATE_COUNT_BITS;
+}
+
+_Use_decl_annotations_
+NONPAGED_CODE_SEG
+bool SampleRateEstimator::IsConfident() const
+{
+    return (m_packets != 0) && (GetUncertaintyHz() <= SAMPLE_RATE_MAX_UNCERTAINTY_HZ);
+}
+
+_Use_decl_annotations_
+NONPAGED_CODE_SEG
+ULONG SampleRateEstimator::GetSampleRate() const
+{
+    if (m_packets == 0)
+    {
+        return 0;
+    }
+
+    return (ULONG)((m_samples * m_packetsPerSec + m_packets / 2) / m_packets);
+}
+
+_Use_decl_annotations_
+NONPAGED_CODE_SEG
+ULONG SampleRateEstimator::GetUncertaintyHz() const
+{
+    if (m_packets == 0)
+    {
+        return MAXULONG;
+    }
+
+    return (ULONG)((((LONGLONG)m_packetsPerSec << SAMPLE_RATE_COUNT_BITS) + m_packets - 1) / m_packets);
+}
+
+_Use_decl_annotations_
+NONPAGED_CODE_SEG
+ULONG SampleRateEstimator::GetRestartCount() const
+{
+    return m_restartCount;
+}
@@ -0,0 +1,96 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+// ASIO is a trademark and software of Steinberg Media Technologies GmbH
+
+/*++
+
+Module Name:
+
+    SampleRateEstimator.h
+
+Abstract:
+
+    Define a class that estimates the sample rate of an isochronous stream
+    from the samples and packets of each completed URB.
+
+Environment:
+
+    Kernel-mode Driver Framework
+
+--*/
+
+#ifndef _SAMPLE_RATE_ESTIMATOR_H_
+#define _SAMPLE_RATE_ESTIMATOR_H_
+
+#define SAMPLE_RATE_COUNT_BITS         16   // Fractional bits of the decayed sample and packet counts
+#define SAMPLE_RATE_WINDOW_MS          1000 // Time constant of the decay, about the window of the former 1 second count
+#define SAMPLE_RATE_MAX_UNCERTAINTY_HZ 16   // The estimate is published once a sample is worth at most this much
+#define SAMPLE_RATE_STEP_SHIFT         4    // A URB more than 1/16 away from the estimate is a step of the clock
+#define SAMPLE_RATE_STEP_MIN_SAMPLES   2    // but a difference of fewer samples is quantization
+#define SAMPLE_RATE_MAX_STEPS          2    // Consecutive steps after which the estimate restarts
+
+//
+// The estimator keeps the sample and packet counts of the stream, both
+// decayed by the share of the window each URB stands for, so that the rate
+// is their ratio. Right after Reset the counts are not decayed yet, and the
+// rate is the exact average since the start, which is usable after a few
+// tens of milliseconds. The packet count serves as the time base, since it
+// is exact whereas the completion times carry the DPC latency. The
+// uncertainty is the rate one sample is worth over the counted packets.
+// It does not depend on the framework, so it is also built on the host and
+// driven with synthetic packet lengths by test/SampleRateEstimatorTest.cpp.
+//
+class SampleRateEstimator
+{
+  public:
+    __drv_maxIRQL(DISPATCH_LEVEL)
+    NONPAGED_CODE_SEG
+    void Reset(
+        _In_ ULONG packetsPerSec
+    );
+
+    //
+    // Feeds the samples carried by the packets of one URB. A URB that is
+    // far from the estimate twice in a row restarts the estimate, as after
+    // a switch of the clock source.
+    //
+    __drv_maxIRQL(DISPATCH_LEVEL)
+    NONPAGED_CODE_SEG
+    void Update(
+        _In_ ULONG samples,
+        _In_ ULONG packets
+    );
+
+    //
+    // Returns true if the uncertainty is at most SAMPLE_RATE_MAX_UNCERTAINTY_HZ.
+    //
+    __drv_maxIRQL(DISPATCH_LEVEL)
+    NONPAGED_CODE_SEG
+    bool IsConfident() const;
+
+    __drv_maxIRQL(DISPATCH_LEVEL)
+    NONPAGED_CODE_SEG
+    ULONG GetSampleRate() const;
+
+    __drv_maxIRQL(DISPATCH_LEVEL)
+    NONPAGED_CODE_SEG
+    ULONG GetUncertaintyHz() const;
+
+    __drv_maxIRQL(DISPATCH_LEVEL)
+    NONPAGED_CODE_SEG
+    ULONG GetRestartCount() const;
+
+  private:
+    ULONG    m_packetsPerSec{0};
+    LONGLONG m_windowPackets{0LL};
+    LONGLONG m_samples{0LL}; // SAMPLE_RATE_COUNT_BITS fixed point
+    LONGLONG m_packets{0LL}; // SAMPLE_RATE_COUNT_BITS fixed point
+    ULONG    m_steps{0};
+    ULONG    m_restartCount{0};
+};
+
+#endif
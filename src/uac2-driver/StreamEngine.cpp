@@ -347,6 +347,7 @@ CStreamEngine::Pause()
     }
 
     m_currentState = AcxStreamStatePause;
+    USBAudioAcxDriverStreamSetActive(m_input, m_deviceIndex, m_deviceContext, false);
 
     status = USBAudioAcxDriverStreamPause(m_input, m_deviceIndex, m_deviceContext);
 
@@ -406,6 +407,7 @@ CStreamEngine::Run()
     IF_FAILED_JUMP(status, exit);
 
     m_currentState = AcxStreamStateRun;
+    USBAudioAcxDriverStreamSetActive(m_input, m_deviceIndex, m_deviceContext, true);
     status = STATUS_SUCCESS;
 
 exit:
@@ -35,11 +35,20 @@ Environment:
 #include "TransferObject.h"
 #include "RtPacketObject.h"
 #include "AsioBufferObject.h"
+#include "SampleConverter.h"
+#include "StreamTiming.h"
 
 #ifndef __INTELLISENSE__
 #include "StreamObject.tmh"
 #endif
 
+#define WAKE_UP_STATISTICS_PERIOD_US 1000000
+#define COMPENSATE_PACKETS_PER_SAMPLE         8  // At most one sample owed to the feedback is paid back per this many OUT packets
+#define PARALLEL_PROCESSING_THRESHOLD_PERCENT 50 // Share of the packet period the copies may take before the IN side moves to the worker
+#define PARALLEL_PROCESSING_SLOW_WAKE_UPS     16 // Consecutive wakes above the threshold before the worker takes over
+#define PARALLEL_PROCESSING_RELEASE_PERCENT   20 // Share of the packet period a parallel wake may take before it counts as slow
+#define PARALLEL_PROCESSING_FAST_WAKE_UPS     1000 // Consecutive parallel wakes below the release threshold before the worker is released
+
 _Use_decl_annotations_
 PAGED_CODE_SEG
 StreamObject * StreamObject::Create(
@@ -77,6 +86,21 @@ StreamObject::StreamObject(
     attributes.ParentObject = deviceContext->Device;
     WdfSpinLockCreate(&attributes, &m_packetSpinLock);
 
+    KeInitializeEvent(&m_parallelDoneEvent, SynchronizationEvent, FALSE);
+
+    // Each feedback value stands for 2^(bInterval - 1) (micro)frames.
+    ULONG feedbackValueShift = (deviceContext->FeedbackProperty.FeedbackInterval != 0) ? (deviceContext->FeedbackProperty.FeedbackInterval - 1) : 0;
+    if ((deviceContext->IsDeviceSuperSpeed && deviceContext->SuperSpeedCompatible) || (deviceContext->IsDeviceHighSpeed))
+    {
+        // The feedback of high-speed endpoints is in 16.16 format, in samples per microframe.
+        m_feedbackFilter.Reset(16, feedbackValueShift, (ULONG)(((ULONGLONG)deviceContext->AudioProperty.SampleRate << 16) / 8000));
+    }
+    else
+    {
+        // The feedback of full-speed endpoints is in 10.14 format, in samples per frame.
+        m_feedbackFilter.Reset(14, feedbackValueShift, (ULONG)(((ULONGLONG)deviceContext->AudioProperty.SampleRate << 14) / 1000));
+    }
+
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit");
 }
 
@@ -95,21 +119,16 @@ StreamObject::~StreamObject()
 _Use_decl_annotations_
 PAGED_CODE_SEG
 void StreamObject::ResetNextMeasureFrames(
-    LONG inputMeasureFrames,
-    LONG outputMeasureFrames
+    ULONG inputPacketsPerSec,
+    ULONG outputPacketsPerSec
 )
 {
     PAGED_CODE();
 
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Entry");
 
-    m_inputProcessedFrames = 0;
-    m_inputBytesLastOneSec = 0;
-    m_outputProcessedFrames = 0;
-    m_outputBytesLastOneSec = 0;
-
-    m_inputNextMeasureFrames = inputMeasureFrames;
-    m_outputNextMeasureFrames = outputMeasureFrames;
+    m_inputRateEstimator.Reset(inputPacketsPerSec);
+    m_outputRateEstimator.Reset(outputPacketsPerSec);
 
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit");
 }
@@ -398,9 +417,14 @@ void StreamObject::CompleteRequest(
 
     if ((lastTimeUs != 0) && (timeDiffUs > thresholdUs))
     {
-        if ((m_deviceContext->AsioBufferObject != nullptr) && m_deviceContext->AsioBufferObject->IsRecHeaderRegistered())
+        AsioBufferObject * asioBufferObject = USBAudioAcxDriverAcquireAsioBufferObject(m_deviceContext);
+        if (asioBufferObject != nullptr)
         {
-            m_deviceContext->AsioBufferObject->SetRecDeviceStatus(DeviceStatuses::OverloadDetected);
+            if (asioBufferObject->IsRecHeaderRegistered())
+            {
+                asioBufferObject->SetRecDeviceStatus(DeviceStatuses::OverloadDetected);
+            }
+            USBAudioAcxDriverReleaseAsioBufferObject(m_deviceContext);
         }
         TraceEvents(TRACE_LEVEL_ERROR, TRACE_DEVICE, "process transfer %s: dropout detected. Elapsed time after previous DPC: %llu us, threshold %uus.", GetDirectionString(direction), timeDiffUs, thresholdUs);
         m_deviceContext->ErrorStatistics->LogErrorOccurrence(ErrorStatus::DropoutDetectedElapsedTime, (ULONG)(timeDiffUs - thresholdUs));
@@ -440,39 +464,26 @@ NONPAGED_CODE_SEG
 bool StreamObject::CalculateSampleRate(
     const bool       input,
     const ULONG      bytesPerBlock,
-    const ULONG      packetsPerSec,
     const ULONG      length,
+    const ULONG      packets,
     volatile ULONG & measuredSampleRate
 )
 {
-    volatile LONG * processedFrames = 0;
-    volatile LONG * bytesLastOneSec = nullptr;
-    LONG *          nextMeasureFrames = nullptr;
-    bool            updated = false;
-
-    if (input)
-    {
-        processedFrames = &m_inputProcessedFrames;
-        bytesLastOneSec = &m_inputBytesLastOneSec;
-        nextMeasureFrames = &m_inputNextMeasureFrames;
-    }
-    else
-    {
-        processedFrames = &m_outputProcessedFrames;
-        bytesLastOneSec = &m_outputBytesLastOneSec;
-        nextMeasureFrames = &m_outputNextMeasureFrames;
-    }
-
-    InterlockedIncrement(processedFrames);
-    InterlockedExchangeAdd(bytesLastOneSec, (LONG)length);
+    SampleRateEstimator & rateEstimator = input ? m_inputRateEstimator : m_outputRateEstimator;
+    bool                  updated = false;
 
     ASSERT(bytesPerBlock != 0);
-    if (*processedFrames >= *nextMeasureFrames)
+    rateEstimator.Update(length / bytesPerBlock, packets);
+
+    // Until the estimate is confident, the nominal sample rate set at the start of the stream stays in place.
+    if (rateEstimator.IsConfident())
     {
-        updated = true;
-        InterlockedExchangeAdd(nextMeasureFrames, packetsPerSec);
-        LONG bytesOneSec = InterlockedExchange(bytesLastOneSec, 0);
-        measuredSampleRate = bytesOneSec / bytesPerBlock;
+        ULONG sampleRate = rateEstimator.GetSampleRate();
+        if (sampleRate != measuredSampleRate)
+        {
+            updated = true;
+            InterlockedExchange(reinterpret_cast<volatile LONG *>(&measuredSampleRate), (LONG)sampleRate);
+        }
     }
     return updated;
 }
@@ -602,9 +613,12 @@ StreamObject::CalculateTransferSizeAndSetURB(
         ULONG remainSamples = static_cast<ULONG>(requiredSamples);
         if (m_compensateSamples != 0)
         {
-            remainSamples = (ULONG)((LONG)remainSamples + m_compensateSamples);
-            TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, "compensating %d samples ", m_compensateSamples);
-            m_compensateSamples = 0;
+            // The samples owed are paid back over several URBs, so that no single URB carries a burst of corrections.
+            LONG compensateLimit = (LONG)max(numPackets / COMPENSATE_PACKETS_PER_SAMPLE, 1UL);
+            LONG compensateSamples = max(min(m_compensateSamples, compensateLimit), -compensateLimit);
+            remainSamples = (ULONG)((LONG)remainSamples + compensateSamples);
+            TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, "compensating %d of %d samples ", compensateSamples, m_compensateSamples);
+            m_compensateSamples -= compensateSamples;
         }
 
         ULONG limitSamplesPerPacket = min((m_deviceContext->OutputProperty.MaxSamplesPerPacket), (m_deviceContext->OutputProperty.SamplesPerPacket + 1));
@@ -677,6 +691,43 @@ StreamObject::CreateMixingEngineThread(
     PAGED_CODE();
 
     ASSERT(m_deviceContext != nullptr);
+    if (m_deviceContext->OutputInterfaceAndPipe.Pipe != nullptr)
+    {
+        // The mix bus is owned by the device context and was sized for the selected alternate setting.
+        // If it could not be allocated, the packets are mixed directly in the transfer buffer.
+        m_outputMixBus = m_deviceContext->OutputMixBus;
+        m_outputMixBusSize = m_deviceContext->OutputMixBusSize;
+        TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, " - output mix bus %p, size %u", m_outputMixBus, m_outputMixBusSize);
+    }
+
+    if (m_deviceContext->InputInterfaceAndPipe.Pipe != nullptr)
+    {
+        // The staging buffer is owned by the device context and was sized for the selected alternate setting.
+        // If it could not be allocated, the consumers read the transfer buffer directly.
+        m_inputStagingBuffer = m_deviceContext->InputStagingBuffer;
+        m_inputStagingBufferSize = m_deviceContext->InputStagingBufferSize;
+        TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, " - input staging buffer %p, size %u", m_inputStagingBuffer, m_inputStagingBufferSize);
+    }
+
+    if ((m_parallelWorkerThread == nullptr) && (m_deviceContext->ParallelProcessing != UAC_PARALLEL_PROCESSING_DISABLED) && (KeQueryActiveProcessorCountEx(ALL_PROCESSOR_GROUPS) > 1))
+    {
+        // The parallel worker is optional. Without it, both directions are processed on the mixing engine thread.
+        m_parallelProcessing = false;
+        m_slowWakeUps = 0;
+        m_fastWakeUps = 0;
+        m_parallelWorkerThread = WorkerThread::CreateWorkerThread(m_deviceContext);
+        if (m_parallelWorkerThread != nullptr)
+        {
+            NTSTATUS workerStatus = m_parallelWorkerThread->CreateThread(ParallelWorkerThreadFunction, priority);
+            if (!NT_SUCCESS(workerStatus))
+            {
+                TraceEvents(TRACE_LEVEL_WARNING, TRACE_DEVICE, " - parallel worker thread creation failed %!STATUS!", workerStatus);
+                delete m_parallelWorkerThread;
+                m_parallelWorkerThread = nullptr;
+            }
+        }
+    }
+
     if (m_mixingEngineThread == nullptr)
     {
         m_mixingEngineThread = MixingEngineThread::CreateMixingEngineThread(m_deviceContext, 1000);
@@ -705,6 +756,21 @@ void StreamObject::TerminateMixingEngineThread()
         m_mixingEngineThread = nullptr;
     }
 
+    // The worker is terminated after the mixing engine thread, which may be waiting for it.
+    if (m_parallelWorkerThread != nullptr)
+    {
+        m_parallelWorkerThread->Terminate();
+        delete m_parallelWorkerThread;
+        m_parallelWorkerThread = nullptr;
+    }
+    m_parallelProcessing = false;
+
+    m_outputMixBus = nullptr;
+    m_outputMixBusSize = 0;
+
+    m_inputStagingBuffer = nullptr;
+    m_inputStagingBufferSize = 0;
+
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit");
 }
 
@@ -720,6 +786,13 @@ void StreamObject::WakeupMixingEngineThread()
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit");
 }
 
+_Use_decl_annotations_
+NONPAGED_CODE_SEG
+void StreamObject::SkipWakeupMixingEngineThread()
+{
+    InterlockedIncrement(&m_wakeUpStatistics.SuppressedWakeUps);
+}
+
 _Use_decl_annotations_
 PAGED_CODE_SEG
 NTSTATUS StreamObject::Wait()
@@ -743,20 +816,17 @@ StreamStatuses StreamObject::GetStreamStatuses(bool & isProcessIo)
 {
     StreamStatuses status;
 
-    WdfSpinLockAcquire(m_positionSpinLock);
-
-    status = static_cast<StreamStatuses>(m_streamStatus);
+    status = static_cast<StreamStatuses>(InterlockedCompareExchange(reinterpret_cast<volatile LONG *>(&m_streamStatus), 0, 0));
     if (m_deviceContext->UsbAudioConfiguration->HasInputAndOutputIsochronousInterfaces())
     {
-        isProcessIo = m_inputLastProcessedIrpIndex == m_outputLastProcessedIrpIndex;
+        isProcessIo = InterlockedCompareExchange(reinterpret_cast<volatile LONG *>(&m_inputLastProcessedIrpIndex), 0, 0) ==
+                      InterlockedCompareExchange(reinterpret_cast<volatile LONG *>(&m_outputLastProcessedIrpIndex), 0, 0);
     }
     else
     {
         isProcessIo = true;
     }
 
-    WdfSpinLockRelease(m_positionSpinLock);
-
     return status;
 }
 
@@ -766,11 +836,7 @@ StreamStatuses StreamObject::GetStreamStatuses()
 {
     StreamStatuses status;
 
-    WdfSpinLockAcquire(m_positionSpinLock);
-
-    status = static_cast<StreamStatuses>(m_streamStatus);
-
-    WdfSpinLockRelease(m_positionSpinLock);
+    status = static_cast<StreamStatuses>(InterlockedCompareExchange(reinterpret_cast<volatile LONG *>(&m_streamStatus), 0, 0));
 
     return status;
 }
@@ -802,6 +868,120 @@ bool StreamObject::IsFirstWakeUp()
     return (m_threadWakeUpCount <= 1);
 }
 
+_Use_decl_annotations_
+PAGED_CODE_SEG
+void StreamObject::GetSafetyOffsetContext(
+    PUAC_SAFETY_OFFSET_CONTEXT context
+)
+{
+    PAGED_CODE();
+
+    m_safetyOffsetController.GetContext(context);
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+void StreamObject::AccountWakeUp(
+    NTSTATUS  wakeupReason,
+    bool      isProductive,
+    ULONGLONG currentTimePCUs
+)
+{
+    PAGED_CODE();
+
+    ULONG wakeToDoneUs = (ULONG)(USBAudioAcxDriverStreamGetCurrentTimeUs(m_deviceContext, nullptr) - currentTimePCUs);
+    if (wakeToDoneUs > m_wakeUpStatistics.MaxWakeToDoneUs)
+    {
+        m_wakeUpStatistics.MaxWakeToDoneUs = wakeToDoneUs;
+    }
+
+    if (wakeupReason == STATUS_WAIT_0 + toInt(MixingEngineWaitEventsNumber::TimerEvent))
+    {
+        ++m_wakeUpStatistics.TimerWakeUps;
+    }
+    else if (wakeupReason == STATUS_TIMEOUT)
+    {
+        ++m_wakeUpStatistics.TimeoutWakeUps;
+    }
+    else
+    {
+        ++m_wakeUpStatistics.EventWakeUps;
+    }
+    if (isProductive)
+    {
+        ++m_wakeUpStatistics.ProductiveWakeUps;
+    }
+
+    if (m_wakeUpStatistics.StartPCUs == 0ULL)
+    {
+        m_wakeUpStatistics.StartPCUs = currentTimePCUs;
+    }
+    else if ((currentTimePCUs - m_wakeUpStatistics.StartPCUs) >= WAKE_UP_STATISTICS_PERIOD_US)
+    {
+        ULONG wakeUps = m_wakeUpStatistics.TimerWakeUps + m_wakeUpStatistics.EventWakeUps + m_wakeUpStatistics.TimeoutWakeUps;
+        LONG  suppressedWakeUps = InterlockedExchange(&m_wakeUpStatistics.SuppressedWakeUps, 0);
+        LONG  streamEngineLocks = InterlockedExchange(&m_deviceContext->StreamEngineLockCount, 0);
+
+        TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "wake ups in %llu us: total %u, productive %u, timer %u, event %u, timeout %u, suppressed %d, max wake to done %u us, stream engine locks %d", currentTimePCUs - m_wakeUpStatistics.StartPCUs, wakeUps, m_wakeUpStatistics.ProductiveWakeUps, m_wakeUpStatistics.TimerWakeUps, m_wakeUpStatistics.EventWakeUps, m_wakeUpStatistics.TimeoutWakeUps, suppressedWakeUps, m_wakeUpStatistics.MaxWakeToDoneUs, streamEngineLocks);
+        TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "usb clock: drift %d ppm, jitter %u us, relocks %u", m_inputClockModel.GetDriftPpm(), m_inputClockModel.GetJitterUs(), m_inputClockModel.GetRelockCount());
+        TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "measured sample rate: in %u +-%u Hz, restarts %u, out %u +-%u Hz, restarts %u", m_inputRateEstimator.GetSampleRate(), m_inputRateEstimator.GetUncertaintyHz(), m_inputRateEstimator.GetRestartCount(), m_outputRateEstimator.GetSampleRate(), m_outputRateEstimator.GetUncertaintyHz(), m_outputRateEstimator.GetRestartCount());
+        if (m_feedbackFilter.IsLocked())
+        {
+            TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "feedback: rate %u millisamples per frame, outliers %u, relocks %u", m_feedbackFilter.GetRateMilliSamples(), m_feedbackFilter.GetOutlierCount(), m_feedbackFilter.GetRelockCount());
+        }
+
+        m_wakeUpStatistics.TimerWakeUps = 0;
+        m_wakeUpStatistics.EventWakeUps = 0;
+        m_wakeUpStatistics.TimeoutWakeUps = 0;
+        m_wakeUpStatistics.ProductiveWakeUps = 0;
+        m_wakeUpStatistics.MaxWakeToDoneUs = 0;
+        m_wakeUpStatistics.StartPCUs = currentTimePCUs;
+    }
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+LONG StreamObject::CalculateNextWakeUpIntervalUs(
+    ULONGLONG currentTimePCUs,
+    bool      waitingForOutputReady,
+    ULONGLONG lastAsioNotifyPCUs,
+    LONG      clientProcessingTimeUs
+)
+{
+    ULONGLONG completionTimeUs = m_deviceContext->UsbAudioConfiguration->HasInputIsochronousInterface() ? m_inputIsoRequestCompletionTime.LastTimeUs : m_outputIsoRequestCompletionTime.LastTimeUs;
+
+    PAGED_CODE();
+
+    return StreamTiming::CalculateNextWakeUpIntervalUs(m_inputClockModel, m_deviceContext->FramesPerMs, completionTimeUs, currentTimePCUs, waitingForOutputReady, lastAsioNotifyPCUs, clientProcessingTimeUs);
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+void StreamObject::UpdateOutputLatencyOffset(
+    AsioBufferObject * asioBufferObject
+)
+{
+    PAGED_CODE();
+
+    // Only a latency taken from the driver buffer depends on the offset, a latency given by the hardware and hub delays does not.
+    if ((m_deviceContext->Params.OutputBufferOperationOffset & 0x80000000UL) == 0)
+    {
+        return;
+    }
+
+    // As OutputDriverBuffer in CalculateUsbLatency, for the current offset instead of the configured one.
+    LONG outputLatencyOffset = (LONG)((ULONGLONG)m_deviceContext->AudioProperty.SampleRate * m_safetyOffsetController.GetOffsetFrame() / (m_deviceContext->FramesPerMs * 1000));
+    LONG previousOutputLatencyOffset = InterlockedExchange(&m_deviceContext->AudioProperty.OutputLatencyOffset, outputLatencyOffset);
+    if (previousOutputLatencyOffset != outputLatencyOffset)
+    {
+        TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "output latency offset %d -> %d samples, safety offset %u frames", previousOutputLatencyOffset, outputLatencyOffset, m_safetyOffsetController.GetOffsetFrame());
+        if (asioBufferObject != nullptr)
+        {
+            asioBufferObject->SetRecDeviceStatus(DeviceStatuses::LatencyChanged);
+        }
+    }
+}
+
 _Use_decl_annotations_
 PAGED_CODE_SEG
 void StreamObject::SaveStartPCUs()
@@ -818,6 +998,17 @@ void StreamObject::SaveStartPCUs()
     m_asioElapsedTimeUs = 0;
 }
 
+_Use_decl_annotations_
+PAGED_CODE_SEG
+void StreamObject::SetSampleRateSwitchContext(
+    PUAC_SAMPLE_RATE_SWITCH_CONTEXT sampleRateSwitch
+)
+{
+    PAGED_CODE();
+
+    m_sampleRateSwitch = sampleRateSwitch;
+}
+
 _Use_decl_annotations_
 PAGED_CODE_SEG
 void StreamObject::SaveWakeUpTimePCUs(ULONGLONG currentTimePCUs)
@@ -840,59 +1031,6 @@ StreamObject::GetWakeUpDiffPCUs()
     return m_wakeUpDiffPCUs;
 }
 
-_Use_decl_annotations_
-PAGED_CODE_SEG
-ULONG
-StreamObject::EstimateUSBBusTime(
-    ULONG usbBusTimeCurrent,
-    ULONG wakeupDiffPCUs
-)
-{
-    ULONG usbBusTimeDiff = 0;
-
-    PAGED_CODE();
-
-    if (IsFirstWakeUp())
-    {
-        // First loop
-        usbBusTimeDiff = 0;
-        m_usbBusTimeEstimated = 0;
-        m_usbBusTimePrev = usbBusTimeCurrent;
-    }
-    else if (m_usbBusTimeEstimated != 0)
-    {
-        // If an estimated value was used last time, measure the difference between the estimated value and the current value.
-        if ((usbBusTimeCurrent < m_usbBusTimeEstimated) || ((usbBusTimeCurrent - m_usbBusTimeEstimated) > m_deviceContext->ClassicFramesPerIrp))
-        {
-            // If the guessed value is wrong, erase it as a fixed value.
-            usbBusTimeDiff = 0;
-        }
-        else
-        {
-            usbBusTimeDiff = usbBusTimeCurrent - m_usbBusTimeEstimated;
-        }
-        TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "USB bus time recovered, current %x prev %x, assuming Tdiff %u", usbBusTimeCurrent, m_usbBusTimePrev, usbBusTimeDiff);
-        m_usbBusTimePrev = usbBusTimeCurrent;
-        m_usbBusTimeEstimated = 0;
-    }
-    else if ((usbBusTimeCurrent < m_usbBusTimePrev) || ((usbBusTimeCurrent - m_usbBusTimePrev) > m_deviceContext->ClassicFramesPerIrp))
-    {
-        // When an abnormal value is detected in BusTime,the elapsed time is estimated from Performance Counter.
-        usbBusTimeDiff = (wakeupDiffPCUs + 500) / 1000;
-        TraceEvents(TRACE_LEVEL_ERROR, TRACE_DEVICE, "USB bus time error, current %x prev %x, assuming Tdiff %u", usbBusTimeCurrent, m_usbBusTimePrev, usbBusTimeDiff);
-        m_deviceContext->ErrorStatistics->LogErrorOccurrence(ErrorStatus::IllegalBusTime, 0);
-        m_usbBusTimeEstimated = m_usbBusTimePrev + usbBusTimeDiff;
-    }
-    else
-    {
-        usbBusTimeDiff = usbBusTimeCurrent - m_usbBusTimePrev;
-        TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "USB bus time is normal, current %x prev %x, assuming Tdiff %u", usbBusTimeCurrent, m_usbBusTimePrev, usbBusTimeDiff);
-        m_usbBusTimePrev = usbBusTimeCurrent;
-    }
-
-    return usbBusTimeDiff;
-}
-
 _Use_decl_annotations_
 PAGED_CODE_SEG
 void StreamObject::UpdateElapsedTimeUs(ULONG wakeUpDiffPCUs)
@@ -923,14 +1061,17 @@ bool StreamObject::IsOverrideIgnoreEstimation()
 _Use_decl_annotations_
 NONPAGED_CODE_SEG
 void StreamObject::GetCompletedPacket(
-    LONGLONG & inCompletedPacket,
-    LONGLONG & outCompletedPacket
+    LONGLONG &  inCompletedPacket,
+    LONGLONG &  outCompletedPacket,
+    ULONGLONG & inCompletedTimeUs
 )
 {
-    WdfSpinLockAcquire(m_packetSpinLock);
-    inCompletedPacket = m_inputCompletedPacket;
-    outCompletedPacket = m_outputCompletedPacket;
-    WdfSpinLockRelease(m_packetSpinLock);
+    PACKET_POSITION position;
+
+    m_packetPosition.Read(position);
+    inCompletedPacket = position.InputCompletedPacket;
+    outCompletedPacket = position.OutputCompletedPacket;
+    inCompletedTimeUs = position.InputCompletedTimeUs;
 }
 
 _Use_decl_annotations_
@@ -946,20 +1087,24 @@ void StreamObject::UpdateCompletedPacket(
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Entry, %s, %u, %u", isInput ? "Input" : "Output", numberOfPackets, index);
 
     WdfSpinLockAcquire(m_packetSpinLock);
+    PACKET_POSITION & position = m_packetPosition.BeginUpdate();
     if (isInput)
     {
-        currentPacketNumber = (ULONG)((m_inputCompletedPacket / numberOfPackets) % m_deviceContext->Params.MaxIrpNumber);
-        m_inputCompletedPacket += numberOfPackets;
+        currentPacketNumber = (ULONG)((position.InputCompletedPacket / numberOfPackets) % m_deviceContext->Params.MaxIrpNumber);
+        position.InputCompletedPacket += numberOfPackets;
+        position.InputCompletedTimeUs = m_inputIsoRequestCompletionTime.LastTimeUs;
     }
     else
     {
-        currentPacketNumber = (ULONG)((m_outputCompletedPacket / numberOfPackets) % m_deviceContext->Params.MaxIrpNumber);
-        m_outputCompletedPacket += numberOfPackets;
+        currentPacketNumber = (ULONG)((position.OutputCompletedPacket / numberOfPackets) % m_deviceContext->Params.MaxIrpNumber);
+        position.OutputCompletedPacket += numberOfPackets;
         if (!m_deviceContext->UsbAudioConfiguration->HasInputIsochronousInterface())
         {
-            m_inputCompletedPacket = m_outputCompletedPacket;
+            position.InputCompletedPacket = position.OutputCompletedPacket;
+            position.InputCompletedTimeUs = m_outputIsoRequestCompletionTime.LastTimeUs;
         }
     }
+    m_packetPosition.EndUpdate();
     WdfSpinLockRelease(m_packetSpinLock);
 
     if (currentPacketNumber != index)
@@ -973,14 +1118,21 @@ void StreamObject::UpdateCompletedPacket(
 _Use_decl_annotations_
 PAGED_CODE_SEG
 void StreamObject::DeterminePacket(
-    const LONGLONG inCompletedPacket,
-    const ULONG    usbBusTimeDiff,
-    const ULONG    packetsPerIrp,
-    const ULONG    packetsPerMs
+    const LONGLONG  inCompletedPacket,
+    const ULONGLONG inCompletedTimeUs,
+    const ULONGLONG currentTimeUs,
+    const ULONG     packetsPerIrp,
+    const ULONG     packetsPerMs
 )
 {
     PAGED_CODE();
-    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Entry, %llu, %u, %u, %u", inCompletedPacket, usbBusTimeDiff, packetsPerIrp, packetsPerMs);
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Entry, %llu, %llu, %llu, %u, %u", inCompletedPacket, inCompletedTimeUs, currentTimeUs, packetsPerIrp, packetsPerMs);
+
+    if (IsFirstWakeUp())
+    {
+        // Completions that differ from the prediction by more than an IRP are not jitter.
+        m_inputClockModel.Reset(packetsPerMs, packetsPerIrp);
+    }
 
     if (IsOverrideIgnoreEstimation())
     {
@@ -988,32 +1140,16 @@ void StreamObject::DeterminePacket(
         m_inputSyncPacket = m_inputEstimatedPacket = inCompletedPacket;
         TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " -  In sync packet %llu, estimated packet %llu, completed packet %llu", m_inputSyncPacket, m_inputEstimatedPacket, inCompletedPacket);
     }
-    else if (m_inputSyncPacket == inCompletedPacket)
+    else
     {
-        // If the number of INs completed has not changed since the previous loop,
-        // predict the position of the packet to be currently processed according to the USB bus time elapsed since the previous loop.
-        LONG packetRoom = (LONG)(m_inputSyncPacket - m_inputEstimatedPacket);
-        TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " -  packetRoom %u, In sync packet %llu,  estimated packet %llu", packetRoom, m_inputSyncPacket, m_inputEstimatedPacket);
-        if (packetRoom > 0)
+        if (m_inputSyncPacket != inCompletedPacket)
         {
-            ULONG packetsPerUsbBusTimeDiff = usbBusTimeDiff * packetsPerMs;
-            TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " -  packetRoom %u, usb bus time diff %u, frames per ms %u, packets per usb bus time diff %u", packetRoom, usbBusTimeDiff, m_deviceContext->FramesPerMs, packetsPerUsbBusTimeDiff);
-            if (packetRoom > (LONG)packetsPerUsbBusTimeDiff)
-            {
-                m_inputEstimatedPacket += packetsPerUsbBusTimeDiff;
-            }
-            else
-            {
-                m_inputEstimatedPacket += packetRoom;
-            }
+            // If an IN is found for the first time in this loop, feed its completion time to the clock model.
+            m_inputSyncPacket = inCompletedPacket;
+            m_inputClockModel.Update(inCompletedTimeUs, inCompletedPacket);
         }
-        TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " -  In sync packet %llu, estimated packet %llu, completed packet %llu", m_inputSyncPacket, m_inputEstimatedPacket, inCompletedPacket);
-    }
-    else
-    {
-        // If an IN is found for the first time in this loop
-        m_inputSyncPacket = inCompletedPacket;
-        m_inputEstimatedPacket = m_inputSyncPacket - packetsPerIrp;
+
+        m_inputEstimatedPacket = StreamTiming::EstimateInputPacket(m_inputClockModel, currentTimeUs, packetsPerIrp, m_inputSyncPacket, m_inputEstimatedPacket);
         TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " -  In sync packet %llu, estimated packet %llu, completed packet %llu", m_inputSyncPacket, m_inputEstimatedPacket, inCompletedPacket);
     }
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit");
@@ -1138,7 +1274,7 @@ bool StreamObject::IsInputPacketAtEstimatedPosition(
 
     // TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - In processed packet %llu, offset %u, estimated packet %llu", m_inputProcessedPacket, inOffsetFrame, m_inputEstimatedPacket);
 
-    return (m_inputProcessedPacket + inOffsetFrame) >= m_inputEstimatedPacket;
+    return StreamTiming::IsInputPacketAtEstimatedPosition(m_inputProcessedPacket, inOffsetFrame, m_inputEstimatedPacket);
 }
 
 _Use_decl_annotations_
@@ -1153,19 +1289,7 @@ bool StreamObject::IsOutputPacketOverlapWithEstimatePosition(
 
     TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - Out processed packet %llu, estimated packet %llu, out limit %u", m_outputProcessedPacket, m_inputEstimatedPacket, outLimit);
 
-    if (inputInterval == outputInterval)
-    {
-        // Use Input m_inputEstimatedPacket
-        return m_outputProcessedPacket >= (m_inputEstimatedPacket + outLimit);
-    }
-    else if (inputInterval > outputInterval)
-    {
-        return m_outputProcessedPacket >= ((m_inputEstimatedPacket << (inputInterval - outputInterval)) + outLimit);
-    }
-    else // (inputInterval < outputInterval)
-    {
-        return (m_outputProcessedPacket << (outputInterval - inputInterval)) >= (m_inputEstimatedPacket + (outLimit << (outputInterval - inputInterval)));
-    }
+    return StreamTiming::IsOutputPacketOverlapWithEstimatePosition(m_outputProcessedPacket, m_inputEstimatedPacket, outLimit, inputInterval, outputInterval);
 }
 
 _Use_decl_annotations_
@@ -1235,7 +1359,7 @@ bool StreamObject::CheckInputStability(
     ULONG transferredSamplesInThisIrp = transferredBytesInThisIrp / m_deviceContext->InputProperty.BytesPerBlock;
 
     WdfSpinLockAcquire(m_positionSpinLock);
-    m_inputLastProcessedIrpIndex = index;
+    InterlockedExchange(reinterpret_cast<volatile LONG *>(&m_inputLastProcessedIrpIndex), index);
     m_inputCompletedPosition += transferredSamplesInThisIrp;
 
     if (!(m_streamStatus & toInt(StreamStatuses::InputStable)))
@@ -1292,24 +1416,11 @@ ULONG StreamObject::UpdatePositionsFeedback(
     ULONG            validFeedback
 )
 {
-    feedbackSum <<= (m_deviceContext->FeedbackProperty.FeedbackInterval - 1);
-    feedbackSum += m_feedbackRemainder;
-    m_feedbackRemainder = 0;
-
     if (validFeedback != 0)
     {
-        if ((m_deviceContext->IsDeviceSuperSpeed && m_deviceContext->SuperSpeedCompatible) || (m_deviceContext->IsDeviceHighSpeed))
-        {
-            // For high-speed endpoints, the value is treated as a fixed-point number in 16.16 format.
-            m_lastFeedbackSize = feedbackSum / 0x10000;
-            m_feedbackRemainder = feedbackSum % 0x10000;
-        }
-        else
-        {
-            // For full-speed endpoints, the value is treated as a fixed-point number in 10.14 format.
-            m_lastFeedbackSize = feedbackSum / 0x4000;
-            m_feedbackRemainder = feedbackSum % 0x4000;
-        }
+        // The values were fed to the filter one by one in GetFeedbackSum, and the filter carries the fraction of a sample to the next URB.
+        m_lastFeedbackSize = m_feedbackFilter.GetSamples(validFeedback);
+        TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, "feedback sum %08x of %u values, %u samples", feedbackSum, validFeedback, m_lastFeedbackSize);
 
         {
             m_feedbackPosition += m_lastFeedbackSize;
@@ -1347,6 +1458,14 @@ void StreamObject::SetInputStreaming()
     if (!(m_streamStatus & toInt(StreamStatuses::InputStreaming)))
     {
         InterlockedOr(reinterpret_cast<volatile LONG *>(&m_streamStatus), toInt(StreamStatuses::InputStreaming));
+        if (m_sampleRateSwitch != nullptr)
+        {
+            InterlockedCompareExchange64(&m_sampleRateSwitch->FirstInputQpc, KeQueryPerformanceCounter(nullptr).QuadPart, 0);
+        }
+        if (!(toInt(c_ioStreaming) & toInt(StreamStatuses::OutputStreaming)))
+        {
+            RecordFirstAudio();
+        }
     }
 }
 
@@ -1362,24 +1481,35 @@ void StreamObject::SetOutputStreaming(
         if (!(m_streamStatus & toInt(StreamStatuses::OutputStreaming)))
         {
             InterlockedOr(reinterpret_cast<volatile LONG *>(&m_streamStatus), toInt(StreamStatuses::OutputStreaming));
+            if (m_sampleRateSwitch != nullptr)
+            {
+                InterlockedCompareExchange64(&m_sampleRateSwitch->FirstAudibleOutputQpc, KeQueryPerformanceCounter(nullptr).QuadPart, 0);
+            }
+            RecordFirstAudio();
         }
     }
-    WdfSpinLockAcquire(m_positionSpinLock);
-    m_outputLastProcessedIrpIndex = Index;
-    WdfSpinLockRelease(m_positionSpinLock);
+    InterlockedExchange(reinterpret_cast<volatile LONG *>(&m_outputLastProcessedIrpIndex), Index);
 }
 
 _Use_decl_annotations_
 NONPAGED_CODE_SEG
-bool StreamObject::IsIoSteady()
+void StreamObject::RecordFirstAudio()
 {
-    bool isIoSteady = false;
+    // Measured from the entry of StartIsoStream, so that the interface selection is included.
+    ULONGLONG timeToFirstAudioUs = USBAudioAcxDriverStreamGetCurrentTimeUs(m_deviceContext, nullptr) - m_deviceContext->StreamStartRequestUs;
 
-    WdfSpinLockAcquire(m_positionSpinLock);
+    InterlockedExchange(&m_deviceContext->LastTimeToFirstAudioUs, (LONG)min(timeToFirstAudioUs, (ULONGLONG)MAXLONG));
 
-    isIoSteady = (m_streamStatus == (ULONG)toInt(c_ioSteady));
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, " - time to first audio %llu us", timeToFirstAudioUs);
+}
 
-    WdfSpinLockRelease(m_positionSpinLock);
+_Use_decl_annotations_
+NONPAGED_CODE_SEG
+bool StreamObject::IsIoSteady()
+{
+    bool isIoSteady = false;
+
+    isIoSteady = ((ULONG)InterlockedCompareExchange(reinterpret_cast<volatile LONG *>(&m_streamStatus), 0, 0) == (ULONG)toInt(c_ioSteady));
 
     return isIoSteady;
 }
@@ -1405,6 +1535,15 @@ bool StreamObject::IsFeedbackStable()
     return m_feedbackStable;
 }
 
+_Use_decl_annotations_
+NONPAGED_CODE_SEG
+bool StreamObject::AddFeedbackValue(
+    const ULONG feedbackValue
+)
+{
+    return m_feedbackFilter.Add(feedbackValue);
+}
+
 _Use_decl_annotations_
 NONPAGED_CODE_SEG
 void StreamObject::AddCompensateSamples(
@@ -1432,8 +1571,7 @@ _Use_decl_annotations_
 NONPAGED_CODE_SEG
 ULONG StreamObject::CalculateDropoutThresholdTime()
 {
-    // 2 * 1000 microseconds, margin of 500 microseconds.
-    return (ULONG)((m_deviceContext->ClassicFramesPerIrp * 2 * 1000) - 500);
+    return StreamTiming::CalculateDropoutThresholdTime(m_deviceContext->ClassicFramesPerIrp);
 }
 
 _Use_decl_annotations_
@@ -1505,6 +1643,65 @@ void StreamObject::ClearOutputBuffer(
     }
 }
 
+_Use_decl_annotations_
+PAGED_CODE_SEG
+void StreamObject::AccumulateMeters(
+    METER_ACCUMULATOR & meter,
+    UACSampleFormat     currentSampleFormat,
+    const BYTE *        buffer,
+    ULONG               channels,
+    ULONG               bytesPerBlock,
+    ULONG               bytesPerSample,
+    ULONG               samples
+)
+{
+    PAGED_CODE();
+
+    if ((currentSampleFormat != UACSampleFormat::UAC_SAMPLE_FORMAT_PCM) && (currentSampleFormat != UACSampleFormat::UAC_SAMPLE_FORMAT_IEEE_FLOAT))
+    {
+        return;
+    }
+
+    channels = min(channels, UAC_MAX_ASIO_CHANNELS);
+    SampleConverter::AccumulateMeters(meter.Peaks, meter.SumsOfSquares, buffer, bytesPerBlock, bytesPerSample, channels, currentSampleFormat == UACSampleFormat::UAC_SAMPLE_FORMAT_IEEE_FLOAT, samples);
+    meter.Channels = max(meter.Channels, channels);
+    meter.Samples += samples;
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+void StreamObject::PublishMeters(
+    METER_ACCUMULATOR & meter,
+    PUAC_CHANNEL_METER  meters
+)
+{
+    PAGED_CODE();
+
+    if (meter.Samples == 0)
+    {
+        return;
+    }
+
+    // GetMeters takes the values with InterlockedExchange, so they are only ever added here.
+    for (ULONG channel = 0; channel < meter.Channels; ++channel)
+    {
+        LONG peak = meters[channel].Peak;
+        while ((ULONG)peak < meter.Peaks[channel])
+        {
+            LONG previousPeak = InterlockedCompareExchange((PLONG)&meters[channel].Peak, (LONG)meter.Peaks[channel], peak);
+            if (previousPeak == peak)
+            {
+                break;
+            }
+            peak = previousPeak;
+        }
+        InterlockedAdd64((PLONG64)&meters[channel].SumOfSquares, (LONG64)meter.SumsOfSquares[channel]);
+        InterlockedAdd((PLONG)&meters[channel].Samples, (LONG)meter.Samples);
+    }
+
+    RtlZeroMemory(&meter, sizeof(meter));
+}
+
 _Use_decl_annotations_
 PAGED_CODE_SEG
 void StreamObject::MixingEngineThreadFunction(
@@ -1576,6 +1773,16 @@ void StreamObject::MixingEngineThreadMain(
             break;
         }
 
+        // Take the AsioBufferObject once per wake instead of AsioWaitLock, so that property requests never block this thread.
+        // The control path waits for this reference before it deletes the object.
+        AsioBufferObject * asioBufferObject = USBAudioAcxDriverAcquireAsioBufferObject(deviceContext);
+        auto               asioBufferScope = wil::scope_exit([&]() {
+            if (asioBufferObject != nullptr)
+            {
+                USBAudioAcxDriverReleaseAsioBufferObject(deviceContext);
+            }
+        });
+
         // Get the current status of stream.
         StreamStatuses streamStatus = GetStreamStatuses(isProcessIo);
 
@@ -1590,83 +1797,84 @@ void StreamObject::MixingEngineThreadMain(
 
         SaveWakeUpTimePCUs(currentTimePCUs);
 
-        ULONG pcDiffUs = static_cast<ULONG>(GetWakeUpDiffPCUs());
-
-        LONG inElapsedTimeAfterDpc = 0;
-
-        if (hasInputIsochronousInterface)
+        if (IsFirstWakeUp())
         {
-            inElapsedTimeAfterDpc = (LONG)((LONGLONG)currentTimePCUs - m_inputIsoRequestCompletionTime.LastTimeUs);
-        }
-        else
-        {
-            inElapsedTimeAfterDpc = (LONG)((LONGLONG)currentTimePCUs - m_outputIsoRequestCompletionTime.LastTimeUs);
+            m_safetyOffsetController.Reset(deviceContext->UsbLatency.OutputOffsetFrame, deviceContext->UsbLatency.OutputMinOffsetFrame, deviceContext->FramesPerMs, deviceContext->AdaptiveSafetyOffset, currentTimePCUs);
+            // A previous stream may have left the latency of a lowered offset.
+            UpdateOutputLatencyOffset(asioBufferObject);
         }
 
-        WdfWaitLockAcquire(deviceContext->AsioWaitLock, nullptr);
-        if ((m_deviceContext->AsioBufferObject != nullptr) && m_deviceContext->AsioBufferObject->IsRecBufferReady() && m_deviceContext->AsioBufferObject->IsRecHeaderRegistered() && (asioNotifyCount > 1))
+        // Metering is gated by the last GetMeters request, so it costs a single comparison while nobody reads the meters.
+        const bool metering = (currentTimePCUs < (ULONGLONG)ReadNoFence64((volatile LONG64 *)&deviceContext->MeteringExpiryPCUs));
+
+        ULONG pcDiffUs = static_cast<ULONG>(GetWakeUpDiffPCUs());
+
+        // The completion routines keep running while this thread is stalled, so the time since its previous wake is taken as well.
+        ULONGLONG completionTimeUs = hasInputIsochronousInterface ? m_inputIsoRequestCompletionTime.LastTimeUs : m_outputIsoRequestCompletionTime.LastTimeUs;
+        LONG      elapsedTimeUs = StreamTiming::CalculateThreadElapsedTimeUs(currentTimePCUs, completionTimeUs, GetWakeUpDiffPCUs());
+
+        if ((asioBufferObject != nullptr) && asioBufferObject->IsRecBufferReady() && asioBufferObject->IsRecHeaderRegistered() && (asioNotifyCount > 1))
         {
             ULONG thresholdUs = CalculateDropoutThresholdTime();
-            if (inElapsedTimeAfterDpc > (LONG)thresholdUs)
+            if (elapsedTimeUs > (LONG)thresholdUs)
             {
 #ifdef BUFFER_THREAD_STATISTICS
-                TraceEvents(TRACE_LEVEL_ERROR, TRACE_DEVICE, "%03u.%02u: mixing engine thread: dropout detected. Long elapsed time after IN DPC, cur %dus, threshold %uus, stats %u.", (LONG)(m_elapsedPCUs / 60000000), (LONG)(m_elapsedPCUs / 1000000 % 60), inElapsedTimeAfterDpc, thresholdUs, StreamObject->NumStats);
+                TraceEvents(TRACE_LEVEL_ERROR, TRACE_DEVICE, "%03u.%02u: mixing engine thread: dropout detected. Long elapsed time after IN DPC or previous wake, cur %dus, threshold %uus, stats %u.", (LONG)(m_elapsedPCUs / 60000000), (LONG)(m_elapsedPCUs / 1000000 % 60), elapsedTimeUs, thresholdUs, StreamObject->NumStats);
 #else
-                TraceEvents(TRACE_LEVEL_ERROR, TRACE_DEVICE, "%03u.%02u: mixing engine thread: dropout detected. Long elapsed time after IN DPC, cur %dus, threshold %uus.", (LONG)(m_elapsedPCUs / 60000000), (LONG)(m_elapsedPCUs / 1000000 % 60), inElapsedTimeAfterDpc, thresholdUs);
+                TraceEvents(TRACE_LEVEL_ERROR, TRACE_DEVICE, "%03u.%02u: mixing engine thread: dropout detected. Long elapsed time after IN DPC or previous wake, cur %dus, threshold %uus.", (LONG)(m_elapsedPCUs / 60000000), (LONG)(m_elapsedPCUs / 1000000 % 60), elapsedTimeUs, thresholdUs);
 #endif
-                m_deviceContext->AsioBufferObject->SetRecDeviceStatus(DeviceStatuses::OverloadDetected);
-                m_deviceContext->ErrorStatistics->LogErrorOccurrence(ErrorStatus::DropoutDetectedInDPC, (ULONG)(inElapsedTimeAfterDpc - thresholdUs));
+                asioBufferObject->SetRecDeviceStatus(DeviceStatuses::OverloadDetected);
+                m_deviceContext->ErrorStatistics->LogErrorOccurrence(ErrorStatus::DropoutDetectedInDPC, (ULONG)(elapsedTimeUs - thresholdUs));
             }
         }
-        WdfWaitLockRelease(deviceContext->AsioWaitLock);
-        // Use WdfUsbTargetDeviceRetrieveCurrentFrameNumber() instead of USB_BUS_INTERFACE_USBDI_V1::QueryBusTime().
-        // Use USB bus time for control
-        ULONG usbBusTimeCurrent = GetCurrentFrame(deviceContext);
-
-        // Guess USB bus time so that you can respond even if the obtained USB bus time is an abnormal value.
-        ULONG usbBusTimeDiff = EstimateUSBBusTime(usbBusTimeCurrent, pcDiffUs);
 
         UpdateElapsedTimeUs(pcDiffUs);
 
-        LONGLONG inCompletedPacket = 0LL;  // IN Number of packets that have been transferred isochronous
-        LONGLONG outCompletedPacket = 0LL; // OUT Number of packets that have been transferred isochronous
-        GetCompletedPacket(inCompletedPacket, outCompletedPacket);
+        LONGLONG  inCompletedPacket = 0LL;  // IN Number of packets that have been transferred isochronous
+        LONGLONG  outCompletedPacket = 0LL; // OUT Number of packets that have been transferred isochronous
+        ULONGLONG inCompletedTimeUs = 0ULL; // Time when the last IN packet was completed
+        GetCompletedPacket(inCompletedPacket, outCompletedPacket, inCompletedTimeUs);
         // TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - in completed packet, out completed packet %llu, %lld", inCompletedPacket, outCompletedPacket);
-        WdfWaitLockAcquire(deviceContext->AsioWaitLock, nullptr);
-        bool handleAsioBuffer = ((streamStatus == c_ioSteady) && (deviceContext->AsioBufferObject != nullptr) && deviceContext->AsioBufferObject->IsRecBufferReady() && (m_recoverActive == 0) && (m_outputRequireZeroFill == 0) && !IsFirstWakeUp());
+        bool handleAsioBuffer = ((streamStatus == c_ioSteady) && (asioBufferObject != nullptr) && asioBufferObject->IsRecBufferReady() && (m_recoverActive == 0) && (m_outputRequireZeroFill == 0) && !IsFirstWakeUp());
 
         LONGLONG playReadyPosition = {0};
-        if ((deviceContext->AsioBufferObject != nullptr) && deviceContext->AsioBufferObject->IsRecBufferReady())
+        if ((asioBufferObject != nullptr) && asioBufferObject->IsRecBufferReady())
         {
-            m_asioReadyPosition += deviceContext->AsioBufferObject->UpdateReadyPosition();
+            m_asioReadyPosition += asioBufferObject->UpdateReadyPosition();
 
-            if (deviceContext->AsioBufferObject->IsUserSpaceThreadOutputReady())
+            if (asioBufferObject->IsUserSpaceThreadOutputReady())
             {
 
-                playReadyPosition = m_asioReadyPosition + (deviceContext->AsioBufferObject->GetBufferPeriod() * 2);
+                playReadyPosition = m_asioReadyPosition + (asioBufferObject->GetBufferPeriod() * 2);
                 if (!outputReadyInThisPeriod)
                 {
                     outputReadyInThisPeriod = true;
                     prevClientProcessingTimeUs = curClientProcessingTimeUs;
                     curClientProcessingTimeUs = m_asioElapsedTimeUs;
-                    LONG thresholdUs = (LONG)((deviceContext->AsioBufferObject->GetBufferPeriod()) * 1000000 / deviceContext->AudioProperty.SampleRate) + 1500;
+                    LONG thresholdUs = StreamTiming::CalculateClientProcessingThresholdUs(asioBufferObject->GetBufferPeriod(), deviceContext->AudioProperty.SampleRate);
                     if (curClientProcessingTimeUs > thresholdUs)
                     {
                         TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, "dropout detected. long client processing time %d us, threshold %d us", curClientProcessingTimeUs, thresholdUs);
-                        deviceContext->AsioBufferObject->SetRecDeviceStatus(DeviceStatuses::OverloadDetected);
+                        asioBufferObject->SetRecDeviceStatus(DeviceStatuses::OverloadDetected);
                         deviceContext->ErrorStatistics->LogErrorOccurrence(ErrorStatus::DropoutDetectedLongClientProcessingTime, curClientProcessingTimeUs - thresholdUs);
                     }
                 }
             }
             else
             {
-                playReadyPosition = m_asioReadyPosition + deviceContext->AsioBufferObject->GetBufferPeriod();
+                playReadyPosition = m_asioReadyPosition + asioBufferObject->GetBufferPeriod();
             }
         }
 
+        if ((inCompletedPacket != m_inputSyncPacket) && (inCompletedTimeUs != 0ULL))
+        {
+            // The first wake that sees an IN completion measures the latency from the completion routine to this thread.
+            m_safetyOffsetController.RecordWakeLatency((LONG)((LONGLONG)currentTimePCUs - (LONGLONG)inCompletedTimeUs));
+        }
+
         // Analyze and decide which packets to use.
         // The determined packet will be recorded in StreamObject::m_inputEstimatedPacket.
-        DeterminePacket(inCompletedPacket, usbBusTimeDiff, inputPacketsPerIrp, inputPacketsPerMs);
+        DeterminePacket(inCompletedPacket, inCompletedTimeUs, currentTimePCUs, inputPacketsPerIrp, inputPacketsPerMs);
 
         // Counts packets for which isochronous IN processing has been completed and creates a list.
         // The created list is stored in inBuffer, and if there is a remainder (inputRemainder) from the previous thread wakeup, it is allocated to the beginning of that list.
@@ -1693,10 +1901,10 @@ void StreamObject::MixingEngineThreadMain(
 
                 if (handleAsioBuffer && hasInputIsochronousInterface)
                 {
-                    LONG asioRemainSamples = (LONG)((m_asioReadyPosition + deviceContext->AsioBufferObject->GetBufferPeriod()) - m_inputAsioBufferedPosition);
+                    LONG asioRemainSamples = (LONG)((m_asioReadyPosition + asioBufferObject->GetBufferPeriod()) - m_inputAsioBufferedPosition);
                     LONG asioRemainBytes = asioRemainSamples * deviceContext->InputProperty.BytesPerBlock;
 
-                    // TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - asio remain samples %d, asio ready position %lld, asio buffer period %u, asio buffered position out %lld, in %lld", asioRemainSamples, m_asioReadyPosition, deviceContext->AsioBufferObject->GetBufferPeriod(), m_outputAsioBufferedPosition, m_inputAsioBufferedPosition);
+                    // TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - asio remain samples %d, asio ready position %lld, asio buffer period %u, asio buffered position out %lld, in %lld", asioRemainSamples, m_asioReadyPosition, asioBufferObject->GetBufferPeriod(), m_outputAsioBufferedPosition, m_inputAsioBufferedPosition);
                     if (asioRemainSamples <= 0)
                     {
                         // No more ASIO buffers to process
@@ -1749,15 +1957,7 @@ void StreamObject::MixingEngineThreadMain(
             {
                 if (!safetyOffsetApplied)
                 {
-                    ULONGLONG outAdjustedBuffersCount = (outBuffersTotalCount << (outputInterval - 1));
-
-                    ULONG safetyOffsetFrame = deviceContext->AsioBufferObject != nullptr ? (deviceContext->UsbLatency.OutputOffsetFrame) : (outputPacketsPerIrp + deviceContext->UsbLatency.OutputOffsetFrame);
-                    // The buffer has not yet been processed by this thread.
-                    ULONG dpcOffset = outputPacketsPerIrp;
-
-                    // TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - outAdjustedBuffersCount %llu, dpcOffset %lu, InputOffsetFrame %lu, safetyOffsetFrame %lu, %!bool!", outAdjustedBuffersCount, dpcOffset, deviceContext->UsbLatency.InputOffsetFrame, safetyOffsetFrame, (outAdjustedBuffersCount >= (dpcOffset + deviceContext->UsbLatency.InputOffsetFrame + safetyOffsetFrame)));
-
-                    if (outAdjustedBuffersCount >= (dpcOffset + deviceContext->UsbLatency.InputOffsetFrame + safetyOffsetFrame))
+                    if (StreamTiming::IsSafetyOffsetReached(outBuffersTotalCount, outputInterval, outputPacketsPerIrp, deviceContext->UsbLatency.InputOffsetFrame, m_safetyOffsetController.GetOffsetFrame(), asioBufferObject != nullptr))
                     {
                         // Exit the loop after processing a safety offset
                         outLoopExitReason = PacketLoopReason::ExitLoopAfterSafetyOffset;
@@ -1768,24 +1968,7 @@ void StreamObject::MixingEngineThreadMain(
                 else if (hasInputIsochronousInterface && hasOutputIsochronousInterface)
                 {
                     // Perform the sync evaluation only when both input and output isochronous transfer interfaces are present.
-                    ASSERT(inputInterval != 0);
-                    ASSERT(outputInterval != 0);
-
-                    ULONGLONG inAdjustedBuffersCount = inBuffersTotalCount;
-                    ULONGLONG outAdjustedBuffersCount = outBuffersTotalCount;
-
-                    if (inputInterval > outputInterval)
-                    {
-                        inAdjustedBuffersCount <<= (inputInterval - outputInterval);
-                    }
-                    else if (outputInterval > inputInterval)
-                    {
-                        outAdjustedBuffersCount <<= (outputInterval - inputInterval);
-                    }
-
-                    // TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - outputInterval %llu, inputInterval %llu, inAdjustedBuffersCount %llu, outAdjustedBuffersCount %llu", outputInterval, inputInterval, inAdjustedBuffersCount, outAdjustedBuffersCount);
-
-                    if (((streamStatus != StreamStatuses::IoSteady) || !handleAsioBuffer) && (outAdjustedBuffersCount >= inAdjustedBuffersCount))
+                    if (((streamStatus != StreamStatuses::IoSteady) || !handleAsioBuffer) && StreamTiming::IsOutputInSyncWithInput(inBuffersTotalCount, outBuffersTotalCount, inputInterval, outputInterval))
                     {
                         // If do not preceding processing of OUT, exit the loop when synchronized with IN.
                         outLoopExitReason = PacketLoopReason::ExitLoopAtInSync;
@@ -1867,7 +2050,6 @@ void StreamObject::MixingEngineThreadMain(
             }
             ReportPacketLoopReason("OUT loop", outLoopExitReason);
         }
-        WdfWaitLockRelease(deviceContext->AsioWaitLock);
 
         if (inBuffersCount == 0)
         {
@@ -1892,124 +2074,99 @@ void StreamObject::MixingEngineThreadMain(
         }
 
         // Dropout Detection
-        ULONG outMinOffsetFrame = deviceContext->UsbLatency.OutputOffsetFrame;
-        if (outMinOffsetFrame >= (deviceContext->Params.MaxIrpNumber - 2) * outputPacketsPerIrp)
-        {
-            outMinOffsetFrame = ((deviceContext->Params.MaxIrpNumber - 2) * outputPacketsPerIrp) - 1;
-        }
-
-        ULONG dpcOffset = outputPacketsPerIrp;
-        LONG  safetyOffset = (LONG)(m_outputProcessedPacket - m_inputProcessedPacket) - (LONG)deviceContext->UsbLatency.InputOffsetFrame - (LONG)(dpcOffset);
-        WdfWaitLockAcquire(deviceContext->AsioWaitLock, nullptr);
-        if (safetyOffset < (LONG)(outMinOffsetFrame) &&
-            (deviceContext->AsioBufferObject != nullptr) && deviceContext->AsioBufferObject->IsRecHeaderRegistered() &&
+        ULONG outMinOffsetFrame = StreamTiming::CalculateMinSafetyOffsetFrame(m_safetyOffsetController.GetOffsetFrame(), deviceContext->Params.MaxIrpNumber, outputPacketsPerIrp);
+        LONG  safetyOffset = StreamTiming::CalculateSafetyOffset(m_outputProcessedPacket, m_inputProcessedPacket, deviceContext->UsbLatency.InputOffsetFrame, outputPacketsPerIrp);
+        if ((asioBufferObject != nullptr) && asioBufferObject->IsRecHeaderRegistered() &&
             (hasOutputIsochronousInterface && hasInputIsochronousInterface))
         {
-            TraceEvents(TRACE_LEVEL_ERROR, TRACE_DEVICE, "dropout detected. Safety offset %d, minimum offset frame %d", safetyOffset, outMinOffsetFrame);
-            deviceContext->AsioBufferObject->SetRecDeviceStatus(DeviceStatuses::OverloadDetected);
-            deviceContext->ErrorStatistics->LogErrorOccurrence(ErrorStatus::DropoutDetectedSafetyOffset, 0);
-        }
-
-        TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - In buffers count %u, ioStable 0x%x, inLoopExitReason %u", inBuffersCount, static_cast<ULONG>(streamStatus), static_cast<ULONG>(inLoopExitReason));
-        if ((streamStatus == c_ioSteady) && hasInputIsochronousInterface)
-        {
-            for (ULONG bufIndex = 0; bufIndex < inBuffersCount; ++bufIndex)
+            m_safetyOffsetController.RecordSafetyOffset(safetyOffset);
+            if (safetyOffset < (LONG)(outMinOffsetFrame))
             {
-                // ULONG length = m_inputBuffers[bufIndex].length;
-                if ((deviceContext->AsioBufferObject != nullptr) && handleAsioBuffer)
+                TraceEvents(TRACE_LEVEL_ERROR, TRACE_DEVICE, "dropout detected. Safety offset %d, minimum offset frame %d", safetyOffset, outMinOffsetFrame);
+                asioBufferObject->SetRecDeviceStatus(DeviceStatuses::OverloadDetected);
+                deviceContext->ErrorStatistics->LogErrorOccurrence(ErrorStatus::DropoutDetectedSafetyOffset, 0);
+                if (m_safetyOffsetController.BackOff(currentTimePCUs))
                 {
-                    deviceContext->AsioBufferObject->CopyToAsioFromInputData(
-                        m_inputBuffers[bufIndex].Buffer + m_inputBuffers[bufIndex].Offset,
-                        m_inputBuffers[bufIndex].Length,
-                        deviceContext->InputProperty.BytesPerBlock,
-                        deviceContext->InputProperty.BytesPerSample
-                    );
-                }
-
-                if (deviceContext->RtPacketObject != nullptr)
-                {
-                    WdfWaitLockAcquire(deviceContext->StreamEngineWaitLock, nullptr);
-                    for (ULONG deviceIndex = 0; deviceIndex < deviceContext->NumOfInputDevices; deviceIndex++)
-                    {
-                        if ((deviceContext->CaptureStreamEngine[deviceIndex] != nullptr) && (deviceContext->CaptureStreamEngine[deviceIndex]->GetCurrentState() == AcxStreamStateRun))
-                        {
-                            TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - buffer index %u, transfer object %p", bufIndex, m_inputBuffers[bufIndex].TransferObject);
-                            deviceContext->RtPacketObject->CopyToRtPacketFromInputData(
-                                deviceIndex,
-                                m_inputBuffers[bufIndex].Buffer + m_inputBuffers[bufIndex].Offset,
-                                m_inputBuffers[bufIndex].Length,
-                                m_inputBuffers[bufIndex].TotalProcessedBytesSoFar,
-                                m_inputBuffers[bufIndex].TransferObject,
-                                deviceContext->InputProperty.BytesPerSample /* ex: 3 */,
-                                deviceContext->InputProperty.ValidBitsPerSample /* ex: 24*/,
-                                deviceContext->InputProperty.UsbChannels
-                            );
-                        }
-                    }
-                    WdfWaitLockRelease(deviceContext->StreamEngineWaitLock);
+                    UpdateOutputLatencyOffset(asioBufferObject);
                 }
             }
+            else if (m_safetyOffsetController.Update(currentTimePCUs))
+            {
+                UpdateOutputLatencyOffset(asioBufferObject);
+            }
         }
-        ULONG bytesPerBlock = deviceContext->OutputProperty.BytesPerBlock;
 
+        // The running stream engines are read once per wake rather than asking every engine for its state for every packet.
+        ACTIVE_STREAM_ENGINES activeStreamEngines{};
+        const bool            streamEngineLocked = (deviceContext->RtPacketObject != nullptr) && USBAudioAcxDriverStreamLockActiveEngines(deviceContext, activeStreamEngines);
+
+        TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - In buffers count %u, ioStable 0x%x, inLoopExitReason %u", inBuffersCount, static_cast<ULONG>(streamStatus), static_cast<ULONG>(inLoopExitReason));
         TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - Out buffers count %u, ioStable 0x%x, outLoopExitReason %u", outBuffersCount, static_cast<int>(streamStatus), static_cast<ULONG>(outLoopExitReason));
 
-        if (hasOutputIsochronousInterface)
+        BUFFER_PROCESS_CONTEXT processContext{};
+        processContext.AsioBufferObject = asioBufferObject;
+        processContext.ActiveStreamEngines = activeStreamEngines;
+        processContext.StreamStatus = streamStatus;
+        processContext.InBuffersCount = inBuffersCount;
+        processContext.OutBuffersCount = outBuffersCount;
+        processContext.HandleAsioBuffer = handleAsioBuffer;
+        processContext.StreamEngineLocked = streamEngineLocked;
+        processContext.Metering = metering;
+
+        const bool processInput = (streamStatus == c_ioSteady) && hasInputIsochronousInterface && (inBuffersCount != 0);
+        const bool processOutput = hasOutputIsochronousInterface && (outBuffersCount != 0);
+        ULONGLONG  processStartPCUs = USBAudioAcxDriverStreamGetCurrentTimeUs(deviceContext, nullptr);
+        ULONG      packetPeriodUs = 0;
+        if (processInput && processOutput)
         {
-            for (ULONG bufIndex = 0; bufIndex < outBuffersCount; ++bufIndex)
-            {
-                ULONG  transferSize = m_outputBuffers[bufIndex].Length;
-                PUCHAR outBufferStart = m_outputBuffers[bufIndex].Buffer + m_outputBuffers[bufIndex].Offset;
-                ULONG  outChannels = deviceContext->OutputProperty.UsbChannels;
-                ULONG  samples = transferSize / bytesPerBlock;
+            packetPeriodUs = max(inBuffersCount * 1000 / inputPacketsPerMs, outBuffersCount * 1000 / outputPacketsPerMs);
+        }
 
-                TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - outputBuffers[%u] Irp, Packet, PacketID, TransferObject, Index, %u, %u, %u, %p, %u, %llu, %lld", bufIndex, m_outputBuffers[bufIndex].Irp, m_outputBuffers[bufIndex].Packet, m_outputBuffers[bufIndex].PacketId, m_outputBuffers[bufIndex].TransferObject, m_outputBuffers[bufIndex].TransferObject->GetIndex(), m_outputBuffers[bufIndex].TransferObject->GetQPCPosition(), (bufIndex == 0) ? 0LL : (LONGLONG)(m_outputBuffers[bufIndex].TransferObject->GetQPCPosition()) - (LONGLONG)(m_outputBuffers[bufIndex - 1].TransferObject->GetQPCPosition()));
+        if (m_parallelProcessing && processInput && processOutput)
+        {
+            // The IN side is handed to the parallel worker while this thread processes the OUT side.
+            // The two sides share no state, and the context is published by the sequence increment.
+            m_parallelContext = processContext;
+            LONG sequence = InterlockedIncrement(&m_parallelRequestSequence);
+            m_parallelWorkerThread->WakeUp();
 
-                StreamObject::ClearOutputBuffer(deviceContext->AudioProperty.CurrentSampleFormat, outBufferStart, outChannels, bytesPerBlock, samples);
-                if (streamStatus == c_ioSteady)
-                {
-                    if ((deviceContext->AsioBufferObject != nullptr) && handleAsioBuffer)
-                    {
-                        if (!NT_SUCCESS(deviceContext->AsioBufferObject->CopyFromAsioToOutputData(
-                                outBufferStart,
-                                transferSize,
-                                bytesPerBlock,
-                                deviceContext->OutputProperty.BytesPerSample
-                            )))
-                        {
-                            StreamObject::ClearOutputBuffer(deviceContext->AudioProperty.CurrentSampleFormat, outBufferStart, outChannels, bytesPerBlock, samples);
-                        }
-                    }
+            ProcessOutputBuffers(processContext);
 
-                    if (deviceContext->RtPacketObject != nullptr)
-                    {
-                        WdfWaitLockAcquire(deviceContext->StreamEngineWaitLock, nullptr);
-                        for (ULONG deviceIndex = 0; deviceIndex < deviceContext->NumOfOutputDevices; deviceIndex++)
-                        {
-                            if ((deviceContext->RenderStreamEngine[deviceIndex] != nullptr) && (deviceContext->RenderStreamEngine[deviceIndex]->GetCurrentState() == AcxStreamStateRun))
-                            {
-                                TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - buffer index %u, transfer object %p", bufIndex, m_outputBuffers[bufIndex].TransferObject);
-                                deviceContext->RtPacketObject->CopyFromRtPacketToOutputData(
-                                    deviceIndex,
-                                    outBufferStart,
-                                    transferSize,
-                                    m_outputBuffers[bufIndex].TotalProcessedBytesSoFar,
-                                    m_outputBuffers[bufIndex].TransferObject,
-                                    deviceContext->OutputProperty.BytesPerSample /* ex: 3 */,
-                                    deviceContext->OutputProperty.ValidBitsPerSample /* ex: 24*/,
-                                    deviceContext->OutputProperty.UsbChannels
-                                );
-                            }
-                        }
-                        WdfWaitLockRelease(deviceContext->StreamEngineWaitLock);
-                    }
-                }
+            if (!WaitParallelWorker(sequence, processStartPCUs + packetPeriodUs))
+            {
+                // The worker did not pick up the request in time, so the IN side is processed here and the wakes stay serial.
+                ProcessInputBuffers(processContext);
+                InterlockedExchange(&m_parallelDoneSequence, sequence);
             }
         }
-        if ((deviceContext->AsioBufferObject != nullptr) && deviceContext->AsioBufferObject->IsRecBufferReady())
+        else
         {
-            if (deviceContext->AsioBufferObject->EvaluatePositionAndNotifyIfNeeded(currentTimePCUs, lastAsioNotifyPCUs, asioNotifyCount, prevAsioMeasuredPeriodUs, curClientProcessingTimeUs, curAsioMeasuredPeriodUs, hasInputIsochronousInterface, hasOutputIsochronousInterface))
+            if (processInput)
             {
+                ProcessInputBuffers(processContext);
+            }
+            if (processOutput)
+            {
+                ProcessOutputBuffers(processContext);
+            }
+        }
+
+        if (processInput && processOutput)
+        {
+            ULONG processTimeUs = (ULONG)(USBAudioAcxDriverStreamGetCurrentTimeUs(deviceContext, nullptr) - processStartPCUs);
+            UpdateParallelProcessing(processTimeUs, packetPeriodUs);
+        }
+
+        if (streamEngineLocked)
+        {
+            USBAudioAcxDriverStreamUnlockActiveEngines(deviceContext);
+        }
+        bool asioNotified = false;
+        if ((asioBufferObject != nullptr) && asioBufferObject->IsRecBufferReady())
+        {
+            if (asioBufferObject->EvaluatePositionAndNotifyIfNeeded(currentTimePCUs, lastAsioNotifyPCUs, asioNotifyCount, prevAsioMeasuredPeriodUs, curClientProcessingTimeUs, curAsioMeasuredPeriodUs, hasInputIsochronousInterface, hasOutputIsochronousInterface))
+            {
+                asioNotified = true;
                 m_asioElapsedTimeUs = 0;
                 prevAsioMeasuredPeriodUs = curAsioMeasuredPeriodUs;
                 lastAsioNotifyPCUs = currentTimePCUs;
@@ -2018,7 +2175,17 @@ void StreamObject::MixingEngineThreadMain(
                 ++asioNotifyCount;
             }
         }
-        WdfWaitLockRelease(deviceContext->AsioWaitLock);
+        const bool waitingForOutputReady = (asioBufferObject != nullptr) && asioBufferObject->IsRecBufferReady() && (asioNotifyCount != 0) && !outputReadyInThisPeriod;
+        if (metering)
+        {
+            PublishMeters(m_inputMeter, deviceContext->Meters.Input);
+            PublishMeters(m_outputMeter, deviceContext->Meters.Output);
+        }
+
+        // Instead of polling, the timer is armed for the next instant at which this thread can have work: the next USB frame, or the expected OutputReady
+        // of the ASIO client. URB completions still wake the thread through the wake-up event.
+        AccountWakeUp(wakeupReason, (inBuffersCount != 0) || (outBuffersCount != 0) || asioNotified, currentTimePCUs);
+        m_mixingEngineThread->ScheduleWakeUp(CalculateNextWakeUpIntervalUs(currentTimePCUs, waitingForOutputReady, lastAsioNotifyPCUs, curClientProcessingTimeUs));
         if (inBuffersCount != 0 || outBuffersCount != 0)
         {
             if (m_bufferProcessed < 2)
@@ -2031,3 +2198,311 @@ void StreamObject::MixingEngineThreadMain(
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit");
     return;
 }
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+void StreamObject::ProcessInputBuffers(
+    const BUFFER_PROCESS_CONTEXT & context
+)
+{
+    PAGED_CODE();
+
+    for (ULONG bufIndex = 0; bufIndex < context.InBuffersCount; ++bufIndex)
+    {
+        // ULONG length = m_inputBuffers[bufIndex].length;
+        // The packet is read from the non-cached transfer buffer once in bulk, and all consumers
+        // read the cached copy.
+        PUCHAR inBufferStart = m_inputBuffers[bufIndex].Buffer + m_inputBuffers[bufIndex].Offset;
+        ASSERT((m_inputStagingBuffer == nullptr) || (m_inputBuffers[bufIndex].Length <= m_inputStagingBufferSize));
+        const bool useStagingBuffer = (m_inputStagingBuffer != nullptr) && (m_inputBuffers[bufIndex].Length <= m_inputStagingBufferSize);
+        if (useStagingBuffer)
+        {
+            RtlCopyMemory(m_inputStagingBuffer, inBufferStart, m_inputBuffers[bufIndex].Length);
+            inBufferStart = m_inputStagingBuffer;
+        }
+
+        if (context.Metering)
+        {
+            // The staged packet is still in the cache, so metering does not read the transfer buffer again.
+            // Without the staging buffer the transfer buffer is metered directly, and the packet is counted so that the extra cost is visible.
+            AccumulateMeters(m_inputMeter, m_deviceContext->AudioProperty.CurrentSampleFormat, inBufferStart, m_deviceContext->InputProperty.UsbChannels, m_deviceContext->InputProperty.BytesPerBlock, m_deviceContext->InputProperty.BytesPerSample, m_inputBuffers[bufIndex].Length / m_deviceContext->InputProperty.BytesPerBlock);
+            if (!useStagingBuffer)
+            {
+                InterlockedIncrement((PLONG)&m_deviceContext->Meters.InputUncachedPackets);
+            }
+        }
+
+        if ((context.AsioBufferObject != nullptr) && context.HandleAsioBuffer)
+        {
+            context.AsioBufferObject->CopyToAsioFromInputData(
+                inBufferStart,
+                m_inputBuffers[bufIndex].Length,
+                m_deviceContext->InputProperty.BytesPerBlock,
+                m_deviceContext->InputProperty.BytesPerSample
+            );
+        }
+
+        if (context.StreamEngineLocked)
+        {
+            for (ULONG deviceIndex = 0; deviceIndex < m_deviceContext->NumOfInputDevices; deviceIndex++)
+            {
+                if ((context.ActiveStreamEngines.Capture[deviceIndex / 64] & (1LL << (deviceIndex % 64))) != 0)
+                {
+                    TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - buffer index %u, transfer object %p", bufIndex, m_inputBuffers[bufIndex].TransferObject);
+                    m_deviceContext->RtPacketObject->CopyToRtPacketFromInputData(
+                        deviceIndex,
+                        inBufferStart,
+                        m_inputBuffers[bufIndex].Length,
+                        m_inputBuffers[bufIndex].TotalProcessedBytesSoFar,
+                        m_inputBuffers[bufIndex].TransferObject,
+                        m_deviceContext->InputProperty.BytesPerSample /* ex: 3 */,
+                        m_deviceContext->InputProperty.ValidBitsPerSample /* ex: 24*/,
+                        m_deviceContext->InputProperty.UsbChannels
+                    );
+                }
+            }
+        }
+    }
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+void StreamObject::ProcessOutputBuffers(
+    const BUFFER_PROCESS_CONTEXT & context
+)
+{
+    const ULONG bytesPerBlock = m_deviceContext->OutputProperty.BytesPerBlock;
+
+    PAGED_CODE();
+
+    for (ULONG bufIndex = 0; bufIndex < context.OutBuffersCount; ++bufIndex)
+    {
+        ULONG  transferSize = m_outputBuffers[bufIndex].Length;
+        PUCHAR outBufferStart = m_outputBuffers[bufIndex].Buffer + m_outputBuffers[bufIndex].Offset;
+        ULONG  outChannels = m_deviceContext->OutputProperty.UsbChannels;
+        ULONG  samples = transferSize / bytesPerBlock;
+
+        TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - outputBuffers[%u] Irp, Packet, PacketID, TransferObject, Index, %u, %u, %u, %p, %u, %llu, %lld", bufIndex, m_outputBuffers[bufIndex].Irp, m_outputBuffers[bufIndex].Packet, m_outputBuffers[bufIndex].PacketId, m_outputBuffers[bufIndex].TransferObject, m_outputBuffers[bufIndex].TransferObject->GetIndex(), m_outputBuffers[bufIndex].TransferObject->GetQPCPosition(), (bufIndex == 0) ? 0LL : (LONGLONG)(m_outputBuffers[bufIndex].TransferObject->GetQPCPosition()) - (LONGLONG)(m_outputBuffers[bufIndex - 1].TransferObject->GetQPCPosition()));
+
+        // Zero fill, ASIO copy and WDM mixing are done in the cached mix bus, which is then
+        // written to the non-cached transfer buffer at once, so that the transfer buffer is never read.
+        // The bus holds the largest packet of the selected alternate setting, so every packet fits.
+        ASSERT((m_outputMixBus == nullptr) || (transferSize <= m_outputMixBusSize));
+        bool   useMixBus = (m_outputMixBus != nullptr) && (transferSize <= m_outputMixBusSize);
+        PUCHAR mixBuffer = useMixBus ? m_outputMixBus : outBufferStart;
+
+        StreamObject::ClearOutputBuffer(m_deviceContext->AudioProperty.CurrentSampleFormat, mixBuffer, outChannels, bytesPerBlock, samples);
+        if (context.StreamStatus == c_ioSteady)
+        {
+            if ((context.AsioBufferObject != nullptr) && context.HandleAsioBuffer)
+            {
+                if (!NT_SUCCESS(context.AsioBufferObject->CopyFromAsioToOutputData(
+                        mixBuffer,
+                        transferSize,
+                        bytesPerBlock,
+                        m_deviceContext->OutputProperty.BytesPerSample
+                    )))
+                {
+                    StreamObject::ClearOutputBuffer(m_deviceContext->AudioProperty.CurrentSampleFormat, mixBuffer, outChannels, bytesPerBlock, samples);
+                }
+            }
+
+            if (context.StreamEngineLocked)
+            {
+                for (ULONG deviceIndex = 0; deviceIndex < m_deviceContext->NumOfOutputDevices; deviceIndex++)
+                {
+                    if ((context.ActiveStreamEngines.Render[deviceIndex / 64] & (1LL << (deviceIndex % 64))) != 0)
+                    {
+                        TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - buffer index %u, transfer object %p", bufIndex, m_outputBuffers[bufIndex].TransferObject);
+                        m_deviceContext->RtPacketObject->CopyFromRtPacketToOutputData(
+                            deviceIndex,
+                            mixBuffer,
+                            transferSize,
+                            m_outputBuffers[bufIndex].TotalProcessedBytesSoFar,
+                            m_outputBuffers[bufIndex].TransferObject,
+                            m_deviceContext->OutputProperty.BytesPerSample /* ex: 3 */,
+                            m_deviceContext->OutputProperty.ValidBitsPerSample /* ex: 24*/,
+                            m_deviceContext->OutputProperty.UsbChannels
+                        );
+                    }
+                }
+            }
+        }
+
+        if (context.Metering)
+        {
+            // Without the mix bus the packet was mixed in the transfer buffer, which is then metered directly and counted.
+            AccumulateMeters(m_outputMeter, m_deviceContext->AudioProperty.CurrentSampleFormat, mixBuffer, outChannels, bytesPerBlock, m_deviceContext->OutputProperty.BytesPerSample, samples);
+            if (!useMixBus)
+            {
+                InterlockedIncrement((PLONG)&m_deviceContext->Meters.OutputUncachedPackets);
+            }
+        }
+        if (useMixBus)
+        {
+            SampleConverter::StreamCopy(outBufferStart, mixBuffer, samples * bytesPerBlock);
+        }
+    }
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+void StreamObject::UpdateParallelProcessing(
+    ULONG processTimeUs,
+    ULONG packetPeriodUs
+)
+{
+    PAGED_CODE();
+
+    if (m_parallelWorkerThread == nullptr)
+    {
+        return;
+    }
+
+    if (m_parallelProcessing)
+    {
+        // A parallel wake takes about as long as the slower side, so the release threshold is kept below half of the
+        // enable threshold. Otherwise the serial wakes that follow the release would enable the worker again.
+        if (m_deviceContext->ParallelProcessing == UAC_PARALLEL_PROCESSING_ALWAYS)
+        {
+            return;
+        }
+        if ((packetPeriodUs != 0) && ((ULONGLONG)processTimeUs * 100 < (ULONGLONG)packetPeriodUs * PARALLEL_PROCESSING_RELEASE_PERCENT))
+        {
+            ++m_fastWakeUps;
+        }
+        else
+        {
+            m_fastWakeUps = 0;
+        }
+        if (m_fastWakeUps >= PARALLEL_PROCESSING_FAST_WAKE_UPS)
+        {
+            TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "parallel processing disabled, %u us for %u us of packets", processTimeUs, packetPeriodUs);
+            m_parallelProcessing = false;
+            m_slowWakeUps = 0;
+        }
+        return;
+    }
+
+    if ((packetPeriodUs != 0) && ((ULONGLONG)processTimeUs * 100 > (ULONGLONG)packetPeriodUs * PARALLEL_PROCESSING_THRESHOLD_PERCENT))
+    {
+        ++m_slowWakeUps;
+    }
+    else
+    {
+        m_slowWakeUps = 0;
+    }
+
+    if ((m_deviceContext->ParallelProcessing == UAC_PARALLEL_PROCESSING_ALWAYS) || (m_slowWakeUps >= PARALLEL_PROCESSING_SLOW_WAKE_UPS))
+    {
+        TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "parallel processing enabled, %u us for %u us of packets", processTimeUs, packetPeriodUs);
+        m_parallelProcessing = true;
+        m_fastWakeUps = 0;
+    }
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+bool StreamObject::WaitParallelWorker(
+    LONG      sequence,
+    ULONGLONG deadlinePCUs
+)
+{
+    PAGED_CODE();
+
+    while (InterlockedCompareExchange(&m_parallelDoneSequence, 0, 0) != sequence)
+    {
+        ULONGLONG currentTimePCUs = USBAudioAcxDriverStreamGetCurrentTimeUs(m_deviceContext, nullptr);
+        if (currentTimePCUs < deadlinePCUs)
+        {
+            LARGE_INTEGER timeout{};
+            timeout.QuadPart = -((LONGLONG)(deadlinePCUs - currentTimePCUs) * 10);
+            KeWaitForSingleObject(&m_parallelDoneEvent, Executive, KernelMode, FALSE, &timeout);
+            continue;
+        }
+
+        // Past the deadline. If the worker has not started the request yet, it is taken back so that the caller
+        // processes it. Once started, the worker runs the same copies the caller would, so it is waited for.
+        if (InterlockedCompareExchange(&m_parallelStartedSequence, sequence, sequence - 1) == (sequence - 1))
+        {
+            TraceEvents(TRACE_LEVEL_WARNING, TRACE_DEVICE, "parallel worker did not start in time, parallel processing disabled");
+            m_parallelProcessing = false;
+            m_slowWakeUps = 0;
+            return false;
+        }
+        KeWaitForSingleObject(&m_parallelDoneEvent, Executive, KernelMode, FALSE, nullptr);
+    }
+
+    return true;
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+void StreamObject::ParallelWorkerThreadFunction(
+    PDEVICE_CONTEXT deviceContext
+)
+{
+    PAGED_CODE();
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Entry");
+
+    ASSERT(deviceContext != nullptr);
+    StreamObject * streamObject = deviceContext->StreamObject;
+    ASSERT(streamObject != nullptr);
+
+    streamObject->ParallelWorkerThreadMain();
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit");
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+void StreamObject::ParallelWorkerThreadMain()
+{
+    GROUP_AFFINITY   previousAffinity{};
+    bool             affinitySet = false;
+    PROCESSOR_NUMBER processorNumber{};
+
+    PAGED_CODE();
+
+    // Pinned to the last active processor across all processor groups. The mixing engine thread is not pinned,
+    // so the two threads only run in parallel while the scheduler keeps the mixing engine thread elsewhere.
+    ULONG processors = KeQueryActiveProcessorCountEx(ALL_PROCESSOR_GROUPS);
+    if ((processors > 1) && NT_SUCCESS(KeGetProcessorNumberFromIndex(processors - 1, &processorNumber)))
+    {
+        GROUP_AFFINITY affinity{};
+        affinity.Group = processorNumber.Group;
+        affinity.Mask = AFFINITY_MASK(processorNumber.Number);
+        KeSetSystemGroupAffinityThread(&affinity, &previousAffinity);
+        affinitySet = true;
+    }
+
+    for (;;)
+    {
+        NTSTATUS wakeupReason = m_parallelWorkerThread->Wait();
+        if (!NT_SUCCESS(wakeupReason) || (wakeupReason == STATUS_WAIT_0))
+        {
+            break;
+        }
+
+        LONG sequence = InterlockedCompareExchange(&m_parallelRequestSequence, 0, 0);
+        if (sequence == InterlockedCompareExchange(&m_parallelDoneSequence, 0, 0))
+        {
+            continue;
+        }
+        // The mixing engine thread takes the request back if it is not started before its deadline.
+        if (InterlockedCompareExchange(&m_parallelStartedSequence, sequence, sequence - 1) != (sequence - 1))
+        {
+            continue;
+        }
+
+        ProcessInputBuffers(m_parallelContext);
+
+        InterlockedExchange(&m_parallelDoneSequence, sequence);
+        KeSetEvent(&m_parallelDoneEvent, IO_SOUND_INCREMENT, FALSE);
+    }
+
+    if (affinitySet)
+    {
+        KeRevertToUserGroupAffinityThread(&previousAffinity);
+    }
+}
@@ -27,6 +27,11 @@ Environment:
 #define _STREAMOBJECT_H_
 
 #include "MixingEngineThread.h"
+#include "UsbClockModel.h"
+#include "PacketPositionSnapshot.h"
+#include "SafetyOffsetController.h"
+#include "FeedbackFilter.h"
+#include "SampleRateEstimator.h"
 
 enum class StreamStatuses
 {
@@ -72,6 +77,43 @@ typedef struct BUFFER_PROPERTY_
     TransferObject * TransferObject;
 } BUFFER_PROPERTY, *PBUFFER_PROPERTY;
 
+// Meters of the packets processed in one wake of the stream thread, indexed
+// by USB channel. They are added to DEVICE_CONTEXT::Meters once per wake.
+typedef struct METER_ACCUMULATOR_
+{
+    ULONG     Peaks[UAC_MAX_ASIO_CHANNELS];
+    ULONGLONG SumsOfSquares[UAC_MAX_ASIO_CHANNELS];
+    ULONG     Channels;
+    ULONG     Samples;
+} METER_ACCUMULATOR, *PMETER_ACCUMULATOR;
+
+// Wake accounting of the mixing engine thread, traced and cleared once per
+// second. A wake is productive if it processed a packet or notified ASIO.
+typedef struct WAKE_UP_STATISTICS_
+{
+    ULONG     TimerWakeUps;
+    ULONG     EventWakeUps;
+    ULONG     TimeoutWakeUps;
+    ULONG     ProductiveWakeUps;
+    LONG      SuppressedWakeUps; // Counted in the completion routine
+    ULONG     MaxWakeToDoneUs;   // Longest time from a wake to the end of its processing
+    ULONGLONG StartPCUs;
+} WAKE_UP_STATISTICS, *PWAKE_UP_STATISTICS;
+
+// State of one wake of the mixing engine thread that the IN and OUT buffer
+// processing need. It is copied to the parallel worker when the IN side runs there.
+typedef struct BUFFER_PROCESS_CONTEXT_
+{
+    AsioBufferObject *    AsioBufferObject;
+    ACTIVE_STREAM_ENGINES ActiveStreamEngines;
+    StreamStatuses        StreamStatus;
+    ULONG                 InBuffersCount;
+    ULONG                 OutBuffersCount;
+    bool                  HandleAsioBuffer;
+    bool                  StreamEngineLocked;
+    bool                  Metering;
+} BUFFER_PROCESS_CONTEXT, *PBUFFER_PROCESS_CONTEXT;
+
 typedef struct UAC_STREAM_STATISTICS_
 {
     ULONG         Time;
@@ -141,8 +183,8 @@ class StreamObject
     __drv_maxIRQL(PASSIVE_LEVEL)
     PAGED_CODE_SEG
     void ResetNextMeasureFrames(
-        _In_ LONG inputMeasureFrames,
-        _In_ LONG outputMeasureFrames
+        _In_ ULONG inputPacketsPerSec,
+        _In_ ULONG outputPacketsPerSec
     );
 
     __drv_maxIRQL(PASSIVE_LEVEL)
@@ -211,8 +253,8 @@ class StreamObject
     bool CalculateSampleRate(
         _In_ const bool        isInput,
         _In_ const ULONG       bytesPerBlock,
-        _In_ const ULONG       packetsPerSec,
         _In_ const ULONG       length,
+        _In_ const ULONG       packets,
         _Out_ volatile ULONG & measuredSampleRate
     );
 
@@ -246,11 +288,33 @@ class StreamObject
     void
     WakeupMixingEngineThread();
 
+    // Called instead of WakeupMixingEngineThread for a completion that brings no work to the thread.
+    __drv_maxIRQL(DISPATCH_LEVEL)
+    NONPAGED_CODE_SEG
+    void
+    SkipWakeupMixingEngineThread();
+
+    //
+    // Copies the safety offset state of the stream. The stream thread keeps
+    // updating it, so histogram buckets may come from different wakes.
+    //
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    void GetSafetyOffsetContext(
+        _Out_ PUAC_SAFETY_OFFSET_CONTEXT context
+    );
+
     __drv_maxIRQL(PASSIVE_LEVEL)
     PAGED_CODE_SEG
     void
     SaveStartPCUs();
 
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    void SetSampleRateSwitchContext(
+        _In_opt_ PUAC_SAMPLE_RATE_SWITCH_CONTEXT sampleRateSwitch
+    );
+
     __drv_maxIRQL(DISPATCH_LEVEL)
     NONPAGED_CODE_SEG
     void UpdateCompletedPacket(
@@ -317,6 +381,12 @@ class StreamObject
     NONPAGED_CODE_SEG
     bool IsFeedbackStable();
 
+    __drv_maxIRQL(DISPATCH_LEVEL)
+    NONPAGED_CODE_SEG
+    bool AddFeedbackValue(
+        _In_ const ULONG feedbackValue
+    );
+
     __drv_maxIRQL(DISPATCH_LEVEL)
     NONPAGED_CODE_SEG
     void AddCompensateSamples(
@@ -346,6 +416,10 @@ class StreamObject
     PAGED_CODE_SEG
     NTSTATUS Wait();
 
+    __drv_maxIRQL(DISPATCH_LEVEL)
+    NONPAGED_CODE_SEG
+    void RecordFirstAudio();
+
     __drv_maxIRQL(PASSIVE_LEVEL)
     NONPAGED_CODE_SEG
     StreamStatuses GetStreamStatuses(
@@ -364,6 +438,33 @@ class StreamObject
     PAGED_CODE_SEG
     void IncrementWakeUpCount();
 
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    void AccountWakeUp(
+        _In_ NTSTATUS  wakeupReason,
+        _In_ bool      isProductive,
+        _In_ ULONGLONG currentTimePCUs
+    );
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    LONG CalculateNextWakeUpIntervalUs(
+        _In_ ULONGLONG currentTimePCUs,
+        _In_ bool      waitingForOutputReady,
+        _In_ ULONGLONG lastAsioNotifyPCUs,
+        _In_ LONG      clientProcessingTimeUs
+    );
+
+    //
+    // Publishes the output latency for the safety offset in use, and asks
+    // the ASIO client to query the latencies again when it moved.
+    //
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    void UpdateOutputLatencyOffset(
+        _In_opt_ AsioBufferObject * asioBufferObject
+    );
+
     __drv_maxIRQL(PASSIVE_LEVEL)
     PAGED_CODE_SEG
     bool IsFirstWakeUp();
@@ -380,14 +481,6 @@ class StreamObject
     ULONGLONG
     GetWakeUpDiffPCUs();
 
-    __drv_maxIRQL(PASSIVE_LEVEL)
-    PAGED_CODE_SEG
-    ULONG
-    EstimateUSBBusTime(
-        _In_ ULONG usbBusTimeCurrent,
-        _In_ ULONG wakeupDiffPCUs
-    );
-
     __drv_maxIRQL(PASSIVE_LEVEL)
     PAGED_CODE_SEG
     void UpdateElapsedTimeUs(
@@ -401,17 +494,19 @@ class StreamObject
     __drv_maxIRQL(PASSIVE_LEVEL)
     NONPAGED_CODE_SEG
     void GetCompletedPacket(
-        _Out_ LONGLONG & inCompletedPacket,
-        _Out_ LONGLONG & outCompletedPacket
+        _Out_ LONGLONG &  inCompletedPacket,
+        _Out_ LONGLONG &  outCompletedPacket,
+        _Out_ ULONGLONG & inCompletedTimeUs
     );
 
     __drv_maxIRQL(PASSIVE_LEVEL)
     PAGED_CODE_SEG
     void DeterminePacket(
-        _In_ const LONGLONG inCompletedPacket,
-        _In_ const ULONG    usbBusTimeDiff,
-        _In_ const ULONG    packetsPerIrp,
-        _In_ const ULONG    packetsPerMs
+        _In_ const LONGLONG  inCompletedPacket,
+        _In_ const ULONGLONG inCompletedTimeUs,
+        _In_ const ULONGLONG currentTimeUs,
+        _In_ const ULONG     packetsPerIrp,
+        _In_ const ULONG     packetsPerMs
     );
 
     __drv_maxIRQL(PASSIVE_LEVEL)
@@ -488,6 +583,25 @@ class StreamObject
         _In_ ULONG                                         samples
     );
 
+    static __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    void AccumulateMeters(
+        _Inout_ METER_ACCUMULATOR &                       meter,
+        _In_ UACSampleFormat                              currentSampleFormat,
+        _In_reads_bytes_(bytesPerBlock * samples) const BYTE * buffer,
+        _In_ ULONG                                        channels,
+        _In_ ULONG                                        bytesPerBlock,
+        _In_ ULONG                                        bytesPerSample,
+        _In_ ULONG                                        samples
+    );
+
+    static __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    void PublishMeters(
+        _Inout_ METER_ACCUMULATOR &                          meter,
+        _Inout_updates_(UAC_MAX_ASIO_CHANNELS) PUAC_CHANNEL_METER meters
+    );
+
     static __drv_maxIRQL(PASSIVE_LEVEL)
     PAGED_CODE_SEG
     void MixingEngineThreadFunction(
@@ -500,6 +614,48 @@ class StreamObject
         _In_ PDEVICE_CONTEXT deviceContext
     );
 
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    void ProcessInputBuffers(
+        _In_ const BUFFER_PROCESS_CONTEXT & context
+    );
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    void ProcessOutputBuffers(
+        _In_ const BUFFER_PROCESS_CONTEXT & context
+    );
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    void UpdateParallelProcessing(
+        _In_ ULONG processTimeUs,
+        _In_ ULONG packetPeriodUs
+    );
+
+    //
+    // Waits for the parallel worker to finish the request. Returns false if
+    // the worker had not started it by the deadline, in which case the
+    // request is withdrawn, parallel processing is disabled and the caller
+    // has to process the IN side itself.
+    //
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    bool WaitParallelWorker(
+        _In_ LONG      sequence,
+        _In_ ULONGLONG deadlinePCUs
+    );
+
+    static __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    void ParallelWorkerThreadFunction(
+        _In_ PDEVICE_CONTEXT deviceContext
+    );
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    void ParallelWorkerThreadMain();
+
     const PDEVICE_CONTEXT m_deviceContext;
 
     TransferObject *     m_inputTransferObject[UAC_MAX_IRP_NUMBER]{};
@@ -507,6 +663,39 @@ class StreamObject
     TransferObject *     m_transferObjectFeedback[UAC_MAX_IRP_NUMBER]{};
     MixingEngineThread * m_mixingEngineThread{nullptr};
 
+    // With many channels, the IN side of a wake is processed on this worker
+    // while the mixing engine thread processes the OUT side. A request is
+    // published by incrementing m_parallelRequestSequence, and the worker
+    // reports it done by storing the same value in m_parallelDoneSequence.
+    // Whichever of the worker and the waiting thread first moves
+    // m_parallelStartedSequence to the request processes the IN side.
+    WorkerThread *         m_parallelWorkerThread{nullptr};
+    KEVENT                 m_parallelDoneEvent{0};
+    BUFFER_PROCESS_CONTEXT m_parallelContext{};
+    volatile LONG          m_parallelRequestSequence{0};
+    volatile LONG          m_parallelStartedSequence{0};
+    volatile LONG          m_parallelDoneSequence{0};
+    bool                   m_parallelProcessing{false};
+    ULONG                  m_slowWakeUps{0};
+    ULONG                  m_fastWakeUps{0};
+
+    // Cached, cache-line aligned buffer in which one OUT packet is mixed
+    // before it is stored into the non-cached isochronous transfer buffer.
+    // Borrowed from DEVICE_CONTEXT::OutputMixBus for the life of the thread.
+    PUCHAR m_outputMixBus{nullptr};
+    ULONG  m_outputMixBusSize{0};
+
+    // Cached, cache-line aligned copy of one IN packet, read by the ASIO and
+    // WDM capture paths instead of the non-cached isochronous transfer buffer.
+    // Borrowed from DEVICE_CONTEXT::InputStagingBuffer for the life of the thread.
+    PUCHAR m_inputStagingBuffer{nullptr};
+    ULONG  m_inputStagingBufferSize{0};
+
+    // Meters of the cached IN and OUT packets, only accumulated while the
+    // meters are being read.
+    METER_ACCUMULATOR m_inputMeter{};
+    METER_ACCUMULATOR m_outputMeter{};
+
     LONG   m_pendingIrps{0};
     KEVENT m_noPendingIrpEvent{0};
 
@@ -533,7 +722,6 @@ class StreamObject
     LONG     m_outputRemainder{0};
 
     LONGLONG m_feedbackPosition{0LL};
-    ULONG    m_feedbackRemainder{0};
     ULONG    m_lastFeedbackSize{0};
     ULONG    m_feedbackNextIsoFrame{0};
     ULONG    m_feedbackIsoFrameDelay{0};
@@ -542,34 +730,32 @@ class StreamObject
 
     WDFSPINLOCK m_positionSpinLock{nullptr};
 
-    LONG m_inputBytesLastOneSec{0};
-    LONG m_inputProcessedFrames{0};
-    LONG m_inputNextMeasureFrames{0};
-
-    LONG m_outputBytesLastOneSec{0};
-    LONG m_outputProcessedFrames{0};
-    LONG m_outputNextMeasureFrames{0};
+    // Each is updated by the completion of its own direction, once per URB.
+    SampleRateEstimator m_inputRateEstimator;
+    SampleRateEstimator m_outputRateEstimator;
 
     LONG m_outputRequireZeroFill{0};
 
     LONG m_inputValidPackets{0};
     LONG m_outputValidPackets{0};
 
-    // m_xxCompletedPacket is protected by SpinLock because it is operated within the DPC.
+    // m_packetPosition is updated under SpinLock because the input and output completions run in separate DPCs.
+    // The thread reads it without the lock.
 
-    WDFSPINLOCK m_packetSpinLock{nullptr};
+    WDFSPINLOCK            m_packetSpinLock{nullptr};
+    PacketPositionSnapshot m_packetPosition;
 
-    LONGLONG m_inputCompletedPacket{0LL};
-    LONGLONG m_inputSyncPacket{0LL};
-    LONGLONG m_inputEstimatedPacket{0LL};
-    LONGLONG m_inputProcessedPacket{0LL};
+    LONGLONG  m_inputSyncPacket{0LL};
+    LONGLONG  m_inputEstimatedPacket{0LL};
+    LONGLONG  m_inputProcessedPacket{0LL};
 
-    LONGLONG m_outputCompletedPacket{0LL};
     LONGLONG m_outputSyncPacket{0LL};
     LONGLONG m_outputProcessedPacket{0LL};
 
     LONGLONG m_asioReadyPosition{0LL};
     LONGLONG m_threadWakeUpCount{0LL};
+
+    WAKE_UP_STATISTICS m_wakeUpStatistics{};
     ULONG    m_bufferProcessed{0};
 
     LONGLONG m_outputAsioBufferedPosition{0LL};
@@ -594,8 +780,15 @@ class StreamObject
     ULONGLONG m_wakeUpDiffPCUs{0ULL};
     ULONGLONG m_lastWakePCUs{0ULL};
 
-    ULONG m_usbBusTimeEstimated{0};
-    ULONG m_usbBusTimePrev{0};
+    UsbClockModel m_inputClockModel;
+
+    // Set when the stream was started by a sample rate switch, whose first IN and audible OUT completions it records.
+    PUAC_SAMPLE_RATE_SWITCH_CONTEXT m_sampleRateSwitch{nullptr};
+
+    SafetyOffsetController m_safetyOffsetController;
+
+    // Written by the feedback completion only.
+    FeedbackFilter m_feedbackFilter;
 
     ULONG m_syncElapsedTimeUs{0};
     ULONG m_asioElapsedTimeUs{0};
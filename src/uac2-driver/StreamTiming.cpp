@@ -0,0 +1,336 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+// ASIO is a trademark and software of Steinberg Media Technologies GmbH
+
+/*++
+
+Module Name:
+
+    StreamTiming.cpp
+
+Abstract:
+
+    Implement the timing rules of the mixing engine thread.
+
+Environment:
+
+    Kernel-mode Driver Framework
+
+--*/
+
+#ifdef UAC_HOST_BUILD
+#include "HostCompat.h"
+#else
+#include "Driver.h"
+#endif
+#include "StreamTiming.h"
+
+#if !defined(__INTELLISENSE__) && !defined(UAC_HOST_BUILD)
+#include "StreamTiming.tmh"
+#endif
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+LONGLONG StreamTiming::EstimateInputPacket(
+    const UsbClockModel & clockModel,
+    ULONGLONG             currentTimeUs,
+    ULONG                 packetsPerIrp,
+    LONGLONG              syncPacket,
+    LONGLONG              estimatedPacket
+)
+{
+    PAGED_CODE();
+
+    if (!clockModel.IsLocked())
+    {
+        return estimatedPacket;
+    }
+
+    LONGLONG predictedPacket = clockModel.PredictPosition(currentTimeUs) / (1LL << USB_CLOCK_POSITION_BITS) - packetsPerIrp;
+    if (predictedPacket > syncPacket)
+    {
+        predictedPacket = syncPacket;
+    }
+    return (predictedPacket > estimatedPacket) ? predictedPacket : estimatedPacket;
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+bool StreamTiming::IsInputPacketAtEstimatedPosition(
+    LONGLONG inputProcessedPacket,
+    ULONG    inOffsetFrame,
+    LONGLONG inputEstimatedPacket
+)
+{
+    PAGED_CODE();
+
+    return (inputProcessedPacket + inOffsetFrame) >= inputEstimatedPacket;
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+bool StreamTiming::IsOutputPacketOverlapWithEstimatePosition(
+    LONGLONG outputProcessedPacket,
+    LONGLONG inputEstimatedPacket,
+    ULONG    outLimit,
+    ULONG    inputInterval,
+    ULONG    outputInterval
+)
+{
+    PAGED_CODE();
+
+    if (inputInterval == outputInterval)
+    {
+        return outputProcessedPacket >= (inputEstimatedPacket + outLimit);
+    }
+    else if (inputInterval > outputInterval)
+    {
+        return outputProcessedPacket >= ((inputEstimatedPacket << (inputInterval - outputInterval)) + outLimit);
+    }
+    else // (inputInterval < outputInterval)
+    {
+        return (outputProcessedPacket << (outputInterval - inputInterval)) >= (inputEstimatedPacket + ((LONGLONG)outLimit << (outputInterval - inputInterval)));
+    }
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+bool StreamTiming::IsSafetyOffsetReached(
+    LONGLONG outBuffersTotalCount,
+    ULONG    outputInterval,
+    ULONG    outputPacketsPerIrp,
+    ULONG    inOffsetFrame,
+    ULONG    safetyOffsetFrame,
+    bool     hasAsioBuffer
+)
+{
+    PAGED_CODE();
+
+    ULONGLONG outAdjustedBuffersCount = ((ULONGLONG)outBuffersTotalCount << (outputInterval - 1));
+    ULONG     offsetFrame = hasAsioBuffer ? safetyOffsetFrame : (outputPacketsPerIrp + safetyOffsetFrame);
+
+    // The buffer of the IRP being completed has not yet been processed by the thread.
+    return outAdjustedBuffersCount >= ((ULONGLONG)outputPacketsPerIrp + inOffsetFrame + offsetFrame);
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+bool StreamTiming::IsOutputInSyncWithInput(
+    LONGLONG inBuffersTotalCount,
+    LONGLONG outBuffersTotalCount,
+    ULONG    inputInterval,
+    ULONG    outputInterval
+)
+{
+    ULONGLONG inAdjustedBuffersCount = (ULONGLONG)inBuffersTotalCount;
+    ULONGLONG outAdjustedBuffersCount = (ULONGLONG)outBuffersTotalCount;
+
+    PAGED_CODE();
+
+    ASSERT(inputInterval != 0);
+    ASSERT(outputInterval != 0);
+
+    if (inputInterval > outputInterval)
+    {
+        inAdjustedBuffersCount <<= (inputInterval - outputInterval);
+    }
+    else if (outputInterval > inputInterval)
+    {
+        outAdjustedBuffersCount <<= (outputInterval - inputInterval);
+    }
+
+    return outAdjustedBuffersCount >= inAdjustedBuffersCount;
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+LONG StreamTiming::CalculateSafetyOffset(
+    LONGLONG outputProcessedPacket,
+    LONGLONG inputProcessedPacket,
+    ULONG    inOffsetFrame,
+    ULONG    outputPacketsPerIrp
+)
+{
+    PAGED_CODE();
+
+    return (LONG)(outputProcessedPacket - inputProcessedPacket) - (LONG)inOffsetFrame - (LONG)outputPacketsPerIrp;
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+ULONG StreamTiming::CalculateMinSafetyOffsetFrame(
+    ULONG safetyOffsetFrame,
+    ULONG numIrp,
+    ULONG outputPacketsPerIrp
+)
+{
+    PAGED_CODE();
+
+    if (safetyOffsetFrame >= (numIrp - 2) * outputPacketsPerIrp)
+    {
+        return ((numIrp - 2) * outputPacketsPerIrp) - 1;
+    }
+    return safetyOffsetFrame;
+}
+
+_Use_decl_annotations_
+NONPAGED_CODE_SEG
+ULONG StreamTiming::CalculateDropoutThresholdTime(
+    ULONG classicFramesPerIrp
+)
+{
+    // 2 * 1000 microseconds, margin of 500 microseconds.
+    return (ULONG)((classicFramesPerIrp * 2 * 1000) - 500);
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+LONG StreamTiming::CalculateThreadElapsedTimeUs(
+    ULONGLONG currentTimeUs,
+    ULONGLONG completionTimeUs,
+    ULONGLONG wakeUpDiffUs
+)
+{
+    LONG elapsedTimeAfterDpcUs = (LONG)((LONGLONG)currentTimeUs - (LONGLONG)completionTimeUs);
+    LONG elapsedTimeAfterWakeUpUs = (LONG)min(wakeUpDiffUs, (ULONGLONG)MAXLONG);
+
+    PAGED_CODE();
+
+    return max(elapsedTimeAfterDpcUs, elapsedTimeAfterWakeUpUs);
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+LONG StreamTiming::CalculateClientProcessingThresholdUs(
+    ULONG bufferPeriod,
+    ULONG sampleRate
+)
+{
+    PAGED_CODE();
+
+    // One buffer period, margin of 1500 microseconds.
+    return (LONG)((ULONGLONG)bufferPeriod * 1000000ULL / sampleRate) + 1500;
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+bool StreamTiming::IsAsioNotifyDue(
+    LONGLONG writePosition,
+    LONGLONG readPosition,
+    LONGLONG notifyPosition,
+    ULONG    bufferPeriod,
+    bool     hasInputIsochronousInterface,
+    bool     hasOutputIsochronousInterface
+)
+{
+    PAGED_CODE();
+
+    if (hasInputIsochronousInterface && hasOutputIsochronousInterface)
+    {
+        return ((writePosition - notifyPosition) >= bufferPeriod) && ((readPosition - notifyPosition) >= bufferPeriod);
+    }
+    else if (!hasInputIsochronousInterface)
+    {
+        // output only
+        return (readPosition - notifyPosition) >= bufferPeriod;
+    }
+    else
+    {
+        // input only
+        return (writePosition - notifyPosition) >= bufferPeriod;
+    }
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+LONG StreamTiming::CalculateCallbackPeriodThresholdUs(
+    ULONG sampleRate,
+    ULONG bufferPeriod,
+    ULONG outputDriverBuffer
+)
+{
+    ULONG minimumPeriod = sampleRate / 1000;
+
+    PAGED_CODE();
+
+    if (minimumPeriod < bufferPeriod)
+    {
+        minimumPeriod = bufferPeriod;
+    }
+    return (LONG)((LONGLONG)(minimumPeriod + outputDriverBuffer) * 1000000LL / sampleRate);
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+LONG StreamTiming::CalculateNextWakeUpIntervalUs(
+    const UsbClockModel & clockModel,
+    ULONG                 framesPerMs,
+    ULONGLONG             completionTimeUs,
+    ULONGLONG             currentTimeUs,
+    bool                  waitingForOutputReady,
+    ULONGLONG             lastAsioNotifyUs,
+    LONG                  clientProcessingTimeUs
+)
+{
+    // One frame at full speed, one microframe at high speed.
+    LONG busIntervalUs = WAKE_UP_FRAME_PERIOD_US / (LONG)max(framesPerMs, (ULONG)1);
+    LONG intervalUs = busIntervalUs;
+
+    PAGED_CODE();
+
+    // URBs complete just after a USB frame boundary, so the clock model, or the last completion until the model locks, gives the phase of the (micro)frames.
+    if (clockModel.IsLocked())
+    {
+        intervalUs = (LONG)(clockModel.GetTimeToNextFrameUs(currentTimeUs) % (ULONG)busIntervalUs) + WAKE_UP_FRAME_EDGE_GUARD_US;
+        if (intervalUs > busIntervalUs)
+        {
+            intervalUs -= busIntervalUs;
+        }
+    }
+    else if ((completionTimeUs != 0ULL) && (currentTimeUs >= completionTimeUs))
+    {
+        ULONG sinceFrameEdgeUs = (ULONG)((currentTimeUs - completionTimeUs) % (ULONGLONG)busIntervalUs);
+        intervalUs = (LONG)(busIntervalUs - sinceFrameEdgeUs + WAKE_UP_FRAME_EDGE_GUARD_US);
+        if (intervalUs > busIntervalUs)
+        {
+            intervalUs -= busIntervalUs;
+        }
+    }
+
+    if (waitingForOutputReady)
+    {
+        // OutputReady is polled, so wake when the client is expected to finish and poll at the minimum interval after that.
+        LONGLONG untilOutputReadyUs = (LONGLONG)(lastAsioNotifyUs + (ULONGLONG)max(clientProcessingTimeUs, (LONG)0)) - (LONGLONG)currentTimeUs - WAKE_UP_OUTPUT_READY_LEAD_US;
+        if (untilOutputReadyUs < (LONGLONG)intervalUs)
+        {
+            intervalUs = (untilOutputReadyUs > 0) ? (LONG)untilOutputReadyUs : 0;
+        }
+    }
+
+    return intervalUs;
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+LONG StreamTiming::ClampWakeUpIntervalUs(
+    LONG intervalUs,
+    LONG minIntervalUs,
+    LONG busIntervalUs
+)
+{
+    PAGED_CODE();
+
+    if (intervalUs < minIntervalUs)
+    {
+        intervalUs = minIntervalUs;
+    }
+    if (intervalUs > busIntervalUs)
+    {
+        intervalUs = busIntervalUs;
+    }
+    return intervalUs;
+}
@@ -0,0 +1,237 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+// ASIO is a trademark and software of Steinberg Media Technologies GmbH
+
+/*++
+
+Module Name:
+
+    StreamTiming.h
+
+Abstract:
+
+    Define the timing rules of the mixing engine thread: where the packet
+    loops stop, when the safety offset and the elapsed times count as a
+    dropout, when the ASIO client is notified and when the thread wakes
+    up next.
+
+Environment:
+
+    Kernel-mode Driver Framework
+
+--*/
+
+#ifndef _STREAM_TIMING_H_
+#define _STREAM_TIMING_H_
+
+#include "UsbClockModel.h"
+
+//
+// The packet estimation advances with the USB frame number, so the mixing
+// engine thread is woken just after each (micro)frame boundary. The guard lets
+// the host controller move on to the new frame number first.
+//
+#define WAKE_UP_FRAME_PERIOD_US     1000
+#define WAKE_UP_FRAME_EDGE_GUARD_US 50
+
+//
+// OutputReady is polled from a little before the client processing time
+// measured in the previous period, so that a client that gets faster is
+// still picked up early.
+//
+#define WAKE_UP_OUTPUT_READY_LEAD_US 100
+
+//
+// The rules only take positions, counts and times, so StreamObject,
+// AsioBufferObject and MixingEngineThread keep their state and apply the
+// rules to it. They do not depend on the framework, so they are also built
+// on the host, where test/PipelineSimulator.cpp applies the same rules to a
+// simulated pipeline.
+//
+class StreamTiming
+{
+  public:
+    //
+    // Returns the packet position the IN loop may process up to, given the
+    // previous one. Packets only become visible when their IRP completes,
+    // so the position trails the position predicted by the clock model by
+    // one IRP. It never moves backwards and never passes syncPacket, the
+    // packets that have actually completed.
+    //
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    static LONGLONG EstimateInputPacket(
+        _In_ const UsbClockModel & clockModel,
+        _In_ ULONGLONG             currentTimeUs,
+        _In_ ULONG                 packetsPerIrp,
+        _In_ LONGLONG              syncPacket,
+        _In_ LONGLONG              estimatedPacket
+    );
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    static bool IsInputPacketAtEstimatedPosition(
+        _In_ LONGLONG inputProcessedPacket,
+        _In_ ULONG    inOffsetFrame,
+        _In_ LONGLONG inputEstimatedPacket
+    );
+
+    //
+    // Returns true once the OUT loop has gone outLimit packets past the
+    // estimated IN position, where it would overwrite the packets the bus
+    // is still sending. The positions are in packets of their own interval.
+    //
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    static bool IsOutputPacketOverlapWithEstimatePosition(
+        _In_ LONGLONG outputProcessedPacket,
+        _In_ LONGLONG inputEstimatedPacket,
+        _In_ ULONG    outLimit,
+        _In_ ULONG    inputInterval,
+        _In_ ULONG    outputInterval
+    );
+
+    //
+    // Returns true once the OUT packets processed since the stream started
+    // cover the IRP being completed, the IN offset and the safety offset.
+    // Without an ASIO client one more IRP is kept as a safety offset.
+    //
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    static bool IsSafetyOffsetReached(
+        _In_ LONGLONG outBuffersTotalCount,
+        _In_ ULONG    outputInterval,
+        _In_ ULONG    outputPacketsPerIrp,
+        _In_ ULONG    inOffsetFrame,
+        _In_ ULONG    safetyOffsetFrame,
+        _In_ bool     hasAsioBuffer
+    );
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    static bool IsOutputInSyncWithInput(
+        _In_ LONGLONG inBuffersTotalCount,
+        _In_ LONGLONG outBuffersTotalCount,
+        _In_ ULONG    inputInterval,
+        _In_ ULONG    outputInterval
+    );
+
+    //
+    // Returns the frames by which the OUT position leads the IN position,
+    // less the IN offset and the IRP being completed.
+    //
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    static LONG CalculateSafetyOffset(
+        _In_ LONGLONG outputProcessedPacket,
+        _In_ LONGLONG inputProcessedPacket,
+        _In_ ULONG    inOffsetFrame,
+        _In_ ULONG    outputPacketsPerIrp
+    );
+
+    //
+    // Returns the safety offset below which a dropout is reported. It is
+    // kept below the two IRPs that are always in flight.
+    //
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    static ULONG CalculateMinSafetyOffsetFrame(
+        _In_ ULONG safetyOffsetFrame,
+        _In_ ULONG numIrp,
+        _In_ ULONG outputPacketsPerIrp
+    );
+
+    //
+    // Returns the time after which a late URB completion, or a mixing
+    // engine thread that has not run, counts as a dropout.
+    //
+    __drv_maxIRQL(DISPATCH_LEVEL)
+    NONPAGED_CODE_SEG
+    static ULONG CalculateDropoutThresholdTime(
+        _In_ ULONG classicFramesPerIrp
+    );
+
+    //
+    // Returns how long the mixing engine thread has not run, as the longer
+    // of the time since the last URB completion and the time since its
+    // previous wake. The completions keep running while the thread is
+    // stalled, so the time since the completion alone does not show a stall.
+    //
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    static LONG CalculateThreadElapsedTimeUs(
+        _In_ ULONGLONG currentTimeUs,
+        _In_ ULONGLONG completionTimeUs,
+        _In_ ULONGLONG wakeUpDiffUs
+    );
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    static LONG CalculateClientProcessingThresholdUs(
+        _In_ ULONG bufferPeriod,
+        _In_ ULONG sampleRate
+    );
+
+    //
+    // Returns true when every direction in use has moved a whole buffer
+    // period past the notified position.
+    //
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    static bool IsAsioNotifyDue(
+        _In_ LONGLONG writePosition,
+        _In_ LONGLONG readPosition,
+        _In_ LONGLONG notifyPosition,
+        _In_ ULONG    bufferPeriod,
+        _In_ bool     hasInputIsochronousInterface,
+        _In_ bool     hasOutputIsochronousInterface
+    );
+
+    //
+    // Returns the callback period above which a dropout is reported: the
+    // buffer period, at least 1 ms, plus the OUT driver buffer.
+    //
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    static LONG CalculateCallbackPeriodThresholdUs(
+        _In_ ULONG sampleRate,
+        _In_ ULONG bufferPeriod,
+        _In_ ULONG outputDriverBuffer
+    );
+
+    //
+    // Returns the time until the mixing engine thread next has work: just
+    // after the next (micro)frame boundary, taken from the clock model or,
+    // until the model locks, from the last completion, or earlier when the
+    // ASIO client is expected to set OutputReady.
+    //
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    static LONG CalculateNextWakeUpIntervalUs(
+        _In_ const UsbClockModel & clockModel,
+        _In_ ULONG                 framesPerMs,
+        _In_ ULONGLONG             completionTimeUs,
+        _In_ ULONGLONG             currentTimeUs,
+        _In_ bool                  waitingForOutputReady,
+        _In_ ULONGLONG             lastAsioNotifyUs,
+        _In_ LONG                  clientProcessingTimeUs
+    );
+
+    //
+    // Returns the interval the timer is armed with, kept between the
+    // minimum interval of the thread and one (micro)frame.
+    //
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    static LONG ClampWakeUpIntervalUs(
+        _In_ LONG intervalUs,
+        _In_ LONG minIntervalUs,
+        _In_ LONG busIntervalUs
+    );
+};
+
+#endif
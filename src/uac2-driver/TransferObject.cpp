@@ -162,6 +162,20 @@ TransferObject::Reset()
     return STATUS_SUCCESS;
 }
 
+_Use_decl_annotations_
+PAGED_CODE_SEG
+void TransferObject::SetStreamObject(
+    StreamObject * streamObject
+)
+{
+    PAGED_CODE();
+
+    // The transfer object is handed over only between streams, so no request refers to the previous stream object.
+    ASSERT(!m_isRequested && (m_request == nullptr));
+
+    m_streamObject = streamObject;
+}
+
 _Use_decl_annotations_
 NONPAGED_CODE_SEG
 NTSTATUS
@@ -984,6 +998,8 @@ NTSTATUS
 TransferObject::UpdateTransferredBytesInThisIrp(ULONG & transferredBytesInThisIrp, ULONG * invalidPacket)
 {
     NTSTATUS status = STATUS_SUCCESS;
+    ULONG    measuredBytes = 0;
+    ULONG    measuredPackets = 0;
     transferredBytesInThisIrp = 0;
 
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Entry");
@@ -1035,15 +1051,19 @@ TransferObject::UpdateTransferredBytesInThisIrp(ULONG & transferredBytesInThisIr
                     }
                     if (length != 0)
                     {
-                        // detecting sampling rate
-                        bool updated = m_streamObject->CalculateSampleRate(TRUE, m_deviceContext->InputProperty.BytesPerBlock, m_deviceContext->InputProperty.PacketsPerSec, length, m_deviceContext->InputProperty.MeasuredSampleRate);
-                        if (updated)
-                        {
-                            TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - InputMeasuredSampleRate = %d", m_deviceContext->InputProperty.MeasuredSampleRate);
-                        }
+                        ++measuredPackets;
                     }
                 }
             }
+            if (measuredPackets != 0)
+            {
+                // detecting sampling rate, once per URB
+                bool updated = m_streamObject->CalculateSampleRate(TRUE, m_deviceContext->InputProperty.BytesPerBlock, transferredBytesInThisIrp, measuredPackets, m_deviceContext->InputProperty.MeasuredSampleRate);
+                if (updated)
+                {
+                    TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - InputMeasuredSampleRate = %d", m_deviceContext->InputProperty.MeasuredSampleRate);
+                }
+            }
         }
         break;
         case IsoDirection::Out: {
@@ -1066,14 +1086,17 @@ TransferObject::UpdateTransferredBytesInThisIrp(ULONG & transferredBytesInThisIr
                     // Length is ignored by the USB driver stack for isochronous OUT transfers.
                     // https://learn.microsoft.com/en-us/windows-hardware/drivers/usbcon/transfer-data-to-isochronous-endpoints
                     // For this reason, it is not possible to detect when a sample ends in the middle of a packet.
-
-                    // detecting sampling rate
-                    ULONG length = m_urb->UrbIsochronousTransfer.IsoPacket[i].Length;
-                    bool  updated = m_streamObject->CalculateSampleRate(FALSE, m_deviceContext->OutputProperty.BytesPerBlock, m_deviceContext->OutputProperty.PacketsPerSec, length, m_deviceContext->OutputProperty.MeasuredSampleRate);
-                    if (updated)
-                    {
-                        TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - OutputMeasuredSampleRate = %d", m_deviceContext->OutputProperty.MeasuredSampleRate);
-                    }
+                    measuredBytes += m_urb->UrbIsochronousTransfer.IsoPacket[i].Length;
+                    ++measuredPackets;
+                }
+            }
+            if (measuredPackets != 0)
+            {
+                // detecting sampling rate, once per URB
+                bool updated = m_streamObject->CalculateSampleRate(FALSE, m_deviceContext->OutputProperty.BytesPerBlock, measuredBytes, measuredPackets, m_deviceContext->OutputProperty.MeasuredSampleRate);
+                if (updated)
+                {
+                    TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - OutputMeasuredSampleRate = %d", m_deviceContext->OutputProperty.MeasuredSampleRate);
                 }
             }
             // For isochronous out, IsoPacket[].Length field is not updated by the USB stack.
@@ -1167,7 +1190,15 @@ ULONG TransferObject::GetFeedbackSum(ULONG & validFeedback)
             }
             if (m_streamObject->IsFeedbackStable())
             {
-                feedbackSum += feedbackValue;
+                // An outlier is still counted, since the filter stands in for it with the smoothed rate.
+                if (m_streamObject->AddFeedbackValue(feedbackValue))
+                {
+                    feedbackSum += feedbackValue;
+                }
+                else
+                {
+                    TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, "feedback frame %u, value %08x rejected as an outlier.", m_urb->UrbIsochronousTransfer.StartFrame, feedbackValue);
+                }
                 ++validFeedback;
             }
         }
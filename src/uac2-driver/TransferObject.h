@@ -61,6 +61,12 @@ class TransferObject
     NTSTATUS
     Reset();
 
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    void SetStreamObject(
+        _In_ StreamObject * streamObject
+    );
+
     __drv_maxIRQL(DISPATCH_LEVEL)
     NONPAGED_CODE_SEG
     NTSTATUS
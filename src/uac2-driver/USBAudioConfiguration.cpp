@@ -2500,14 +2500,16 @@ NTSTATUS USBAudio2ControlInterface::GetCurrentSupportedSampleFrequency(
 
     RETURN_NTSTATUS_IF_FAILED(QuerySampleFrequencyControls(clockSourceID, clockFrequencyControl));
 
-    if ((clockFrequencyControl & NS_USBAudio0200::CLOCK_FREQUENCY_CONTROL_MASK) == NS_USBAudio0200::CLOCK_FREQUENCY_CONTROL_READ)
+    bool isReadOnly = ((clockFrequencyControl & NS_USBAudio0200::CLOCK_FREQUENCY_CONTROL_MASK) == NS_USBAudio0200::CLOCK_FREQUENCY_CONTROL_READ);
+    if (isReadOnly)
     {
         RETURN_NTSTATUS_IF_FAILED(GetCurrentSampleFrequency(deviceContext, sampleRate));
 
         TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DESCRIPTOR, " - interface %u, clock id 0x%02x, sample frequency control is read only. sample frequency %u", GetInterfaceNumber(), clockSourceID, sampleRate);
     }
 
-    status = ControlRequestGetSampleFrequencyRange(deviceContext, GetInterfaceNumber(), clockSourceID, memory, parameterBlock);
+    // The range of a read-only clock may follow the external clock it is locked to, so it is not cached.
+    status = ControlRequestGetSampleFrequencyRange(deviceContext, GetInterfaceNumber(), clockSourceID, memory, parameterBlock, !isReadOnly);
     if (NT_SUCCESS(status))
     {
         ASSERT(memory != nullptr);
@@ -7302,6 +7304,10 @@ Return Value:
         {
             sampleRate = desiredSampleRate;
         }
+        if (m_deviceContext->IsSampleRateSwitching)
+        {
+            m_deviceContext->SampleRateSwitch.ClockSetQpc = KeQueryPerformanceCounter(nullptr).QuadPart;
+        }
 #if false
 		// verify
 		ULONG updatedSampleRate = 0;
@@ -7316,20 +7322,12 @@ Return Value:
     // Determines the output interface and alternate settings.
     RETURN_NTSTATUS_IF_FAILED(SelectAlternateInterface(m_deviceContext, false, desiredFormatType, desiredFormat, outputDesiredBytesPerSample, outputDesiredValidBitsPerSample));
 
-    if (m_deviceContext->IsDeviceHighSpeed || m_deviceContext->IsDeviceSuperSpeed)
-    {
-        // USB 2.0 or USB 3.0
-        m_deviceContext->ClassicFramesPerIrp = m_deviceContext->Params.ClassicFramesPerIrp2;
-    }
-    else
-    {
-        // USB 1.1
-        m_deviceContext->ClassicFramesPerIrp = m_deviceContext->Params.ClassicFramesPerIrp;
-    }
-    if (m_deviceContext->ClassicFramesPerIrp == 0)
+    if (m_deviceContext->IsSampleRateSwitching)
     {
-        m_deviceContext->ClassicFramesPerIrp = 1;
+        m_deviceContext->SampleRateSwitch.AlternateSettingQpc = KeQueryPerformanceCounter(nullptr).QuadPart;
     }
+
+    SelectClassicFramesPerIrp();
     m_deviceContext->AudioProperty.SampleRate = sampleRate;
 
     m_deviceContext->InputProperty.SamplesPerPacket = 1;
@@ -7351,6 +7349,28 @@ Return Value:
     return status;
 }
 
+_Use_decl_annotations_
+PAGED_CODE_SEG
+void USBAudioConfiguration::SelectClassicFramesPerIrp()
+{
+    PAGED_CODE();
+
+    if (m_deviceContext->IsDeviceHighSpeed || m_deviceContext->IsDeviceSuperSpeed)
+    {
+        // USB 2.0 or USB 3.0
+        m_deviceContext->ClassicFramesPerIrp = m_deviceContext->Params.ClassicFramesPerIrp2;
+    }
+    else
+    {
+        // USB 1.1
+        m_deviceContext->ClassicFramesPerIrp = m_deviceContext->Params.ClassicFramesPerIrp;
+    }
+    if (m_deviceContext->ClassicFramesPerIrp == 0)
+    {
+        m_deviceContext->ClassicFramesPerIrp = 1;
+    }
+}
+
 _Use_decl_annotations_
 PAGED_CODE_SEG
 NTSTATUS
@@ -2168,6 +2168,10 @@ class USBAudioConfiguration
         _In_ bool  forceSetSampleRate
     );
 
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    void SelectClassicFramesPerIrp();
+
     __drv_maxIRQL(PASSIVE_LEVEL)
     PAGED_CODE_SEG
     NTSTATUS
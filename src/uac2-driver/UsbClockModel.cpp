@@ -0,0 +1,220 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+// ASIO is a trademark and software of Steinberg Media Technologies GmbH
+
+/*++
+
+Module Name:
+
+    UsbClockModel.cpp
+
+Abstract:
+
+    Implement a class that tracks the USB frame clock against the performance
+    counter and predicts the current packet position.
+
+Environment:
+
+    Kernel-mode Driver Framework
+
+--*/
+
+#ifdef UAC_HOST_BUILD
+#include "HostCompat.h"
+#else
+#include "Driver.h"
+#endif
+#include "UsbClockModel.h"
+
+#if !defined(__INTELLISENSE__) && !defined(UAC_HOST_BUILD)
+#include "UsbClockModel.tmh"
+#endif
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+void UsbClockModel::Reset(
+    ULONG packetsPerMs,
+    ULONG maxPhaseErrorPackets
+)
+{
+    PAGED_CODE();
+
+    m_packetsPerMs = packetsPerMs;
+    m_maxPhaseError = (LONGLONG)maxPhaseErrorPackets << USB_CLOCK_POSITION_BITS;
+    m_nominalRate = ((LONGLONG)packetsPerMs << USB_CLOCK_RATE_BITS) / 1000;
+    m_rate = m_nominalRate;
+    m_position = 0LL;
+    m_referenceTimeUs = 0ULL;
+    m_completedPacket = 0LL;
+    m_lateCompletions = 0;
+    m_averagePhaseError = 0LL;
+    m_relockCount = 0;
+    m_isLocked = false;
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+void UsbClockModel::Update(
+    ULONGLONG completedTimeUs,
+    LONGLONG  completedPacket
+)
+{
+    PAGED_CODE();
+
+    LONGLONG observedPosition = completedPacket * (1LL << USB_CLOCK_POSITION_BITS);
+
+    if (!m_isLocked || (m_packetsPerMs == 0))
+    {
+        m_position = observedPosition;
+        m_referenceTimeUs = completedTimeUs;
+        m_completedPacket = completedPacket;
+        m_isLocked = true;
+        return;
+    }
+
+    LONGLONG elapsedUs = (LONGLONG)(completedTimeUs - m_referenceTimeUs);
+    if (elapsedUs <= 0)
+    {
+        // Two completions observed at the same time carry no phase information.
+        return;
+    }
+
+    LONGLONG predictedPosition = PredictPosition(completedTimeUs);
+    LONGLONG phaseError = observedPosition - predictedPosition;
+
+    if (phaseError < -m_maxPhaseError)
+    {
+        // Completions are never early, so a large lag is the latency of this completion rather than the bus.
+        // Skip it, unless the lag persists and the bus really has stopped advancing.
+        m_lateCompletions++;
+        if (m_lateCompletions < USB_CLOCK_MAX_LATE_COMPLETIONS)
+        {
+            return;
+        }
+    }
+
+    // The rate correction is scaled by the nominal interval between the completions rather than the measured one,
+    // so that the completion latency does not also modulate the loop gain.
+    LONGLONG nominalIntervalUs = (completedPacket - m_completedPacket) * 1000 / (LONGLONG)m_packetsPerMs;
+    if (nominalIntervalUs <= 0)
+    {
+        nominalIntervalUs = 1;
+    }
+
+    m_referenceTimeUs = completedTimeUs;
+    m_completedPacket = completedPacket;
+
+    if ((phaseError > m_maxPhaseError) || (phaseError < -m_maxPhaseError))
+    {
+        // The pipe was restarted or stopped. Follow the completion and keep the rate.
+        m_position = observedPosition;
+        m_lateCompletions = 0;
+        m_relockCount++;
+        return;
+    }
+    m_lateCompletions = 0;
+
+    m_position = predictedPosition + phaseError / (1LL << USB_CLOCK_PHASE_SHIFT);
+    m_rate += (phaseError * (1LL << (USB_CLOCK_RATE_BITS - USB_CLOCK_POSITION_BITS))) / (nominalIntervalUs << USB_CLOCK_RATE_SHIFT);
+
+    LONGLONG maxDrift = m_nominalRate * USB_CLOCK_MAX_DRIFT_PPM / 1000000;
+    if (m_rate > m_nominalRate + maxDrift)
+    {
+        m_rate = m_nominalRate + maxDrift;
+    }
+    else if (m_rate < m_nominalRate - maxDrift)
+    {
+        m_rate = m_nominalRate - maxDrift;
+    }
+
+    LONGLONG absolutePhaseError = (phaseError < 0) ? -phaseError : phaseError;
+    m_averagePhaseError += (absolutePhaseError - m_averagePhaseError) / (1LL << USB_CLOCK_JITTER_SHIFT);
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+bool UsbClockModel::IsLocked() const
+{
+    PAGED_CODE();
+
+    return m_isLocked;
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+LONGLONG UsbClockModel::PredictPosition(
+    ULONGLONG currentTimeUs
+) const
+{
+    PAGED_CODE();
+
+    LONGLONG elapsedUs = (LONGLONG)(currentTimeUs - m_referenceTimeUs);
+
+    return m_position + (elapsedUs * m_rate) / (1LL << (USB_CLOCK_RATE_BITS - USB_CLOCK_POSITION_BITS));
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+ULONG UsbClockModel::GetTimeToNextFrameUs(
+    ULONGLONG currentTimeUs
+) const
+{
+    PAGED_CODE();
+
+    if (!m_isLocked || (m_packetsPerMs == 0) || (m_rate <= 0))
+    {
+        return 1000;
+    }
+
+    LONGLONG framePositions = (LONGLONG)m_packetsPerMs << USB_CLOCK_POSITION_BITS;
+    LONGLONG position = PredictPosition(currentTimeUs);
+    LONGLONG sinceFrame = position % framePositions;
+    if (sinceFrame < 0)
+    {
+        sinceFrame += framePositions;
+    }
+    LONGLONG untilFrame = framePositions - sinceFrame;
+
+    return (ULONG)((untilFrame * (1LL << (USB_CLOCK_RATE_BITS - USB_CLOCK_POSITION_BITS)) + m_rate - 1) / m_rate);
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+LONG UsbClockModel::GetDriftPpm() const
+{
+    PAGED_CODE();
+
+    if (m_nominalRate == 0)
+    {
+        return 0;
+    }
+
+    return (LONG)((m_rate - m_nominalRate) * 1000000 / m_nominalRate);
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+ULONG UsbClockModel::GetJitterUs() const
+{
+    PAGED_CODE();
+
+    if (m_rate <= 0)
+    {
+        return 0;
+    }
+
+    return (ULONG)(m_averagePhaseError * (1LL << (USB_CLOCK_RATE_BITS - USB_CLOCK_POSITION_BITS)) / m_rate);
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+ULONG UsbClockModel::GetRelockCount() const
+{
+    PAGED_CODE();
+
+    return m_relockCount;
+}
@@ -0,0 +1,124 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+// ASIO is a trademark and software of Steinberg Media Technologies GmbH
+
+/*++
+
+Module Name:
+
+    UsbClockModel.h
+
+Abstract:
+
+    Define a class that tracks the USB frame clock against the performance
+    counter with a second-order phase-locked loop fed by URB completion
+    times, and predicts the current packet position between completions.
+
+Environment:
+
+    Kernel-mode Driver Framework
+
+--*/
+
+#ifndef _USB_CLOCK_MODEL_H_
+#define _USB_CLOCK_MODEL_H_
+
+#define USB_CLOCK_POSITION_BITS        16   // Fractional bits of a packet position
+#define USB_CLOCK_RATE_BITS            32   // Fractional bits of a rate in packets per microsecond
+#define USB_CLOCK_PHASE_SHIFT          6    // Phase gain 1/64, narrow enough to average out the completion latency
+#define USB_CLOCK_RATE_SHIFT           13   // Rate gain 1/8192, a damping factor of about 0.7 with the phase gain
+#define USB_CLOCK_JITTER_SHIFT         4    // Averages the absolute phase error over about 16 completions
+#define USB_CLOCK_MAX_DRIFT_PPM        1000
+#define USB_CLOCK_MAX_LATE_COMPLETIONS 4    // Consecutive late completions after which the position is relocked
+
+//
+// The model keeps the packet position at the last completion and the rate
+// at which the position advances, both in fixed point so that it runs on
+// the integer unit only. It does not depend on the framework, so it is also
+// built on the host and driven with synthetic completion times by
+// test/UsbClockModelTest.cpp.
+//
+class UsbClockModel
+{
+  public:
+    //
+    // Forgets the locked position and rate. packetsPerMs is the nominal
+    // rate of the bus and maxPhaseErrorPackets is the largest error that
+    // is treated as jitter rather than as a discontinuity.
+    //
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    void Reset(
+        _In_ ULONG packetsPerMs,
+        _In_ ULONG maxPhaseErrorPackets
+    );
+
+    //
+    // Feeds the time at which the completed packet count reached
+    // completedPacket. The first completion after Reset locks the model.
+    // A completion that is ahead of the prediction by more than the maximum
+    // phase error relocks the position while keeping the rate; one that is
+    // that far behind is skipped as latency unless it keeps happening.
+    //
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    void Update(
+        _In_ ULONGLONG completedTimeUs,
+        _In_ LONGLONG  completedPacket
+    );
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    bool IsLocked() const;
+
+    //
+    // Returns the predicted packet position at currentTimeUs with
+    // USB_CLOCK_POSITION_BITS fractional bits.
+    //
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    LONGLONG PredictPosition(
+        _In_ ULONGLONG currentTimeUs
+    ) const;
+
+    //
+    // Returns the time from currentTimeUs until the predicted position
+    // reaches the next 1 ms USB frame boundary.
+    //
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    ULONG GetTimeToNextFrameUs(
+        _In_ ULONGLONG currentTimeUs
+    ) const;
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    LONG GetDriftPpm() const;
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    ULONG GetJitterUs() const;
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    ULONG GetRelockCount() const;
+
+  private:
+    ULONG     m_packetsPerMs{0};
+    LONGLONG  m_maxPhaseError{0LL};   // USB_CLOCK_POSITION_BITS fixed point
+    LONGLONG  m_nominalRate{0LL};     // USB_CLOCK_RATE_BITS fixed point
+    LONGLONG  m_rate{0LL};            // USB_CLOCK_RATE_BITS fixed point
+    LONGLONG  m_position{0LL};        // USB_CLOCK_POSITION_BITS fixed point, at m_referenceTimeUs
+    ULONGLONG m_referenceTimeUs{0ULL};
+    LONGLONG  m_completedPacket{0LL}; // Completed packet count at m_referenceTimeUs
+    LONGLONG  m_averagePhaseError{0LL}; // USB_CLOCK_POSITION_BITS fixed point
+    ULONG     m_lateCompletions{0};
+    ULONG     m_relockCount{0};
+    bool      m_isLocked{false};
+};
+
+#endif
@@ -0,0 +1,306 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+// ASIO is a trademark and software of Steinberg Media Technologies GmbH
+
+/*++
+
+Module Name:
+
+    DescriptorCacheTest.cpp
+
+Abstract:
+
+    Fill a DescriptorCache with parameter blocks, save it and load it into
+    a fresh cache, and check that the blocks come back unchanged, that a
+    blob saved for another device, firmware or configuration descriptor is
+    refused, and that truncated, corrupted or malformed blobs are refused
+    without touching the cache.
+
+Environment:
+
+    User mode (host build only)
+
+--*/
+
+#include "HostCompat.h"
+#include "DescriptorCache.h"
+#include "TestCommon.h"
+
+#define TEST_VENDOR_ID      0x0499
+#define TEST_PRODUCT_ID     0x1509
+#define TEST_DEVICE_RELEASE 0x0100
+#define TEST_RANGES         64
+
+static std::vector<UCHAR> MakeDescriptor(ULONG seed)
+{
+    std::vector<UCHAR> descriptor(512);
+    FillRandom(descriptor, seed);
+    return descriptor;
+}
+
+//
+// A parameter block of wNumSubRanges followed by the subranges, as returned
+// for a 4-byte CUR/MIN/MAX/RES layout, with a length that depends on index.
+//
+static std::vector<UCHAR> MakeBlock(ULONG index)
+{
+    USHORT             subRanges = (USHORT)(1 + (index % 5));
+    std::vector<UCHAR> block(sizeof(USHORT) + subRanges * 12);
+    FillRandom(block, 1000 + index);
+    RtlCopyMemory(block.data(), &subRanges, sizeof(subRanges));
+    return block;
+}
+
+static void Initialize(
+    DescriptorCache &          cache,
+    const std::vector<UCHAR> & descriptor
+)
+{
+    cache.Initialize(TEST_VENDOR_ID, TEST_PRODUCT_ID, TEST_DEVICE_RELEASE, descriptor.data(), (ULONG)descriptor.size());
+}
+
+static void Fill(DescriptorCache & cache)
+{
+    for (ULONG index = 0; index < TEST_RANGES; index++)
+    {
+        std::vector<UCHAR> block = MakeBlock(index);
+        TEST_CHECK(cache.AddRange((UCHAR)(index / 32), (UCHAR)(index % 32), 2, (UCHAR)(index % 3), block.data(), (USHORT)block.size()));
+    }
+}
+
+static void CheckFilled(const DescriptorCache & cache)
+{
+    TEST_CHECK(cache.GetNumOfEntries() == TEST_RANGES);
+    for (ULONG index = 0; index < TEST_RANGES; index++)
+    {
+        std::vector<UCHAR> block = MakeBlock(index);
+        const UCHAR *      parameterBlock = nullptr;
+        USHORT             length = 0;
+        bool               found = cache.FindRange((UCHAR)(index / 32), (UCHAR)(index % 32), 2, (UCHAR)(index % 3), parameterBlock, length);
+        TEST_CHECK_MESSAGE(found && (length == block.size()) && (memcmp(parameterBlock, block.data(), length) == 0), "range %u", index);
+    }
+}
+
+static std::vector<UCHAR> Save(DescriptorCache & cache)
+{
+    ULONG         length = 0;
+    const UCHAR * data = cache.GetData(length);
+    TEST_CHECK((data != nullptr) && (length >= sizeof(DESCRIPTOR_CACHE_HEADER)));
+    return std::vector<UCHAR>(data, data + length);
+}
+
+//
+// Loads blob into a cache keyed for descriptor, and checks that a refused
+// blob leaves the cache empty.
+//
+static bool TryLoad(
+    const std::vector<UCHAR> & descriptor,
+    const std::vector<UCHAR> & blob,
+    USHORT                     deviceRelease = TEST_DEVICE_RELEASE
+)
+{
+    DescriptorCache cache;
+    cache.Initialize(TEST_VENDOR_ID, TEST_PRODUCT_ID, deviceRelease, descriptor.data(), (ULONG)descriptor.size());
+    bool loaded = cache.Load(blob.data(), (ULONG)blob.size());
+    if (!loaded)
+    {
+        TEST_CHECK(cache.GetNumOfEntries() == 0);
+        TEST_CHECK(!cache.IsModified());
+    }
+    return loaded;
+}
+
+//
+// Recomputes the checksum so that only the layout checks of Load can refuse
+// the blob.
+//
+static void Reseal(std::vector<UCHAR> & blob)
+{
+    DESCRIPTOR_CACHE_HEADER header{};
+    RtlCopyMemory(&header, blob.data(), sizeof(header));
+    header.Size = (ULONG)blob.size();
+    header.Checksum = DescriptorCache::Hash(blob.data() + sizeof(header), (ULONG)(blob.size() - sizeof(header)));
+    RtlCopyMemory(blob.data(), &header, sizeof(header));
+}
+
+static void TestHash()
+{
+    // FNV-1a test vectors.
+    TEST_CHECK(DescriptorCache::Hash(nullptr, 0) == 0x811c9dc5);
+    TEST_CHECK(DescriptorCache::Hash((const UCHAR *)"a", 1) == 0xe40c292c);
+    TEST_CHECK(DescriptorCache::Hash((const UCHAR *)"foobar", 6) == 0xbf9cf968);
+}
+
+static void TestRoundTrip()
+{
+    std::vector<UCHAR> descriptor = MakeDescriptor(1);
+    DescriptorCache    cache;
+
+    Initialize(cache, descriptor);
+    TEST_CHECK((cache.GetNumOfEntries() == 0) && !cache.IsModified());
+
+    Fill(cache);
+    TEST_CHECK(cache.IsModified());
+    CheckFilled(cache);
+
+    std::vector<UCHAR> blob = Save(cache);
+    TEST_CHECK(!cache.IsModified());
+
+    DescriptorCache loaded;
+    Initialize(loaded, descriptor);
+    TEST_CHECK(loaded.Load(blob.data(), (ULONG)blob.size()));
+    TEST_CHECK(!loaded.IsModified());
+    CheckFilled(loaded);
+
+    // A loaded cache saves the same blob.
+    TEST_CHECK(Save(loaded) == blob);
+
+    // An empty cache is saved and loaded as well.
+    DescriptorCache empty;
+    Initialize(empty, descriptor);
+    TEST_CHECK(TryLoad(descriptor, Save(empty)));
+}
+
+static void TestAddRange()
+{
+    std::vector<UCHAR> descriptor = MakeDescriptor(2);
+    std::vector<UCHAR> block = MakeBlock(0);
+    DescriptorCache    cache;
+
+    // Nothing is added before the key is set.
+    TEST_CHECK(!cache.AddRange(0, 1, 2, 0, block.data(), (USHORT)block.size()));
+
+    Initialize(cache, descriptor);
+    TEST_CHECK(cache.AddRange(0, 1, 2, 0, block.data(), (USHORT)block.size()));
+    TEST_CHECK(!cache.AddRange(0, 1, 2, 0, block.data(), (USHORT)block.size()));
+    TEST_CHECK(!cache.AddRange(0, 1, 2, 1, nullptr, (USHORT)block.size()));
+    TEST_CHECK(!cache.AddRange(0, 1, 2, 1, block.data(), 0));
+    TEST_CHECK(cache.GetNumOfEntries() == 1);
+
+    const UCHAR * parameterBlock = nullptr;
+    USHORT        length = 0;
+    TEST_CHECK(!cache.FindRange(0, 1, 2, 1, parameterBlock, length) && (parameterBlock == nullptr) && (length == 0));
+
+    // Ranges are added until the blob is full, and a range that does not fit is refused.
+    std::vector<UCHAR> large(1000);
+    FillRandom(large, 3);
+    ULONG added = 0;
+    while (cache.AddRange(1, (UCHAR)added, 2, 0, large.data(), (USHORT)large.size()))
+    {
+        added++;
+    }
+    ULONG expected = (DESCRIPTOR_CACHE_MAX_SIZE - sizeof(DESCRIPTOR_CACHE_HEADER) - sizeof(DESCRIPTOR_CACHE_ENTRY) - (ULONG)block.size()) / (sizeof(DESCRIPTOR_CACHE_ENTRY) + (ULONG)large.size());
+    TEST_CHECK_MESSAGE(added == expected, "%u ranges added, %u expected", added, expected);
+
+    std::vector<UCHAR> blob = Save(cache);
+    TEST_CHECK(blob.size() <= DESCRIPTOR_CACHE_MAX_SIZE);
+    TEST_CHECK(TryLoad(descriptor, blob));
+
+    // Initialize forgets the entries.
+    Initialize(cache, descriptor);
+    TEST_CHECK((cache.GetNumOfEntries() == 0) && !cache.IsModified());
+}
+
+static void TestKey()
+{
+    std::vector<UCHAR> descriptor = MakeDescriptor(4);
+    DescriptorCache    cache;
+
+    Initialize(cache, descriptor);
+    Fill(cache);
+    std::vector<UCHAR> blob = Save(cache);
+
+    TEST_CHECK(TryLoad(descriptor, blob));
+    TEST_CHECK(!TryLoad(descriptor, blob, TEST_DEVICE_RELEASE + 1));
+
+    // One byte of the configuration descriptor differs.
+    std::vector<UCHAR> changed = descriptor;
+    changed[100] ^= 0x01;
+    TEST_CHECK(!TryLoad(changed, blob));
+
+    // The descriptor is longer.
+    changed = descriptor;
+    changed.push_back(0);
+    TEST_CHECK(!TryLoad(changed, blob));
+
+    DescriptorCache other;
+    other.Initialize(TEST_VENDOR_ID, TEST_PRODUCT_ID + 1, TEST_DEVICE_RELEASE, descriptor.data(), (ULONG)descriptor.size());
+    TEST_CHECK(!other.Load(blob.data(), (ULONG)blob.size()) && (other.GetNumOfEntries() == 0));
+    other.Initialize(TEST_VENDOR_ID + 1, TEST_PRODUCT_ID, TEST_DEVICE_RELEASE, descriptor.data(), (ULONG)descriptor.size());
+    TEST_CHECK(!other.Load(blob.data(), (ULONG)blob.size()) && (other.GetNumOfEntries() == 0));
+}
+
+static void TestCorruption()
+{
+    std::vector<UCHAR> descriptor = MakeDescriptor(5);
+    DescriptorCache    cache;
+
+    Initialize(cache, descriptor);
+    Fill(cache);
+    std::vector<UCHAR> blob = Save(cache);
+
+    TEST_CHECK(!cache.Load(nullptr, (ULONG)blob.size()));
+    TEST_CHECK(!TryLoad(descriptor, std::vector<UCHAR>(blob.begin(), blob.begin() + sizeof(DESCRIPTOR_CACHE_HEADER) - 1)));
+
+    // Every truncation is refused.
+    for (size_t length = sizeof(DESCRIPTOR_CACHE_HEADER); length < blob.size(); length += 7)
+    {
+        TEST_CHECK_MESSAGE(!TryLoad(descriptor, std::vector<UCHAR>(blob.begin(), blob.begin() + length)), "%zu bytes", length);
+    }
+
+    // Every flipped bit in the entries is caught by the checksum.
+    for (size_t offset = sizeof(DESCRIPTOR_CACHE_HEADER); offset < blob.size(); offset += 3)
+    {
+        std::vector<UCHAR> corrupted = blob;
+        corrupted[offset] ^= (UCHAR)(1 << (offset % 8));
+        TEST_CHECK_MESSAGE(!TryLoad(descriptor, corrupted), "offset %zu", offset);
+    }
+
+    // Entries that overrun the blob or are empty are refused even with a valid checksum.
+    DESCRIPTOR_CACHE_ENTRY entry{};
+    std::vector<UCHAR>     malformed = blob;
+    RtlCopyMemory(&entry, malformed.data() + sizeof(DESCRIPTOR_CACHE_HEADER), sizeof(entry));
+    entry.Length = (USHORT)(blob.size());
+    RtlCopyMemory(malformed.data() + sizeof(DESCRIPTOR_CACHE_HEADER), &entry, sizeof(entry));
+    Reseal(malformed);
+    TEST_CHECK(!TryLoad(descriptor, malformed));
+
+    malformed = blob;
+    entry.Length = 0;
+    RtlCopyMemory(malformed.data() + sizeof(DESCRIPTOR_CACHE_HEADER), &entry, sizeof(entry));
+    Reseal(malformed);
+    TEST_CHECK(!TryLoad(descriptor, malformed));
+
+    // Trailing bytes after the last entry.
+    malformed = blob;
+    malformed.push_back(0);
+    Reseal(malformed);
+    TEST_CHECK(!TryLoad(descriptor, malformed));
+
+    // More entries than the blob holds.
+    DESCRIPTOR_CACHE_HEADER header{};
+    malformed = blob;
+    RtlCopyMemory(&header, malformed.data(), sizeof(header));
+    header.NumOfEntries++;
+    RtlCopyMemory(malformed.data(), &header, sizeof(header));
+    TEST_CHECK(!TryLoad(descriptor, malformed));
+
+    // A refused blob leaves the entries of the cache as they were.
+    TEST_CHECK(!cache.Load(malformed.data(), (ULONG)malformed.size()));
+    CheckFilled(cache);
+}
+
+int main()
+{
+    TestHash();
+    TestRoundTrip();
+    TestAddRange();
+    TestKey();
+    TestCorruption();
+
+    return TestResult("DescriptorCacheTest");
+}
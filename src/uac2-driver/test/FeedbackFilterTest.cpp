@@ -0,0 +1,261 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+// ASIO is a trademark and software of Steinberg Media Technologies GmbH
+
+/*++
+
+Module Name:
+
+    FeedbackFilterTest.cpp
+
+Abstract:
+
+    Drive FeedbackFilter with synthetic feedback sequences: a device clock
+    with phase noise and stray values, a device far from the nominal rate,
+    a clock that moves, and values that never agree. Check that the samples
+    handed out follow the device clock and that the filter locks only on
+    values that agree with each other.
+
+Environment:
+
+    User mode (host build only)
+
+--*/
+
+#include "HostCompat.h"
+#include "FeedbackFilter.h"
+#include "TestCommon.h"
+
+#define TEST_URBS              200000
+#define TEST_VALUES_PER_URB    8
+#define TEST_MAX_DRIFT_SAMPLES 3.0
+
+//
+// A device clock of `rate` samples per (micro)frame that reports its rate
+// in a feedback format with fractionBits. Each value is the difference of
+// two quantized phase measurements, which carry up to phaseNoise samples
+// of jitter, so the noise does not accumulate in the sum of the values.
+//
+struct SyntheticFeedback
+{
+    double       Rate;
+    double       Scale;
+    double       PhaseNoise;
+    double       Position{0.0};
+    LONGLONG     ReportedPosition{0};
+    std::mt19937 Random;
+
+    SyntheticFeedback(
+        double rate,
+        ULONG  fractionBits,
+        double phaseNoise,
+        ULONG  seed
+    )
+        : Rate(rate), Scale((double)(1UL << fractionBits)), PhaseNoise(phaseNoise), Random(seed)
+    {
+    }
+
+    ULONG Next()
+    {
+        Position += Rate;
+        double   noise = std::uniform_real_distribution<double>(-PhaseNoise, PhaseNoise)(Random);
+        LONGLONG reported = std::llround((Position + noise) * Scale);
+        ULONG    value = (ULONG)(reported - ReportedPosition);
+        ReportedPosition = reported;
+        return value;
+    }
+};
+
+static ULONG GetNominalValue(
+    ULONG sampleRate,
+    ULONG fractionBits,
+    ULONG framesPerSecond
+)
+{
+    return (ULONG)(((ULONGLONG)sampleRate << fractionBits) / framesPerSecond);
+}
+
+//
+// 44.1 kHz at high speed with a zero and a doubled value. The samples
+// handed out must stay within TEST_MAX_DRIFT_SAMPLES of the device clock,
+// and each URB may only differ from the rate by the quantization.
+//
+static void TestPhaseNoise()
+{
+    FeedbackFilter    filter;
+    SyntheticFeedback feedback(44100.0 / 8000.0, 16, 1.0 / 16.0, 1);
+    ULONGLONG         handedOut = 0;
+    double            maxDrift = 0.0;
+    ULONG             minSamples = 0xffffffffUL;
+    ULONG             maxSamples = 0;
+
+    filter.Reset(16, 0, GetNominalValue(44100, 16, 8000));
+
+    for (ULONG urb = 0; urb < TEST_URBS; ++urb)
+    {
+        for (ULONG value = 0; value < TEST_VALUES_PER_URB; ++value)
+        {
+            ULONG feedbackValue = feedback.Next();
+            if ((urb == 1000) && (value == 0))
+            {
+                feedbackValue = 0;
+            }
+            else if ((urb == 2000) && (value == 0))
+            {
+                feedbackValue *= 2;
+            }
+            filter.Add(feedbackValue);
+        }
+        ULONG samples = filter.GetSamples(TEST_VALUES_PER_URB);
+        handedOut += samples;
+        if (urb >= 100)
+        {
+            minSamples = min(minSamples, samples);
+            maxSamples = max(maxSamples, samples);
+            maxDrift = max(maxDrift, std::fabs((double)handedOut - feedback.Position));
+        }
+    }
+
+    TEST_CHECK(filter.IsLocked());
+    TEST_CHECK(filter.GetOutlierCount() == 2);
+    TEST_CHECK(filter.GetRelockCount() == 0);
+    TEST_CHECK_MESSAGE(maxDrift <= TEST_MAX_DRIFT_SAMPLES, "drift %.2f samples", maxDrift);
+    TEST_CHECK_MESSAGE((minSamples == 44) && (maxSamples == 45), "URB sizes %u to %u", minSamples, maxSamples);
+
+    printf("phase noise: max drift %.2f samples over %u URBs, URB sizes %u to %u\n", maxDrift, TEST_URBS, minSamples, maxSamples);
+}
+
+//
+// A device whose feedback is 20% above the nominal rate from the start
+// locks after FEEDBACK_FILTER_MAX_OUTLIERS values and is paced at its own
+// rate rather than at the nominal rate, including the values that stood in
+// for the outliers before the lock.
+//
+static void TestOffNominalLock()
+{
+    FeedbackFilter    filter;
+    SyntheticFeedback feedback(6.0 * 1.2, 16, 0.0, 2);
+    ULONGLONG         handedOut = 0;
+
+    filter.Reset(16, 0, GetNominalValue(48000, 16, 8000));
+
+    for (ULONG value = 1; value < FEEDBACK_FILTER_MAX_OUTLIERS; ++value)
+    {
+        TEST_CHECK(!filter.Add(feedback.Next()));
+        TEST_CHECK(!filter.IsLocked());
+    }
+    TEST_CHECK(filter.Add(feedback.Next()));
+    TEST_CHECK(filter.IsLocked());
+    TEST_CHECK(filter.GetRelockCount() == 0);
+
+    for (ULONG urb = 0; urb < 1000; ++urb)
+    {
+        for (ULONG value = 0; value < TEST_VALUES_PER_URB; ++value)
+        {
+            filter.Add(feedback.Next());
+        }
+        handedOut += filter.GetSamples(TEST_VALUES_PER_URB);
+    }
+
+    TEST_CHECK_MESSAGE(filter.GetRateMilliSamples() == 7200, "rate %u", filter.GetRateMilliSamples());
+    TEST_CHECK_MESSAGE(std::fabs((double)handedOut - feedback.Position) <= TEST_MAX_DRIFT_SAMPLES, "%llu samples for %.1f", (unsigned long long)handedOut, feedback.Position);
+}
+
+//
+// A locked filter follows a clock that moves by more than the outlier
+// window once the new values agree, and counts a relock.
+//
+static void TestRelock()
+{
+    FeedbackFilter    filter;
+    SyntheticFeedback before(6.0, 16, 1.0 / 16.0, 3);
+    SyntheticFeedback after(5.5125, 16, 1.0 / 16.0, 4);
+
+    filter.Reset(16, 0, GetNominalValue(48000, 16, 8000));
+
+    for (ULONG value = 0; value < 1000; ++value)
+    {
+        filter.Add(before.Next());
+    }
+    TEST_CHECK(filter.IsLocked());
+    TEST_CHECK_MESSAGE((filter.GetRateMilliSamples() >= 5998) && (filter.GetRateMilliSamples() <= 6002), "rate %u", filter.GetRateMilliSamples());
+
+    for (ULONG value = 0; value < 1000; ++value)
+    {
+        filter.Add(after.Next());
+    }
+    TEST_CHECK(filter.GetRelockCount() == 1);
+    TEST_CHECK(filter.GetOutlierCount() == FEEDBACK_FILTER_MAX_OUTLIERS);
+    TEST_CHECK_MESSAGE((filter.GetRateMilliSamples() >= 5510) && (filter.GetRateMilliSamples() <= 5514), "rate %u", filter.GetRateMilliSamples());
+}
+
+//
+// Outliers that do not agree with each other, and zeros, never lock or
+// relock the filter.
+//
+static void TestInconsistentOutliers()
+{
+    FeedbackFilter filter;
+    const ULONG    nominal = GetNominalValue(48000, 16, 8000);
+
+    filter.Reset(16, 0, nominal);
+    for (ULONG urb = 0; urb < 100; ++urb)
+    {
+        for (ULONG value = 0; value < TEST_VALUES_PER_URB; ++value)
+        {
+            TEST_CHECK(!filter.Add(0));
+        }
+        TEST_CHECK(filter.GetSamples(TEST_VALUES_PER_URB) == 48);
+    }
+    TEST_CHECK(!filter.IsLocked());
+
+    for (ULONG value = 0; value < 100; ++value)
+    {
+        filter.Add(nominal);
+    }
+    TEST_CHECK(filter.IsLocked());
+    for (ULONG value = 0; value < 100; ++value)
+    {
+        TEST_CHECK(!filter.Add(((value % 2) == 0) ? nominal * 2 : nominal / 2));
+    }
+    TEST_CHECK(filter.GetRelockCount() == 0);
+    TEST_CHECK(filter.GetRateMilliSamples() == 6000);
+}
+
+//
+// At full speed the values are in 10.14 format, in samples per frame.
+//
+static void TestFullSpeed()
+{
+    FeedbackFilter    filter;
+    SyntheticFeedback feedback(44.1, 14, 1.0 / 16.0, 5);
+    ULONGLONG         handedOut = 0;
+
+    filter.Reset(14, 0, GetNominalValue(44100, 14, 1000));
+    for (ULONG urb = 0; urb < 10000; ++urb)
+    {
+        for (ULONG value = 0; value < TEST_VALUES_PER_URB; ++value)
+        {
+            filter.Add(feedback.Next());
+        }
+        handedOut += filter.GetSamples(TEST_VALUES_PER_URB);
+    }
+
+    TEST_CHECK(filter.IsLocked());
+    TEST_CHECK_MESSAGE(std::fabs((double)handedOut - feedback.Position) <= TEST_MAX_DRIFT_SAMPLES, "%llu samples for %.1f", (unsigned long long)handedOut, feedback.Position);
+}
+
+int main()
+{
+    TestPhaseNoise();
+    TestOffNominalLock();
+    TestRelock();
+    TestInconsistentOutliers();
+    TestFullSpeed();
+
+    return TestResult("FeedbackFilterTest");
+}
@@ -0,0 +1,328 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+// ASIO is a trademark and software of Steinberg Media Technologies GmbH
+
+/*++
+
+Module Name:
+
+    HostCompat.h
+
+Abstract:
+
+    Define the subset of the kernel types, annotations and routines that the
+    framework independent parts of the driver use, so that they can be built
+    and tested as ordinary user mode code. The driver sources include this
+    header instead of Driver.h when UAC_HOST_BUILD is defined.
+
+Environment:
+
+    User mode (host build only)
+
+--*/
+
+#ifndef _HOST_COMPAT_H_
+#define _HOST_COMPAT_H_
+
+//
+// The standard headers are included before min and max are defined as
+// macros, as they are in the kernel headers.
+//
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <queue>
+#include <random>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) && !defined(_M_X64)
+#define _M_X64 1
+#elif defined(__aarch64__) && !defined(_M_ARM64)
+#define _M_ARM64 1
+#endif
+
+//
+// Types
+//
+typedef unsigned char      UCHAR, *PUCHAR, BYTE, *PBYTE, BOOLEAN;
+typedef char               CHAR;
+typedef unsigned short     USHORT, *PUSHORT;
+typedef short              SHORT;
+typedef uint32_t           ULONG, *PULONG, DWORD;
+typedef int32_t            LONG, *PLONG, BOOL, NTSTATUS;
+typedef int64_t            LONGLONG, LONG64, *PLONGLONG;
+typedef uint64_t           ULONGLONG, ULONG64, *PULONGLONG;
+typedef uintptr_t          ULONG_PTR, SIZE_T;
+typedef wchar_t            WCHAR;
+typedef void               VOID, *PVOID;
+typedef void *             HANDLE;
+typedef ULONGLONG          POOL_FLAGS;
+typedef UCHAR              KIRQL;
+
+typedef struct _GUID
+{
+    ULONG  Data1;
+    USHORT Data2;
+    USHORT Data3;
+    UCHAR  Data4[8];
+} GUID;
+
+typedef struct _XSTATE_SAVE
+{
+    ULONG Reserved;
+} XSTATE_SAVE, *PXSTATE_SAVE;
+
+typedef struct _KFLOATING_SAVE
+{
+    ULONG Reserved;
+} KFLOATING_SAVE, *PKFLOATING_SAVE;
+
+#define FALSE 0
+#define TRUE  1
+
+#define MAXUCHAR  0xff
+#define MAXUSHORT 0xffff
+#define MAXULONG  0xffffffffUL
+#define MAXSHORT  0x7fff
+#define MINSHORT  (-MAXSHORT - 1)
+#define MAXLONG   0x7fffffffL
+#define MINLONG   (-MAXLONG - 1)
+#define MAXLONGLONG INT64_MAX
+
+#ifndef min
+#define min(a, b) (((a) < (b)) ? (a) : (b))
+#endif
+#ifndef max
+#define max(a, b) (((a) > (b)) ? (a) : (b))
+#endif
+
+//
+// Annotations
+//
+#define UNALIGNED
+#define POINTER_32
+#define IN
+#define OUT
+#define __forceinline                        inline __attribute__((always_inline))
+#define __cdecl
+#define FORCEINLINE                          __forceinline
+#define __declspec(attribute)                HOST_DECLSPEC_##attribute
+#define HOST_DECLSPEC_align(alignment)       alignas(alignment)
+#define _Use_decl_annotations_
+#define __drv_maxIRQL(irql)
+#define _IRQL_requires_max_(irql)
+#define _In_
+#define _In_opt_
+#define _Out_
+#define _Out_opt_
+#define _Inout_
+#define _Inout_opt_
+#define _In_reads_(size)
+#define _In_reads_bytes_(size)
+#define _Out_writes_(size)
+#define _Out_writes_bytes_(size)
+#define _Out_writes_to_(size, count)
+#define _Inout_updates_(size)
+#define _Inout_updates_bytes_(size)
+#define _Must_inspect_result_
+#define _Ret_maybenull_
+#define _Success_(expr)
+#define _Requires_lock_held_(lock)
+#define PAGED_CODE_SEG
+#define NONPAGED_CODE_SEG
+#define PAGED_CODE()
+#define ASSERT(expr)                         assert(expr)
+#define UNREFERENCED_PARAMETER(p)            (void)(p)
+#define DEFINE_GUID(name, l, w1, w2, b1, b2, b3, b4, b5, b6, b7, b8)
+
+//
+// Status
+//
+#define STATUS_SUCCESS                ((NTSTATUS)0x00000000L)
+#define STATUS_UNSUCCESSFUL           ((NTSTATUS)0xC0000001L)
+#define STATUS_INVALID_PARAMETER      ((NTSTATUS)0xC000000DL)
+#define STATUS_INSUFFICIENT_RESOURCES ((NTSTATUS)0xC000009AL)
+#define STATUS_NOT_SUPPORTED          ((NTSTATUS)0xC00000BBL)
+#define NT_SUCCESS(status)            (((NTSTATUS)(status)) >= 0)
+
+//
+// The wil result macros that the driver uses.
+//
+#define RETURN_NTSTATUS_IF_TRUE(condition, status) \
+    do                                             \
+    {                                              \
+        if (condition)                             \
+        {                                          \
+            return (status);                       \
+        }                                          \
+    } while (0)
+
+#define RETURN_NTSTATUS_IF_FAILED(status) \
+    do                                    \
+    {                                     \
+        NTSTATUS __status = (status);     \
+        if (!NT_SUCCESS(__status))        \
+        {                                 \
+            return __status;              \
+        }                                 \
+    } while (0)
+
+//
+// Tracing is compiled out.
+//
+#define TraceEvents(level, flags, ...) ((void)0)
+
+//
+// Memory
+//
+#define POOL_FLAG_NON_PAGED 0x0000000000000040ULL
+#define DRIVER_TAG          (ULONG)'DaAU'
+
+#define RtlCopyMemory(dst, src, length) memcpy((dst), (src), (length))
+#define RtlMoveMemory(dst, src, length) memmove((dst), (src), (length))
+#define RtlZeroMemory(dst, length)      memset((dst), 0, (length))
+#define RtlFillMemory(dst, length, fill) memset((dst), (fill), (length))
+
+inline PVOID ExAllocatePool2(POOL_FLAGS /* flags */, SIZE_T size, ULONG /* tag */)
+{
+    return calloc(1, size);
+}
+
+inline void ExFreePoolWithTag(PVOID buffer, ULONG /* tag */)
+{
+    free(buffer);
+}
+
+// Objects are released with the ordinary delete, so they come from the ordinary allocator.
+inline PVOID operator new(size_t size, POOL_FLAGS /* flags */, ULONG /* tag */)
+{
+    PVOID buffer = ::operator new(size, std::nothrow);
+    if (buffer != nullptr)
+    {
+        memset(buffer, 0, size);
+    }
+    return buffer;
+}
+
+//
+// Interlocked operations
+//
+template <typename T>
+inline T InterlockedExchangeT(volatile T * target, T value)
+{
+    return __atomic_exchange_n(target, value, __ATOMIC_SEQ_CST);
+}
+
+#define InterlockedExchange(target, value)   InterlockedExchangeT<LONG>((volatile LONG *)(target), (LONG)(value))
+#define InterlockedExchange64(target, value) InterlockedExchangeT<LONG64>((volatile LONG64 *)(target), (LONG64)(value))
+#define InterlockedIncrement(target)         __atomic_add_fetch((volatile LONG *)(target), 1, __ATOMIC_SEQ_CST)
+#define InterlockedDecrement(target)         __atomic_sub_fetch((volatile LONG *)(target), 1, __ATOMIC_SEQ_CST)
+#define InterlockedAdd(target, value)        __atomic_add_fetch((volatile LONG *)(target), (LONG)(value), __ATOMIC_SEQ_CST)
+#define InterlockedAdd64(target, value)      __atomic_add_fetch((volatile LONG64 *)(target), (LONG64)(value), __ATOMIC_SEQ_CST)
+#define InterlockedOr(target, value)         __atomic_fetch_or((volatile LONG *)(target), (LONG)(value), __ATOMIC_SEQ_CST)
+#define InterlockedAnd(target, value)        __atomic_fetch_and((volatile LONG *)(target), (LONG)(value), __ATOMIC_SEQ_CST)
+#define MemoryBarrier()                      __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define ReadNoFence(source)                  __atomic_load_n((volatile LONG *)(source), __ATOMIC_RELAXED)
+#define ReadAcquire(source)                  __atomic_load_n((volatile LONG *)(source), __ATOMIC_ACQUIRE)
+#define WriteRelease(target, value)          __atomic_store_n((volatile LONG *)(target), (LONG)(value), __ATOMIC_RELEASE)
+#define ReadAcquire64(source)                __atomic_load_n((volatile LONG64 *)(source), __ATOMIC_ACQUIRE)
+#define WriteRelease64(target, value)        __atomic_store_n((volatile LONG64 *)(target), (LONG64)(value), __ATOMIC_RELEASE)
+
+inline LONG InterlockedCompareExchange(volatile LONG * target, LONG exchange, LONG comparand)
+{
+    __atomic_compare_exchange_n(target, &comparand, exchange, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return comparand;
+}
+
+// The host threads may share a processor, so a spinning thread gives it up instead of pausing.
+#define YieldProcessor() std::this_thread::yield()
+
+//
+// Processor features. The kernel reports them once from DriverEntry; the
+// host build asks the compiler runtime.
+//
+#define PF_SSSE3_INSTRUCTIONS_AVAILABLE  36
+#define PF_SSE4_1_INSTRUCTIONS_AVAILABLE 37
+#define PF_AVX_INSTRUCTIONS_AVAILABLE    39
+#define XSTATE_MASK_AVX                  0x4ULL
+
+inline BOOLEAN ExIsProcessorFeaturePresent(ULONG feature)
+{
+#if defined(_M_X64)
+    __builtin_cpu_init();
+    switch (feature)
+    {
+    case PF_SSSE3_INSTRUCTIONS_AVAILABLE:
+        return __builtin_cpu_supports("ssse3") ? TRUE : FALSE;
+    case PF_SSE4_1_INSTRUCTIONS_AVAILABLE:
+        return __builtin_cpu_supports("sse4.1") ? TRUE : FALSE;
+    case PF_AVX_INSTRUCTIONS_AVAILABLE:
+        return __builtin_cpu_supports("avx") ? TRUE : FALSE;
+    default:
+        return FALSE;
+    }
+#else
+    UNREFERENCED_PARAMETER(feature);
+    return FALSE;
+#endif
+}
+
+inline ULONG64 RtlGetEnabledExtendedFeatures(ULONG64 featureMask)
+{
+    return featureMask;
+}
+
+inline NTSTATUS KeSaveExtendedProcessorState(ULONG64 /* mask */, PXSTATE_SAVE /* save */)
+{
+    return STATUS_SUCCESS;
+}
+
+inline void KeRestoreExtendedProcessorState(PXSTATE_SAVE /* save */)
+{
+}
+
+inline NTSTATUS KeSaveFloatingPointState(PKFLOATING_SAVE /* save */)
+{
+    return STATUS_SUCCESS;
+}
+
+inline NTSTATUS KeRestoreFloatingPointState(PKFLOATING_SAVE /* save */)
+{
+    return STATUS_SUCCESS;
+}
+
+//
+// Framework objects that the shared headers refer to. The host build never
+// creates them.
+//
+typedef struct WDFWAITLOCK__ * WDFWAITLOCK;
+
+inline NTSTATUS WdfWaitLockAcquire(WDFWAITLOCK /* lock */, PLONGLONG /* timeout */)
+{
+    return STATUS_SUCCESS;
+}
+
+inline void WdfWaitLockRelease(WDFWAITLOCK /* lock */)
+{
+}
+
+#include "Common.h"
+#include "UAC_User.h"
+
+#endif
@@ -0,0 +1,137 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+// ASIO is a trademark and software of Steinberg Media Technologies GmbH
+
+/*++
+
+Module Name:
+
+    PacketPositionSnapshotBenchmark.cpp
+
+Abstract:
+
+    Measure the cost of reading the completed packet counters through
+    PacketPositionSnapshot against reading them under the lock that the
+    writers hold, alone and while writers update the counters. The results
+    depend on the host and are only printed.
+
+Environment:
+
+    User mode (host build only)
+
+--*/
+
+#include "HostCompat.h"
+#include "PacketPositionSnapshot.h"
+#include "TestCommon.h"
+
+#include <atomic>
+
+#define BENCHMARK_DURATION_MS 300
+#define BENCHMARK_WRITERS     2
+
+static const ULONG c_readerCounts[] = {1, 2, 4};
+
+//
+// Runs the readers and writers for BENCHMARK_DURATION_MS and prints the
+// reads and updates per second. The writers always take the lock; the
+// readers take it only when useLock is set.
+//
+static void BenchmarkContention(
+    bool  useLock,
+    ULONG readerCount,
+    ULONG writerCount
+)
+{
+    PacketPositionSnapshot snapshot;
+    std::mutex             writerLock;
+    std::atomic<bool>      running{true};
+    std::atomic<ULONGLONG> reads{0};
+    std::atomic<ULONGLONG> updates{0};
+    std::atomic<LONGLONG>  sink{0};
+
+    auto writer = [&](bool isInput) {
+        ULONGLONG count = 0;
+        while (running.load(std::memory_order_relaxed))
+        {
+            std::lock_guard<std::mutex> lock(writerLock);
+            PACKET_POSITION &           position = snapshot.BeginUpdate();
+            if (isInput)
+            {
+                position.InputCompletedPacket += 8;
+                position.InputCompletedTimeUs += 1000;
+            }
+            else
+            {
+                position.OutputCompletedPacket += 8;
+            }
+            snapshot.EndUpdate();
+            ++count;
+        }
+        updates += count;
+    };
+
+    auto reader = [&]() {
+        ULONGLONG count = 0;
+        LONGLONG  total = 0;
+        while (running.load(std::memory_order_relaxed))
+        {
+            PACKET_POSITION position;
+            if (useLock)
+            {
+                std::lock_guard<std::mutex> lock(writerLock);
+                snapshot.Read(position);
+            }
+            else
+            {
+                snapshot.Read(position);
+            }
+            total += position.InputCompletedPacket + position.OutputCompletedPacket;
+            ++count;
+        }
+        reads += count;
+        sink += total;
+    };
+
+    std::vector<std::thread> threads;
+    for (ULONG i = 0; i < writerCount; ++i)
+    {
+        threads.emplace_back(writer, (i % 2) == 0);
+    }
+    for (ULONG i = 0; i < readerCount; ++i)
+    {
+        threads.emplace_back(reader);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(std::chrono::milliseconds(BENCHMARK_DURATION_MS));
+    running.store(false);
+    for (auto & thread : threads)
+    {
+        thread.join();
+    }
+    double seconds = ElapsedNs(start) / 1e9;
+
+    printf("  %-9s %7u %7u %14.0f %14.0f %10.1f\n", useLock ? "lock" : "sequence", readerCount, writerCount, reads.load() / seconds, updates.load() / seconds, (reads.load() != 0) ? (seconds * 1e9 * readerCount / reads.load()) : 0.0);
+}
+
+int main()
+{
+    printf("Completed packet counters, %u ms per run, %u hardware threads\n", BENCHMARK_DURATION_MS, std::thread::hardware_concurrency());
+    printf("  reader    readers writers       reads/s      updates/s  ns/read\n");
+
+    for (ULONG writerCount : {0U, (ULONG)BENCHMARK_WRITERS})
+    {
+        for (ULONG readerCount : c_readerCounts)
+        {
+            BenchmarkContention(true, readerCount, writerCount);
+            BenchmarkContention(false, readerCount, writerCount);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,173 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+// ASIO is a trademark and software of Steinberg Media Technologies GmbH
+
+/*++
+
+Module Name:
+
+    PacketPositionSnapshotTest.cpp
+
+Abstract:
+
+    Stress PacketPositionSnapshot with an input and an output writer, which
+    are serialized by a lock as the completion routines are, and readers
+    that never take the lock. Every snapshot must be a state that the
+    writers published, must not be older than an update that finished
+    before the read started, and must not go backwards.
+
+Environment:
+
+    User mode (host build only)
+
+--*/
+
+#include "HostCompat.h"
+#include "PacketPositionSnapshot.h"
+#include "TestCommon.h"
+
+#include <atomic>
+
+#define STRESS_UPDATES        200000
+#define STRESS_READERS        3
+#define STRESS_PACKETS        8
+#define STRESS_YIELD_INTERVAL 64     // Every so many updates the writer is preempted inside the update
+#define STRESS_CHECK_FACTOR   1000003LL
+
+//
+// The time field carries a check value of both counters, so a snapshot that
+// mixes two updates does not match it.
+//
+static ULONGLONG GetCheckValue(
+    const PACKET_POSITION & position
+)
+{
+    return (ULONGLONG)(position.InputCompletedPacket * STRESS_CHECK_FACTOR + position.OutputCompletedPacket);
+}
+
+static void TestSingleThread()
+{
+    PacketPositionSnapshot snapshot;
+    PACKET_POSITION        position{};
+
+    snapshot.Read(position);
+    TEST_CHECK((position.InputCompletedPacket == 0) && (position.OutputCompletedPacket == 0) && (position.InputCompletedTimeUs == 0));
+
+    PACKET_POSITION & update = snapshot.BeginUpdate();
+    update.InputCompletedPacket = 32;
+    update.OutputCompletedPacket = 64;
+    update.InputCompletedTimeUs = 123456;
+    snapshot.EndUpdate();
+
+    snapshot.Read(position);
+    TEST_CHECK((position.InputCompletedPacket == 32) && (position.OutputCompletedPacket == 64) && (position.InputCompletedTimeUs == 123456));
+}
+
+static void TestConcurrentReaders()
+{
+    PacketPositionSnapshot snapshot;
+    std::mutex             writerLock;
+    std::atomic<LONGLONG>  publishedInput{0};
+    std::atomic<LONGLONG>  publishedOutput{0};
+    std::atomic<bool>      writing{true};
+    std::atomic<ULONG>     tornReads{0};
+    std::atomic<ULONG>     staleReads{0};
+    std::atomic<ULONG>     backwardReads{0};
+    std::atomic<ULONGLONG> reads{0};
+
+    auto writer = [&](bool isInput) {
+        for (ULONG update = 1; update <= STRESS_UPDATES; ++update)
+        {
+            LONGLONG value = 0;
+            {
+                std::lock_guard<std::mutex> lock(writerLock);
+                PACKET_POSITION &           position = snapshot.BeginUpdate();
+                if (isInput)
+                {
+                    position.InputCompletedPacket += STRESS_PACKETS;
+                    value = position.InputCompletedPacket;
+                }
+                else
+                {
+                    position.OutputCompletedPacket += STRESS_PACKETS;
+                    value = position.OutputCompletedPacket;
+                }
+                if ((update % STRESS_YIELD_INTERVAL) == 0)
+                {
+                    std::this_thread::yield();
+                }
+                position.InputCompletedTimeUs = GetCheckValue(position);
+                snapshot.EndUpdate();
+            }
+            (isInput ? publishedInput : publishedOutput).store(value);
+        }
+    };
+
+    auto reader = [&]() {
+        PACKET_POSITION previous{};
+        ULONGLONG       count = 0;
+        while (writing.load())
+        {
+            LONGLONG        input = publishedInput.load();
+            LONGLONG        output = publishedOutput.load();
+            PACKET_POSITION position;
+
+            snapshot.Read(position);
+            ++count;
+            if ((position.InputCompletedTimeUs != GetCheckValue(position)) || ((position.InputCompletedPacket % STRESS_PACKETS) != 0) || ((position.OutputCompletedPacket % STRESS_PACKETS) != 0))
+            {
+                tornReads++;
+            }
+            if ((position.InputCompletedPacket < input) || (position.OutputCompletedPacket < output))
+            {
+                staleReads++;
+            }
+            if ((position.InputCompletedPacket < previous.InputCompletedPacket) || (position.OutputCompletedPacket < previous.OutputCompletedPacket))
+            {
+                backwardReads++;
+            }
+            previous = position;
+        }
+        reads += count;
+    };
+
+    std::vector<std::thread> readers;
+    for (ULONG i = 0; i < STRESS_READERS; ++i)
+    {
+        readers.emplace_back(reader);
+    }
+    std::thread inputWriter(writer, true);
+    std::thread outputWriter(writer, false);
+
+    inputWriter.join();
+    outputWriter.join();
+    writing.store(false);
+    for (auto & thread : readers)
+    {
+        thread.join();
+    }
+
+    PACKET_POSITION position;
+    snapshot.Read(position);
+    TEST_CHECK(position.InputCompletedPacket == (LONGLONG)STRESS_UPDATES * STRESS_PACKETS);
+    TEST_CHECK(position.OutputCompletedPacket == (LONGLONG)STRESS_UPDATES * STRESS_PACKETS);
+    TEST_CHECK(position.InputCompletedTimeUs == GetCheckValue(position));
+    TEST_CHECK_MESSAGE(tornReads.load() == 0, "%u torn snapshots", tornReads.load());
+    TEST_CHECK_MESSAGE(staleReads.load() == 0, "%u snapshots older than a finished update", staleReads.load());
+    TEST_CHECK_MESSAGE(backwardReads.load() == 0, "%u snapshots older than the previous one", backwardReads.load());
+    TEST_CHECK(reads.load() != 0);
+
+    printf("%llu snapshots by %u readers against %u updates\n", (unsigned long long)reads.load(), STRESS_READERS, STRESS_UPDATES * 2);
+}
+
+int main()
+{
+    TestSingleThread();
+    TestConcurrentReaders();
+
+    return TestResult("PacketPositionSnapshotTest");
+}
@@ -0,0 +1,99 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+// ASIO is a trademark and software of Steinberg Media Technologies GmbH
+
+/*++
+
+Module Name:
+
+    PacketScheduleReference.h
+
+Abstract:
+
+    Define the packet sizing of StreamObject::CalculateTransferSizeAndSetURB
+    for the packets sized by calculation, copied from the driver, so that
+    the test can pin the sequence of packet sizes it produces.
+
+Environment:
+
+    User mode (host build only)
+
+--*/
+
+#ifndef _PACKET_SCHEDULE_REFERENCE_H_
+#define _PACKET_SCHEDULE_REFERENCE_H_
+
+// The state that the packet sizing carries from one URB to the next.
+typedef struct PACKET_SIZE_STATE_
+{
+    LONG Remainder;         // m_outputRemainder
+    LONG CompensateSamples; // m_compensateSamples
+} PACKET_SIZE_STATE, *PPACKET_SIZE_STATE;
+
+//
+// Returns the samples of one packet from its adjustment, paying back the
+// samples owed through compensateSamples on packets without adjustment.
+//
+inline ULONG GetPacketSamples(
+    LONG   adjustment,
+    ULONG  samplesPerPacket,
+    LONG & compensateSamples
+)
+{
+    ULONG samples = samplesPerPacket;
+    if (adjustment > 0)
+    {
+        ++samples;
+        if (compensateSamples < 0)
+        {
+            ++compensateSamples;
+            --samples;
+        }
+    }
+    else if (adjustment < 0)
+    {
+        --samples;
+    }
+    else
+    {
+        if (compensateSamples > 0)
+        {
+            --compensateSamples;
+            ++samples;
+        }
+    }
+    return samples;
+}
+
+inline void ReferencePacketSizes(
+    PACKET_SIZE_STATE & state,
+    LONG                remainder,
+    ULONG               samplesPerPacket,
+    LONG                packetsPerSec,
+    ULONG               numPackets,
+    PULONG              samples
+)
+{
+    for (ULONG i = 0; i < numPackets; ++i)
+    {
+        LONG adjustment = 0;
+        state.Remainder += remainder;
+        if (state.Remainder - packetsPerSec >= 0)
+        {
+            adjustment = 1;
+            state.Remainder -= packetsPerSec;
+        }
+        else if (state.Remainder + packetsPerSec <= 0)
+        {
+            adjustment = -1;
+            state.Remainder += packetsPerSec;
+        }
+        samples[i] = GetPacketSamples(adjustment, samplesPerPacket, state.CompensateSamples);
+    }
+}
+
+#endif
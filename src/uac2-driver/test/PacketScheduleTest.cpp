@@ -0,0 +1,202 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+// ASIO is a trademark and software of Steinberg Media Technologies GmbH
+
+/*++
+
+Module Name:
+
+    PacketScheduleTest.cpp
+
+Abstract:
+
+    Pin the OUT packet sizes that the remainder arithmetic of
+    StreamObject::CalculateTransferSizeAndSetURB produces for the packets
+    sized by calculation: one second carries the sample rate, the sizes
+    repeat with the quoted cycle length, a measured rate is followed in
+    both directions and the compensation is paid back without taking a
+    packet outside one sample of the nominal size.
+
+Environment:
+
+    User mode (host build only)
+
+--*/
+
+#include "HostCompat.h"
+#include "TestCommon.h"
+#include "PacketScheduleReference.h"
+
+#include <numeric>
+
+#define TEST_URBS        100000
+#define TEST_MAX_PACKETS 80
+
+static const ULONG c_sampleRates[] = {44100, 88200, 176400, 48000, 11025};
+static const ULONG c_packetsPerSec[] = {1000, 4000, 8000};
+static const ULONG c_packetsPerUrb[] = {1, 2, 8, 32, 80};
+
+static LONG NominalRemainder(
+    ULONG sampleRate,
+    ULONG packetsPerSec
+)
+{
+    return (LONG)(sampleRate % packetsPerSec);
+}
+
+//
+// At the nominal rate, one second of packets carries exactly the sample
+// rate and leaves no remainder.
+//
+static void TestNominalSecond()
+{
+    for (ULONG sampleRate : c_sampleRates)
+    {
+        for (ULONG packetsPerSec : c_packetsPerSec)
+        {
+            PACKET_SIZE_STATE state{};
+            ULONG             samples[1];
+            ULONGLONG         totalSamples = 0;
+
+            for (ULONG packet = 0; packet < packetsPerSec; ++packet)
+            {
+                ReferencePacketSizes(state, NominalRemainder(sampleRate, packetsPerSec), sampleRate / packetsPerSec, (LONG)packetsPerSec, 1, samples);
+                totalSamples += samples[0];
+            }
+            TEST_CHECK_MESSAGE((totalSamples == sampleRate) && (state.Remainder == 0), "%u Hz, %u packets/s: %llu samples, remainder %d", sampleRate, packetsPerSec, (unsigned long long)totalSamples, state.Remainder);
+        }
+    }
+}
+
+//
+// The sizes repeat every packetsPerSec / gcd(remainder, packetsPerSec)
+// packets, for example 80 at 44.1 kHz high speed.
+//
+static void TestCycleLength(
+    ULONG sampleRate,
+    ULONG packetsPerSec,
+    ULONG expectedLength
+)
+{
+    const LONG        remainder = NominalRemainder(sampleRate, packetsPerSec);
+    PACKET_SIZE_STATE state{};
+    ULONG             samples[1];
+    ULONG             length = 0;
+
+    TEST_CHECK((ULONG)(packetsPerSec / std::gcd((ULONG)remainder, packetsPerSec)) == expectedLength);
+    do
+    {
+        ReferencePacketSizes(state, remainder, sampleRate / packetsPerSec, (LONG)packetsPerSec, 1, samples);
+        ++length;
+    } while ((state.Remainder != 0) && (length <= packetsPerSec));
+
+    TEST_CHECK_MESSAGE(length == expectedLength, "%u Hz, %u packets/s: cycle of %u packets", sampleRate, packetsPerSec, length);
+}
+
+//
+// A measured rate within a few samples of the nominal rate is followed in
+// both directions, through +1 and -1 adjustments.
+//
+static void TestMeasuredRate()
+{
+    for (ULONG sampleRate : c_sampleRates)
+    {
+        for (ULONG packetsPerSec : c_packetsPerSec)
+        {
+            const ULONG samplesPerPacket = sampleRate / packetsPerSec;
+            const LONG  rounded = (LONG)(samplesPerPacket * packetsPerSec);
+
+            for (LONG offset = -3; offset <= 3; ++offset)
+            {
+                const LONG        measuredSampleRate = (LONG)sampleRate + offset;
+                const LONG        remainder = (measuredSampleRate - rounded) % (LONG)packetsPerSec;
+                PACKET_SIZE_STATE state{};
+                ULONG             samples[1];
+                LONGLONG          totalSamples = 0;
+
+                for (ULONG packet = 0; packet < packetsPerSec; ++packet)
+                {
+                    ReferencePacketSizes(state, remainder, samplesPerPacket, (LONG)packetsPerSec, 1, samples);
+                    totalSamples += samples[0];
+                }
+                TEST_CHECK_MESSAGE(totalSamples == measuredSampleRate, "%u Hz, %u packets/s, measured %d Hz: %lld samples", sampleRate, packetsPerSec, measuredSampleRate, (long long)totalSamples);
+            }
+        }
+    }
+}
+
+//
+// Over long runs with compensation injected now and then, every packet
+// stays within one sample of the nominal size and the samples sent are
+// the nominal samples plus the compensation paid back.
+//
+static void TestCompensation(
+    ULONG sampleRate,
+    ULONG packetsPerSec,
+    ULONG packetsPerUrb
+)
+{
+    const ULONG       samplesPerPacket = sampleRate / packetsPerSec;
+    const LONG        remainder = NominalRemainder(sampleRate, packetsPerSec);
+    PACKET_SIZE_STATE state{};
+    ULONG             samples[TEST_MAX_PACKETS]{};
+    LONGLONG          totalSamples = 0;
+    LONGLONG          injectedSamples = 0;
+    ULONG             outOfRange = 0;
+    std::mt19937      random(sampleRate ^ (packetsPerSec << 8) ^ packetsPerUrb);
+
+    for (ULONG urb = 0; urb < TEST_URBS; ++urb)
+    {
+        if ((random() % 100) == 0)
+        {
+            LONG compensateSamples = std::uniform_int_distribution<LONG>(-4, 4)(random);
+            state.CompensateSamples += compensateSamples;
+            injectedSamples += compensateSamples;
+        }
+
+        ReferencePacketSizes(state, remainder, samplesPerPacket, (LONG)packetsPerSec, packetsPerUrb, samples);
+        for (ULONG i = 0; i < packetsPerUrb; ++i)
+        {
+            if ((samples[i] + 1 < samplesPerPacket) || (samples[i] > samplesPerPacket + 1))
+            {
+                ++outOfRange;
+            }
+            totalSamples += samples[i];
+        }
+    }
+
+    const ULONGLONG packets = (ULONGLONG)TEST_URBS * packetsPerUrb;
+    const LONGLONG  nominalSamples = (LONGLONG)(packets * samplesPerPacket + (packets * (ULONG)remainder - (ULONG)state.Remainder) / packetsPerSec);
+    TEST_CHECK_MESSAGE(outOfRange == 0, "%u Hz, %u packets/s, %u packets/URB: %u packets out of range", sampleRate, packetsPerSec, packetsPerUrb, outOfRange);
+    TEST_CHECK_MESSAGE(totalSamples == nominalSamples + injectedSamples - state.CompensateSamples, "%u Hz, %u packets/s, %u packets/URB: %lld samples, expected %lld", sampleRate, packetsPerSec, packetsPerUrb, (long long)totalSamples, (long long)(nominalSamples + injectedSamples - state.CompensateSamples));
+}
+
+int main()
+{
+    TestNominalSecond();
+
+    TestCycleLength(44100, 8000, 80);
+    TestCycleLength(88200, 8000, 40);
+    TestCycleLength(176400, 8000, 20);
+    TestCycleLength(44100, 1000, 10);
+    TestCycleLength(48000, 8000, 1);
+
+    TestMeasuredRate();
+
+    for (ULONG sampleRate : c_sampleRates)
+    {
+        for (ULONG packetsPerSec : c_packetsPerSec)
+        {
+            for (ULONG packetsPerUrb : c_packetsPerUrb)
+            {
+                TestCompensation(sampleRate, packetsPerSec, packetsPerUrb);
+            }
+        }
+    }
+
+    return TestResult("PacketScheduleTest");
+}
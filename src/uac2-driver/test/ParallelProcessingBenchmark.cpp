@@ -0,0 +1,221 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+// ASIO is a trademark and software of Steinberg Media Technologies GmbH
+
+/*++
+
+Module Name:
+
+    ParallelProcessingBenchmark.cpp
+
+Abstract:
+
+    Measure how a wake of the mixing engine thread scales when the IN side
+    is handed to a worker thread while the OUT side is processed on the
+    calling thread, as StreamObject does in parallel processing mode. The IN
+    side is modelled by SampleConverter::InterleavedToPlanar and the OUT
+    side by SampleConverter::PlanarToInterleaved. The handoff mirrors
+    StreamObject::WaitParallelWorker and ParallelWorkerThreadMain, with a
+    condition variable in place of the KEVENT. The results depend on the
+    host and are only printed.
+
+Environment:
+
+    User mode (host build only)
+
+--*/
+
+#include "HostCompat.h"
+#include "SampleConverter.h"
+#include "TestCommon.h"
+
+#include <atomic>
+#include <condition_variable>
+
+#define BENCHMARK_WAKE_UPS        2000
+#define BENCHMARK_FRAMES_PER_WAKE 48 // 1 ms at 48 kHz
+#define BENCHMARK_SAMPLE_SIZE     4
+#define BENCHMARK_USB_SAMPLE_SIZE 3
+#define BENCHMARK_DEADLINE_US     1000
+
+static const ULONG c_channelCounts[] = {8, 16, 32, 64};
+
+class BenchmarkStreams
+{
+  public:
+    explicit BenchmarkStreams(
+        ULONG channels
+    )
+        : m_channels(channels),
+          m_channelsMap((channels >= 64) ? ~0ULL : ((1ULL << channels) - 1)),
+          m_inPlanar(BENCHMARK_FRAMES_PER_WAKE * BENCHMARK_SAMPLE_SIZE * channels),
+          m_inUsb(BENCHMARK_FRAMES_PER_WAKE * BENCHMARK_USB_SAMPLE_SIZE * channels),
+          m_outPlanar(BENCHMARK_FRAMES_PER_WAKE * BENCHMARK_SAMPLE_SIZE * channels),
+          m_outUsb(BENCHMARK_FRAMES_PER_WAKE * BENCHMARK_USB_SAMPLE_SIZE * channels)
+    {
+        FillRandom(m_inUsb, channels);
+        FillRandom(m_outPlanar, channels + 1);
+    }
+
+    void ProcessInput()
+    {
+        SampleConverter::InterleavedToPlanar(m_inPlanar.data(), BENCHMARK_FRAMES_PER_WAKE * BENCHMARK_SAMPLE_SIZE, BENCHMARK_SAMPLE_SIZE, m_channels, m_channelsMap, 0, m_inUsb.data(), BENCHMARK_USB_SAMPLE_SIZE * m_channels, BENCHMARK_USB_SAMPLE_SIZE, m_channels, BENCHMARK_FRAMES_PER_WAKE);
+    }
+
+    void ProcessOutput()
+    {
+        SampleConverter::PlanarToInterleaved(m_outUsb.data(), BENCHMARK_USB_SAMPLE_SIZE * m_channels, BENCHMARK_USB_SAMPLE_SIZE, m_channels, m_outPlanar.data(), BENCHMARK_FRAMES_PER_WAKE * BENCHMARK_SAMPLE_SIZE, BENCHMARK_SAMPLE_SIZE, m_channels, m_channelsMap, 0, BENCHMARK_FRAMES_PER_WAKE);
+    }
+
+  private:
+    const ULONG        m_channels;
+    const ULONGLONG    m_channelsMap;
+    std::vector<UCHAR> m_inPlanar;
+    std::vector<UCHAR> m_inUsb;
+    std::vector<UCHAR> m_outPlanar;
+    std::vector<UCHAR> m_outUsb;
+};
+
+class BenchmarkParallelWorker
+{
+  public:
+    explicit BenchmarkParallelWorker(
+        BenchmarkStreams & streams
+    )
+        : m_streams(streams), m_thread(&BenchmarkParallelWorker::ThreadMain, this)
+    {
+    }
+
+    ~BenchmarkParallelWorker()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_terminate = true;
+        }
+        m_wakeUp.notify_one();
+        m_thread.join();
+    }
+
+    // One wake: the IN side is requested from the worker, the OUT side is
+    // processed here, and the IN side is taken back if the worker has not
+    // started it by the deadline.
+    void ProcessWake()
+    {
+        LONG sequence = 0;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            sequence = ++m_requestSequence;
+        }
+        m_wakeUp.notify_one();
+
+        m_streams.ProcessOutput();
+
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(BENCHMARK_DEADLINE_US);
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (m_doneSequence.load() != sequence)
+        {
+            if (std::chrono::steady_clock::now() < deadline)
+            {
+                m_done.wait_until(lock, deadline);
+                continue;
+            }
+            LONG expected = sequence - 1;
+            if (m_startedSequence.compare_exchange_strong(expected, sequence))
+            {
+                lock.unlock();
+                m_streams.ProcessInput();
+                m_doneSequence.store(sequence);
+                ++m_takenBack;
+                return;
+            }
+            m_done.wait(lock);
+        }
+    }
+
+    ULONG GetTakenBack() const
+    {
+        return m_takenBack;
+    }
+
+  private:
+    void ThreadMain()
+    {
+        for (;;)
+        {
+            LONG sequence = 0;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_wakeUp.wait(lock, [&]() { return m_terminate || (m_requestSequence.load() != m_doneSequence.load()); });
+                if (m_terminate)
+                {
+                    break;
+                }
+                sequence = m_requestSequence.load();
+            }
+            LONG expected = sequence - 1;
+            if (!m_startedSequence.compare_exchange_strong(expected, sequence))
+            {
+                continue;
+            }
+
+            m_streams.ProcessInput();
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_doneSequence.store(sequence);
+            }
+            m_done.notify_one();
+        }
+    }
+
+    BenchmarkStreams &      m_streams;
+    std::mutex              m_mutex;
+    std::condition_variable m_wakeUp;
+    std::condition_variable m_done;
+    std::atomic<LONG>       m_requestSequence{0};
+    std::atomic<LONG>       m_startedSequence{0};
+    std::atomic<LONG>       m_doneSequence{0};
+    bool                    m_terminate{false};
+    ULONG                   m_takenBack{0};
+    std::thread             m_thread;
+};
+
+int main()
+{
+    SampleConverter::Initialize();
+
+    printf("Mixing engine wake, %u frames per wake, %u wakes, %u hardware threads (us/wake)\n", BENCHMARK_FRAMES_PER_WAKE, BENCHMARK_WAKE_UPS, std::thread::hardware_concurrency());
+    printf("  channels     serial   parallel  speedup  taken back\n");
+
+    for (ULONG channels : c_channelCounts)
+    {
+        BenchmarkStreams streams(channels);
+
+        streams.ProcessInput();
+        streams.ProcessOutput();
+        auto start = std::chrono::steady_clock::now();
+        for (ULONG wakeUp = 0; wakeUp < BENCHMARK_WAKE_UPS; ++wakeUp)
+        {
+            streams.ProcessInput();
+            streams.ProcessOutput();
+        }
+        double serialUs = ElapsedNs(start) / 1e3 / BENCHMARK_WAKE_UPS;
+
+        BenchmarkParallelWorker worker(streams);
+        worker.ProcessWake();
+        start = std::chrono::steady_clock::now();
+        for (ULONG wakeUp = 0; wakeUp < BENCHMARK_WAKE_UPS; ++wakeUp)
+        {
+            worker.ProcessWake();
+        }
+        double parallelUs = ElapsedNs(start) / 1e3 / BENCHMARK_WAKE_UPS;
+
+        printf("  %8u %10.2f %10.2f %8.2f %11u\n", channels, serialUs, parallelUs, serialUs / parallelUs, worker.GetTakenBack());
+    }
+
+    return 0;
+}
@@ -0,0 +1,1076 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+// ASIO is a trademark and software of Steinberg Media Technologies GmbH
+
+/*++
+
+Module Name:
+
+    PipelineSimulator.cpp
+
+Abstract:
+
+    Discrete-event simulator of the isochronous pipeline. A virtual USB
+    frame clock drives IN, OUT and feedback URB completions with jitter,
+    loss and device clock drift, and a simulated mixing engine thread is
+    woken by the completions and by its own timer. The thread runs the
+    driver's UsbClockModel, FeedbackFilter and SafetyOffsetController and
+    applies the packet loop, dropout, ASIO notification and wake-up rules
+    of StreamTiming the way StreamObject::MixingEngineThreadMain does, and
+    an ASIO client answers each notification after a processing time.
+
+    For every row of g_DriverSettingsTable the simulator reports dropouts,
+    the distribution of the IN and OUT packet loop exit reasons and the
+    latency achieved between the bus and the ASIO client.
+
+Environment:
+
+    User mode (host build only)
+
+--*/
+
+#include "HostCompat.h"
+#include "DriverSettingsTable.h"
+#include "UsbClockModel.h"
+#include "FeedbackFilter.h"
+#include "SafetyOffsetController.h"
+#include "StreamTiming.h"
+#include "TestCommon.h"
+
+#define SIM_START_DELAY_MS            UAC_DEFAULT_FIRST_PACKET_LATENCY // The first packet is scheduled this many frames after the stream starts
+#define SIM_WAKE_UP_INTERVAL_MIN_US   100                              // The minimum interval given to MixingEngineThread::CreateThread
+#define SIM_HOST_PREFETCH_US          250                              // The host controller fetches an OUT packet this long before the bus sends it
+#define SIM_UNLISTED_PERIOD_FRAMES    480                              // Period simulated for the fallback row, which has no period of its own
+#define SIM_DEFAULT_SECONDS           4
+
+//
+// In the order of PacketLoopReason in StreamObject.h.
+//
+enum class SimLoopReason
+{
+    ContinueLoop = 0,
+    ExitLoopListCycleCompleted,
+    ExitLoopAsioNotifyTimeExceeded,
+    ExitLoopPacketEstimateReached,
+    ExitLoopNoMoreAsioBuffers,
+    ExitLoopAtAsioBoundary,
+    ExitLoopAfterSafetyOffset,
+    ExitLoopAtInSync,
+    ExitLoopToPreventOutOverlap,
+    NumOfReasons
+};
+
+constexpr int toInt(SimLoopReason reason)
+{
+    return static_cast<int>(reason);
+}
+
+static const char * const c_loopReasonNames[] = {"Continue", "Cycle", "Notify", "Estimate", "NoBuffer", "Boundary", "Offset", "InSync", "Overlap"};
+
+enum class SimDropout
+{
+    InOverrun = 0,  // IN packets overwritten by the bus before the thread processed them
+    OutUnderrun,    // OUT packets fetched by the host controller before the thread wrote them
+    SafetyOffset,   // The driver's safety offset check fired
+    LateWake,       // The driver's long elapsed time after the IN completion or the previous wake check fired
+    CallbackPeriod, // The driver's ASIO callback period check fired
+    ClientLate,     // The driver's long client processing time check fired
+    UrbError,       // A URB was lost
+    DeviceFifo,     // The OUT samples drifted from the device clock by more than one packet
+    NumOfDropouts
+};
+
+constexpr int toInt(SimDropout dropout)
+{
+    return static_cast<int>(dropout);
+}
+
+static const char * const c_dropoutNames[] = {"overrun", "underrun", "safety", "late", "period", "client", "urb", "fifo"};
+
+struct SimulationSettings
+{
+    const char * Name;
+    ULONG        FramesPerMs;
+    ULONG        SampleRate;
+    ULONG        MaxIrpNumber;
+    double       BusDriftPpm;         // USB frame clock against the performance counter
+    double       DeviceDriftPpm;      // Device sample clock against the USB frame clock
+    ULONG        CompletionJitterUs;  // Completions are observed up to this much after the bus finishes the URB
+    double       UrbLossRate;         // Share of IN, OUT and feedback URBs that complete with an error
+    ULONG        WakeLatencyUs;       // Shortest time from a wake-up cause to the thread running
+    ULONG        WakeLatencyMeanUs;   // Mean of the exponential part of the wake latency
+    double       WakeSpikeRate;       // Share of wake-ups delayed by WakeSpikeUs on top
+    ULONG        WakeSpikeUs;
+    ULONG        ClientLoadPercent;   // ASIO client processing time as a share of the buffer period
+    ULONG        AdaptiveSafetyOffset; // Quiet period of the safety offset controller in seconds, 0 to disable
+    double       StallAtSeconds;      // A single thread stall is injected at this time, 0 for none
+    ULONG        StallUs;
+    ULONG        Seconds;
+    ULONG        Seed;
+};
+
+struct SimulationResult
+{
+    ULONG     PeriodFrames;
+    ULONG     ClassicFramesPerIrp;
+    ULONG     InputOffsetFrame;
+    ULONG     OutputOffsetFrame;
+    ULONGLONG Wakes;
+    ULONGLONG Notifications;
+    ULONGLONG Dropouts[toInt(SimDropout::NumOfDropouts)];
+    ULONGLONG InLoopReasons[toInt(SimLoopReason::NumOfReasons)];
+    ULONGLONG OutLoopReasons[toInt(SimLoopReason::NumOfReasons)];
+    double    InputLatencyUs;  // Capture of the first sample of a buffer to its notification, average
+    double    OutputLatencyUs; // Notification to the bus playing the first sample of the answer, average
+    double    RoundTripUs;     // Capture to play, average
+    double    MaxRoundTripUs;
+    ULONG     FinalSafetyOffsetFrame;
+    LONG      ClockDriftPpm;
+    ULONG     ClockJitterUs;
+    ULONG     FeedbackMilliSamples;
+
+    ULONGLONG GetTotalDropouts() const
+    {
+        ULONGLONG total = 0;
+        for (ULONGLONG dropouts : Dropouts)
+        {
+            total += dropouts;
+        }
+        return total;
+    }
+};
+
+//
+// Decodes a buffer operation offset the way CalculateUsbLatency does for a
+// device that is not behind a hub.
+//
+static void DecodeBufferOperationOffset(
+    ULONG   bufferOperationOffset,
+    ULONG   listHardwareMs,
+    ULONG   framesPerMs,
+    ULONG & offsetFrame,
+    ULONG & minOffsetFrame
+)
+{
+    ULONG rawOffset = bufferOperationOffset & 0x0fffffffUL;
+    ULONG hardwareMs = (((bufferOperationOffset & 0x30000000UL) >> 28) == 0x01) ? listHardwareMs : 0;
+
+    if ((bufferOperationOffset & 0x40000000UL) != 0)
+    {
+        offsetFrame = hardwareMs * framesPerMs + (rawOffset * framesPerMs / 8);
+        minOffsetFrame = (hardwareMs != 0) ? (framesPerMs + (rawOffset * 8 / framesPerMs)) : 1;
+    }
+    else
+    {
+        offsetFrame = (hardwareMs + rawOffset) * framesPerMs;
+        minOffsetFrame = (hardwareMs != 0) ? ((rawOffset + 1) * framesPerMs) : 1;
+    }
+}
+
+class PipelineSimulator
+{
+  public:
+    PipelineSimulator(
+        const SimulationSettings & settings,
+        const UAC_DRIVER_FLAGS &   row
+    );
+
+    SimulationResult Run();
+
+  private:
+    enum class EventType
+    {
+        Frame,
+        InCompletion,
+        OutCompletion,
+        Timer,
+        WakeUp,
+        ClientDone,
+    };
+
+    struct Event
+    {
+        double    TimeUs;
+        ULONGLONG Order; // Keeps events at the same time in the order they were scheduled
+        EventType Type;
+        LONGLONG  Index;
+
+        bool operator>(const Event & other) const
+        {
+            return (TimeUs != other.TimeUs) ? (TimeUs > other.TimeUs) : (Order > other.Order);
+        }
+    };
+
+    struct PendingOutput
+    {
+        LONGLONG ReadPosition;
+        double   NotifyTimeUs;
+        double   CaptureTimeUs;
+    };
+
+    void Schedule(
+        double    timeUs,
+        EventType type,
+        LONGLONG  index = 0
+    );
+
+    double GetPacketTimeUs(
+        LONGLONG packet
+    ) const;
+
+    LONGLONG GetBusPacket(
+        double timeUs
+    ) const;
+
+    ULONG GetInputSamples(
+        LONGLONG packet
+    ) const;
+
+    double GetCompletionTimeUs(
+        LONGLONG irp,
+        double & lastCompletionUs
+    );
+
+    bool IsUrbLost();
+
+    void WakeThread(
+        double causeTimeUs
+    );
+
+    void OnFrame(
+        LONGLONG packet
+    );
+
+    void OnInCompletion(
+        LONGLONG irp
+    );
+
+    void OnOutCompletion(
+        LONGLONG irp
+    );
+
+    ULONG ReadFeedback();
+
+    void OnClientDone(
+        LONGLONG buffer
+    );
+
+    void RunMixingEngine();
+
+    void DeterminePacket();
+
+    SimLoopReason ProcessInput(
+        bool handleAsioBuffer
+    );
+
+    SimLoopReason ProcessOutput(
+        bool handleAsioBuffer
+    );
+
+    void CheckSafetyOffset();
+
+    void EvaluateAsioNotification();
+
+    void ScheduleWakeUp(
+        bool waitingForOutputReady
+    );
+
+    void AssignOutputPackets(
+        LONGLONG irp,
+        ULONG    samples
+    );
+
+    const SimulationSettings & m_settings;
+    const ULONG                m_periodFrames;
+    ULONG                      m_classicFramesPerIrp{0};
+    ULONG                      m_packetsPerIrp{0};
+    ULONG                      m_numIrp{0};
+    ULONG                      m_busIntervalUs{0};
+    ULONG                      m_inputOffsetFrame{0};
+    ULONG                      m_outputOffsetFrame{0};
+    ULONG                      m_outputMinOffsetFrame{0};
+    ULONG                      m_outputDriverBuffer{0};
+    double                     m_packetPeriodUs{0.0};
+    double                     m_startUs{0.0};
+    double                     m_endUs{0.0};
+    double                     m_samplesPerPacket{0.0};
+    double                     m_periodUs{0.0};
+
+    std::priority_queue<Event, std::vector<Event>, std::greater<Event>> m_events;
+    ULONGLONG                                                          m_eventOrder{0};
+    double                                                             m_nowUs{0.0};
+    std::mt19937                                                       m_random;
+    std::exponential_distribution<double>                              m_wakeLatency;
+    bool                                                               m_stallInjected{false};
+    double                                                             m_stalledUntilUs{0.0};
+    double                                                             m_pendingWakeUpUs{-1.0}; // Earliest wake-up already scheduled, negative for none
+    ULONGLONG                                                          m_wakeUpGeneration{0};
+
+    // Bus and device
+    double             m_lastInCompletionUs{0.0};
+    double             m_lastOutCompletionUs{0.0};
+    LONGLONG           m_inCompletedPacket{0};
+    ULONGLONG          m_inCompletedTimeUs{0};
+    std::vector<ULONG> m_outPacketSamples; // Per bus packet, assigned when the URB is (re)submitted
+    ULONG              m_lastFeedbackSize{0};
+    ULONG              m_feedbackValueShift{0};
+    double             m_deviceFifoSamples{0.0};
+    bool               m_deviceFifoSlipping{false};
+    FeedbackFilter     m_feedbackFilter;
+
+    // Mixing engine thread, as in StreamObject
+    UsbClockModel          m_inputClockModel;
+    SafetyOffsetController m_safetyOffsetController;
+    ULONGLONG              m_timerGeneration{0};
+    bool                   m_firstWakeUp{true};
+    ULONGLONG              m_lastWakeUpTimeUs{0};
+    bool                   m_safetyOffsetApplied{false};
+    LONGLONG               m_inputSyncPacket{0};
+    LONGLONG               m_inputEstimatedPacket{0};
+    LONGLONG               m_inputProcessedPacket{0};
+    ULONG                  m_inputRemainder{0};  // Samples of the last started IN packet not handed to ASIO yet
+    LONGLONG               m_outputProcessedPacket{0};
+    ULONG                  m_outputRemainder{0}; // Samples of the last started OUT packet not taken from ASIO yet
+    LONGLONG               m_inBuffersTotalCount{0};
+    LONGLONG               m_outBuffersTotalCount{0};
+    bool                   m_outputStarted{false};
+
+    // ASIO buffer and client
+    LONGLONG                  m_asioReadyPosition{0};
+    LONGLONG                  m_inputAsioBufferedPosition{0};
+    LONGLONG                  m_outputAsioBufferedPosition{0};
+    LONGLONG                  m_notifyPosition{0};
+    ULONGLONG                 m_asioNotifyCount{0};
+    double                    m_lastAsioNotifyUs{0.0};
+    LONG                      m_clientProcessingTimeUs{0};
+    LONG                      m_readyBuffers{0};
+    bool                      m_clientOutputReady{false};
+    bool                      m_outputReadyInThisPeriod{false};
+    std::vector<double>       m_captureTimeUs; // Per ASIO buffer
+    std::deque<PendingOutput> m_pendingOutputs;
+    std::vector<double>       m_notifyTimeUs;  // Per ASIO buffer
+
+    // Statistics
+    SimulationResult m_result{};
+    ULONGLONG        m_latencyCount{0};
+    double           m_inputLatencySumUs{0.0};
+    double           m_outputLatencySumUs{0.0};
+    double           m_roundTripSumUs{0.0};
+};
+
+PipelineSimulator::PipelineSimulator(
+    const SimulationSettings & settings,
+    const UAC_DRIVER_FLAGS &   row
+)
+    : m_settings(settings), m_periodFrames((row.PeriodFrames != 0) ? row.PeriodFrames : SIM_UNLISTED_PERIOD_FRAMES), m_random(settings.Seed), m_wakeLatency(1.0 / max(settings.WakeLatencyMeanUs, 1U))
+{
+    const bool                      highSpeed = (settings.FramesPerMs > 1);
+    const UAC_LATENCY_OFFSET_LIST & list = g_LatencyOffsetList[highSpeed ? 1 : 0];
+
+    // As in USBAudioConfiguration::ActivateAudioInterface and CalculateUsbLatency.
+    m_classicFramesPerIrp = highSpeed ? row.Parameter.ClassicFramesPerIrp2 : row.Parameter.ClassicFramesPerIrp;
+    if (m_classicFramesPerIrp == 0)
+    {
+        m_classicFramesPerIrp = 1;
+    }
+    m_packetsPerIrp = m_classicFramesPerIrp * settings.FramesPerMs;
+    m_numIrp = settings.MaxIrpNumber;
+    m_busIntervalUs = 1000 / settings.FramesPerMs;
+    ULONG inputMinOffsetFrame = 0;
+    DecodeBufferOperationOffset(row.Parameter.InputBufferOperationOffset, list.InputBufferOperationOffset, settings.FramesPerMs, m_inputOffsetFrame, inputMinOffsetFrame);
+    DecodeBufferOperationOffset(row.Parameter.OutputBufferOperationOffset, list.OutputBufferOperationOffset, settings.FramesPerMs, m_outputOffsetFrame, m_outputMinOffsetFrame);
+    m_outputDriverBuffer = (ULONG)((double)settings.SampleRate * m_outputOffsetFrame / (double)(settings.FramesPerMs * 1000));
+
+    m_packetPeriodUs = (double)m_busIntervalUs / (1.0 + settings.BusDriftPpm / 1000000.0);
+    m_startUs = SIM_START_DELAY_MS * 1000.0;
+    m_endUs = m_startUs + settings.Seconds * 1000000.0;
+    m_samplesPerPacket = (double)settings.SampleRate * (1.0 + settings.DeviceDriftPpm / 1000000.0) / (1000.0 * settings.FramesPerMs);
+    m_periodUs = (double)m_periodFrames * 1000000.0 / settings.SampleRate;
+
+    // Each feedback value stands for one millisecond, as with a bInterval of 4 at high speed and 1 at full speed.
+    m_feedbackValueShift = highSpeed ? 3 : 0;
+    if (highSpeed)
+    {
+        m_feedbackFilter.Reset(16, m_feedbackValueShift, (ULONG)(((ULONGLONG)settings.SampleRate << 16) / 8000));
+    }
+    else
+    {
+        m_feedbackFilter.Reset(14, m_feedbackValueShift, (ULONG)(((ULONGLONG)settings.SampleRate << 14) / 1000));
+    }
+    m_lastFeedbackSize = (ULONG)((ULONGLONG)settings.SampleRate * m_classicFramesPerIrp / 1000);
+
+    m_result.PeriodFrames = row.PeriodFrames;
+    m_result.ClassicFramesPerIrp = m_classicFramesPerIrp;
+    m_result.InputOffsetFrame = m_inputOffsetFrame;
+    m_result.OutputOffsetFrame = m_outputOffsetFrame;
+}
+
+void PipelineSimulator::Schedule(
+    double    timeUs,
+    EventType type,
+    LONGLONG  index
+)
+{
+    m_events.push(Event{timeUs, m_eventOrder++, type, index});
+}
+
+double PipelineSimulator::GetPacketTimeUs(
+    LONGLONG packet
+) const
+{
+    return m_startUs + (double)packet * m_packetPeriodUs;
+}
+
+LONGLONG PipelineSimulator::GetBusPacket(
+    double timeUs
+) const
+{
+    return (LONGLONG)std::floor((timeUs - m_startUs) / m_packetPeriodUs);
+}
+
+ULONG PipelineSimulator::GetInputSamples(
+    LONGLONG packet
+) const
+{
+    return (ULONG)(std::floor((double)(packet + 1) * m_samplesPerPacket) - std::floor((double)packet * m_samplesPerPacket));
+}
+
+double PipelineSimulator::GetCompletionTimeUs(
+    LONGLONG irp,
+    double & lastCompletionUs
+)
+{
+    // Completions of a pipe are observed in order.
+    ULONG  jitterUs = (m_settings.CompletionJitterUs != 0) ? (ULONG)(m_random() % (m_settings.CompletionJitterUs + 1)) : 0;
+    double completionUs = GetPacketTimeUs((irp + 1) * m_packetsPerIrp) + jitterUs;
+
+    lastCompletionUs = max(lastCompletionUs, completionUs);
+    return lastCompletionUs;
+}
+
+bool PipelineSimulator::IsUrbLost()
+{
+    return (m_settings.UrbLossRate > 0.0) && (std::uniform_real_distribution<double>(0.0, 1.0)(m_random) < m_settings.UrbLossRate);
+}
+
+void PipelineSimulator::WakeThread(
+    double causeTimeUs
+)
+{
+    double latencyUs = m_settings.WakeLatencyUs + m_wakeLatency(m_random);
+
+    if ((m_settings.WakeSpikeRate > 0.0) && (std::uniform_real_distribution<double>(0.0, 1.0)(m_random) < m_settings.WakeSpikeRate))
+    {
+        latencyUs += m_settings.WakeSpikeUs;
+    }
+    if (!m_stallInjected && (m_settings.StallAtSeconds > 0.0) && (causeTimeUs >= m_startUs + m_settings.StallAtSeconds * 1000000.0))
+    {
+        // The thread does not run at all during a stall, whatever wakes it.
+        m_stallInjected = true;
+        m_stalledUntilUs = causeTimeUs + m_settings.StallUs;
+    }
+
+    // Wake-up causes that come before the thread runs are merged into one pass, as with the wake-up event.
+    double wakeUpUs = max(causeTimeUs + latencyUs, m_stalledUntilUs);
+    if ((m_pendingWakeUpUs >= 0.0) && (m_pendingWakeUpUs <= wakeUpUs))
+    {
+        return;
+    }
+    m_pendingWakeUpUs = wakeUpUs;
+    Schedule(wakeUpUs, EventType::WakeUp, (LONGLONG)++m_wakeUpGeneration);
+}
+
+SimulationResult PipelineSimulator::Run()
+{
+    // The OUT URBs that are submitted when the stream starts carry silence of the nominal size.
+    for (ULONG irp = 0; irp < m_numIrp; ++irp)
+    {
+        AssignOutputPackets(irp, m_lastFeedbackSize);
+    }
+
+    // The thread timer first expires after one URB, and each pass of the thread re-arms it.
+    Schedule(m_classicFramesPerIrp * 1000.0, EventType::Timer, (LONGLONG)m_timerGeneration);
+    Schedule(m_startUs - SIM_HOST_PREFETCH_US, EventType::Frame, 0);
+
+    while (!m_events.empty())
+    {
+        Event event = m_events.top();
+        m_events.pop();
+        if (event.TimeUs > m_endUs)
+        {
+            break;
+        }
+        m_nowUs = event.TimeUs;
+
+        switch (event.Type)
+        {
+        case EventType::Frame:
+            OnFrame(event.Index);
+            break;
+        case EventType::InCompletion:
+            OnInCompletion(event.Index);
+            break;
+        case EventType::OutCompletion:
+            OnOutCompletion(event.Index);
+            break;
+        case EventType::Timer:
+            if ((ULONGLONG)event.Index == m_timerGeneration)
+            {
+                WakeThread(m_nowUs);
+            }
+            break;
+        case EventType::WakeUp:
+            if ((ULONGLONG)event.Index == m_wakeUpGeneration)
+            {
+                m_pendingWakeUpUs = -1.0;
+                RunMixingEngine();
+            }
+            break;
+        case EventType::ClientDone:
+            OnClientDone(event.Index);
+            break;
+        }
+    }
+
+    if (m_latencyCount != 0)
+    {
+        m_result.InputLatencyUs = m_inputLatencySumUs / m_latencyCount;
+        m_result.OutputLatencyUs = m_outputLatencySumUs / m_latencyCount;
+        m_result.RoundTripUs = m_roundTripSumUs / m_latencyCount;
+    }
+    m_result.Notifications = m_asioNotifyCount;
+    m_result.FinalSafetyOffsetFrame = m_safetyOffsetController.GetOffsetFrame();
+    m_result.ClockDriftPpm = m_inputClockModel.GetDriftPpm();
+    m_result.ClockJitterUs = m_inputClockModel.GetJitterUs();
+    m_result.FeedbackMilliSamples = m_feedbackFilter.GetRateMilliSamples();
+
+    return m_result;
+}
+
+void PipelineSimulator::OnFrame(
+    LONGLONG packet
+)
+{
+    // The host controller fetches the OUT packet a little ahead of the bus. Packets before the thread has primed the pipe carry silence.
+    if (m_outputStarted && ((m_outputProcessedPacket < packet + 1) || ((m_outputProcessedPacket == packet + 1) && (m_outputRemainder != 0))))
+    {
+        m_result.Dropouts[toInt(SimDropout::OutUnderrun)]++;
+    }
+
+    // The device plays the OUT packet of this frame at its own clock.
+    m_deviceFifoSamples += (double)m_outPacketSamples[(size_t)packet] - m_samplesPerPacket;
+    bool slipping = (std::fabs(m_deviceFifoSamples) > m_samplesPerPacket + 1.0);
+    if (slipping && !m_deviceFifoSlipping)
+    {
+        m_result.Dropouts[toInt(SimDropout::DeviceFifo)]++;
+    }
+    m_deviceFifoSlipping = slipping;
+
+    LONGLONG nextPacket = packet + 1;
+    if ((nextPacket % m_packetsPerIrp) == 0)
+    {
+        LONGLONG irp = nextPacket / m_packetsPerIrp - 1;
+        Schedule(GetCompletionTimeUs(irp, m_lastInCompletionUs), EventType::InCompletion, irp);
+        Schedule(GetCompletionTimeUs(irp, m_lastOutCompletionUs), EventType::OutCompletion, irp);
+    }
+    Schedule(GetPacketTimeUs(nextPacket) - SIM_HOST_PREFETCH_US, EventType::Frame, nextPacket);
+}
+
+void PipelineSimulator::OnInCompletion(
+    LONGLONG irp
+)
+{
+    if (IsUrbLost())
+    {
+        m_result.Dropouts[toInt(SimDropout::UrbError)]++;
+    }
+    m_inCompletedPacket = (irp + 1) * m_packetsPerIrp;
+    m_inCompletedTimeUs = (ULONGLONG)std::llround(m_nowUs);
+
+    // URB completions wake the thread through the wake-up event.
+    WakeThread(m_nowUs);
+}
+
+void PipelineSimulator::OnOutCompletion(
+    LONGLONG irp
+)
+{
+    if (IsUrbLost())
+    {
+        m_result.Dropouts[toInt(SimDropout::UrbError)]++;
+    }
+
+    // The URB is resubmitted for the frames numIrp URBs later, sized from the feedback of the same frames.
+    // Without valid feedback the last size is used again.
+    ULONG validFeedback = ReadFeedback();
+    if (validFeedback != 0)
+    {
+        m_lastFeedbackSize = m_feedbackFilter.GetSamples(validFeedback);
+    }
+    AssignOutputPackets(irp + m_numIrp, m_lastFeedbackSize);
+}
+
+ULONG PipelineSimulator::ReadFeedback()
+{
+    if (IsUrbLost())
+    {
+        m_result.Dropouts[toInt(SimDropout::UrbError)]++;
+        return 0;
+    }
+
+    // The device measures its rate in samples per (micro)frame, with one unit of quantization noise.
+    const double scale = (m_settings.FramesPerMs > 1) ? 65536.0 : 16384.0;
+    const ULONG  values = max(m_packetsPerIrp >> m_feedbackValueShift, 1U);
+    for (ULONG value = 0; value < values; ++value)
+    {
+        double noise = std::uniform_real_distribution<double>(-1.0, 1.0)(m_random);
+        m_feedbackFilter.Add((ULONG)std::llround(m_samplesPerPacket * scale + noise));
+    }
+    return values;
+}
+
+void PipelineSimulator::OnClientDone(
+    LONGLONG buffer
+)
+{
+    m_clientOutputReady = true;
+
+    // The answer to buffer n is the ASIO half that becomes playable when n is ready, from (n + 2) periods on.
+    // Buffers whose input was lost to an overrun have no capture time and are left out of the latency.
+    if ((size_t)buffer < m_captureTimeUs.size() && (m_captureTimeUs[(size_t)buffer] != 0.0))
+    {
+        m_pendingOutputs.push_back(PendingOutput{(buffer + 2) * (LONGLONG)m_periodFrames, m_notifyTimeUs[(size_t)buffer], m_captureTimeUs[(size_t)buffer]});
+    }
+}
+
+void PipelineSimulator::AssignOutputPackets(
+    LONGLONG irp,
+    ULONG    samples
+)
+{
+    size_t first = (size_t)(irp * m_packetsPerIrp);
+    if (m_outPacketSamples.size() < first + m_packetsPerIrp)
+    {
+        m_outPacketSamples.resize(first + m_packetsPerIrp, 0);
+    }
+    for (ULONG packet = 0; packet < m_packetsPerIrp; ++packet)
+    {
+        m_outPacketSamples[first + packet] = samples / m_packetsPerIrp + ((packet < samples % m_packetsPerIrp) ? 1 : 0);
+    }
+}
+
+void PipelineSimulator::DeterminePacket()
+{
+    if (m_firstWakeUp)
+    {
+        m_inputClockModel.Reset(m_settings.FramesPerMs, m_packetsPerIrp);
+    }
+
+    if (m_inputSyncPacket != m_inCompletedPacket)
+    {
+        m_inputSyncPacket = m_inCompletedPacket;
+        m_inputClockModel.Update(m_inCompletedTimeUs, m_inCompletedPacket);
+    }
+
+    m_inputEstimatedPacket = StreamTiming::EstimateInputPacket(m_inputClockModel, (ULONGLONG)std::llround(m_nowUs), m_packetsPerIrp, m_inputSyncPacket, m_inputEstimatedPacket);
+}
+
+SimLoopReason PipelineSimulator::ProcessInput(
+    bool handleAsioBuffer
+)
+{
+    // The bus refills a URB numIrp URBs after it was last filled. Packets the thread did not get to before are lost.
+    LONGLONG oldestValidPacket = (GetBusPacket(m_nowUs) / m_packetsPerIrp - m_numIrp + 1) * m_packetsPerIrp;
+    if (m_inputProcessedPacket < oldestValidPacket)
+    {
+        m_result.Dropouts[toInt(SimDropout::InOverrun)] += (ULONGLONG)(oldestValidPacket - m_inputProcessedPacket);
+        for (; m_inputProcessedPacket < oldestValidPacket; ++m_inputProcessedPacket)
+        {
+            if (handleAsioBuffer)
+            {
+                m_inputAsioBufferedPosition += GetInputSamples(m_inputProcessedPacket);
+            }
+        }
+        m_inputRemainder = 0;
+    }
+
+    for (ULONG inBuffersCount = 0; inBuffersCount < m_packetsPerIrp * m_numIrp; ++inBuffersCount)
+    {
+        if (StreamTiming::IsInputPacketAtEstimatedPosition(m_inputProcessedPacket, m_inputOffsetFrame, m_inputEstimatedPacket))
+        {
+            return SimLoopReason::ExitLoopPacketEstimateReached;
+        }
+
+        bool     isRemainder = (m_inputRemainder != 0);
+        LONGLONG packet = isRemainder ? (m_inputProcessedPacket - 1) : m_inputProcessedPacket;
+        ULONG    samples = isRemainder ? m_inputRemainder : GetInputSamples(packet);
+        bool     atAsioBoundary = false;
+
+        if (handleAsioBuffer)
+        {
+            LONG asioRemainSamples = (LONG)((m_asioReadyPosition + m_periodFrames) - m_inputAsioBufferedPosition);
+            if (asioRemainSamples <= 0)
+            {
+                return SimLoopReason::ExitLoopNoMoreAsioBuffers;
+            }
+            ULONG handed = samples;
+            if ((ULONG)asioRemainSamples < samples)
+            {
+                handed = (ULONG)asioRemainSamples;
+                atAsioBoundary = true;
+            }
+
+            // The capture time of the first sample of each ASIO buffer.
+            LONGLONG nextBuffer = (m_inputAsioBufferedPosition + m_periodFrames - 1) / m_periodFrames;
+            for (; nextBuffer * (LONGLONG)m_periodFrames < m_inputAsioBufferedPosition + handed; ++nextBuffer)
+            {
+                if (m_captureTimeUs.size() <= (size_t)nextBuffer)
+                {
+                    m_captureTimeUs.resize((size_t)nextBuffer + 1, 0.0);
+                }
+                m_captureTimeUs[(size_t)nextBuffer] = GetPacketTimeUs(packet);
+            }
+            m_inputAsioBufferedPosition += handed;
+            m_inputRemainder = samples - handed;
+        }
+        else
+        {
+            m_inputRemainder = 0;
+        }
+
+        if (!isRemainder)
+        {
+            ++m_inputProcessedPacket;
+        }
+        ++m_inBuffersTotalCount;
+
+        if (atAsioBoundary)
+        {
+            return SimLoopReason::ExitLoopAtAsioBoundary;
+        }
+    }
+
+    return SimLoopReason::ContinueLoop;
+}
+
+SimLoopReason PipelineSimulator::ProcessOutput(
+    bool handleAsioBuffer
+)
+{
+    const ULONG    outLimit = (m_numIrp - 1) * m_packetsPerIrp;
+    const LONGLONG playReadyPosition = m_asioReadyPosition + (LONGLONG)m_periodFrames * (m_clientOutputReady ? 2 : 1);
+
+    for (ULONG outBuffersCount = 0; outBuffersCount < outLimit; ++outBuffersCount)
+    {
+        if (!m_safetyOffsetApplied)
+        {
+            // The ASIO client is attached from the start, so the offset does not include the extra URB used without it.
+            if (StreamTiming::IsSafetyOffsetReached(m_outBuffersTotalCount, 1, m_packetsPerIrp, m_inputOffsetFrame, m_safetyOffsetController.GetOffsetFrame(), true))
+            {
+                m_safetyOffsetApplied = true;
+                m_outputStarted = true;
+                return SimLoopReason::ExitLoopAfterSafetyOffset;
+            }
+        }
+        else if (!handleAsioBuffer && StreamTiming::IsOutputInSyncWithInput(m_inBuffersTotalCount, m_outBuffersTotalCount, 1, 1))
+        {
+            return SimLoopReason::ExitLoopAtInSync;
+        }
+
+        if (StreamTiming::IsOutputPacketOverlapWithEstimatePosition(m_outputProcessedPacket, m_inputEstimatedPacket, outLimit, 1, 1))
+        {
+            return SimLoopReason::ExitLoopToPreventOutOverlap;
+        }
+
+        bool     isRemainder = (m_outputRemainder != 0);
+        LONGLONG packet = isRemainder ? (m_outputProcessedPacket - 1) : m_outputProcessedPacket;
+        if (m_outPacketSamples.size() <= (size_t)packet)
+        {
+            // The URB of this packet has not been submitted yet.
+            return SimLoopReason::ExitLoopToPreventOutOverlap;
+        }
+        ULONG samples = isRemainder ? m_outputRemainder : m_outPacketSamples[(size_t)packet];
+        bool  atAsioBoundary = false;
+
+        if (handleAsioBuffer)
+        {
+            LONG asioRemain = (LONG)(playReadyPosition - m_outputAsioBufferedPosition);
+            if (asioRemain <= 0)
+            {
+                return SimLoopReason::ExitLoopNoMoreAsioBuffers;
+            }
+            ULONG taken = samples;
+            if ((ULONG)asioRemain < samples)
+            {
+                taken = (ULONG)asioRemain;
+                atAsioBoundary = true;
+            }
+
+            // The first sample of each answer of the client reaches the bus with this packet.
+            while (!m_pendingOutputs.empty() && (m_pendingOutputs.front().ReadPosition < m_outputAsioBufferedPosition + taken))
+            {
+                const PendingOutput & output = m_pendingOutputs.front();
+                double                playUs = GetPacketTimeUs(packet);
+                m_inputLatencySumUs += output.NotifyTimeUs - output.CaptureTimeUs;
+                m_outputLatencySumUs += playUs - output.NotifyTimeUs;
+                m_roundTripSumUs += playUs - output.CaptureTimeUs;
+                m_result.MaxRoundTripUs = max(m_result.MaxRoundTripUs, playUs - output.CaptureTimeUs);
+                m_latencyCount++;
+                m_pendingOutputs.pop_front();
+            }
+            m_outputAsioBufferedPosition += taken;
+            m_outputRemainder = samples - taken;
+        }
+        else
+        {
+            m_outputRemainder = 0;
+        }
+
+        if (!isRemainder)
+        {
+            ++m_outputProcessedPacket;
+        }
+        ++m_outBuffersTotalCount;
+
+        if (atAsioBoundary)
+        {
+            return SimLoopReason::ExitLoopAtAsioBoundary;
+        }
+    }
+
+    return SimLoopReason::ContinueLoop;
+}
+
+void PipelineSimulator::CheckSafetyOffset()
+{
+    ULONG outMinOffsetFrame = StreamTiming::CalculateMinSafetyOffsetFrame(m_safetyOffsetController.GetOffsetFrame(), m_numIrp, m_packetsPerIrp);
+    LONG  safetyOffset = StreamTiming::CalculateSafetyOffset(m_outputProcessedPacket, m_inputProcessedPacket, m_inputOffsetFrame, m_packetsPerIrp);
+    m_safetyOffsetController.RecordSafetyOffset(safetyOffset);
+    if (safetyOffset < (LONG)outMinOffsetFrame)
+    {
+        m_result.Dropouts[toInt(SimDropout::SafetyOffset)]++;
+        m_safetyOffsetController.BackOff((ULONGLONG)std::llround(m_nowUs));
+    }
+    else
+    {
+        m_safetyOffsetController.Update((ULONGLONG)std::llround(m_nowUs));
+    }
+}
+
+void PipelineSimulator::EvaluateAsioNotification()
+{
+    // As in AsioBufferObject::EvaluatePositionAndNotifyIfNeeded, for a device with both directions.
+    if (!StreamTiming::IsAsioNotifyDue(m_inputAsioBufferedPosition, m_outputAsioBufferedPosition, m_notifyPosition, m_periodFrames, true, true))
+    {
+        return;
+    }
+
+    LONGLONG buffer = m_notifyPosition / m_periodFrames;
+    m_notifyPosition += m_periodFrames;
+
+    LONG measuredPeriodUs = (LONG)(m_nowUs - m_lastAsioNotifyUs);
+    LONG thresholdUs = StreamTiming::CalculateCallbackPeriodThresholdUs(m_settings.SampleRate, m_periodFrames, m_outputDriverBuffer);
+    if ((m_asioNotifyCount >= 2) && (measuredPeriodUs > thresholdUs))
+    {
+        m_result.Dropouts[toInt(SimDropout::CallbackPeriod)]++;
+    }
+
+    if (m_notifyTimeUs.size() <= (size_t)buffer)
+    {
+        m_notifyTimeUs.resize((size_t)buffer + 1, 0.0);
+    }
+    m_notifyTimeUs[(size_t)buffer] = m_nowUs;
+    m_lastAsioNotifyUs = m_nowUs;
+    m_asioNotifyCount++;
+    m_clientOutputReady = false;
+    m_outputReadyInThisPeriod = false;
+
+    // The client counts the buffer as ready when its callback starts and flags OutputReady when it returns.
+    m_readyBuffers++;
+
+    double load = m_settings.ClientLoadPercent / 100.0 * std::uniform_real_distribution<double>(0.9, 1.1)(m_random);
+    Schedule(m_nowUs + m_periodUs * load, EventType::ClientDone, buffer);
+}
+
+void PipelineSimulator::ScheduleWakeUp(
+    bool waitingForOutputReady
+)
+{
+    // As in StreamObject::CalculateNextWakeUpIntervalUs and MixingEngineThread::ScheduleWakeUp.
+    ULONGLONG currentTimeUs = (ULONGLONG)std::llround(m_nowUs);
+    LONG      intervalUs = StreamTiming::CalculateNextWakeUpIntervalUs(m_inputClockModel, m_settings.FramesPerMs, m_inCompletedTimeUs, currentTimeUs, waitingForOutputReady, (ULONGLONG)std::llround(m_lastAsioNotifyUs), m_clientProcessingTimeUs);
+
+    intervalUs = StreamTiming::ClampWakeUpIntervalUs(intervalUs, SIM_WAKE_UP_INTERVAL_MIN_US, (LONG)m_busIntervalUs);
+
+    ++m_timerGeneration;
+    Schedule(m_nowUs + intervalUs, EventType::Timer, (LONGLONG)m_timerGeneration);
+}
+
+void PipelineSimulator::RunMixingEngine()
+{
+    const ULONGLONG currentTimeUs = (ULONGLONG)std::llround(m_nowUs);
+
+    m_result.Wakes++;
+
+    if (m_firstWakeUp)
+    {
+        m_safetyOffsetController.Reset(m_outputOffsetFrame, m_outputMinOffsetFrame, m_settings.FramesPerMs, m_settings.AdaptiveSafetyOffset, currentTimeUs);
+    }
+
+    LONG elapsedTimeUs = StreamTiming::CalculateThreadElapsedTimeUs(currentTimeUs, m_inCompletedTimeUs, currentTimeUs - m_lastWakeUpTimeUs);
+    m_lastWakeUpTimeUs = currentTimeUs;
+    if ((m_asioNotifyCount > 1) && (m_inCompletedTimeUs != 0ULL) && (elapsedTimeUs > (LONG)StreamTiming::CalculateDropoutThresholdTime(m_classicFramesPerIrp)))
+    {
+        m_result.Dropouts[toInt(SimDropout::LateWake)]++;
+    }
+
+    m_asioReadyPosition += (LONGLONG)m_readyBuffers * m_periodFrames;
+    m_readyBuffers = 0;
+    if (m_clientOutputReady && !m_outputReadyInThisPeriod)
+    {
+        m_outputReadyInThisPeriod = true;
+        m_clientProcessingTimeUs = (LONG)(m_nowUs - m_lastAsioNotifyUs);
+        if (m_clientProcessingTimeUs > StreamTiming::CalculateClientProcessingThresholdUs(m_periodFrames, m_settings.SampleRate))
+        {
+            m_result.Dropouts[toInt(SimDropout::ClientLate)]++;
+        }
+    }
+
+    if ((m_inCompletedPacket != m_inputSyncPacket) && (m_inCompletedTimeUs != 0ULL))
+    {
+        m_safetyOffsetController.RecordWakeLatency((LONG)((LONGLONG)currentTimeUs - (LONGLONG)m_inCompletedTimeUs));
+    }
+    DeterminePacket();
+
+    const bool    handleAsioBuffer = !m_firstWakeUp;
+    SimLoopReason inLoopExitReason = ProcessInput(handleAsioBuffer);
+    SimLoopReason outLoopExitReason = ProcessOutput(handleAsioBuffer);
+    m_result.InLoopReasons[toInt(inLoopExitReason)]++;
+    m_result.OutLoopReasons[toInt(outLoopExitReason)]++;
+
+    CheckSafetyOffset();
+    EvaluateAsioNotification();
+
+    m_firstWakeUp = false;
+    ScheduleWakeUp((m_asioNotifyCount != 0) && !m_outputReadyInThisPeriod);
+}
+
+static void PrintReasons(
+    const ULONGLONG * reasons
+)
+{
+    ULONGLONG total = 0;
+    for (ULONG reason = 0; reason < toInt(SimLoopReason::NumOfReasons); ++reason)
+    {
+        total += reasons[reason];
+    }
+    for (ULONG reason = 0; reason < toInt(SimLoopReason::NumOfReasons); ++reason)
+    {
+        if (reasons[reason] * 100 >= total)
+        {
+            printf(" %s %llu%%", c_loopReasonNames[reason], (unsigned long long)(reasons[reason] * 100 / max(total, 1ULL)));
+        }
+    }
+}
+
+static void PrintResult(
+    const SimulationSettings & settings,
+    const SimulationResult &   result
+)
+{
+    printf("%5u %2u %3u %3u | %6.0f /s |", result.PeriodFrames, result.ClassicFramesPerIrp, result.InputOffsetFrame, result.OutputOffsetFrame, (double)result.Wakes / settings.Seconds);
+    for (ULONG dropout = 0; dropout < toInt(SimDropout::NumOfDropouts); ++dropout)
+    {
+        printf(" %llu", (unsigned long long)result.Dropouts[dropout]);
+    }
+    printf(" | %6.2f %6.2f %6.2f %6.2f ms | offset %u, drift %d ppm, jitter %u us |", result.InputLatencyUs / 1000.0, result.OutputLatencyUs / 1000.0, result.RoundTripUs / 1000.0, result.MaxRoundTripUs / 1000.0, result.FinalSafetyOffsetFrame, result.ClockDriftPpm, result.ClockJitterUs);
+    printf(" IN");
+    PrintReasons(result.InLoopReasons);
+    printf(" | OUT");
+    PrintReasons(result.OutLoopReasons);
+    printf("\n");
+}
+
+static std::vector<SimulationResult> RunScenario(
+    const SimulationSettings & settings
+)
+{
+    std::vector<SimulationResult> results;
+
+    printf("\n%s: %u (micro)frames/ms, %u Hz, %u URBs, bus %.0f ppm, device %.0f ppm, completion jitter %u us, loss %g, wake %u+%u us, spikes %g x %u us, client %u%%\n", settings.Name, settings.FramesPerMs, settings.SampleRate, settings.MaxIrpNumber, settings.BusDriftPpm, settings.DeviceDriftPpm, settings.CompletionJitterUs, settings.UrbLossRate, settings.WakeLatencyUs, settings.WakeLatencyMeanUs, settings.WakeSpikeRate, settings.WakeSpikeUs, settings.ClientLoadPercent);
+    printf("period irp in out | wakes     | dropouts:");
+    for (const char * name : c_dropoutNames)
+    {
+        printf(" %s", name);
+    }
+    printf(" | latency in, out, round trip, max round trip | loop exit reasons\n");
+
+    for (const UAC_DRIVER_FLAGS & row : g_DriverSettingsTable)
+    {
+        PipelineSimulator simulator(settings, row);
+        SimulationResult  result = simulator.Run();
+        PrintResult(settings, result);
+        results.push_back(result);
+    }
+
+    return results;
+}
+
+static void CheckNominal(
+    const SimulationSettings &            settings,
+    const std::vector<SimulationResult> & results
+)
+{
+    for (const SimulationResult & result : results)
+    {
+        // A period shorter than a packet is answered from more than one ASIO buffer per packet, which the OUT offsets of the table
+        // do not cover. Those rows are reported but not checked; see test/README.md.
+        ULONG periodFrames = (result.PeriodFrames != 0) ? result.PeriodFrames : SIM_UNLISTED_PERIOD_FRAMES;
+        if ((ULONGLONG)periodFrames * 1000 * settings.FramesPerMs < settings.SampleRate)
+        {
+            continue;
+        }
+        TEST_CHECK_MESSAGE(result.GetTotalDropouts() == 0, "%s, period %u: %llu dropouts", settings.Name, result.PeriodFrames, (unsigned long long)result.GetTotalDropouts());
+        TEST_CHECK_MESSAGE(result.Notifications * 100 >= (ULONGLONG)settings.Seconds * settings.SampleRate / periodFrames * 95, "%s, period %u: %llu notifications", settings.Name, result.PeriodFrames, (unsigned long long)result.Notifications);
+
+        // The answer to a buffer reaches the bus within two periods plus the driver's offsets and a few URBs.
+        double boundUs = 2.0 * periodFrames * 1000000.0 / settings.SampleRate + (result.InputOffsetFrame + result.OutputOffsetFrame + 4 * result.ClassicFramesPerIrp * settings.FramesPerMs) * (1000.0 / settings.FramesPerMs);
+        TEST_CHECK_MESSAGE((result.RoundTripUs > 0.0) && (result.MaxRoundTripUs <= boundUs), "%s, period %u: round trip %.0f us, max %.0f us, bound %.0f us", settings.Name, result.PeriodFrames, result.RoundTripUs, result.MaxRoundTripUs, boundUs);
+    }
+}
+
+int main(
+    int    argc,
+    char * argv[]
+)
+{
+    ULONG seconds = (argc > 1) ? (ULONG)atoi(argv[1]) : SIM_DEFAULT_SECONDS;
+    if (seconds == 0)
+    {
+        seconds = SIM_DEFAULT_SECONDS;
+    }
+
+    const SimulationSettings highSpeed = {"high speed, nominal", 8, 48000, UAC_DEFAULT_MAX_IRP_NUMBER, 20.0, 150.0, 100, 0.0, 10, 15, 0.0, 0, 50, 0, 0.0, 0, seconds, 1};
+    const SimulationSettings fullSpeed = {"full speed, nominal", 1, 44100, UAC_DEFAULT_MAX_IRP_NUMBER, -20.0, -150.0, 200, 0.0, 10, 15, 0.0, 0, 50, 0, 0.0, 0, seconds, 2};
+    const SimulationSettings stressed = {"high speed, stressed", 8, 48000, UAC_DEFAULT_MAX_IRP_NUMBER, 50.0, 500.0, 300, 0.0005, 20, 40, 0.001, 1500, 70, 0, 0.0, 0, seconds, 3};
+    const SimulationSettings stalled = {"high speed, one 8 ms stall", 8, 48000, UAC_DEFAULT_MAX_IRP_NUMBER, 20.0, 150.0, 100, 0.0, 10, 15, 0.0, 0, 50, 0, 1.0, 8000, seconds, 4};
+
+    CheckNominal(highSpeed, RunScenario(highSpeed));
+    CheckNominal(fullSpeed, RunScenario(fullSpeed));
+    RunScenario(stressed);
+
+    // An 8 ms stall of the thread loses packets on the bus in every row, and the driver's elapsed time check has to report it.
+    // The completion routines keep running during the stall, so it is the time since the previous wake that exceeds the threshold.
+    std::vector<SimulationResult> stalledResults = RunScenario(stalled);
+    for (const SimulationResult & result : stalledResults)
+    {
+        TEST_CHECK_MESSAGE(result.Dropouts[toInt(SimDropout::InOverrun)] + result.Dropouts[toInt(SimDropout::OutUnderrun)] != 0, "%s, period %u: stall not simulated", stalled.Name, result.PeriodFrames);
+        TEST_CHECK_MESSAGE(result.Dropouts[toInt(SimDropout::LateWake)] != 0, "%s, period %u: stall not reported by the driver", stalled.Name, result.PeriodFrames);
+    }
+
+    return TestResult("PipelineSimulator");
+}
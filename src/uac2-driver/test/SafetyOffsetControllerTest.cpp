@@ -0,0 +1,273 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+// ASIO is a trademark and software of Steinberg Media Technologies GmbH
+
+/*++
+
+Module Name:
+
+    SafetyOffsetControllerTest.cpp
+
+Abstract:
+
+    Drive SafetyOffsetController with synthetic wake latencies, quiet
+    periods and dropouts. Check that the offset is lowered by one packet
+    per quiet period, that a dropout raises it once per back-off hold, and
+    that it never goes below the offset that dropped out or the wake
+    latency quantile.
+
+Environment:
+
+    User mode (host build only)
+
+--*/
+
+#include "HostCompat.h"
+#include "SafetyOffsetController.h"
+#include "TestCommon.h"
+
+#define TEST_QUIET_PERIOD_SECONDS 2
+#define TEST_QUIET_PERIOD_US      (TEST_QUIET_PERIOD_SECONDS * 1000000ULL)
+#define TEST_START_US             1000000ULL
+#define TEST_WAKE_LATENCIES       1000 // Enough for the 99.9th percentile
+
+static void RecordWakeLatencies(
+    SafetyOffsetController & controller,
+    ULONG                    count,
+    LONG                     wakeLatencyUs
+)
+{
+    for (ULONG i = 0; i < count; ++i)
+    {
+        controller.RecordWakeLatency(wakeLatencyUs);
+    }
+}
+
+//
+// Calls Update once per quiet period until the offset stops moving, and
+// returns the offset it stopped at.
+//
+static ULONG StepDown(
+    SafetyOffsetController & controller,
+    ULONGLONG &              currentTimeUs
+)
+{
+    for (;;)
+    {
+        currentTimeUs += TEST_QUIET_PERIOD_US;
+        ULONG previousOffsetFrame = controller.GetOffsetFrame();
+        if (!controller.Update(currentTimeUs))
+        {
+            TEST_CHECK(controller.GetOffsetFrame() == previousOffsetFrame);
+            return controller.GetOffsetFrame();
+        }
+        TEST_CHECK(controller.GetOffsetFrame() == previousOffsetFrame - 1);
+    }
+}
+
+//
+// One packet per quiet period, never within a period, down to the minimum
+// offset. Without the registry value the offset never moves.
+//
+static void TestQuietPeriodStepping()
+{
+    SafetyOffsetController controller;
+    ULONGLONG              currentTimeUs = TEST_START_US;
+
+    controller.Reset(24, 8, 8, TEST_QUIET_PERIOD_SECONDS, currentTimeUs);
+    RecordWakeLatencies(controller, TEST_WAKE_LATENCIES, 50);
+    TEST_CHECK(controller.GetOffsetFrame() == 24);
+
+    TEST_CHECK(!controller.Update(currentTimeUs + TEST_QUIET_PERIOD_US - 1));
+    TEST_CHECK(controller.Update(currentTimeUs + TEST_QUIET_PERIOD_US));
+    TEST_CHECK(controller.GetOffsetFrame() == 23);
+    currentTimeUs += TEST_QUIET_PERIOD_US;
+
+    // The next quiet period starts at the change, not at the previous deadline.
+    TEST_CHECK(!controller.Update(currentTimeUs + TEST_QUIET_PERIOD_US / 2));
+    TEST_CHECK(controller.GetOffsetFrame() == 23);
+
+    TEST_CHECK_MESSAGE(StepDown(controller, currentTimeUs) == 8, "stopped at %u frames", controller.GetOffsetFrame());
+
+    // Disabled: dropouts are counted, the offset stays where it is configured.
+    controller.Reset(24, 8, 8, 0, TEST_START_US);
+    RecordWakeLatencies(controller, TEST_WAKE_LATENCIES, 50);
+    TEST_CHECK(!controller.Update(TEST_START_US + 100 * TEST_QUIET_PERIOD_US));
+    TEST_CHECK(!controller.BackOff(TEST_START_US + 101 * TEST_QUIET_PERIOD_US));
+    TEST_CHECK(controller.GetOffsetFrame() == 24);
+
+    UAC_SAFETY_OFFSET_CONTEXT context{};
+    controller.GetContext(&context);
+    TEST_CHECK((context.QuietPeriodSeconds == 0) && (context.ConfiguredOffsetFrame == 24) && (context.CurrentOffsetFrame == 24) && (context.Dropouts == 1));
+
+    // A minimum above the configured offset is clamped to it.
+    controller.Reset(4, 8, 8, TEST_QUIET_PERIOD_SECONDS, TEST_START_US);
+    controller.GetContext(&context);
+    TEST_CHECK(context.MinimumOffsetFrame == 4);
+}
+
+//
+// Nothing is lowered before there are enough wake latencies for the
+// quantile.
+//
+static void TestTooFewWakeLatencies()
+{
+    SafetyOffsetController controller;
+    ULONGLONG              currentTimeUs = TEST_START_US;
+
+    controller.Reset(24, 8, 8, TEST_QUIET_PERIOD_SECONDS, currentTimeUs);
+    RecordWakeLatencies(controller, TEST_WAKE_LATENCIES - 1, 50);
+    TEST_CHECK(StepDown(controller, currentTimeUs) == 24);
+
+    controller.RecordWakeLatency(50);
+    TEST_CHECK(StepDown(controller, currentTimeUs) == 8);
+}
+
+//
+// A dropout raises the offset by 1 ms at once. Further dropouts within
+// SAFETY_OFFSET_BACK_OFF_HOLD_US are counted but do not raise it again.
+//
+static void TestBackOffHold()
+{
+    SafetyOffsetController controller;
+    ULONGLONG              currentTimeUs = TEST_START_US;
+
+    controller.Reset(40, 8, 8, TEST_QUIET_PERIOD_SECONDS, currentTimeUs);
+    RecordWakeLatencies(controller, TEST_WAKE_LATENCIES, 50);
+    for (ULONG step = 0; step < 20; ++step)
+    {
+        currentTimeUs += TEST_QUIET_PERIOD_US;
+        TEST_CHECK(controller.Update(currentTimeUs));
+    }
+    TEST_CHECK(controller.GetOffsetFrame() == 20);
+
+    currentTimeUs += 1000;
+    TEST_CHECK(controller.BackOff(currentTimeUs));
+    TEST_CHECK(controller.GetOffsetFrame() == 28);
+
+    TEST_CHECK(!controller.BackOff(currentTimeUs + 1));
+    TEST_CHECK(!controller.BackOff(currentTimeUs + SAFETY_OFFSET_BACK_OFF_HOLD_US - 1));
+    TEST_CHECK(controller.GetOffsetFrame() == 28);
+
+    TEST_CHECK(controller.BackOff(currentTimeUs + SAFETY_OFFSET_BACK_OFF_HOLD_US));
+    TEST_CHECK(controller.GetOffsetFrame() == 36);
+    currentTimeUs += SAFETY_OFFSET_BACK_OFF_HOLD_US;
+
+    // Raised up to the configured offset, not past it.
+    TEST_CHECK(controller.BackOff(currentTimeUs + SAFETY_OFFSET_BACK_OFF_HOLD_US));
+    TEST_CHECK(controller.GetOffsetFrame() == 40);
+    currentTimeUs += SAFETY_OFFSET_BACK_OFF_HOLD_US;
+
+    // A back off restarts the quiet period.
+    TEST_CHECK(!controller.Update(currentTimeUs + TEST_QUIET_PERIOD_US - 1));
+
+    UAC_SAFETY_OFFSET_CONTEXT context{};
+    controller.GetContext(&context);
+    TEST_CHECK(context.Dropouts == 5);
+}
+
+//
+// After a dropout at a lowered offset, the offset never goes back down to
+// it. A dropout at the configured offset is not caused by the controller
+// and does not set a floor.
+//
+static void TestFailedOffsetFloor()
+{
+    SafetyOffsetController controller;
+    ULONGLONG              currentTimeUs = TEST_START_US;
+
+    controller.Reset(24, 4, 8, TEST_QUIET_PERIOD_SECONDS, currentTimeUs);
+    RecordWakeLatencies(controller, TEST_WAKE_LATENCIES, 50);
+
+    currentTimeUs += TEST_QUIET_PERIOD_US;
+    TEST_CHECK(!controller.BackOff(currentTimeUs));
+    TEST_CHECK(controller.GetOffsetFrame() == 24);
+
+    for (ULONG step = 0; step < 12; ++step)
+    {
+        currentTimeUs += TEST_QUIET_PERIOD_US;
+        TEST_CHECK(controller.Update(currentTimeUs));
+    }
+    TEST_CHECK(controller.GetOffsetFrame() == 12);
+
+    currentTimeUs += 1000;
+    TEST_CHECK(controller.BackOff(currentTimeUs));
+    TEST_CHECK(controller.GetOffsetFrame() == 20);
+    TEST_CHECK_MESSAGE(StepDown(controller, currentTimeUs) == 13, "stopped at %u frames", controller.GetOffsetFrame());
+
+    // A second dropout further up raises the floor.
+    TEST_CHECK(controller.BackOff(currentTimeUs + 1));
+    TEST_CHECK(controller.GetOffsetFrame() == 21);
+    currentTimeUs += 1;
+    TEST_CHECK_MESSAGE(StepDown(controller, currentTimeUs) == 14, "stopped at %u frames", controller.GetOffsetFrame());
+}
+
+//
+// The offset has to cover the 99.9th percentile of the wake latency, taken
+// at the upper edge of its histogram bucket.
+//
+static void TestWakeLatencyQuantileFloor()
+{
+    SafetyOffsetController controller;
+    ULONGLONG              currentTimeUs = TEST_START_US;
+
+    // Two late wakes in a thousand are above the quantile: 1250 us falls in the 1200-1300 us bucket, 11 microframes.
+    controller.Reset(24, 4, 8, TEST_QUIET_PERIOD_SECONDS, currentTimeUs);
+    RecordWakeLatencies(controller, TEST_WAKE_LATENCIES - 2, 50);
+    RecordWakeLatencies(controller, 2, 1250);
+    TEST_CHECK_MESSAGE(StepDown(controller, currentTimeUs) == 11, "stopped at %u frames", controller.GetOffsetFrame());
+
+    // One late wake in a thousand is within the quantile.
+    controller.Reset(24, 4, 8, TEST_QUIET_PERIOD_SECONDS, currentTimeUs);
+    RecordWakeLatencies(controller, TEST_WAKE_LATENCIES - 1, 50);
+    RecordWakeLatencies(controller, 1, 1250);
+    TEST_CHECK_MESSAGE(StepDown(controller, currentTimeUs) == 4, "stopped at %u frames", controller.GetOffsetFrame());
+
+    // At full speed a frame is 1 ms: 2300 us rounds up to 3 frames.
+    controller.Reset(6, 1, 1, TEST_QUIET_PERIOD_SECONDS, currentTimeUs);
+    RecordWakeLatencies(controller, TEST_WAKE_LATENCIES, 2250);
+    TEST_CHECK_MESSAGE(StepDown(controller, currentTimeUs) == 3, "stopped at %u frames", controller.GetOffsetFrame());
+
+    // Latencies past the histogram keep the offset in the last bucket.
+    controller.Reset(40, 4, 8, TEST_QUIET_PERIOD_SECONDS, currentTimeUs);
+    RecordWakeLatencies(controller, TEST_WAKE_LATENCIES, 1000000);
+    TEST_CHECK_MESSAGE(StepDown(controller, currentTimeUs) == (UAC_WAKE_LATENCY_HISTOGRAM_SIZE * UAC_WAKE_LATENCY_BUCKET_US * 8 + 999) / 1000, "stopped at %u frames", controller.GetOffsetFrame());
+}
+
+static void TestHistograms()
+{
+    SafetyOffsetController    controller;
+    UAC_SAFETY_OFFSET_CONTEXT context{};
+
+    controller.Reset(24, 8, 8, TEST_QUIET_PERIOD_SECONDS, TEST_START_US);
+    controller.RecordSafetyOffset(-3);
+    controller.RecordSafetyOffset(5);
+    controller.RecordSafetyOffset(UAC_SAFETY_OFFSET_HISTOGRAM_SIZE + 10);
+    controller.RecordWakeLatency(-1);
+    controller.RecordWakeLatency(150);
+    controller.RecordWakeLatency(UAC_WAKE_LATENCY_HISTOGRAM_SIZE * UAC_WAKE_LATENCY_BUCKET_US);
+    controller.GetContext(&context);
+
+    TEST_CHECK((context.SafetyOffsetHistogram[0] == 1) && (context.SafetyOffsetHistogram[5] == 1) && (context.SafetyOffsetHistogram[UAC_SAFETY_OFFSET_HISTOGRAM_SIZE - 1] == 1));
+    TEST_CHECK((context.WakeLatencyHistogram[0] == 1) && (context.WakeLatencyHistogram[1] == 1) && (context.WakeLatencyHistogram[UAC_WAKE_LATENCY_HISTOGRAM_SIZE - 1] == 1));
+
+    controller.Reset(24, 8, 8, TEST_QUIET_PERIOD_SECONDS, TEST_START_US);
+    controller.GetContext(&context);
+    TEST_CHECK((context.SafetyOffsetHistogram[5] == 0) && (context.WakeLatencyHistogram[1] == 0) && (context.Dropouts == 0));
+}
+
+int main()
+{
+    TestQuietPeriodStepping();
+    TestTooFewWakeLatencies();
+    TestBackOffHold();
+    TestFailedOffsetFloor();
+    TestWakeLatencyQuantileFloor();
+    TestHistograms();
+
+    return TestResult("SafetyOffsetControllerTest");
+}
@@ -0,0 +1,230 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+// ASIO is a trademark and software of Steinberg Media Technologies GmbH
+
+/*++
+
+Module Name:
+
+    SampleConverterBenchmark.cpp
+
+Abstract:
+
+    Measure the SampleConverter kernels against the per-sample scalar
+    references on cached buffers. The results are printed in nanoseconds
+    per frame; they are not checked, because they depend on the host.
+
+Environment:
+
+    User mode (host build only)
+
+--*/
+
+#include "HostCompat.h"
+#include "SampleConverter.h"
+#include "TestCommon.h"
+#include "SampleConverterReference.h"
+
+#define BENCHMARK_FRAMES     512
+#define BENCHMARK_ITERATIONS 2000
+
+typedef struct BENCHMARK_FORMAT_
+{
+    ULONG AsioSampleSize;
+    ULONG UsbBytesPerSample;
+} BENCHMARK_FORMAT;
+
+static const BENCHMARK_FORMAT c_formats[] = {{4, 4}, {4, 3}, {4, 2}, {2, 2}};
+static const ULONG            c_channelCounts[] = {2, 8, 32};
+
+template <typename Function>
+static double MeasureNsPerFrame(
+    Function function
+)
+{
+    function(); // warm up
+    auto start = std::chrono::steady_clock::now();
+    for (ULONG iteration = 0; iteration < BENCHMARK_ITERATIONS; ++iteration)
+    {
+        function();
+    }
+    return ElapsedNs(start) / ((double)BENCHMARK_ITERATIONS * BENCHMARK_FRAMES);
+}
+
+static void BenchmarkPlanarToInterleaved()
+{
+    printf("PlanarToInterleaved (ns/frame)\n");
+    printf("  asio usb channels  reference  converter\n");
+
+    for (const BENCHMARK_FORMAT & format : c_formats)
+    {
+        const ULONG asioSampleSize = format.AsioSampleSize;
+        const ULONG usbBytesPerSample = format.UsbBytesPerSample;
+
+        for (ULONG channels : c_channelCounts)
+        {
+            const ULONG        planarChannelStride = BENCHMARK_FRAMES * asioSampleSize;
+            const ULONG        bytesPerBlock = usbBytesPerSample * channels;
+            const ULONGLONG    channelsMap = (channels >= 64) ? ~0ULL : ((1ULL << channels) - 1);
+            std::vector<UCHAR> planar(planarChannelStride * channels);
+            std::vector<UCHAR> interleaved(bytesPerBlock * BENCHMARK_FRAMES);
+            FillRandom(planar, channels);
+
+            double reference = MeasureNsPerFrame([&]() {
+                ReferencePlanarToInterleaved(interleaved.data(), bytesPerBlock, usbBytesPerSample, channels, planar.data(), planarChannelStride, asioSampleSize, channels, channelsMap, 0, BENCHMARK_FRAMES);
+            });
+            double converter = MeasureNsPerFrame([&]() {
+                SampleConverter::PlanarToInterleaved(interleaved.data(), bytesPerBlock, usbBytesPerSample, channels, planar.data(), planarChannelStride, asioSampleSize, channels, channelsMap, 0, BENCHMARK_FRAMES);
+            });
+            printf("  %4u %3u %8u  %9.2f  %9.2f\n", asioSampleSize, usbBytesPerSample, channels, reference, converter);
+        }
+    }
+}
+
+static void BenchmarkInterleavedToPlanar()
+{
+    printf("InterleavedToPlanar (ns/frame)\n");
+    printf("  asio usb channels  reference  converter\n");
+
+    for (const BENCHMARK_FORMAT & format : c_formats)
+    {
+        const ULONG asioSampleSize = format.AsioSampleSize;
+        const ULONG usbBytesPerSample = format.UsbBytesPerSample;
+
+        for (ULONG channels : c_channelCounts)
+        {
+            const ULONG        planarChannelStride = BENCHMARK_FRAMES * asioSampleSize;
+            const ULONG        bytesPerBlock = usbBytesPerSample * channels;
+            const ULONGLONG    channelsMap = (channels >= 64) ? ~0ULL : ((1ULL << channels) - 1);
+            std::vector<UCHAR> planar(planarChannelStride * channels);
+            std::vector<UCHAR> interleaved(bytesPerBlock * BENCHMARK_FRAMES);
+            FillRandom(interleaved, channels);
+
+            double reference = MeasureNsPerFrame([&]() {
+                ReferenceInterleavedToPlanar(planar.data(), planarChannelStride, asioSampleSize, channels, channelsMap, 0, interleaved.data(), bytesPerBlock, usbBytesPerSample, channels, BENCHMARK_FRAMES);
+            });
+            double converter = MeasureNsPerFrame([&]() {
+                SampleConverter::InterleavedToPlanar(planar.data(), planarChannelStride, asioSampleSize, channels, channelsMap, 0, interleaved.data(), bytesPerBlock, usbBytesPerSample, channels, BENCHMARK_FRAMES);
+            });
+            printf("  %4u %3u %8u  %9.2f  %9.2f\n", asioSampleSize, usbBytesPerSample, channels, reference, converter);
+        }
+    }
+}
+
+static void BenchmarkMixFunction()
+{
+    printf("GetMixFunction, one channel of an interleaved stream (ns/frame)\n");
+    printf("  format channels  reference  kernel\n");
+
+    for (ULONG format = 0; format < 4; ++format)
+    {
+        const bool                isFloat = (format == 3);
+        const ULONG               bytesPerSample = isFloat ? 4 : format + 2;
+        const SAMPLE_MIX_FUNCTION mixSamples = SampleConverter::GetMixFunction(isFloat, bytesPerSample);
+
+        for (ULONG channels : c_channelCounts)
+        {
+            const ULONG        stride = bytesPerSample * channels;
+            std::vector<UCHAR> src(stride * BENCHMARK_FRAMES);
+            std::vector<UCHAR> dst(stride * BENCHMARK_FRAMES);
+            FillRandom(src, channels);
+
+            double reference = MeasureNsPerFrame([&]() {
+                RtlZeroMemory(dst.data(), dst.size());
+                ReferenceMixSamples(isFloat, bytesPerSample, dst.data(), stride, src.data(), stride, BENCHMARK_FRAMES);
+            });
+            double kernel = MeasureNsPerFrame([&]() {
+                RtlZeroMemory(dst.data(), dst.size());
+                mixSamples(dst.data(), stride, src.data(), stride, BENCHMARK_FRAMES);
+            });
+            printf("  %-6s %8u  %9.2f  %6.2f\n", isFloat ? "float" : (bytesPerSample == 2 ? "int16" : (bytesPerSample == 3 ? "int24" : "int32")), channels, reference, kernel);
+        }
+    }
+}
+
+static void BenchmarkCopyFunction()
+{
+    printf("GetCopyFunction, one channel of an interleaved stream (ns/frame)\n");
+    printf("  bytes channels  reference  kernel\n");
+
+    for (ULONG bytesPerSample = 2; bytesPerSample <= 4; ++bytesPerSample)
+    {
+        const SAMPLE_COPY_FUNCTION copySamples = SampleConverter::GetCopyFunction(false, bytesPerSample);
+
+        for (ULONG channels : c_channelCounts)
+        {
+            const ULONG        stride = bytesPerSample * channels;
+            std::vector<UCHAR> src(stride * BENCHMARK_FRAMES);
+            std::vector<UCHAR> dst(stride * BENCHMARK_FRAMES);
+            FillRandom(src, channels);
+
+            // The width is passed through a volatile, as the data format was read from the device context.
+            volatile ULONG runtimeBytesPerSample = bytesPerSample;
+            double         reference = MeasureNsPerFrame([&]() {
+                ReferenceCopySamples(runtimeBytesPerSample, dst.data(), stride, src.data(), stride, BENCHMARK_FRAMES);
+            });
+            double kernel = MeasureNsPerFrame([&]() {
+                copySamples(dst.data(), stride, src.data(), stride, BENCHMARK_FRAMES);
+            });
+            printf("  %5u %8u  %9.2f  %6.2f\n", bytesPerSample, channels, reference, kernel);
+        }
+    }
+}
+
+//
+// One WDM render packet of a multi-channel stream, mixed with the span mix
+// and with the per-channel loop that walked the whole USB buffer once per
+// channel before the frame-major mix.
+//
+static void BenchmarkMixChannelSpansToUsb()
+{
+    printf("MixChannelSpansToUsb, int24 identity routing (ns/frame)\n");
+    printf("  channels  per channel  spans\n");
+
+    const ULONG               bytesPerSample = 3;
+    const SAMPLE_MIX_FUNCTION mixSamples = SampleConverter::GetMixFunction(false, bytesPerSample);
+
+    for (ULONG channels : {2UL, 8UL, 32UL})
+    {
+        const ULONG        frameBytes = bytesPerSample * channels;
+        std::vector<UCHAR> src(frameBytes * BENCHMARK_FRAMES);
+        std::vector<UCHAR> dst(frameBytes * BENCHMARK_FRAMES);
+        LONG               routing[UAC_MAX_ASIO_CHANNELS];
+        CHANNEL_SPAN       spans[UAC_MAX_ASIO_CHANNELS];
+        FillRandom(src, channels);
+
+        for (ULONG ch = 0; ch < channels; ++ch)
+        {
+            routing[ch] = (LONG)ch;
+        }
+        const ULONG spanCount = SampleConverter::BuildChannelSpans(spans, routing, channels, ~0ULL, channels);
+
+        double perChannel = MeasureNsPerFrame([&]() {
+            for (ULONG ch = 0; ch < channels; ++ch)
+            {
+                ReferenceMixSamples(false, bytesPerSample, dst.data() + ch * bytesPerSample, frameBytes, src.data() + ch * bytesPerSample, frameBytes, BENCHMARK_FRAMES);
+            }
+        });
+        double spanMix = MeasureNsPerFrame([&]() {
+            SampleConverter::MixChannelSpansToUsb(dst.data(), bytesPerSample, channels, src.data(), bytesPerSample, channels, spans, spanCount, BENCHMARK_FRAMES, mixSamples);
+        });
+        printf("  %8u  %11.2f  %5.2f\n", channels, perChannel, spanMix);
+    }
+}
+
+int main()
+{
+    SampleConverter::Initialize();
+
+    BenchmarkPlanarToInterleaved();
+    BenchmarkInterleavedToPlanar();
+    BenchmarkMixFunction();
+    BenchmarkCopyFunction();
+    BenchmarkMixChannelSpansToUsb();
+
+    return 0;
+}
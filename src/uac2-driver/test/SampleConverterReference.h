@@ -0,0 +1,273 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+// ASIO is a trademark and software of Steinberg Media Technologies GmbH
+
+/*++
+
+Module Name:
+
+    SampleConverterReference.h
+
+Abstract:
+
+    Define per-sample scalar versions of the SampleConverter kernels. They
+    follow the loops that the driver used before the kernels were added and
+    serve as the expected results of the tests and the baseline of the
+    benchmarks.
+
+Environment:
+
+    User mode (host build only)
+
+--*/
+
+#ifndef _SAMPLE_CONVERTER_REFERENCE_H_
+#define _SAMPLE_CONVERTER_REFERENCE_H_
+
+//
+// The upper usbBytesPerSample bytes of every planar sample are copied one
+// sample at a time and one channel at a time, as CopyFromAsioToOutputData
+// did before the converter. The ASIO buffer is shared with the client, so
+// it is read through a volatile pointer.
+//
+inline void ReferencePlanarToInterleaved(
+    PUCHAR       interleaved,
+    ULONG        bytesPerBlock,
+    ULONG        usbBytesPerSample,
+    ULONG        usbChannels,
+    const BYTE * planar,
+    ULONG        planarChannelStride,
+    ULONG        asioSampleSize,
+    ULONG        asioChannels,
+    ULONGLONG    channelsMap,
+    ULONG        planarStartIndex,
+    ULONG        samples
+)
+{
+    const ULONG asioByteOffset = asioSampleSize - usbBytesPerSample;
+
+    for (ULONG ch = 0; ch < min(asioChannels, (ULONG)UAC_MAX_ASIO_CHANNELS); ++ch)
+    {
+        if ((ch >= usbChannels) || ((channelsMap & (1ULL << ch)) == 0))
+        {
+            continue;
+        }
+
+        volatile const BYTE * asioBuffer = planar + planarChannelStride * ch;
+        switch (usbBytesPerSample)
+        {
+        case 1:
+            for (ULONG index = 0; index < samples; ++index)
+            {
+                interleaved[index * bytesPerBlock + ch * usbBytesPerSample] = asioBuffer[(planarStartIndex + index) * asioSampleSize + asioByteOffset];
+            }
+            break;
+        case 2:
+            for (ULONG index = 0; index < samples; ++index)
+            {
+                *(UNALIGNED USHORT *)&(interleaved[index * bytesPerBlock + ch * usbBytesPerSample]) = *(volatile const UNALIGNED USHORT *)&(asioBuffer[(planarStartIndex + index) * asioSampleSize + asioByteOffset]);
+            }
+            break;
+        case 3:
+            for (ULONG index = 0; index < samples; ++index)
+            {
+                volatile const BYTE * src = &(asioBuffer[(planarStartIndex + index) * asioSampleSize + asioByteOffset]);
+                BYTE *                dst = &(interleaved[index * bytesPerBlock + ch * usbBytesPerSample]);
+                *dst++ = *src++;
+                *dst++ = *src++;
+                *dst++ = *src++;
+            }
+            break;
+        case 4:
+            for (ULONG index = 0; index < samples; ++index)
+            {
+                *(UNALIGNED ULONG *)&(interleaved[index * bytesPerBlock + ch * usbBytesPerSample]) = *(volatile const UNALIGNED ULONG *)&(asioBuffer[(planarStartIndex + index) * asioSampleSize + asioByteOffset]);
+            }
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+//
+// Copies one channel at a time as CopyToAsioFromInputData did before the
+// converter. The lower ASIO bytes not covered by the USB sample are cleared
+// per sample; the old loop cleared a contiguous range of the wrong length
+// instead, which the converter fixed, so that part is not reproduced.
+//
+inline void ReferenceInterleavedToPlanar(
+    PBYTE         planar,
+    ULONG         planarChannelStride,
+    ULONG         asioSampleSize,
+    ULONG         asioChannels,
+    ULONGLONG     channelsMap,
+    ULONG         planarStartIndex,
+    const UCHAR * interleaved,
+    ULONG         bytesPerBlock,
+    ULONG         usbBytesPerSample,
+    ULONG         usbChannels,
+    ULONG         samples
+)
+{
+    const ULONG asioByteOffset = asioSampleSize - usbBytesPerSample;
+
+    for (ULONG ch = 0; ch < min(asioChannels, (ULONG)UAC_MAX_ASIO_CHANNELS); ++ch)
+    {
+        if ((ch >= usbChannels) || ((channelsMap & (1ULL << ch)) == 0))
+        {
+            continue;
+        }
+
+        PBYTE asioBuffer = planar + planarChannelStride * ch;
+        for (ULONG index = 0; index < samples; ++index)
+        {
+            RtlZeroMemory(&(asioBuffer[(planarStartIndex + index) * asioSampleSize]), asioByteOffset);
+        }
+        switch (usbBytesPerSample)
+        {
+        case 1:
+            for (ULONG index = 0; index < samples; ++index)
+            {
+                asioBuffer[(planarStartIndex + index) * asioSampleSize + asioByteOffset] = interleaved[index * bytesPerBlock + ch * usbBytesPerSample];
+            }
+            break;
+        case 2:
+            for (ULONG index = 0; index < samples; ++index)
+            {
+                *(UNALIGNED USHORT *)&(asioBuffer[(planarStartIndex + index) * asioSampleSize + asioByteOffset]) = *(const UNALIGNED USHORT *)&(interleaved[index * bytesPerBlock + ch * usbBytesPerSample]);
+            }
+            break;
+        case 3:
+            for (ULONG index = 0; index < samples; ++index)
+            {
+                const BYTE * src = &(interleaved[index * bytesPerBlock + ch * usbBytesPerSample]);
+                BYTE *       dst = &(asioBuffer[(planarStartIndex + index) * asioSampleSize + asioByteOffset]);
+                *dst++ = *src++;
+                *dst++ = *src++;
+                *dst++ = *src++;
+            }
+            break;
+        case 4:
+            for (ULONG index = 0; index < samples; ++index)
+            {
+                *(UNALIGNED ULONG *)&(asioBuffer[(planarStartIndex + index) * asioSampleSize + asioByteOffset]) = *(const UNALIGNED ULONG *)&(interleaved[index * bytesPerBlock + ch * usbBytesPerSample]);
+            }
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+//
+// Adds one sample at a time and clamps the sum to the range of the sample
+// width, as the WDM render path did before the packed kernels.
+//
+inline void ReferenceMixSamples(
+    bool         isFloat,
+    ULONG        bytesPerSample,
+    PUCHAR       dst,
+    ULONG        dstStride,
+    const BYTE * src,
+    ULONG        srcStride,
+    ULONG        samples
+)
+{
+    for (ULONG index = 0; index < samples; ++index)
+    {
+        PUCHAR       dstSample = dst + index * dstStride;
+        const BYTE * srcSample = src + index * srcStride;
+
+        if (isFloat)
+        {
+            *(UNALIGNED float *)dstSample = *(const UNALIGNED float *)dstSample + *(const UNALIGNED float *)srcSample;
+            continue;
+        }
+
+        LONGLONG a = 0;
+        LONGLONG b = 0;
+        switch (bytesPerSample)
+        {
+        case 2:
+            a = *(const UNALIGNED SHORT *)dstSample;
+            b = *(const UNALIGNED SHORT *)srcSample;
+            break;
+        case 3:
+            a = (LONG)(((ULONG)dstSample[0] << 8) | ((ULONG)dstSample[1] << 16) | ((ULONG)dstSample[2] << 24)) >> 8;
+            b = (LONG)(((ULONG)srcSample[0] << 8) | ((ULONG)srcSample[1] << 16) | ((ULONG)srcSample[2] << 24)) >> 8;
+            break;
+        case 4:
+            a = *(const UNALIGNED LONG *)dstSample;
+            b = *(const UNALIGNED LONG *)srcSample;
+            break;
+        default:
+            break;
+        }
+
+        const LONGLONG maximum = (1LL << (bytesPerSample * 8 - 1)) - 1;
+        const LONGLONG minimum = -maximum - 1;
+        LONGLONG       sum = a + b;
+        sum = (sum > maximum) ? maximum : ((sum < minimum) ? minimum : sum);
+
+        switch (bytesPerSample)
+        {
+        case 2:
+            *(UNALIGNED SHORT *)dstSample = (SHORT)sum;
+            break;
+        case 3:
+            dstSample[0] = (UCHAR)sum;
+            dstSample[1] = (UCHAR)(sum >> 8);
+            dstSample[2] = (UCHAR)(sum >> 16);
+            break;
+        case 4:
+            *(UNALIGNED LONG *)dstSample = (LONG)sum;
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+//
+// Tests the sample width for every sample, as the WDM capture path did
+// before the copy kernel was selected with the data format.
+//
+inline void ReferenceCopySamples(
+    ULONG        bytesPerSample,
+    PUCHAR       dst,
+    ULONG        dstStride,
+    const BYTE * src,
+    ULONG        srcStride,
+    ULONG        samples
+)
+{
+    for (ULONG index = 0; index < samples; ++index)
+    {
+        PUCHAR       dstSample = dst + index * dstStride;
+        const BYTE * srcSample = src + index * srcStride;
+
+        switch (bytesPerSample)
+        {
+        case 2:
+            *(UNALIGNED USHORT *)dstSample = *(const UNALIGNED USHORT *)srcSample;
+            break;
+        case 3:
+            dstSample[0] = srcSample[0];
+            dstSample[1] = srcSample[1];
+            dstSample[2] = srcSample[2];
+            break;
+        case 4:
+            *(UNALIGNED ULONG *)dstSample = *(const UNALIGNED ULONG *)srcSample;
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+#endif
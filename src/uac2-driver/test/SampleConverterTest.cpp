@@ -0,0 +1,380 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+// ASIO is a trademark and software of Steinberg Media Technologies GmbH
+
+/*++
+
+Module Name:
+
+    SampleConverterTest.cpp
+
+Abstract:
+
+    Compare the SampleConverter kernels against per-sample scalar references
+    for every supported sample width, channel count, channel map and length.
+
+Environment:
+
+    User mode (host build only)
+
+--*/
+
+#include "HostCompat.h"
+#include "SampleConverter.h"
+#include "TestCommon.h"
+#include "SampleConverterReference.h"
+
+static const ULONG c_channelCounts[] = {1, 2, 3, 4, 5, 7, 8, 9, 12, 16, 17, 24, 32, 63, 64};
+static const ULONG c_sampleCounts[] = {1, 3, 4, 7, 8, 15, 16, 17, 33, 100};
+
+static ULONGLONG ChannelsMap(
+    ULONG pattern,
+    ULONG channels
+)
+{
+    const ULONGLONG all = (channels >= 64) ? ~0ULL : ((1ULL << channels) - 1);
+
+    switch (pattern)
+    {
+    case 0:
+        return all;
+    case 1:
+        return all & 0x5555555555555555ULL;
+    case 2:
+        return all & 0x0f0f0f0f0f0f0f0fULL; // Four-channel groups only, never eight
+    case 3:
+        return all & ~0x10ULL;               // One hole that splits a group
+    default:
+        return all & 0x00ff00ff00ff00ffULL; // Eight-channel groups
+    }
+}
+
+static void TestPlanarToInterleaved()
+{
+    ULONG seed = 1;
+
+    for (ULONG asioSampleSize = 2; asioSampleSize <= 4; ++asioSampleSize)
+    {
+        for (ULONG usbBytesPerSample = 1; usbBytesPerSample <= asioSampleSize; ++usbBytesPerSample)
+        {
+            for (ULONG channels : c_channelCounts)
+            {
+                for (ULONG samples : c_sampleCounts)
+                {
+                    for (ULONG pattern = 0; pattern < 5; ++pattern)
+                    {
+                        // The USB side may have more or fewer channels than the ASIO side.
+                        const ULONG     usbChannels = (pattern == 3) ? channels + 2 : channels;
+                        const ULONG     planarStartIndex = (pattern & 1) ? 5 : 0;
+                        const ULONG     planarChannelStride = (planarStartIndex + samples + 3) * asioSampleSize;
+                        const ULONG     bytesPerBlock = usbBytesPerSample * usbChannels;
+                        const ULONGLONG channelsMap = ChannelsMap(pattern, channels);
+
+                        std::vector<UCHAR> planar(planarChannelStride * channels);
+                        std::vector<UCHAR> expected(bytesPerBlock * samples);
+                        FillRandom(planar, seed++);
+                        FillRandom(expected, seed++);
+                        std::vector<UCHAR> actual(expected);
+
+                        ReferencePlanarToInterleaved(expected.data(), bytesPerBlock, usbBytesPerSample, usbChannels, planar.data(), planarChannelStride, asioSampleSize, channels, channelsMap, planarStartIndex, samples);
+                        SampleConverter::PlanarToInterleaved(actual.data(), bytesPerBlock, usbBytesPerSample, usbChannels, planar.data(), planarChannelStride, asioSampleSize, channels, channelsMap, planarStartIndex, samples);
+
+                        TEST_CHECK_MESSAGE(expected == actual, "asio %u, usb %u, channels %u, samples %u, map %llx", asioSampleSize, usbBytesPerSample, channels, samples, (unsigned long long)channelsMap);
+                    }
+                }
+            }
+        }
+    }
+}
+
+static void TestInterleavedToPlanar()
+{
+    ULONG seed = 1000;
+
+    for (ULONG asioSampleSize = 2; asioSampleSize <= 4; ++asioSampleSize)
+    {
+        for (ULONG usbBytesPerSample = 1; usbBytesPerSample <= asioSampleSize; ++usbBytesPerSample)
+        {
+            for (ULONG channels : c_channelCounts)
+            {
+                // Longer than one deinterleave block, so that the block loop is covered.
+                for (ULONG samples : {1UL, 4UL, 7UL, 8UL, 15UL, 16UL, 17UL, 31UL, 33UL, 100UL})
+                {
+                    for (ULONG pattern = 0; pattern < 5; ++pattern)
+                    {
+                        const ULONG     usbChannels = (pattern == 3) ? channels + 2 : channels;
+                        const ULONG     planarStartIndex = (pattern & 1) ? 5 : 0;
+                        const ULONG     planarChannelStride = (planarStartIndex + samples + 3) * asioSampleSize;
+                        const ULONG     bytesPerBlock = usbBytesPerSample * usbChannels;
+                        const ULONGLONG channelsMap = ChannelsMap(pattern, channels);
+
+                        std::vector<UCHAR> interleaved(bytesPerBlock * samples);
+                        std::vector<UCHAR> expected(planarChannelStride * channels);
+                        FillRandom(interleaved, seed++);
+                        FillRandom(expected, seed++);
+                        std::vector<UCHAR> actual(expected);
+
+                        ReferenceInterleavedToPlanar(expected.data(), planarChannelStride, asioSampleSize, channels, channelsMap, planarStartIndex, interleaved.data(), bytesPerBlock, usbBytesPerSample, usbChannels, samples);
+                        SampleConverter::InterleavedToPlanar(actual.data(), planarChannelStride, asioSampleSize, channels, channelsMap, planarStartIndex, interleaved.data(), bytesPerBlock, usbBytesPerSample, usbChannels, samples);
+
+                        TEST_CHECK_MESSAGE(expected == actual, "asio %u, usb %u, channels %u, samples %u, map %llx", asioSampleSize, usbBytesPerSample, channels, samples, (unsigned long long)channelsMap);
+                    }
+                }
+            }
+        }
+    }
+}
+
+//
+// Random samples overflow in about a quarter of the additions, so both the
+// saturated and the plain sums are covered. Float samples are drawn from
+// [-1, 1) so that the sums are exact and can be compared bit for bit.
+//
+static void FillSamples(
+    std::vector<UCHAR> & buffer,
+    bool                 isFloat,
+    ULONG                seed
+)
+{
+    FillRandom(buffer, seed);
+    if (isFloat)
+    {
+        std::mt19937 random(seed);
+        for (size_t offset = 0; offset + sizeof(float) <= buffer.size(); offset += sizeof(float))
+        {
+            float value = (float)((LONG)random() >> 8) / 8388608.0f;
+            memcpy(&buffer[offset], &value, sizeof(value));
+        }
+    }
+}
+
+static void TestMixFunction()
+{
+    ULONG seed = 2000;
+
+    TEST_CHECK(SampleConverter::GetMixFunction(false, 1) == nullptr);
+    TEST_CHECK(SampleConverter::GetMixFunction(true, 2) == nullptr);
+
+    for (ULONG format = 0; format < 4; ++format)
+    {
+        const bool                isFloat = (format == 3);
+        const ULONG               bytesPerSample = isFloat ? 4 : format + 2;
+        const SAMPLE_MIX_FUNCTION mixSamples = SampleConverter::GetMixFunction(isFloat, bytesPerSample);
+
+        TEST_CHECK(mixSamples != nullptr);
+        if (mixSamples == nullptr)
+        {
+            continue;
+        }
+
+        for (ULONG samples = 0; samples <= 40; ++samples)
+        {
+            // Contiguous samples, one channel of an interleaved frame and one frame of a wider layout.
+            for (ULONG strideSamples : {1UL, 2UL, 6UL})
+            {
+                const ULONG        dstStride = bytesPerSample * strideSamples;
+                const ULONG        srcStride = bytesPerSample * ((strideSamples == 2) ? 3 : strideSamples);
+                std::vector<UCHAR> src(srcStride * samples + bytesPerSample);
+                std::vector<UCHAR> expected(dstStride * samples + bytesPerSample);
+                FillSamples(src, isFloat, seed++);
+                FillSamples(expected, isFloat, seed++);
+                std::vector<UCHAR> actual(expected);
+
+                ReferenceMixSamples(isFloat, bytesPerSample, expected.data(), dstStride, src.data(), srcStride, samples);
+                mixSamples(actual.data(), dstStride, src.data(), srcStride, samples);
+
+                TEST_CHECK_MESSAGE(expected == actual, "float %d, bytes %u, samples %u, dst stride %u, src stride %u", isFloat, bytesPerSample, samples, dstStride, srcStride);
+            }
+        }
+    }
+}
+
+static void TestCopyFunction()
+{
+    ULONG seed = 3000;
+
+    TEST_CHECK(SampleConverter::GetCopyFunction(false, 1) == nullptr);
+    TEST_CHECK(SampleConverter::GetCopyFunction(true, 3) == nullptr);
+
+    for (ULONG format = 0; format < 4; ++format)
+    {
+        const bool                 isFloat = (format == 3);
+        const ULONG                bytesPerSample = isFloat ? 4 : format + 2;
+        const SAMPLE_COPY_FUNCTION copySamples = SampleConverter::GetCopyFunction(isFloat, bytesPerSample);
+
+        TEST_CHECK(copySamples != nullptr);
+        if (copySamples == nullptr)
+        {
+            continue;
+        }
+
+        for (ULONG samples = 0; samples <= 20; ++samples)
+        {
+            for (ULONG strideSamples : {1UL, 2UL, 6UL})
+            {
+                // The RtPacket side is contiguous per frame and the USB side carries more channels.
+                const ULONG        dstStride = bytesPerSample * strideSamples;
+                const ULONG        srcStride = bytesPerSample * (strideSamples + 1);
+                std::vector<UCHAR> src(srcStride * samples + bytesPerSample);
+                std::vector<UCHAR> expected(dstStride * samples + bytesPerSample);
+                FillRandom(src, seed++);
+                FillRandom(expected, seed++);
+                std::vector<UCHAR> actual(expected);
+
+                // Float samples are moved as raw bits, so NaN payloads must survive as well.
+                ReferenceCopySamples(bytesPerSample, expected.data(), dstStride, src.data(), srcStride, samples);
+                copySamples(actual.data(), dstStride, src.data(), srcStride, samples);
+
+                TEST_CHECK_MESSAGE(expected == actual, "float %d, bytes %u, samples %u, dst stride %u, src stride %u", isFloat, bytesPerSample, samples, dstStride, srcStride);
+            }
+        }
+    }
+}
+
+//
+// Builds a routing table: identity, swapped pairs, every third channel
+// unrouted, or shifted so that the last channels fall outside the USB
+// channels.
+//
+static void BuildRouting(
+    LONG * routing,
+    ULONG  pattern,
+    ULONG  channels
+)
+{
+    for (ULONG ch = 0; ch < channels; ++ch)
+    {
+        switch (pattern)
+        {
+        case 0:
+            routing[ch] = (LONG)ch;
+            break;
+        case 1:
+            routing[ch] = (LONG)(ch ^ 1);
+            break;
+        case 2:
+            routing[ch] = ((ch % 3) == 2) ? UAC_CHANNEL_NOT_ROUTED : (LONG)ch;
+            break;
+        default:
+            routing[ch] = (LONG)ch + 2;
+            break;
+        }
+    }
+}
+
+static void TestMixChannelSpansToUsb()
+{
+    ULONG seed = 4000;
+
+    for (ULONG format = 0; format < 4; ++format)
+    {
+        const bool                isFloat = (format == 3);
+        const ULONG               bytesPerSample = isFloat ? 4 : format + 2;
+        const SAMPLE_MIX_FUNCTION mixSamples = SampleConverter::GetMixFunction(isFloat, bytesPerSample);
+
+        // Both sides of the frame-major threshold.
+        for (ULONG channels = 1; channels <= 10; ++channels)
+        {
+            for (ULONG pattern = 0; pattern < 4; ++pattern)
+            {
+                const ULONG  usbChannels = (pattern == 1) ? ((channels + 1) & ~1UL) : channels + 1;
+                LONG         routing[UAC_MAX_ASIO_CHANNELS];
+                CHANNEL_SPAN spans[UAC_MAX_ASIO_CHANNELS];
+
+                BuildRouting(routing, pattern, channels);
+                const ULONG spanCount = SampleConverter::BuildChannelSpans(spans, routing, channels, ~0ULL, usbChannels);
+
+                for (ULONG frames : {1UL, 5UL, 48UL})
+                {
+                    const ULONG        srcFrameBytes = bytesPerSample * channels;
+                    const ULONG        usbFrameBytes = bytesPerSample * usbChannels;
+                    std::vector<UCHAR> src(srcFrameBytes * frames);
+                    std::vector<UCHAR> expected(usbFrameBytes * frames);
+                    FillSamples(src, isFloat, seed++);
+                    FillSamples(expected, isFloat, seed++);
+                    std::vector<UCHAR> actual(expected);
+
+                    for (ULONG ch = 0; ch < channels; ++ch)
+                    {
+                        if ((routing[ch] < 0) || ((ULONG)routing[ch] >= usbChannels))
+                        {
+                            continue;
+                        }
+                        ReferenceMixSamples(isFloat, bytesPerSample, expected.data() + routing[ch] * bytesPerSample, usbFrameBytes, src.data() + ch * bytesPerSample, srcFrameBytes, frames);
+                    }
+                    SampleConverter::MixChannelSpansToUsb(actual.data(), bytesPerSample, usbChannels, src.data(), bytesPerSample, channels, spans, spanCount, frames, mixSamples);
+
+                    TEST_CHECK_MESSAGE(expected == actual, "float %d, bytes %u, channels %u, usb channels %u, routing %u, frames %u", isFloat, bytesPerSample, channels, usbChannels, pattern, frames);
+                }
+            }
+        }
+    }
+}
+
+static void TestCopyChannelSpansFromUsb()
+{
+    ULONG seed = 5000;
+
+    for (ULONG format = 0; format < 4; ++format)
+    {
+        const bool                 isFloat = (format == 3);
+        const ULONG                bytesPerSample = isFloat ? 4 : format + 2;
+        const SAMPLE_COPY_FUNCTION copySamples = SampleConverter::GetCopyFunction(isFloat, bytesPerSample);
+
+        for (ULONG channels = 1; channels <= 10; ++channels)
+        {
+            for (ULONG pattern = 0; pattern < 4; ++pattern)
+            {
+                const ULONG  usbChannels = (pattern == 1) ? ((channels + 1) & ~1UL) : channels + 1;
+                LONG         routing[UAC_MAX_ASIO_CHANNELS];
+                CHANNEL_SPAN spans[UAC_MAX_ASIO_CHANNELS];
+
+                BuildRouting(routing, pattern, channels);
+                const ULONG spanCount = SampleConverter::BuildChannelSpans(spans, routing, channels, ~0ULL, usbChannels);
+
+                for (ULONG frames : {1UL, 5UL, 48UL})
+                {
+                    const ULONG        dstFrameBytes = bytesPerSample * channels;
+                    const ULONG        usbFrameBytes = bytesPerSample * usbChannels;
+                    std::vector<UCHAR> usb(usbFrameBytes * frames);
+                    std::vector<UCHAR> expected(dstFrameBytes * frames);
+                    FillSamples(usb, isFloat, seed++);
+
+                    // The destination starts with stale audio, which must not survive in unrouted channels.
+                    std::vector<UCHAR> actual(expected.size());
+                    FillSamples(actual, isFloat, seed++);
+
+                    for (ULONG ch = 0; ch < channels; ++ch)
+                    {
+                        if ((routing[ch] < 0) || ((ULONG)routing[ch] >= usbChannels))
+                        {
+                            continue;
+                        }
+                        ReferenceCopySamples(bytesPerSample, expected.data() + ch * bytesPerSample, dstFrameBytes, usb.data() + routing[ch] * bytesPerSample, usbFrameBytes, frames);
+                    }
+                    SampleConverter::CopyChannelSpansFromUsb(actual.data(), bytesPerSample, channels, usb.data(), bytesPerSample, usbChannels, spans, spanCount, frames, copySamples);
+
+                    TEST_CHECK_MESSAGE(expected == actual, "float %d, bytes %u, channels %u, usb channels %u, routing %u, frames %u", isFloat, bytesPerSample, channels, usbChannels, pattern, frames);
+                }
+            }
+        }
+    }
+}
+
+int main()
+{
+    SampleConverter::Initialize();
+
+    TestPlanarToInterleaved();
+    TestInterleavedToPlanar();
+    TestMixFunction();
+    TestCopyFunction();
+    TestMixChannelSpansToUsb();
+    TestCopyChannelSpansFromUsb();
+
+    return TestResult("SampleConverterTest");
+}
@@ -0,0 +1,164 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+// ASIO is a trademark and software of Steinberg Media Technologies GmbH
+
+/*++
+
+Module Name:
+
+    SampleRateConverterBenchmark.cpp
+
+Abstract:
+
+    Measure the cost of the resampler per converted sample, in the same
+    push and pull loop as the RtPacketObject copy paths, and the width
+    kernels against the per-sample references. The results depend on the
+    host and are only printed.
+
+Environment:
+
+    User mode (host build only)
+
+--*/
+
+#include "HostCompat.h"
+#include "SampleRateConverter.h"
+#include "TestCommon.h"
+#include "SampleRateConverterReference.h"
+
+#if defined(_M_X64)
+#include <x86intrin.h>
+#endif
+
+#define BENCHMARK_FRAMES     480
+#define BENCHMARK_ITERATIONS 400
+
+static const ULONG c_channelCounts[] = {2, 8, 32};
+
+static ULONGLONG ReadCycleCounter()
+{
+#if defined(_M_X64)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+//
+// Converts BENCHMARK_FRAMES output frames per iteration from a 24-bit
+// interleaved source into a 24-bit interleaved destination, and prints the
+// time and the cycle counter ticks per output sample.
+//
+static void BenchmarkResampler()
+{
+    static const ULONG c_rates[][2] = {{44100, 48000}, {48000, 44100}, {48000, 96000}};
+    const ULONG        bytesPerSample = 3;
+
+    printf("SampleRateConverter push/pull, 24-bit (per output sample)\n");
+    printf("  input  output channels       ns   cycles\n");
+
+    for (const auto & rates : c_rates)
+    {
+        for (ULONG channels : c_channelCounts)
+        {
+            const ULONG              frameBytes = bytesPerSample * channels;
+            const ULONG              inputFrames = (ULONG)((ULONGLONG)BENCHMARK_FRAMES * rates[0] / rates[1]) + SRC_FILTER_TAPS;
+            const SRC_LOAD_FUNCTION  loadSamples = SampleRateConverter::GetLoadFunction(bytesPerSample);
+            const SRC_STORE_FUNCTION storeSamples = SampleRateConverter::GetStoreFunction(bytesPerSample);
+            SampleRateConverter *    resampler = SampleRateConverter::Create(channels);
+            std::vector<UCHAR>       src(frameBytes * inputFrames);
+            std::vector<UCHAR>       dst(frameBytes * BENCHMARK_FRAMES);
+            LONG                     frameSamples[UAC_MAX_ASIO_CHANNELS];
+
+            if ((resampler == nullptr) || !NT_SUCCESS(resampler->SetRates(rates[0], rates[1])))
+            {
+                delete resampler;
+                continue;
+            }
+            FillRandom(src, channels);
+
+            auto convert = [&]() {
+                ULONG srcFrame = 0;
+                for (ULONG frame = 0; frame < BENCHMARK_FRAMES; ++frame)
+                {
+                    while (resampler->IsInputNeeded())
+                    {
+                        loadSamples(frameSamples, src.data() + (srcFrame % inputFrames) * frameBytes, bytesPerSample, channels);
+                        resampler->PushFrame(frameSamples);
+                        srcFrame++;
+                    }
+                    resampler->PullFrame(frameSamples);
+                    storeSamples(dst.data() + frame * frameBytes, bytesPerSample, frameSamples, channels);
+                }
+            };
+
+            convert(); // warm up
+            auto      start = std::chrono::steady_clock::now();
+            ULONGLONG startCycles = ReadCycleCounter();
+            for (ULONG iteration = 0; iteration < BENCHMARK_ITERATIONS; ++iteration)
+            {
+                convert();
+            }
+            double samples = (double)BENCHMARK_ITERATIONS * BENCHMARK_FRAMES * channels;
+            double cycles = (double)(ReadCycleCounter() - startCycles) / samples;
+            double ns = ElapsedNs(start) / samples;
+
+            printf("  %6u %6u %8u %8.2f %8.1f\n", rates[0], rates[1], channels, ns, cycles);
+            delete resampler;
+        }
+    }
+}
+
+//
+// The width of the references is read through a volatile, as it was read
+// from the stream format in the driver, so that the compiler cannot fold
+// the per-sample switch away.
+//
+static void BenchmarkKernels()
+{
+    printf("SampleRateConverter kernels, 8 interleaved channels (ns/sample)\n");
+    printf("  bytes  reference load  kernel load  reference mix  kernel mix\n");
+
+    for (ULONG bytesPerSample = 2; bytesPerSample <= 4; ++bytesPerSample)
+    {
+        const ULONG              channels = 8;
+        const ULONG              samples = BENCHMARK_FRAMES * channels;
+        const SRC_LOAD_FUNCTION  loadSamples = SampleRateConverter::GetLoadFunction(bytesPerSample);
+        const SRC_STORE_FUNCTION mixSamples = SampleRateConverter::GetMixFunction(bytesPerSample);
+        volatile ULONG           runtimeBytesPerSample = bytesPerSample;
+        std::vector<UCHAR>       packed(samples * bytesPerSample);
+        std::vector<LONG>        values(samples);
+        FillRandom(packed, bytesPerSample);
+
+        auto measure = [&](auto function) {
+            function(); // warm up
+            auto start = std::chrono::steady_clock::now();
+            for (ULONG iteration = 0; iteration < BENCHMARK_ITERATIONS * 4; ++iteration)
+            {
+                function();
+            }
+            return ElapsedNs(start) / ((double)BENCHMARK_ITERATIONS * 4 * samples);
+        };
+
+        double referenceLoad = measure([&]() { ReferenceSrcLoadSamples(values.data(), packed.data(), bytesPerSample, runtimeBytesPerSample, samples); });
+        double kernelLoad = measure([&]() { loadSamples(values.data(), packed.data(), bytesPerSample, samples); });
+        double referenceMix = measure([&]() { ReferenceSrcMixSamples(packed.data(), bytesPerSample, runtimeBytesPerSample, values.data(), samples); });
+        double kernelMix = measure([&]() { mixSamples(packed.data(), bytesPerSample, values.data(), samples); });
+
+        printf("  %5u  %14.3f  %11.3f  %13.3f  %10.3f\n", bytesPerSample, referenceLoad, kernelLoad, referenceMix, kernelMix);
+    }
+}
+
+int main()
+{
+    SampleRateConverter::Initialize();
+
+    BenchmarkResampler();
+    BenchmarkKernels();
+
+    return 0;
+}
@@ -0,0 +1,106 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+// ASIO is a trademark and software of Steinberg Media Technologies GmbH
+
+/*++
+
+Module Name:
+
+    SampleRateConverterReference.h
+
+Abstract:
+
+    Define the per-sample conversions that SampleRateConverter used before
+    its kernels were selected by sample width. They test the width for
+    every sample and serve as the expected results of the tests and the
+    baseline of the benchmark.
+
+Environment:
+
+    User mode (host build only)
+
+--*/
+
+#ifndef _SAMPLE_RATE_CONVERTER_REFERENCE_H_
+#define _SAMPLE_RATE_CONVERTER_REFERENCE_H_
+
+inline void ReferenceSrcLoadSamples(
+    LONG *       dst,
+    const BYTE * src,
+    ULONG        srcStride,
+    ULONG        bytesPerSample,
+    ULONG        samples
+)
+{
+    for (ULONG index = 0; index < samples; ++index, src += srcStride)
+    {
+        switch (bytesPerSample)
+        {
+        case 2:
+            dst[index] = (LONG)(*(const SHORT UNALIGNED *)src) << 16;
+            break;
+        case 3:
+            dst[index] = (LONG)(((ULONG)src[0] << 8) | ((ULONG)src[1] << 16) | ((ULONG)src[2] << 24));
+            break;
+        case 4:
+            dst[index] = *(const LONG UNALIGNED *)src;
+            break;
+        default:
+            dst[index] = 0;
+            break;
+        }
+    }
+}
+
+inline void ReferenceSrcStoreSamples(
+    PUCHAR       dst,
+    ULONG        dstStride,
+    ULONG        bytesPerSample,
+    const LONG * src,
+    ULONG        samples
+)
+{
+    for (ULONG index = 0; index < samples; ++index, dst += dstStride)
+    {
+        switch (bytesPerSample)
+        {
+        case 2:
+            *(SHORT UNALIGNED *)dst = (SHORT)(src[index] >> 16);
+            break;
+        case 3:
+            dst[0] = (UCHAR)(src[index] >> 8);
+            dst[1] = (UCHAR)(src[index] >> 16);
+            dst[2] = (UCHAR)(src[index] >> 24);
+            break;
+        case 4:
+            *(LONG UNALIGNED *)dst = src[index];
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+inline void ReferenceSrcMixSamples(
+    PUCHAR       dst,
+    ULONG        dstStride,
+    ULONG        bytesPerSample,
+    const LONG * src,
+    ULONG        samples
+)
+{
+    for (ULONG index = 0; index < samples; ++index, dst += dstStride)
+    {
+        LONG     current = 0;
+        ReferenceSrcLoadSamples(&current, dst, 0, bytesPerSample, 1);
+        LONGLONG sum = (LONGLONG)current + src[index];
+        LONG     mixed = (sum > MAXLONG) ? MAXLONG : ((sum < MINLONG) ? MINLONG : (LONG)sum);
+        ReferenceSrcStoreSamples(dst, 0, bytesPerSample, &mixed, 1);
+    }
+}
+
+#endif
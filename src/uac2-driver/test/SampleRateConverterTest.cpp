@@ -0,0 +1,254 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+// ASIO is a trademark and software of Steinberg Media Technologies GmbH
+
+/*++
+
+Module Name:
+
+    SampleRateConverterTest.cpp
+
+Abstract:
+
+    Check the width-templated SampleRateConverter kernels against the
+    per-sample references, and the accuracy and buffering of the resampler
+    on sine waves converted between the usual rates.
+
+Environment:
+
+    User mode (host build only)
+
+--*/
+
+#include "HostCompat.h"
+#include "SampleRateConverter.h"
+#include "TestCommon.h"
+#include "SampleRateConverterReference.h"
+
+#define TEST_TONE_HZ        1000.0
+#define TEST_TONE_AMPLITUDE 0.5
+#define TEST_OUTPUT_FRAMES  8192
+#define TEST_SETTLE_FRAMES  (SRC_FILTER_TAPS * 4)
+#define TEST_MIN_SNR_DB     96.0
+
+static const ULONG c_strides[] = {0, 1, 2, 3, 4, 8, 12, 24, 32};
+
+static void TestKernels()
+{
+    ULONG seed = 100;
+
+    TEST_CHECK(SampleRateConverter::GetLoadFunction(1) == nullptr);
+    TEST_CHECK(SampleRateConverter::GetStoreFunction(5) == nullptr);
+    TEST_CHECK(SampleRateConverter::GetMixFunction(0) == nullptr);
+
+    for (ULONG bytesPerSample = 2; bytesPerSample <= 4; ++bytesPerSample)
+    {
+        const SRC_LOAD_FUNCTION  loadSamples = SampleRateConverter::GetLoadFunction(bytesPerSample);
+        const SRC_STORE_FUNCTION storeSamples = SampleRateConverter::GetStoreFunction(bytesPerSample);
+        const SRC_STORE_FUNCTION mixSamples = SampleRateConverter::GetMixFunction(bytesPerSample);
+
+        TEST_CHECK((loadSamples != nullptr) && (storeSamples != nullptr) && (mixSamples != nullptr));
+        if ((loadSamples == nullptr) || (storeSamples == nullptr) || (mixSamples == nullptr))
+        {
+            continue;
+        }
+
+        for (ULONG stride : c_strides)
+        {
+            // A stride shorter than a sample only occurs for single samples.
+            const ULONG samples = (stride < bytesPerSample) ? 1 : 37;
+            const ULONG bytes = stride * samples + bytesPerSample;
+
+            std::vector<UCHAR> packed(bytes);
+            std::vector<UCHAR> samplesBytes(samples * sizeof(LONG));
+            FillRandom(packed, seed++);
+            FillRandom(samplesBytes, seed++);
+            std::vector<LONG> values(samples);
+            RtlCopyMemory(values.data(), samplesBytes.data(), samples * sizeof(LONG));
+
+            std::vector<LONG> expectedLoad(samples, 0x5a5a5a5a);
+            std::vector<LONG> actualLoad(expectedLoad);
+            ReferenceSrcLoadSamples(expectedLoad.data(), packed.data(), stride, bytesPerSample, samples);
+            loadSamples(actualLoad.data(), packed.data(), stride, samples);
+            TEST_CHECK_MESSAGE(expectedLoad == actualLoad, "load, bytes %u, stride %u", bytesPerSample, stride);
+
+            std::vector<UCHAR> expectedStore(packed);
+            std::vector<UCHAR> actualStore(packed);
+            ReferenceSrcStoreSamples(expectedStore.data(), stride, bytesPerSample, values.data(), samples);
+            storeSamples(actualStore.data(), stride, values.data(), samples);
+            TEST_CHECK_MESSAGE(expectedStore == actualStore, "store, bytes %u, stride %u", bytesPerSample, stride);
+
+            // Random values saturate about half of the time, so both branches are covered.
+            std::vector<UCHAR> expectedMix(packed);
+            std::vector<UCHAR> actualMix(packed);
+            ReferenceSrcMixSamples(expectedMix.data(), stride, bytesPerSample, values.data(), samples);
+            mixSamples(actualMix.data(), stride, values.data(), samples);
+            TEST_CHECK_MESSAGE(expectedMix == actualMix, "mix, bytes %u, stride %u", bytesPerSample, stride);
+        }
+    }
+}
+
+//
+// Returns the ratio in dB of a sine of the given frequency, fitted by least
+// squares together with a DC offset, to what remains after subtracting it.
+//
+static double MeasureSnrDb(
+    const std::vector<double> & signal,
+    double                      cyclesPerSample
+)
+{
+    double sumSS = 0.0, sumSC = 0.0, sumCC = 0.0, sumS = 0.0, sumC = 0.0, sumYS = 0.0, sumYC = 0.0, sumY = 0.0;
+    const double n = (double)signal.size();
+
+    for (size_t index = 0; index < signal.size(); ++index)
+    {
+        double s = sin(2.0 * M_PI * cyclesPerSample * (double)index);
+        double c = cos(2.0 * M_PI * cyclesPerSample * (double)index);
+        sumSS += s * s;
+        sumSC += s * c;
+        sumCC += c * c;
+        sumS += s;
+        sumC += c;
+        sumYS += signal[index] * s;
+        sumYC += signal[index] * c;
+        sumY += signal[index];
+    }
+
+    // Solves the 3x3 normal equations for [a, b, d] in y = a sin + b cos + d by Cramer's rule.
+    auto det3 = [](double m00, double m01, double m02, double m10, double m11, double m12, double m20, double m21, double m22) {
+        return m00 * (m11 * m22 - m12 * m21) - m01 * (m10 * m22 - m12 * m20) + m02 * (m10 * m21 - m11 * m20);
+    };
+    double det = det3(sumSS, sumSC, sumS, sumSC, sumCC, sumC, sumS, sumC, n);
+    double a = det3(sumYS, sumSC, sumS, sumYC, sumCC, sumC, sumY, sumC, n) / det;
+    double b = det3(sumSS, sumYS, sumS, sumSC, sumYC, sumC, sumS, sumY, n) / det;
+    double d = det3(sumSS, sumSC, sumYS, sumSC, sumCC, sumYC, sumS, sumC, sumY) / det;
+
+    double signalPower = 0.0;
+    double noisePower = 0.0;
+    for (size_t index = 0; index < signal.size(); ++index)
+    {
+        double fit = a * sin(2.0 * M_PI * cyclesPerSample * (double)index) + b * cos(2.0 * M_PI * cyclesPerSample * (double)index);
+        double residual = signal[index] - fit - d;
+        signalPower += fit * fit;
+        noisePower += residual * residual;
+    }
+    return 10.0 * log10(signalPower / max(noisePower, 1e-30));
+}
+
+static void TestSineAccuracy()
+{
+    static const ULONG c_rates[][2] = {
+        {44100, 48000}, {48000, 44100}, {48000, 96000}, {96000, 48000}, {44100, 96000}, {192000, 44100}, {22050, 48000}
+    };
+    const ULONG channels = 2;
+
+    for (const auto & rates : c_rates)
+    {
+        const ULONG           inputRate = rates[0];
+        const ULONG           outputRate = rates[1];
+        SampleRateConverter * resampler = SampleRateConverter::Create(channels);
+
+        TEST_CHECK(resampler != nullptr);
+        if (resampler == nullptr)
+        {
+            continue;
+        }
+        TEST_CHECK(NT_SUCCESS(resampler->SetRates(inputRate, outputRate)));
+
+        // The second channel is inverted, so that the channels are checked to stay apart.
+        std::vector<double> output[2];
+        ULONGLONG           pushed = 0;
+        LONG                frame[2];
+        for (ULONG outputFrame = 0; outputFrame < TEST_OUTPUT_FRAMES; ++outputFrame)
+        {
+            while (resampler->IsInputNeeded())
+            {
+                double value = TEST_TONE_AMPLITUDE * sin(2.0 * M_PI * TEST_TONE_HZ * (double)pushed / (double)inputRate);
+                frame[0] = (LONG)(value * 2147483647.0);
+                frame[1] = -frame[0];
+                resampler->PushFrame(frame);
+                pushed++;
+            }
+            resampler->PullFrame(frame);
+            if (outputFrame >= TEST_SETTLE_FRAMES)
+            {
+                output[0].push_back((double)frame[0] / 2147483648.0);
+                output[1].push_back((double)frame[1] / 2147483648.0);
+            }
+
+            // The resampler never holds more input than one filter length ahead of the output.
+            double consumed = (double)(outputFrame + 1) * (double)inputRate / (double)outputRate;
+            TEST_CHECK_MESSAGE(fabs((double)pushed - consumed) <= SRC_FILTER_TAPS, "%u -> %u, frame %u, pushed %llu", inputRate, outputRate, outputFrame, (unsigned long long)pushed);
+        }
+
+        for (ULONG ch = 0; ch < channels; ++ch)
+        {
+            double snr = MeasureSnrDb(output[ch], TEST_TONE_HZ / (double)outputRate);
+            TEST_CHECK_MESSAGE(snr >= TEST_MIN_SNR_DB, "%u -> %u, channel %u, SNR %.1f dB", inputRate, outputRate, ch, snr);
+            printf("  %6u -> %6u Hz, channel %u: SNR %.1f dB\n", inputRate, outputRate, ch, snr);
+        }
+
+        for (size_t index = 0; index < output[0].size(); ++index)
+        {
+            TEST_CHECK(fabs(output[0][index] + output[1][index]) < 1e-6);
+        }
+
+        delete resampler;
+    }
+}
+
+static void TestReset()
+{
+    SampleRateConverter * resampler = SampleRateConverter::Create(1);
+    LONG                  sample = MAXLONG / 2;
+
+    TEST_CHECK(resampler != nullptr);
+    if (resampler == nullptr)
+    {
+        return;
+    }
+    TEST_CHECK(NT_SUCCESS(resampler->SetRates(44100, 48000)));
+    TEST_CHECK(resampler->GetInputRate() == 44100);
+    TEST_CHECK(resampler->GetOutputRate() == 48000);
+    TEST_CHECK(resampler->SetRates(0, 48000) == STATUS_INVALID_PARAMETER);
+
+    for (ULONG index = 0; index < 256; ++index)
+    {
+        if (resampler->IsInputNeeded())
+        {
+            resampler->PushFrame(&sample);
+        }
+        else
+        {
+            resampler->PullFrame(&sample);
+            sample = MAXLONG / 2;
+        }
+    }
+
+    // After a reset the history is silent, so the first output is silence.
+    resampler->Reset();
+    LONG silence = 0;
+    while (resampler->IsInputNeeded())
+    {
+        resampler->PushFrame(&silence);
+    }
+    resampler->PullFrame(&sample);
+    TEST_CHECK(sample == 0);
+
+    delete resampler;
+}
+
+int main()
+{
+    SampleRateConverter::Initialize();
+
+    TestKernels();
+    TestSineAccuracy();
+    TestReset();
+
+    return TestResult("SampleRateConverterTest");
+}
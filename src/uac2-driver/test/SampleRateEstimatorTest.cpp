@@ -0,0 +1,243 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+// ASIO is a trademark and software of Steinberg Media Technologies GmbH
+
+/*++
+
+Module Name:
+
+    SampleRateEstimatorTest.cpp
+
+Abstract:
+
+    Drive SampleRateEstimator with the packet lengths of a synthetic device
+    clock, whose packet boundaries carry up to half a sample of phase
+    jitter on top of the quantization to whole samples. Check the time to
+    confidence, the steady-state error, the restart on a step of the clock
+    and that the packet quantization alone never restarts the estimate.
+
+Environment:
+
+    User mode (host build only)
+
+--*/
+
+#include "HostCompat.h"
+#include "SampleRateEstimator.h"
+#include "TestCommon.h"
+
+#define TEST_MAX_CONFIDENCE_MS 63  // An uncertainty of 16 Hz needs the samples of 62.5 ms, rounded up to whole URBs
+#define TEST_SETTLED_MS        1000
+#define TEST_MAX_ERROR_HZ      2.0
+#define TEST_QUANTIZATION_MS   60000
+
+//
+// A device clock of `sampleRate` samples per second. The samples of a URB
+// are the difference of two rounded positions, each with a phase jitter of
+// up to phaseJitter samples, so that a URB may be one sample longer or
+// shorter than its neighbours without any change of the rate.
+//
+struct SyntheticClock
+{
+    double       SampleRate;
+    double       PhaseJitter;
+    double       Position{0.0};
+    LONGLONG     ReportedPosition{0};
+    std::mt19937 Random;
+
+    SyntheticClock(
+        double sampleRate,
+        double phaseJitter,
+        ULONG  seed
+    )
+        : SampleRate(sampleRate), PhaseJitter(phaseJitter), Random(seed)
+    {
+    }
+
+    ULONG Next(
+        ULONG packets,
+        ULONG packetsPerSec
+    )
+    {
+        Position += SampleRate * packets / packetsPerSec;
+        double   jitter = std::uniform_real_distribution<double>(-PhaseJitter, PhaseJitter)(Random);
+        LONGLONG reported = std::llround(Position + jitter);
+        ULONG    samples = (ULONG)(reported - ReportedPosition);
+        ReportedPosition = reported;
+        return samples;
+    }
+};
+
+static double GetError(
+    const SampleRateEstimator & estimator,
+    double                      sampleRate
+)
+{
+    return std::fabs((double)estimator.GetSampleRate() - sampleRate);
+}
+
+//
+// The estimate becomes confident after about 63 ms at full and high speed
+// alike, give or take one URB, and then settles within TEST_MAX_ERROR_HZ of an off-nominal clock.
+//
+static void TestConfidenceAndSteadyState(
+    ULONG  packetsPerSec,
+    ULONG  packetsPerUrb,
+    double sampleRate
+)
+{
+    SampleRateEstimator estimator;
+    SyntheticClock      clock(sampleRate, 0.5, packetsPerSec ^ packetsPerUrb);
+    ULONG               packets = 0;
+    ULONG               confidentPackets = 0;
+    double              maxError = 0.0;
+
+    estimator.Reset(packetsPerSec);
+    TEST_CHECK(!estimator.IsConfident());
+    TEST_CHECK(estimator.GetSampleRate() == 0);
+
+    while (packets < packetsPerSec * (TEST_SETTLED_MS * 3 / 1000))
+    {
+        estimator.Update(clock.Next(packetsPerUrb, packetsPerSec), packetsPerUrb);
+        packets += packetsPerUrb;
+        if ((confidentPackets == 0) && estimator.IsConfident())
+        {
+            confidentPackets = packets;
+        }
+        if (packets >= packetsPerSec * TEST_SETTLED_MS / 1000)
+        {
+            maxError = max(maxError, GetError(estimator, sampleRate));
+        }
+    }
+
+    const ULONG confidentMs = (ULONG)((ULONGLONG)confidentPackets * 1000 / packetsPerSec);
+    const ULONG urbMs = max(packetsPerUrb * 1000 / packetsPerSec, 1UL);
+    TEST_CHECK_MESSAGE((confidentPackets != 0) && (confidentMs <= TEST_MAX_CONFIDENCE_MS + urbMs), "%u packets/s, %u packets/URB, %.2f Hz: confident after %u ms", packetsPerSec, packetsPerUrb, sampleRate, confidentMs);
+    TEST_CHECK_MESSAGE(maxError <= TEST_MAX_ERROR_HZ, "%u packets/s, %u packets/URB, %.2f Hz: error %.2f Hz", packetsPerSec, packetsPerUrb, sampleRate, maxError);
+    TEST_CHECK(estimator.GetUncertaintyHz() <= 1);
+    TEST_CHECK(estimator.GetRestartCount() == 0);
+}
+
+//
+// A step of the clock, as after a switch of the clock source, restarts the
+// estimate within two URBs. The new estimate is confident as quickly as
+// after Reset, and settles on the new rate.
+//
+static void TestRateStep(
+    ULONG  packetsPerSec,
+    ULONG  packetsPerUrb,
+    double fromSampleRate,
+    double toSampleRate
+)
+{
+    SampleRateEstimator estimator;
+    SyntheticClock      before(fromSampleRate, 0.5, 7);
+    SyntheticClock      after(toSampleRate, 0.5, 11);
+    const ULONG         settledUrbs = packetsPerSec * TEST_SETTLED_MS / 1000 / packetsPerUrb;
+    ULONG               restartUrbs = 0;
+    ULONG               confidentUrbs = 0;
+
+    estimator.Reset(packetsPerSec);
+    for (ULONG urb = 0; urb < settledUrbs; ++urb)
+    {
+        estimator.Update(before.Next(packetsPerUrb, packetsPerSec), packetsPerUrb);
+    }
+    TEST_CHECK(GetError(estimator, fromSampleRate) <= TEST_MAX_ERROR_HZ);
+
+    for (ULONG urb = 1; urb <= settledUrbs; ++urb)
+    {
+        estimator.Update(after.Next(packetsPerUrb, packetsPerSec), packetsPerUrb);
+        if ((restartUrbs == 0) && (estimator.GetRestartCount() != 0))
+        {
+            restartUrbs = urb;
+        }
+        if ((restartUrbs != 0) && (confidentUrbs == 0) && estimator.IsConfident())
+        {
+            confidentUrbs = urb - restartUrbs;
+        }
+        // While the step is confirmed, the previous estimate stays in place.
+        if (restartUrbs == 0)
+        {
+            TEST_CHECK(GetError(estimator, fromSampleRate) <= TEST_MAX_ERROR_HZ);
+        }
+    }
+
+    const ULONG confidentMs = (ULONG)((ULONGLONG)confidentUrbs * packetsPerUrb * 1000 / packetsPerSec);
+    const ULONG urbMs = max(packetsPerUrb * 1000 / packetsPerSec, 1UL);
+    TEST_CHECK_MESSAGE(restartUrbs == SAMPLE_RATE_MAX_STEPS, "%u packets/s, %.0f -> %.0f Hz: restarted after %u URBs", packetsPerSec, fromSampleRate, toSampleRate, restartUrbs);
+    TEST_CHECK(estimator.GetRestartCount() == 1);
+    TEST_CHECK_MESSAGE((confidentUrbs != 0) && (confidentMs <= TEST_MAX_CONFIDENCE_MS + urbMs), "%u packets/s, %.0f -> %.0f Hz: confident %u ms after the restart", packetsPerSec, fromSampleRate, toSampleRate, confidentMs);
+    TEST_CHECK_MESSAGE(GetError(estimator, toSampleRate) <= TEST_MAX_ERROR_HZ, "%u packets/s, %.0f -> %.0f Hz: %u Hz", packetsPerSec, fromSampleRate, toSampleRate, estimator.GetSampleRate());
+}
+
+//
+// URBs that are one sample longer or shorter than the rate, from the
+// quantization and the phase jitter, are never taken for a step, down to
+// single packet URBs at one sample per packet.
+//
+static void TestQuantizationIsNotAStep(
+    ULONG  packetsPerSec,
+    ULONG  packetsPerUrb,
+    double sampleRate
+)
+{
+    SampleRateEstimator estimator;
+    SyntheticClock      clock(sampleRate, 0.49, packetsPerSec + packetsPerUrb);
+    const ULONG         urbs = (ULONG)((ULONGLONG)packetsPerSec * TEST_QUANTIZATION_MS / 1000 / packetsPerUrb);
+
+    estimator.Reset(packetsPerSec);
+    for (ULONG urb = 0; urb < urbs; ++urb)
+    {
+        estimator.Update(clock.Next(packetsPerUrb, packetsPerSec), packetsPerUrb);
+    }
+
+    TEST_CHECK_MESSAGE(estimator.GetRestartCount() == 0, "%u packets/s, %u packets/URB, %.0f Hz: %u restarts", packetsPerSec, packetsPerUrb, sampleRate, estimator.GetRestartCount());
+    TEST_CHECK(estimator.IsConfident());
+}
+
+static void TestNoPackets()
+{
+    SampleRateEstimator estimator;
+
+    estimator.Reset(8000);
+    estimator.Update(6, 0);
+    TEST_CHECK(!estimator.IsConfident());
+    TEST_CHECK(estimator.GetUncertaintyHz() == MAXULONG);
+
+    estimator.Reset(0);
+    estimator.Update(6, 1);
+    TEST_CHECK(estimator.GetSampleRate() == 0);
+}
+
+int main()
+{
+    // Full speed and high speed, with the URB sizes that ClassicFramesPerIrp selects.
+    TestConfidenceAndSteadyState(1000, 1, 44100.0);
+    TestConfidenceAndSteadyState(1000, 10, 48003.7);
+    TestConfidenceAndSteadyState(8000, 8, 44096.2);
+    TestConfidenceAndSteadyState(8000, 64, 192010.5);
+    TestConfidenceAndSteadyState(8000, 8, 8000.0);
+
+    TestRateStep(8000, 8, 44100.0, 48000.0);
+    TestRateStep(8000, 8, 96000.0, 88200.0);
+    TestRateStep(1000, 1, 48000.0, 44100.0);
+
+    for (ULONG packetsPerSec : {1000UL, 8000UL})
+    {
+        for (ULONG packetsPerUrb : {1UL, 2UL, 8UL})
+        {
+            for (double sampleRate : {8000.0, 11025.0, 44100.0, 48000.0, 192000.0})
+            {
+                TestQuantizationIsNotAStep(packetsPerSec, packetsPerUrb, sampleRate);
+            }
+        }
+    }
+
+    TestNoPackets();
+
+    return TestResult("SampleRateEstimatorTest");
+}
@@ -0,0 +1,151 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+// ASIO is a trademark and software of Steinberg Media Technologies GmbH
+
+/*++
+
+Module Name:
+
+    StreamTimingTest.cpp
+
+Abstract:
+
+    Check the timing rules of the mixing engine thread at their boundaries:
+    the packet estimation, the packet loop exits, the dropout thresholds,
+    the ASIO notification and the wake-up interval.
+
+Environment:
+
+    User mode (host build only)
+
+--*/
+
+#include "HostCompat.h"
+#include "StreamTiming.h"
+#include "TestCommon.h"
+
+static void TestEstimateInputPacket()
+{
+    UsbClockModel model;
+
+    // Until the model locks, the estimate stays where it was.
+    model.Reset(8, 8);
+    TEST_CHECK(StreamTiming::EstimateInputPacket(model, 10500, 8, 80, 60) == 60);
+
+    // Locked to packet 80 at 10 ms, the bus is in packet 84 half a millisecond later, and the estimate trails it by an IRP.
+    model.Update(10000, 80);
+    TEST_CHECK(StreamTiming::EstimateInputPacket(model, 10560, 8, 80, 60) == 76);
+
+    // It never moves backwards and never passes the completed packets.
+    TEST_CHECK(StreamTiming::EstimateInputPacket(model, 10560, 8, 80, 78) == 78);
+    TEST_CHECK(StreamTiming::EstimateInputPacket(model, 10560, 8, 70, 60) == 70);
+}
+
+static void TestPacketLoopExits()
+{
+    TEST_CHECK(!StreamTiming::IsInputPacketAtEstimatedPosition(97, 2, 100));
+    TEST_CHECK(StreamTiming::IsInputPacketAtEstimatedPosition(98, 2, 100));
+
+    // The OUT loop stops outLimit packets past the estimate, in packets of the OUT interval.
+    TEST_CHECK(!StreamTiming::IsOutputPacketOverlapWithEstimatePosition(99, 90, 10, 1, 1));
+    TEST_CHECK(StreamTiming::IsOutputPacketOverlapWithEstimatePosition(100, 90, 10, 1, 1));
+    TEST_CHECK(!StreamTiming::IsOutputPacketOverlapWithEstimatePosition(189, 90, 10, 2, 1));
+    TEST_CHECK(StreamTiming::IsOutputPacketOverlapWithEstimatePosition(190, 90, 10, 2, 1));
+    TEST_CHECK(!StreamTiming::IsOutputPacketOverlapWithEstimatePosition(54, 90, 10, 1, 2));
+    TEST_CHECK(StreamTiming::IsOutputPacketOverlapWithEstimatePosition(55, 90, 10, 1, 2));
+
+    // One IRP, the IN offset and the safety offset; without an ASIO client one more IRP.
+    TEST_CHECK(!StreamTiming::IsSafetyOffsetReached(25, 1, 8, 2, 16, true));
+    TEST_CHECK(StreamTiming::IsSafetyOffsetReached(26, 1, 8, 2, 16, true));
+    TEST_CHECK(!StreamTiming::IsSafetyOffsetReached(33, 1, 8, 2, 16, false));
+    TEST_CHECK(StreamTiming::IsSafetyOffsetReached(34, 1, 8, 2, 16, false));
+    TEST_CHECK(StreamTiming::IsSafetyOffsetReached(13, 2, 8, 2, 16, true));
+
+    TEST_CHECK(!StreamTiming::IsOutputInSyncWithInput(10, 9, 1, 1));
+    TEST_CHECK(StreamTiming::IsOutputInSyncWithInput(10, 10, 1, 1));
+    TEST_CHECK(!StreamTiming::IsOutputInSyncWithInput(10, 19, 2, 1));
+    TEST_CHECK(StreamTiming::IsOutputInSyncWithInput(10, 5, 1, 2));
+}
+
+static void TestDropoutThresholds()
+{
+    TEST_CHECK(StreamTiming::CalculateSafetyOffset(130, 100, 2, 8) == 20);
+    TEST_CHECK(StreamTiming::CalculateSafetyOffset(105, 100, 2, 8) == -5);
+
+    // The minimum stays below the two IRPs that are always in flight.
+    TEST_CHECK(StreamTiming::CalculateMinSafetyOffsetFrame(8, 4, 8) == 8);
+    TEST_CHECK(StreamTiming::CalculateMinSafetyOffsetFrame(16, 4, 8) == 15);
+
+    TEST_CHECK(StreamTiming::CalculateDropoutThresholdTime(1) == 1500);
+    TEST_CHECK(StreamTiming::CalculateDropoutThresholdTime(4) == 7500);
+
+    // A stalled thread finds a recent completion, but its previous wake is as old as the stall.
+    TEST_CHECK(StreamTiming::CalculateThreadElapsedTimeUs(1000000, 1000000 - 200, 8000) == 8000);
+    TEST_CHECK(StreamTiming::CalculateThreadElapsedTimeUs(1000000, 1000000 - 3000, 125) == 3000);
+    TEST_CHECK(StreamTiming::CalculateThreadElapsedTimeUs(1000000, 1000000 - 30, 1000000) == 1000000);
+    TEST_CHECK(StreamTiming::CalculateThreadElapsedTimeUs(1000000, 1000000 - 30, 1ULL << 40) == MAXLONG);
+
+    // The longest period does not overflow the threshold.
+    TEST_CHECK(StreamTiming::CalculateClientProcessingThresholdUs(8192, 44100) == 185759 + 1500);
+    TEST_CHECK(StreamTiming::CalculateClientProcessingThresholdUs(48, 48000) == 1000 + 1500);
+}
+
+static void TestAsioNotification()
+{
+    TEST_CHECK(StreamTiming::IsAsioNotifyDue(128, 128, 64, 64, true, true));
+    TEST_CHECK(!StreamTiming::IsAsioNotifyDue(128, 127, 64, 64, true, true));
+    TEST_CHECK(!StreamTiming::IsAsioNotifyDue(127, 128, 64, 64, true, true));
+
+    // A direction that is not in use does not hold the notification back.
+    TEST_CHECK(StreamTiming::IsAsioNotifyDue(0, 128, 64, 64, false, true));
+    TEST_CHECK(StreamTiming::IsAsioNotifyDue(128, 0, 64, 64, true, false));
+
+    // The buffer period, at least 1 ms, plus the OUT driver buffer.
+    TEST_CHECK(StreamTiming::CalculateCallbackPeriodThresholdUs(48000, 32, 0) == 1000);
+    TEST_CHECK(StreamTiming::CalculateCallbackPeriodThresholdUs(48000, 96, 48) == 3000);
+}
+
+static void TestWakeUpInterval()
+{
+    UsbClockModel model;
+
+    model.Reset(8, 8);
+
+    // Without a completion the thread wakes once per (micro)frame.
+    TEST_CHECK(StreamTiming::CalculateNextWakeUpIntervalUs(model, 8, 0, 10030, false, 0, 0) == 125);
+    TEST_CHECK(StreamTiming::CalculateNextWakeUpIntervalUs(model, 1, 0, 10030, false, 0, 0) == 1000);
+
+    // Until the model locks, the last completion gives the phase of the frames.
+    TEST_CHECK(StreamTiming::CalculateNextWakeUpIntervalUs(model, 8, 10000, 10030, false, 0, 0) == 20);
+    TEST_CHECK(StreamTiming::CalculateNextWakeUpIntervalUs(model, 8, 10000, 10100, false, 0, 0) == 75);
+    TEST_CHECK(StreamTiming::CalculateNextWakeUpIntervalUs(model, 1, 10000, 10300, false, 0, 0) == 750);
+
+    // OutputReady is polled from a little before the client is expected to finish.
+    TEST_CHECK(StreamTiming::CalculateNextWakeUpIntervalUs(model, 1, 10000, 10300, true, 10300, 300) == 200);
+    TEST_CHECK(StreamTiming::CalculateNextWakeUpIntervalUs(model, 1, 10000, 10300, true, 10300, 1000) == 750);
+    TEST_CHECK(StreamTiming::CalculateNextWakeUpIntervalUs(model, 1, 10000, 10300, true, 10100, 250) == 0);
+
+    // Locked, the guard is kept after the next (micro)frame boundary. The fixed point rate may round up by 1 us.
+    model.Update(10000, 80);
+    LONG intervalUs = StreamTiming::CalculateNextWakeUpIntervalUs(model, 8, 10000, 10100, false, 0, 0);
+    TEST_CHECK_MESSAGE((intervalUs >= 75) && (intervalUs <= 76), "%d us", intervalUs);
+
+    TEST_CHECK(StreamTiming::ClampWakeUpIntervalUs(0, 100, 125) == 100);
+    TEST_CHECK(StreamTiming::ClampWakeUpIntervalUs(110, 100, 125) == 110);
+    TEST_CHECK(StreamTiming::ClampWakeUpIntervalUs(750, 100, 125) == 125);
+}
+
+int main()
+{
+    TestEstimateInputPacket();
+    TestPacketLoopExits();
+    TestDropoutThresholds();
+    TestAsioNotification();
+    TestWakeUpInterval();
+
+    return TestResult("StreamTimingTest");
+}
@@ -0,0 +1,90 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+// ASIO is a trademark and software of Steinberg Media Technologies GmbH
+
+/*++
+
+Module Name:
+
+    TestCommon.h
+
+Abstract:
+
+    Define the checks and the timer shared by the host tests and benchmarks.
+
+Environment:
+
+    User mode (host build only)
+
+--*/
+
+#ifndef _TEST_COMMON_H_
+#define _TEST_COMMON_H_
+
+inline ULONG g_checkFailures = 0;
+
+#define TEST_CHECK(expr)                                                              \
+    do                                                                                \
+    {                                                                                 \
+        if (!(expr))                                                                  \
+        {                                                                             \
+            if (g_checkFailures++ < 32)                                               \
+            {                                                                         \
+                fprintf(stderr, "%s(%d): check failed: %s\n", __FILE__, __LINE__, #expr); \
+            }                                                                         \
+        }                                                                             \
+    } while (0)
+
+#define TEST_CHECK_MESSAGE(expr, ...)                                                 \
+    do                                                                                \
+    {                                                                                 \
+        if (!(expr))                                                                  \
+        {                                                                             \
+            if (g_checkFailures++ < 32)                                               \
+            {                                                                         \
+                fprintf(stderr, "%s(%d): check failed: %s: ", __FILE__, __LINE__, #expr); \
+                fprintf(stderr, __VA_ARGS__);                                         \
+                fprintf(stderr, "\n");                                                \
+            }                                                                         \
+        }                                                                             \
+    } while (0)
+
+inline int TestResult(const char * name)
+{
+    if (g_checkFailures != 0)
+    {
+        fprintf(stderr, "%s: %u checks failed\n", name, g_checkFailures);
+        return 1;
+    }
+    printf("%s: passed\n", name);
+    return 0;
+}
+
+//
+// Fills a buffer with a reproducible pattern so that a byte that is written
+// by mistake, or left untouched by mistake, is detected.
+//
+inline void FillRandom(
+    std::vector<UCHAR> & buffer,
+    ULONG                seed
+)
+{
+    std::mt19937 random(seed);
+    for (auto & byte : buffer)
+    {
+        byte = (UCHAR)random();
+    }
+}
+
+inline double ElapsedNs(
+    std::chrono::steady_clock::time_point start
+)
+{
+    return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+#endif
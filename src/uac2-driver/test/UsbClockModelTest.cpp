@@ -0,0 +1,198 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+// ASIO is a trademark and software of Steinberg Media Technologies GmbH
+
+/*++
+
+Module Name:
+
+    UsbClockModelTest.cpp
+
+Abstract:
+
+    Drive UsbClockModel with synthetic URB completion times that carry a
+    drifting bus clock and a random completion latency, and check that the
+    predicted packet position, drift and jitter follow the synthetic bus.
+
+Environment:
+
+    User mode (host build only)
+
+--*/
+
+#include "HostCompat.h"
+#include "UsbClockModel.h"
+#include "TestCommon.h"
+
+#define TEST_SETTLE_COMPLETIONS  2000
+#define TEST_CHECK_COMPLETIONS   4000
+#define TEST_PREDICTIONS_PER_IRP 4
+
+//
+// A bus whose packets advance at packetsPerMs * (1 + driftPpm / 10^6) from
+// startTimeUs, and whose completions are observed up to maxLatencyUs late.
+//
+struct SyntheticBus
+{
+    double    PacketPeriodUs;
+    double    StartTimeUs;
+    ULONG     MaxLatencyUs;
+    std::mt19937 Random;
+
+    SyntheticBus(
+        ULONG  packetsPerMs,
+        double driftPpm,
+        double startTimeUs,
+        ULONG  maxLatencyUs,
+        ULONG  seed
+    )
+        : PacketPeriodUs(1000.0 / packetsPerMs / (1.0 + driftPpm / 1000000.0)), StartTimeUs(startTimeUs), MaxLatencyUs(maxLatencyUs), Random(seed)
+    {
+    }
+
+    double GetPacketTimeUs(
+        LONGLONG packet
+    ) const
+    {
+        return StartTimeUs + (double)packet * PacketPeriodUs;
+    }
+
+    // The position that a model fed with completions of this bus should predict, which trails the bus by the mean latency.
+    double GetObservedPosition(
+        double timeUs
+    ) const
+    {
+        return (timeUs - StartTimeUs - (double)MaxLatencyUs / 2.0) / PacketPeriodUs;
+    }
+
+    ULONGLONG GetCompletionTimeUs(
+        LONGLONG packet
+    )
+    {
+        ULONG latencyUs = (MaxLatencyUs != 0) ? (ULONG)(Random() % (MaxLatencyUs + 1)) : 0;
+        return (ULONGLONG)std::llround(GetPacketTimeUs(packet)) + latencyUs;
+    }
+};
+
+static double ToPackets(
+    LONGLONG position
+)
+{
+    return (double)position / (double)(1LL << USB_CLOCK_POSITION_BITS);
+}
+
+static void TestTracking(
+    ULONG  packetsPerMs,
+    ULONG  packetsPerIrp,
+    double driftPpm,
+    ULONG  maxLatencyUs,
+    double maxErrorPackets
+)
+{
+    UsbClockModel model;
+    SyntheticBus  bus(packetsPerMs, driftPpm, 123456.0, maxLatencyUs, packetsPerMs * 1000 + packetsPerIrp);
+    double        maxError = 0.0;
+    LONGLONG      packet = 0;
+
+    model.Reset(packetsPerMs, packetsPerIrp);
+    TEST_CHECK(!model.IsLocked());
+
+    for (ULONG completion = 0; completion < TEST_SETTLE_COMPLETIONS + TEST_CHECK_COMPLETIONS; ++completion)
+    {
+        packet += packetsPerIrp;
+        ULONGLONG completedTimeUs = bus.GetCompletionTimeUs(packet);
+        model.Update(completedTimeUs, packet);
+        TEST_CHECK(model.IsLocked());
+
+        if (completion < TEST_SETTLE_COMPLETIONS)
+        {
+            continue;
+        }
+
+        // Predict between this completion and the next one, as the mixing engine thread does.
+        double irpPeriodUs = bus.PacketPeriodUs * packetsPerIrp;
+        for (ULONG index = 0; index < TEST_PREDICTIONS_PER_IRP; ++index)
+        {
+            ULONGLONG currentTimeUs = (ULONGLONG)std::llround(bus.GetPacketTimeUs(packet) + irpPeriodUs * index / TEST_PREDICTIONS_PER_IRP);
+            double    error = ToPackets(model.PredictPosition(currentTimeUs)) - bus.GetObservedPosition((double)currentTimeUs);
+            maxError = max(maxError, std::fabs(error));
+        }
+    }
+
+    TEST_CHECK_MESSAGE(maxError <= maxErrorPackets, "%u packets/ms, %u packets/IRP, %.0f ppm, latency %u us: error %.3f packets", packetsPerMs, packetsPerIrp, driftPpm, maxLatencyUs, maxError);
+    TEST_CHECK_MESSAGE(std::fabs(model.GetDriftPpm() - driftPpm) <= 20.0, "%u packets/ms, %.0f ppm: drift %d ppm", packetsPerMs, driftPpm, model.GetDriftPpm());
+    TEST_CHECK_MESSAGE(model.GetJitterUs() <= maxLatencyUs, "%u packets/ms, latency %u us: jitter %u us", packetsPerMs, maxLatencyUs, model.GetJitterUs());
+    TEST_CHECK(model.GetRelockCount() == 0);
+
+    printf("%u packets/ms, %2u packets/IRP, %5.0f ppm, latency %3u us: max error %.3f packets, drift %d ppm, jitter %u us\n", packetsPerMs, packetsPerIrp, driftPpm, maxLatencyUs, maxError, model.GetDriftPpm(), model.GetJitterUs());
+}
+
+static void TestFrameBoundary()
+{
+    UsbClockModel model;
+
+    TEST_CHECK(model.GetTimeToNextFrameUs(0) == 1000);
+
+    // High speed, locked to packet 80 at 10 ms with the nominal rate. The
+    // fixed point rate is truncated, so the times round up by at most 1 us.
+    model.Reset(8, 8);
+    model.Update(10000, 80);
+    TEST_CHECK(model.GetTimeToNextFrameUs(10000) - 1000 <= 1);
+    TEST_CHECK(model.GetTimeToNextFrameUs(10125) - 875 <= 1);
+    TEST_CHECK(model.GetTimeToNextFrameUs(10999) - 1 <= 1);
+    TEST_CHECK(std::fabs(ToPackets(model.PredictPosition(10500)) - 84.0) < 0.001);
+}
+
+static void TestDiscontinuities()
+{
+    UsbClockModel model;
+
+    model.Reset(1, 8);
+    for (LONGLONG packet = 8; packet <= 800; packet += 8)
+    {
+        model.Update(1000 * (ULONGLONG)packet, packet);
+    }
+    TEST_CHECK(model.GetRelockCount() == 0);
+
+    // A single completion that is observed late is latency and is skipped.
+    model.Update(1000 * 808 + 20000, 808);
+    TEST_CHECK(model.GetRelockCount() == 0);
+    TEST_CHECK(std::fabs(ToPackets(model.PredictPosition(1000 * 808)) - 808.0) < 0.5);
+
+    // Completions that keep lagging mean that the bus has stopped, so the position follows them.
+    for (LONGLONG packet = 816; packet < 816 + 8 * USB_CLOCK_MAX_LATE_COMPLETIONS; packet += 8)
+    {
+        model.Update(1000 * (ULONGLONG)packet + 50000, packet);
+    }
+    TEST_CHECK(model.GetRelockCount() == 1);
+
+    // A restarted pipe jumps ahead of the prediction and is followed at once.
+    model.Update(1000 * 2000, 5000);
+    TEST_CHECK(model.GetRelockCount() == 2);
+    TEST_CHECK(std::fabs(ToPackets(model.PredictPosition(1000 * 2000)) - 5000.0) < 0.01);
+
+    // Reset forgets the lock.
+    model.Reset(1, 8);
+    TEST_CHECK(!model.IsLocked());
+    TEST_CHECK(model.GetRelockCount() == 0);
+}
+
+int main()
+{
+    // Full speed and high speed, with the IRP sizes that ClassicFramesPerIrp selects.
+    TestTracking(1, 1, 0.0, 0, 0.01);
+    TestTracking(1, 8, 250.0, 100, 0.05);
+    TestTracking(1, 8, -500.0, 300, 0.1);
+    TestTracking(8, 8, 100.0, 50, 0.2);
+    TestTracking(8, 64, -250.0, 200, 0.5);
+    TestTracking(8, 64, 900.0, 500, 1.0);
+
+    TestFrameBoundary();
+    TestDiscontinuities();
+
+    return TestResult("UsbClockModelTest");
+}
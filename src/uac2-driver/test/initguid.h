@@ -0,0 +1,12 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+// ASIO is a trademark and software of Steinberg Media Technologies GmbH
+
+//
+// UAC_User.h includes <initguid.h>. DEFINE_GUID is provided by HostCompat.h
+// in the host build, so this header is intentionally empty.
+//